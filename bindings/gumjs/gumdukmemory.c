@@ -7,6 +7,7 @@
 #include "gumdukmemory.h"
 
 #include "gumdukmacros.h"
+#include "gumscriptmemoryscan.h"
 
 #ifdef G_OS_WIN32
 # ifndef WIN32_LEAN_AND_MEAN
@@ -40,8 +41,6 @@ enum _GumMemoryValueType
 
 struct _GumMemoryScanContext
 {
-  GumMemoryRange range;
-  GumMatchPattern * pattern;
   GumDukHeapPtr on_match;
   GumDukHeapPtr on_error;
   GumDukHeapPtr on_complete;
@@ -113,13 +112,23 @@ GUMJS_DECLARE_FUNCTION (gumjs_memory_alloc_utf16_string)
 
 GUMJS_DECLARE_FUNCTION (gumjs_memory_scan)
 static void gum_memory_scan_context_free (GumMemoryScanContext * ctx);
-static void gum_memory_scan_context_run (GumMemoryScanContext * self);
 static gboolean gum_memory_scan_context_emit_match (GumAddress address,
     gsize size, GumMemoryScanContext * self);
+static void gum_memory_scan_context_emit_error (const gchar * message,
+    GumMemoryScanContext * self);
+static void gum_memory_scan_context_emit_complete (
+    GumMemoryScanContext * self);
 GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_sync)
 static gboolean gum_append_match (GumAddress address, gsize size,
     gpointer user_data);
 
+static const GumScriptMemoryScanCallbacks gum_memory_scan_callbacks =
+{
+  (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match,
+  (GumScriptMemoryScanErrorFunc) gum_memory_scan_context_emit_error,
+  (GumScriptMemoryScanCompleteFunc) gum_memory_scan_context_emit_complete
+};
+
 GUMJS_DECLARE_CONSTRUCTOR (gumjs_memory_access_monitor_construct)
 GUMJS_DECLARE_FUNCTION (gumjs_memory_access_monitor_enable)
 GUMJS_DECLARE_FUNCTION (gumjs_memory_access_monitor_disable)
@@ -764,28 +773,37 @@ GUMJS_DEFINE_FUNCTION (gumjs_memory_scan)
   gpointer address;
   gsize size;
   const gchar * match_str;
+  GumMemoryRange range;
+  GumMatchPattern * pattern;
+  gboolean ordered;
+  GumScriptMemoryScan * scan;
 
   _gum_duk_args_parse (args, "pZsF{onMatch,onError?,onComplete}",
       &address, &size, &match_str, &sc.on_match, &sc.on_error, &sc.on_complete);
 
-  sc.range.base_address = GUM_ADDRESS (address);
-  sc.range.size = size;
-  sc.pattern = gum_match_pattern_new_from_string (match_str);
+  range.base_address = GUM_ADDRESS (address);
+  range.size = size;
+  pattern = gum_match_pattern_new_from_string (match_str);
   sc.core = core;
 
-  if (sc.pattern == NULL)
+  if (pattern == NULL)
     _gum_duk_throw (ctx, "invalid match pattern");
 
+  duk_get_prop_string (ctx, 3, "ordered");
+  ordered = !duk_is_boolean (ctx, -1) || duk_get_boolean (ctx, -1);
+  duk_pop (ctx);
+
   _gum_duk_protect (ctx, sc.on_match);
   if (sc.on_error != NULL)
     _gum_duk_protect (ctx, sc.on_error);
   _gum_duk_protect (ctx, sc.on_complete);
 
   _gum_duk_core_pin (core);
-  _gum_duk_core_push_job (core,
-      (GumScriptJobFunc) gum_memory_scan_context_run,
-      g_slice_dup (GumMemoryScanContext, &sc),
+
+  scan = gum_script_memory_scan_new (&range, pattern, ordered, core->exceptor,
+      &gum_memory_scan_callbacks, g_slice_dup (GumMemoryScanContext, &sc),
       (GDestroyNotify) gum_memory_scan_context_free);
+  gum_script_memory_scan_start (scan, core->scheduler);
 
   return 0;
 }
@@ -807,52 +825,9 @@ gum_memory_scan_context_free (GumMemoryScanContext * self)
   _gum_duk_core_unpin (core);
   _gum_duk_scope_leave (&scope);
 
-  gum_match_pattern_free (self->pattern);
-
   g_slice_free (GumMemoryScanContext, self);
 }
 
-static void
-gum_memory_scan_context_run (GumMemoryScanContext * self)
-{
-  GumDukCore * core = self->core;
-  GumExceptor * exceptor = core->exceptor;
-  GumExceptorScope exceptor_scope;
-  GumDukScope script_scope;
-  duk_context * ctx;
-
-  if (gum_exceptor_try (exceptor, &exceptor_scope))
-  {
-    gum_memory_scan (&self->range, self->pattern,
-        gum_memory_scan_context_emit_match, self);
-  }
-
-  ctx = _gum_duk_scope_enter (&script_scope, core);
-
-  if (gum_exceptor_catch (exceptor, &exceptor_scope))
-  {
-    if (self->on_error != NULL)
-    {
-      gchar * message;
-
-      duk_push_heapptr (ctx, self->on_error);
-
-      message = gum_exception_details_to_string (&exceptor_scope.exception);
-      duk_push_string (ctx, message);
-      g_free (message);
-
-      _gum_duk_scope_call (&script_scope, 1);
-      duk_pop (ctx);
-    }
-  }
-
-  duk_push_heapptr (ctx, self->on_complete);
-  _gum_duk_scope_call (&script_scope, 0);
-  duk_pop (ctx);
-
-  _gum_duk_scope_leave (&script_scope);
-}
-
 static gboolean
 gum_memory_scan_context_emit_match (GumAddress address,
                                     gsize size,
@@ -884,6 +859,41 @@ gum_memory_scan_context_emit_match (GumAddress address,
   return proceed;
 }
 
+static void
+gum_memory_scan_context_emit_error (const gchar * message,
+                                    GumMemoryScanContext * self)
+{
+  GumDukScope scope;
+  duk_context * ctx;
+
+  if (self->on_error == NULL)
+    return;
+
+  ctx = _gum_duk_scope_enter (&scope, self->core);
+
+  duk_push_heapptr (ctx, self->on_error);
+  duk_push_string (ctx, message);
+  _gum_duk_scope_call (&scope, 1);
+  duk_pop (ctx);
+
+  _gum_duk_scope_leave (&scope);
+}
+
+static void
+gum_memory_scan_context_emit_complete (GumMemoryScanContext * self)
+{
+  GumDukScope scope;
+  duk_context * ctx;
+
+  ctx = _gum_duk_scope_enter (&scope, self->core);
+
+  duk_push_heapptr (ctx, self->on_complete);
+  _gum_duk_scope_call (&scope, 0);
+  duk_pop (ctx);
+
+  _gum_duk_scope_leave (&scope);
+}
+
 GUMJS_DEFINE_FUNCTION (gumjs_memory_scan_sync)
 {
   GumDukCore * core = args->core;
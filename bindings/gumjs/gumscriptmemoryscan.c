@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumscriptmemoryscan.h"
+
+#define GUM_SCRIPT_MEMORY_SCAN_MIN_CHUNK_SIZE (1024 * 1024)
+#define GUM_SCRIPT_MEMORY_SCAN_CHUNKS_PER_CPU 4
+
+typedef struct _GumScriptMemoryScanChunk GumScriptMemoryScanChunk;
+
+struct _GumScriptMemoryScan
+{
+  volatile gint ref_count;
+
+  GumMemoryRange range;
+  GumMatchPattern * pattern;
+  gboolean ordered;
+  GumExceptor * exceptor;
+
+  GumScriptMemoryScanCallbacks callbacks;
+  gpointer user_data;
+  GDestroyNotify user_data_destroy;
+
+  volatile gint stopped;
+
+  GMutex mutex;
+  GumScriptMemoryScanChunk * chunks;
+  guint n_chunks;
+  guint next_chunk_to_emit;
+  GumAddress emitted_end;
+  gboolean emitting;
+};
+
+struct _GumScriptMemoryScanChunk
+{
+  GumScriptMemoryScan * scan;
+
+  GumAddress start;
+  GumAddress end;
+
+  GArray * matches;
+  gchar * error;
+  gboolean done;
+};
+
+static void gum_script_memory_scan_unref (GumScriptMemoryScan * self);
+static void gum_script_memory_scan_stop (GumScriptMemoryScan * self);
+static gboolean gum_script_memory_scan_is_stopped (GumScriptMemoryScan * self);
+
+static void gum_script_memory_scan_chunk_run (
+    GumScriptMemoryScanChunk * chunk);
+static void gum_script_memory_scan_chunk_release (
+    GumScriptMemoryScanChunk * chunk);
+static gboolean gum_script_memory_scan_chunk_on_match (GumAddress address,
+    gsize size, gpointer user_data);
+static void gum_script_memory_scan_chunk_complete (
+    GumScriptMemoryScanChunk * chunk);
+static void gum_script_memory_scan_chunk_emit (
+    GumScriptMemoryScanChunk * chunk);
+
+GumScriptMemoryScan *
+gum_script_memory_scan_new (const GumMemoryRange * range,
+                            GumMatchPattern * pattern,
+                            gboolean ordered,
+                            GumExceptor * exceptor,
+                            const GumScriptMemoryScanCallbacks * callbacks,
+                            gpointer user_data,
+                            GDestroyNotify user_data_destroy)
+{
+  GumScriptMemoryScan * scan;
+  gsize page_size, chunk_size, max_chunks;
+  GumAddress range_end, cursor;
+  guint i;
+
+  scan = g_slice_new0 (GumScriptMemoryScan);
+
+  scan->range = *range;
+  scan->pattern = pattern;
+  scan->ordered = ordered;
+  scan->exceptor = exceptor;
+
+  scan->callbacks = *callbacks;
+  scan->user_data = user_data;
+  scan->user_data_destroy = user_data_destroy;
+
+  g_mutex_init (&scan->mutex);
+
+  /*
+   * Split the range into page-aligned chunks. Each chunk also looks at the
+   * first pattern->size - 1 bytes of the next one, so that matches straddling
+   * a chunk boundary are found by the chunk where they start.
+   */
+  page_size = gum_query_page_size ();
+  max_chunks = MAX (g_get_num_processors (), 1) *
+      GUM_SCRIPT_MEMORY_SCAN_CHUNKS_PER_CPU;
+  chunk_size = MAX (range->size / max_chunks,
+      GUM_SCRIPT_MEMORY_SCAN_MIN_CHUNK_SIZE);
+  chunk_size = (chunk_size + page_size - 1) & ~(page_size - 1);
+
+  range_end = range->base_address + range->size;
+
+  scan->n_chunks = 0;
+  cursor = range->base_address;
+  do
+  {
+    scan->n_chunks++;
+    cursor = (cursor + chunk_size) & ~((GumAddress) page_size - 1);
+  }
+  while (cursor < range_end);
+
+  scan->chunks = g_new0 (GumScriptMemoryScanChunk, scan->n_chunks);
+
+  cursor = range->base_address;
+  for (i = 0; i != scan->n_chunks; i++)
+  {
+    GumScriptMemoryScanChunk * chunk = &scan->chunks[i];
+
+    chunk->scan = scan;
+    chunk->start = cursor;
+    cursor = (cursor + chunk_size) & ~((GumAddress) page_size - 1);
+    chunk->end = MIN (cursor, range_end);
+    if (ordered)
+      chunk->matches = g_array_new (FALSE, FALSE, sizeof (GumMemoryRange));
+  }
+
+  return scan;
+}
+
+void
+gum_script_memory_scan_start (GumScriptMemoryScan * self,
+                              GumScriptScheduler * scheduler)
+{
+  guint i;
+
+  /* Each chunk job holds a reference, the last one to finish completes. */
+  g_atomic_int_set (&self->ref_count, self->n_chunks);
+
+  for (i = 0; i != self->n_chunks; i++)
+  {
+    gum_script_scheduler_push_job_on_thread_pool (scheduler,
+        (GumScriptJobFunc) gum_script_memory_scan_chunk_run, &self->chunks[i],
+        (GDestroyNotify) gum_script_memory_scan_chunk_release);
+  }
+}
+
+static void
+gum_script_memory_scan_unref (GumScriptMemoryScan * self)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&self->ref_count))
+    return;
+
+  self->callbacks.on_complete (self->user_data);
+
+  if (self->user_data_destroy != NULL)
+    self->user_data_destroy (self->user_data);
+
+  for (i = 0; i != self->n_chunks; i++)
+  {
+    GumScriptMemoryScanChunk * chunk = &self->chunks[i];
+
+    if (chunk->matches != NULL)
+      g_array_free (chunk->matches, TRUE);
+    g_free (chunk->error);
+  }
+  g_free (self->chunks);
+
+  g_mutex_clear (&self->mutex);
+
+  gum_match_pattern_free (self->pattern);
+
+  g_slice_free (GumScriptMemoryScan, self);
+}
+
+static void
+gum_script_memory_scan_stop (GumScriptMemoryScan * self)
+{
+  g_atomic_int_set (&self->stopped, TRUE);
+}
+
+static gboolean
+gum_script_memory_scan_is_stopped (GumScriptMemoryScan * self)
+{
+  return g_atomic_int_get (&self->stopped);
+}
+
+#ifdef _MSC_VER
+# pragma warning (push)
+# pragma warning (disable: 4611)
+#endif
+
+static void
+gum_script_memory_scan_chunk_run (GumScriptMemoryScanChunk * chunk)
+{
+  GumScriptMemoryScan * scan = chunk->scan;
+  GumExceptorScope scope;
+
+  if (!gum_script_memory_scan_is_stopped (scan))
+  {
+    GumMemoryRange range;
+    guint pattern_size;
+    GumAddress scan_end;
+
+    pattern_size = gum_match_pattern_get_size (scan->pattern);
+    scan_end = MIN (chunk->end + pattern_size - 1,
+        scan->range.base_address + scan->range.size);
+
+    range.base_address = chunk->start;
+    range.size = scan_end - chunk->start;
+
+    if (gum_exceptor_try (scan->exceptor, &scope))
+    {
+      gum_memory_scan (&range, scan->pattern,
+          gum_script_memory_scan_chunk_on_match, chunk);
+    }
+
+    if (gum_exceptor_catch (scan->exceptor, &scope))
+      chunk->error = gum_exception_details_to_string (&scope.exception);
+  }
+
+  gum_script_memory_scan_chunk_complete (chunk);
+}
+
+#ifdef _MSC_VER
+# pragma warning (pop)
+#endif
+
+static void
+gum_script_memory_scan_chunk_release (GumScriptMemoryScanChunk * chunk)
+{
+  gum_script_memory_scan_unref (chunk->scan);
+}
+
+static gboolean
+gum_script_memory_scan_chunk_on_match (GumAddress address,
+                                       gsize size,
+                                       gpointer user_data)
+{
+  GumScriptMemoryScanChunk * chunk = user_data;
+  GumScriptMemoryScan * scan = chunk->scan;
+
+  if (address >= chunk->end || gum_script_memory_scan_is_stopped (scan))
+    return FALSE;
+
+  if (scan->ordered)
+  {
+    GumMemoryRange match;
+
+    match.base_address = address;
+    match.size = size;
+    g_array_append_val (chunk->matches, match);
+  }
+  else if (!scan->callbacks.on_match (address, size, scan->user_data))
+  {
+    gum_script_memory_scan_stop (scan);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gum_script_memory_scan_chunk_complete (GumScriptMemoryScanChunk * chunk)
+{
+  GumScriptMemoryScan * scan = chunk->scan;
+
+  if (!scan->ordered)
+  {
+    gum_script_memory_scan_chunk_emit (chunk);
+    return;
+  }
+
+  /*
+   * Whoever completes the chunk that is next in line drains it and any
+   * subsequent ones that are already done, so callbacks arrive in address
+   * order and are never made from two threads at once.
+   */
+  g_mutex_lock (&scan->mutex);
+
+  chunk->done = TRUE;
+
+  if (!scan->emitting)
+  {
+    scan->emitting = TRUE;
+
+    while (scan->next_chunk_to_emit != scan->n_chunks &&
+        scan->chunks[scan->next_chunk_to_emit].done)
+    {
+      GumScriptMemoryScanChunk * next =
+          &scan->chunks[scan->next_chunk_to_emit++];
+
+      g_mutex_unlock (&scan->mutex);
+      gum_script_memory_scan_chunk_emit (next);
+      g_mutex_lock (&scan->mutex);
+    }
+
+    scan->emitting = FALSE;
+  }
+
+  g_mutex_unlock (&scan->mutex);
+}
+
+static void
+gum_script_memory_scan_chunk_emit (GumScriptMemoryScanChunk * chunk)
+{
+  GumScriptMemoryScan * scan = chunk->scan;
+
+  if (scan->ordered)
+  {
+    guint i;
+
+    for (i = 0; i != chunk->matches->len &&
+        !gum_script_memory_scan_is_stopped (scan); i++)
+    {
+      const GumMemoryRange * match =
+          &g_array_index (chunk->matches, GumMemoryRange, i);
+
+      /* Keep matches non-overlapping across chunk boundaries. */
+      if (match->base_address < scan->emitted_end)
+        continue;
+      scan->emitted_end = match->base_address + match->size;
+
+      if (!scan->callbacks.on_match (match->base_address, match->size,
+          scan->user_data))
+      {
+        gum_script_memory_scan_stop (scan);
+      }
+    }
+  }
+
+  if (chunk->error != NULL)
+  {
+    gboolean first_error;
+
+    g_mutex_lock (&scan->mutex);
+    first_error = !gum_script_memory_scan_is_stopped (scan);
+    gum_script_memory_scan_stop (scan);
+    g_mutex_unlock (&scan->mutex);
+
+    if (first_error && scan->callbacks.on_error != NULL)
+      scan->callbacks.on_error (chunk->error, scan->user_data);
+  }
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_SCRIPT_MEMORY_SCAN_H__
+#define __GUM_SCRIPT_MEMORY_SCAN_H__
+
+#include "gumscriptscheduler.h"
+
+#include <gum/gumexceptor.h>
+#include <gum/gummemory.h>
+
+typedef struct _GumScriptMemoryScan GumScriptMemoryScan;
+typedef struct _GumScriptMemoryScanCallbacks GumScriptMemoryScanCallbacks;
+
+typedef void (* GumScriptMemoryScanErrorFunc) (const gchar * message,
+    gpointer user_data);
+typedef void (* GumScriptMemoryScanCompleteFunc) (gpointer user_data);
+
+struct _GumScriptMemoryScanCallbacks
+{
+  GumMemoryScanMatchFunc on_match;
+  GumScriptMemoryScanErrorFunc on_error;
+  GumScriptMemoryScanCompleteFunc on_complete;
+};
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL GumScriptMemoryScan * gum_script_memory_scan_new (
+    const GumMemoryRange * range, GumMatchPattern * pattern, gboolean ordered,
+    GumExceptor * exceptor, const GumScriptMemoryScanCallbacks * callbacks,
+    gpointer user_data, GDestroyNotify user_data_destroy);
+G_GNUC_INTERNAL void gum_script_memory_scan_start (GumScriptMemoryScan * self,
+    GumScriptScheduler * scheduler);
+
+G_END_DECLS
+
+#endif
@@ -65,7 +65,7 @@ gum_script_scheduler_init (GumScriptScheduler * self)
   priv->thread_pool = g_thread_pool_new (
       (GFunc) gum_script_scheduler_perform_pool_job,
       self,
-      4,
+      MAX (g_get_num_processors (), 4),
       FALSE,
       NULL);
 }
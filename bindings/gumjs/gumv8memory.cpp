@@ -6,6 +6,7 @@
 
 #include "gumv8memory.h"
 
+#include "gumscriptmemoryscan.h"
 #include "gumv8macros.h"
 #include "gumv8scope.h"
 
@@ -44,8 +45,6 @@ enum GumMemoryValueType
 
 struct GumMemoryScanContext
 {
-  GumMemoryRange range;
-  GumMatchPattern * pattern;
   GumPersistent<Function>::type * on_match;
   GumPersistent<Function>::type * on_error;
   GumPersistent<Function>::type * on_complete;
@@ -119,9 +118,12 @@ GUMJS_DECLARE_FUNCTION (gumjs_memory_alloc_utf16_string)
 
 GUMJS_DECLARE_FUNCTION (gumjs_memory_scan)
 static void gum_memory_scan_context_free (GumMemoryScanContext * self);
-static void gum_memory_scan_context_run (GumMemoryScanContext * self);
 static gboolean gum_memory_scan_context_emit_match (GumAddress address,
     gsize size, GumMemoryScanContext * self);
+static void gum_memory_scan_context_emit_error (const gchar * message,
+    GumMemoryScanContext * self);
+static void gum_memory_scan_context_emit_complete (
+    GumMemoryScanContext * self);
 GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_sync)
 static gboolean gum_append_match (GumAddress address, gsize size,
     GumMemoryScanSyncContext * ctx);
@@ -858,25 +860,42 @@ GUMJS_DEFINE_FUNCTION (gumjs_memory_scan)
 
   g_free (match_str);
 
-  if (pattern != NULL)
+  if (pattern == NULL)
   {
-    auto ctx = g_slice_new0 (GumMemoryScanContext);
-    ctx->range = range;
-    ctx->pattern = pattern;
-    ctx->on_match = new GumPersistent<Function>::type (isolate, on_match);
-    if (!on_error.IsEmpty ())
-      ctx->on_error = new GumPersistent<Function>::type (isolate, on_error);
-    ctx->on_complete = new GumPersistent<Function>::type (isolate, on_complete);
-    ctx->core = core;
-
-    _gum_v8_core_pin (core);
-    _gum_v8_core_push_job (core, (GumScriptJobFunc) gum_memory_scan_context_run,
-        ctx, (GDestroyNotify) gum_memory_scan_context_free);
+    _gum_v8_throw_ascii_literal (isolate, "invalid match pattern");
+    return;
   }
-  else
+
+  gboolean ordered = TRUE;
+  auto callbacks = info[3].As<Object> ();
+  auto ordered_key = _gum_v8_string_new_from_ascii ("ordered", isolate);
+  if (callbacks->Has (ordered_key))
   {
-    _gum_v8_throw_ascii_literal (isolate, "invalid match pattern");
+    auto value = callbacks->Get (ordered_key);
+    if (value->IsBoolean ())
+      ordered = value->BooleanValue ();
   }
+
+  auto ctx = g_slice_new0 (GumMemoryScanContext);
+  ctx->on_match = new GumPersistent<Function>::type (isolate, on_match);
+  if (!on_error.IsEmpty ())
+    ctx->on_error = new GumPersistent<Function>::type (isolate, on_error);
+  ctx->on_complete = new GumPersistent<Function>::type (isolate, on_complete);
+  ctx->core = core;
+
+  _gum_v8_core_pin (core);
+
+  static const GumScriptMemoryScanCallbacks scan_callbacks =
+  {
+    (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match,
+    (GumScriptMemoryScanErrorFunc) gum_memory_scan_context_emit_error,
+    (GumScriptMemoryScanCompleteFunc) gum_memory_scan_context_emit_complete
+  };
+
+  auto scan = gum_script_memory_scan_new (&range, pattern, ordered,
+      core->exceptor, &scan_callbacks, ctx,
+      (GDestroyNotify) gum_memory_scan_context_free);
+  gum_script_memory_scan_start (scan, core->scheduler);
 }
 
 static void
@@ -884,8 +903,6 @@ gum_memory_scan_context_free (GumMemoryScanContext * self)
 {
   auto core = self->core;
 
-  gum_match_pattern_free (self->pattern);
-
   {
     ScriptScope script_scope (core->script);
 
@@ -904,42 +921,6 @@ gum_memory_scan_context_free (GumMemoryScanContext * self)
 # pragma warning (disable: 4611)
 #endif
 
-static void
-gum_memory_scan_context_run (GumMemoryScanContext * self)
-{
-  auto core = self->core;
-  auto exceptor = core->exceptor;
-  GumExceptorScope scope;
-
-  if (gum_exceptor_try (exceptor, &scope))
-  {
-    gum_memory_scan (&self->range, self->pattern,
-        (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match, self);
-  }
-
-  {
-    ScriptScope script_scope (core->script);
-    auto isolate = core->isolate;
-
-    auto receiver = Null (isolate);
-
-    if (gum_exceptor_catch (exceptor, &scope))
-    {
-      if (self->on_error != NULL)
-      {
-        auto message = gum_exception_details_to_string (&scope.exception);
-        auto on_error = Local<Function>::New (isolate, *self->on_error);
-        Handle<Value> argv[] = { String::NewFromUtf8 (isolate, message) };
-        on_error->Call (receiver, G_N_ELEMENTS (argv), argv);
-        g_free (message);
-      }
-    }
-
-    auto on_complete (Local<Function>::New (isolate, *self->on_complete));
-    on_complete->Call (receiver, 0, nullptr);
-  }
-}
-
 static gboolean
 gum_memory_scan_context_emit_match (GumAddress address,
                                     gsize size,
@@ -966,6 +947,32 @@ gum_memory_scan_context_emit_match (GumAddress address,
   return proceed;
 }
 
+static void
+gum_memory_scan_context_emit_error (const gchar * message,
+                                    GumMemoryScanContext * self)
+{
+  if (self->on_error == NULL)
+    return;
+
+  ScriptScope scope (self->core->script);
+  auto isolate = self->core->isolate;
+
+  auto on_error = Local<Function>::New (isolate, *self->on_error);
+  auto receiver = Null (isolate);
+  Handle<Value> argv[] = { String::NewFromUtf8 (isolate, message) };
+  on_error->Call (receiver, G_N_ELEMENTS (argv), argv);
+}
+
+static void
+gum_memory_scan_context_emit_complete (GumMemoryScanContext * self)
+{
+  ScriptScope scope (self->core->script);
+  auto isolate = self->core->isolate;
+
+  auto on_complete = Local<Function>::New (isolate, *self->on_complete);
+  on_complete->Call (Null (isolate), 0, nullptr);
+}
+
 /*
  * Prototype:
  * Memory.scanSync(address, size, match_str)
@@ -5,6 +5,7 @@
  */
 
 #include "gumsymbolutil.h"
+#include "gumsymbolutil-priv.h"
 
 #include "gum-init.h"
 #include "gummemory.h"
@@ -20,7 +21,12 @@
 # include <sys/elf.h>
 #endif
 
+#define GUM_BFD_MODULE_CACHE_CAPACITY 16
+
 typedef struct _GumSymbolCollection GumSymbolCollection;
+typedef struct _GumBfdModule GumBfdModule;
+typedef struct _GumBfdFunction GumBfdFunction;
+typedef struct _GumBfdLocation GumBfdLocation;
 
 struct _GumSymbolCollection
 {
@@ -30,9 +36,51 @@ struct _GumSymbolCollection
   guint num_dynamic_symbols;
 };
 
+struct _GumBfdModule
+{
+  gchar * path;
+  bfd * abfd;
+  GumSymbolCollection sc;
+  gboolean has_debug_info;
+
+  GArray * functions;
+  GHashTable * locations;
+
+  GList link;
+};
+
+struct _GumBfdFunction
+{
+  bfd_vma address;
+  asection * section;
+  const gchar * name;
+};
+
+struct _GumBfdLocation
+{
+  const gchar * symbol_name;
+  const gchar * file_name;
+  guint line_number;
+};
+
 static gpointer do_init (gpointer data);
 static void do_deinit (void);
 
+static void gum_symbol_details_resolve (gpointer address,
+    const Dl_info * dl_info, GumBfdModule * module, GumSymbolDetails * details);
+
+static GumBfdModule * gum_bfd_module_obtain (const gchar * path);
+static GumBfdModule * gum_bfd_module_new (const gchar * path);
+static void gum_bfd_module_free (GumBfdModule * module);
+static const GumBfdLocation * gum_bfd_module_find_location (
+    GumBfdModule * self, bfd_vma offset);
+static const GumBfdFunction * gum_bfd_module_find_function (
+    GumBfdModule * self, bfd_vma offset);
+static void gum_bfd_module_add_functions (GumBfdModule * self,
+    asymbol ** symbols, guint num_symbols);
+static gint gum_bfd_function_compare (const GumBfdFunction * lhs,
+    const GumBfdFunction * rhs);
+
 static void gum_build_symbols_database (void);
 static gboolean gum_consume_symbols_from_range (const GumRangeDetails * details,
     gpointer user_data);
@@ -46,6 +94,10 @@ static bfd * gum_open_bfd_and_load_symbols (const gchar * path,
 static void gum_close_bfd_and_release_symbols (bfd * abfd,
     GumSymbolCollection * sc);
 
+G_LOCK_DEFINE_STATIC (gum_bfd_modules);
+static GHashTable * gum_bfd_module_by_path = NULL;
+static GQueue gum_bfd_module_lru = G_QUEUE_INIT;
+
 static GHashTable * gum_function_address_by_name = NULL;
 
 static void
@@ -61,6 +113,8 @@ do_init (gpointer data)
 {
   gum_function_address_by_name = g_hash_table_new_full (g_str_hash,
       g_str_equal, g_free, NULL);
+  gum_bfd_module_by_path = g_hash_table_new_full (g_str_hash, g_str_equal,
+      NULL, (GDestroyNotify) gum_bfd_module_free);
 
   gum_build_symbols_database ();
 
@@ -72,6 +126,10 @@ do_init (gpointer data)
 static void
 do_deinit (void)
 {
+  g_queue_init (&gum_bfd_module_lru);
+  g_hash_table_unref (gum_bfd_module_by_path);
+  gum_bfd_module_by_path = NULL;
+
   g_hash_table_unref (gum_function_address_by_name);
   gum_function_address_by_name = NULL;
 }
@@ -80,79 +138,102 @@ gboolean
 gum_symbol_details_from_address (gpointer address,
                                  GumSymbolDetails * details)
 {
-  gboolean result = FALSE;
   Dl_info dl_info;
-  const gchar * module_name;
-  bfd * abfd = NULL;
-  GumSymbolCollection sc = { 0, };
-  bfd_vma offset;
-  asection * section;
 
   gum_symbol_util_init ();
 
   if (!dladdr (address, &dl_info))
-    goto beach;
+    return FALSE;
+
+  G_LOCK (gum_bfd_modules);
+  gum_symbol_details_resolve (address, &dl_info,
+      gum_bfd_module_obtain (dl_info.dli_fname), details);
+  G_UNLOCK (gum_bfd_modules);
+
+  return TRUE;
+}
+
+/*
+ * All of the addresses must belong to the same module, which is looked up
+ * and opened only once for all of them.
+ */
+void
+_gum_symbol_details_from_module_addresses (const GumAddress * addresses,
+                                           guint n_addresses,
+                                           GumSymbolDetails * details,
+                                           gboolean * resolved)
+{
+  Dl_info dl_info;
+  GumBfdModule * module;
+  guint i;
+
+  gum_symbol_util_init ();
+
+  if (!dladdr (GSIZE_TO_POINTER (addresses[0]), &dl_info))
+  {
+    for (i = 0; i != n_addresses; i++)
+      resolved[i] = FALSE;
+    return;
+  }
+
+  G_LOCK (gum_bfd_modules);
+
+  module = gum_bfd_module_obtain (dl_info.dli_fname);
+  for (i = 0; i != n_addresses; i++)
+  {
+    gum_symbol_details_resolve (GSIZE_TO_POINTER (addresses[i]), &dl_info,
+        module, &details[i]);
+    resolved[i] = TRUE;
+  }
+
+  G_UNLOCK (gum_bfd_modules);
+}
+
+static void
+gum_symbol_details_resolve (gpointer address,
+                            const Dl_info * dl_info,
+                            GumBfdModule * module,
+                            GumSymbolDetails * details)
+{
+  const gchar * module_name;
+  bfd_vma offset;
+  const GumBfdLocation * location;
 
   memset (details, 0, sizeof (GumSymbolDetails));
 
   details->address = GUM_ADDRESS (address);
 
-  module_name = g_strrstr (dl_info.dli_fname, "/");
+  module_name = g_strrstr (dl_info->dli_fname, "/");
   if (module_name != NULL)
     module_name++;
   else
-    module_name = dl_info.dli_fname;
+    module_name = dl_info->dli_fname;
   g_strlcpy (details->module_name, module_name, sizeof (details->module_name));
 
-  result = TRUE;
-
-  abfd = gum_open_bfd_and_load_symbols (dl_info.dli_fname, &sc);
-  if (abfd == NULL)
-    goto beach;
+  if (module == NULL)
+    return;
 
   offset = GPOINTER_TO_SIZE (address);
-  if (abfd->flags & BSF_KEEP_G)
-    offset -= GPOINTER_TO_SIZE (dl_info.dli_fbase);
-
-  for (section = abfd->sections; section != NULL; section = section->next)
-  {
-    bfd_vma section_start;
-    bfd_size_type section_size;
-    const gchar * file_name;
-    const gchar * symbol_name;
-    guint line_number;
-
-    section_start = bfd_get_section_vma (abfd, section);
-    if (offset < section_start)
-      continue;
-
-    section_size = bfd_get_section_size (section);
-    if (offset >= section_start + section_size)
-      continue;
-
-    if (bfd_find_nearest_line (abfd, section, sc.static_symbols,
-        offset - section_start, &file_name, &symbol_name, &line_number) ||
-        bfd_find_nearest_line (abfd, section, sc.dynamic_symbols,
-        offset - section_start, &file_name, &symbol_name, &line_number))
-    {
-      if (symbol_name != NULL)
-      {
-        g_strlcpy (details->symbol_name, symbol_name,
-            sizeof (details->symbol_name));
-      }
+  if (module->abfd->flags & BSF_KEEP_G)
+    offset -= GPOINTER_TO_SIZE (dl_info->dli_fbase);
 
-      if (file_name != NULL)
-        g_strlcpy (details->file_name, file_name, sizeof (details->file_name));
+  location = gum_bfd_module_find_location (module, offset);
+  if (location == NULL)
+    return;
 
-      details->line_number = line_number;
+  if (location->symbol_name != NULL)
+  {
+    g_strlcpy (details->symbol_name, location->symbol_name,
+        sizeof (details->symbol_name));
+  }
 
-      break;
-    }
+  if (location->file_name != NULL)
+  {
+    g_strlcpy (details->file_name, location->file_name,
+        sizeof (details->file_name));
   }
 
-beach:
-  gum_close_bfd_and_release_symbols (abfd, &sc);
-  return result;
+  details->line_number = location->line_number;
 }
 
 gchar *
@@ -216,6 +297,226 @@ gum_find_functions_matching (const gchar * str)
   return matches;
 }
 
+/*
+ * Opened modules are kept around along with their canonicalized symbols,
+ * a sorted function table, and the locations resolved so far, evicting the
+ * least recently used one once the cache is full. Called with the lock held.
+ */
+static GumBfdModule *
+gum_bfd_module_obtain (const gchar * path)
+{
+  GumBfdModule * module;
+
+  module = g_hash_table_lookup (gum_bfd_module_by_path, path);
+  if (module != NULL)
+  {
+    g_queue_unlink (&gum_bfd_module_lru, &module->link);
+    g_queue_push_head_link (&gum_bfd_module_lru, &module->link);
+
+    return (module->abfd != NULL) ? module : NULL;
+  }
+
+  if (gum_bfd_module_lru.length == GUM_BFD_MODULE_CACHE_CAPACITY)
+  {
+    GList * oldest = g_queue_pop_tail_link (&gum_bfd_module_lru);
+
+    g_hash_table_remove (gum_bfd_module_by_path,
+        ((GumBfdModule *) oldest->data)->path);
+  }
+
+  module = gum_bfd_module_new (path);
+  g_hash_table_insert (gum_bfd_module_by_path, module->path, module);
+  g_queue_push_head_link (&gum_bfd_module_lru, &module->link);
+
+  return (module->abfd != NULL) ? module : NULL;
+}
+
+static GumBfdModule *
+gum_bfd_module_new (const gchar * path)
+{
+  GumBfdModule * module;
+
+  module = g_slice_new0 (GumBfdModule);
+  module->path = g_strdup (path);
+  module->link.data = module;
+
+  /* Remember failures too, so we don't keep trying to open the file. */
+  module->abfd = gum_open_bfd_and_load_symbols (path, &module->sc);
+  if (module->abfd == NULL)
+    return module;
+
+  module->has_debug_info =
+      bfd_get_section_by_name (module->abfd, ".debug_line") != NULL ||
+      bfd_get_section_by_name (module->abfd, ".gnu_debuglink") != NULL;
+
+  module->functions = g_array_new (FALSE, FALSE, sizeof (GumBfdFunction));
+  gum_bfd_module_add_functions (module, module->sc.static_symbols,
+      module->sc.num_static_symbols);
+  gum_bfd_module_add_functions (module, module->sc.dynamic_symbols,
+      module->sc.num_dynamic_symbols);
+  g_array_sort (module->functions, (GCompareFunc) gum_bfd_function_compare);
+
+  module->locations = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_free);
+
+  return module;
+}
+
+static void
+gum_bfd_module_free (GumBfdModule * module)
+{
+  if (module->locations != NULL)
+    g_hash_table_unref (module->locations);
+  if (module->functions != NULL)
+    g_array_free (module->functions, TRUE);
+
+  gum_close_bfd_and_release_symbols (module->abfd, &module->sc);
+
+  g_free (module->path);
+
+  g_slice_free (GumBfdModule, module);
+}
+
+static const GumBfdLocation *
+gum_bfd_module_find_location (GumBfdModule * self,
+                              bfd_vma offset)
+{
+  GumBfdLocation * location;
+  gboolean found = FALSE;
+
+  location = g_hash_table_lookup (self->locations, GSIZE_TO_POINTER (offset));
+  if (location != NULL)
+    return location;
+
+  location = g_new0 (GumBfdLocation, 1);
+
+  /*
+   * Without line information bfd_find_nearest_line() ends up doing a linear
+   * scan of the symbol table, so only ask it when there is some.
+   */
+  if (self->has_debug_info)
+  {
+    asection * section;
+
+    for (section = self->abfd->sections;
+        section != NULL && !found;
+        section = section->next)
+    {
+      bfd_vma section_start;
+      bfd_size_type section_size;
+
+      section_start = bfd_get_section_vma (self->abfd, section);
+      if (offset < section_start)
+        continue;
+
+      section_size = bfd_get_section_size (section);
+      if (offset >= section_start + section_size)
+        continue;
+
+      found = bfd_find_nearest_line (self->abfd, section,
+          self->sc.static_symbols, offset - section_start,
+          &location->file_name, &location->symbol_name,
+          &location->line_number) ||
+          bfd_find_nearest_line (self->abfd, section,
+          self->sc.dynamic_symbols, offset - section_start,
+          &location->file_name, &location->symbol_name,
+          &location->line_number);
+    }
+  }
+
+  if (location->symbol_name == NULL)
+  {
+    const GumBfdFunction * function;
+
+    function = gum_bfd_module_find_function (self, offset);
+    if (function != NULL)
+    {
+      location->symbol_name = function->name;
+      found = TRUE;
+    }
+  }
+
+  if (!found)
+  {
+    g_free (location);
+    return NULL;
+  }
+
+  g_hash_table_insert (self->locations, GSIZE_TO_POINTER (offset), location);
+
+  return location;
+}
+
+static const GumBfdFunction *
+gum_bfd_module_find_function (GumBfdModule * self,
+                              bfd_vma offset)
+{
+  GArray * functions = self->functions;
+  const GumBfdFunction * function;
+  guint lo, hi;
+  bfd_vma section_start;
+
+  lo = 0;
+  hi = functions->len;
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (g_array_index (functions, GumBfdFunction, mid).address <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return NULL;
+
+  function = &g_array_index (functions, GumBfdFunction, lo - 1);
+
+  section_start = bfd_get_section_vma (self->abfd, function->section);
+  if (offset >= section_start + bfd_get_section_size (function->section))
+    return NULL;
+
+  return function;
+}
+
+static void
+gum_bfd_module_add_functions (GumBfdModule * self,
+                              asymbol ** symbols,
+                              guint num_symbols)
+{
+  guint i;
+
+  for (i = 0; i != num_symbols; i++)
+  {
+    asymbol * sym = symbols[i];
+    GumBfdFunction function;
+
+    if (sym->name == NULL || sym->name[0] == '\0')
+      continue;
+    else if ((sym->flags & BSF_FUNCTION) == 0)
+      continue;
+    else if (bfd_is_und_section (sym->section))
+      continue;
+
+    function.address = bfd_asymbol_value (sym);
+    function.section = sym->section;
+    function.name = sym->name;
+    g_array_append_val (self->functions, function);
+  }
+}
+
+static gint
+gum_bfd_function_compare (const GumBfdFunction * lhs,
+                          const GumBfdFunction * rhs)
+{
+  if (lhs->address < rhs->address)
+    return -1;
+  else if (lhs->address > rhs->address)
+    return 1;
+  else
+    return 0;
+}
+
 static void
 gum_build_symbols_database (void)
 {
@@ -5,6 +5,7 @@
  */
 
 #include "gumsymbolutil.h"
+#include "gumsymbolutil-priv.h"
 
 #include "gum-init.h"
 
@@ -227,6 +228,25 @@ gum_symbol_details_from_address (gpointer address,
   return success;
 }
 
+/*
+ * CoreSymbolication keeps its own per-module state, so there is nothing to
+ * share between the lookups.
+ */
+void
+_gum_symbol_details_from_module_addresses (const GumAddress * addresses,
+                                           guint n_addresses,
+                                           GumSymbolDetails * details,
+                                           gboolean * resolved)
+{
+  guint i;
+
+  for (i = 0; i != n_addresses; i++)
+  {
+    resolved[i] = gum_symbol_details_from_address (
+        GSIZE_TO_POINTER (addresses[i]), &details[i]);
+  }
+}
+
 gchar *
 gum_symbol_name_from_address (gpointer address)
 {
@@ -0,0 +1,1629 @@
+/*
+ * Copyright (C) 2008-2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumsymbolutil.h"
+#include "gumsymbolutil-priv.h"
+
+#include "gum-init.h"
+#include "gumprocess.h"
+#include "gumprocess-priv.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined (HAVE_ELF_H)
+# include <elf.h>
+#elif defined (HAVE_SYS_ELF_H)
+# include <sys/elf.h>
+#endif
+
+#ifndef STT_GNU_IFUNC
+# define STT_GNU_IFUNC 10
+#endif
+#ifndef SHF_COMPRESSED
+# define SHF_COMPRESSED (1 << 11)
+#endif
+
+#define GUM_DEBUG_FILE_DIRECTORY "/usr/lib/debug"
+
+#define GUM_DW_LNS_copy               1
+#define GUM_DW_LNS_advance_pc         2
+#define GUM_DW_LNS_advance_line       3
+#define GUM_DW_LNS_set_file           4
+#define GUM_DW_LNS_const_add_pc       8
+#define GUM_DW_LNS_fixed_advance_pc   9
+
+#define GUM_DW_LNE_end_sequence       1
+#define GUM_DW_LNE_set_address        2
+#define GUM_DW_LNE_define_file        3
+
+#define GUM_DW_LNCT_path              1
+#define GUM_DW_LNCT_directory_index   2
+
+#define GUM_DW_FORM_block2         0x03
+#define GUM_DW_FORM_block4         0x04
+#define GUM_DW_FORM_data2          0x05
+#define GUM_DW_FORM_data4          0x06
+#define GUM_DW_FORM_data8          0x07
+#define GUM_DW_FORM_string         0x08
+#define GUM_DW_FORM_block          0x09
+#define GUM_DW_FORM_block1         0x0a
+#define GUM_DW_FORM_data1          0x0b
+#define GUM_DW_FORM_sdata          0x0d
+#define GUM_DW_FORM_strp           0x0e
+#define GUM_DW_FORM_udata          0x0f
+#define GUM_DW_FORM_data16         0x1e
+#define GUM_DW_FORM_line_strp      0x1f
+
+typedef struct _GumElfImage GumElfImage;
+typedef struct _GumElfSymbolModule GumElfSymbolModule;
+typedef struct _GumElfFunction GumElfFunction;
+typedef struct _GumDwarfUnit GumDwarfUnit;
+typedef struct _GumDwarfLineRange GumDwarfLineRange;
+typedef struct _GumDwarfReader GumDwarfReader;
+typedef struct _GumDwarfLineProgram GumDwarfLineProgram;
+typedef struct _GumLoadedModule GumLoadedModule;
+
+#if GLIB_SIZEOF_VOID_P == 4
+typedef Elf32_Ehdr GumElfEHeader;
+typedef Elf32_Phdr GumElfPHeader;
+typedef Elf32_Shdr GumElfSHeader;
+typedef Elf32_Sym GumElfSymbol;
+# define GUM_ELF_CLASS ELFCLASS32
+# define GUM_ELF_ST_TYPE ELF32_ST_TYPE
+# define GUM_ELF_ST_BIND ELF32_ST_BIND
+#else
+typedef Elf64_Ehdr GumElfEHeader;
+typedef Elf64_Phdr GumElfPHeader;
+typedef Elf64_Shdr GumElfSHeader;
+typedef Elf64_Sym GumElfSymbol;
+# define GUM_ELF_CLASS ELFCLASS64
+# define GUM_ELF_ST_TYPE ELF64_ST_TYPE
+# define GUM_ELF_ST_BIND ELF64_ST_BIND
+#endif
+
+struct _GumElfImage
+{
+  gpointer data;
+  gsize size;
+  const GumElfEHeader * ehdr;
+};
+
+struct _GumElfSymbolModule
+{
+  gchar * path;
+  GumElfImage * image;
+  GumElfImage * debug_image;
+  GumAddress preferred_address;
+
+  GArray * functions;
+  GArray * functions_by_name;
+
+  GumElfImage * line_image;
+  GArray * units;
+};
+
+struct _GumElfFunction
+{
+  GumAddress address;
+  GumAddress value;
+  gsize size;
+  const gchar * name;
+  guint8 bind;
+};
+
+struct _GumDwarfUnit
+{
+  gsize offset;
+  GumAddress low;
+  GumAddress high;
+
+  GArray * ranges;
+  GPtrArray * files;
+};
+
+struct _GumDwarfLineRange
+{
+  GumAddress start;
+  GumAddress end;
+  guint file;
+  guint line;
+};
+
+struct _GumDwarfReader
+{
+  const guint8 * cursor;
+  const guint8 * end;
+  gboolean failed;
+};
+
+struct _GumDwarfLineProgram
+{
+  guint version;
+  guint offset_size;
+  guint8 minimum_instruction_length;
+  gboolean default_is_stmt;
+  gint8 line_base;
+  guint8 line_range;
+  guint8 opcode_base;
+  const guint8 * standard_opcode_lengths;
+
+  const guint8 * header;
+  const guint8 * program;
+  const guint8 * end;
+};
+
+struct _GumLoadedModule
+{
+  gchar * path;
+  GumAddress base;
+};
+
+static gpointer do_init (gpointer data);
+static void do_deinit (void);
+
+static void gum_symbol_details_resolve (gpointer address,
+    const Dl_info * dl_info, GumElfSymbolModule * module,
+    GumSymbolDetails * details);
+
+static GArray * gum_find_functions (const gchar * name,
+    GPatternSpec * spec);
+static gboolean gum_collect_loaded_module (const GumModuleDetails * details,
+    gpointer user_data);
+
+static GumElfSymbolModule * gum_elf_symbol_module_obtain (const gchar * path,
+    GumAddress base);
+static GumElfSymbolModule * gum_elf_symbol_module_new (const gchar * path,
+    GumAddress base);
+static void gum_elf_symbol_module_free (GumElfSymbolModule * module);
+static GumElfImage * gum_elf_symbol_module_open_debug_image (
+    GumElfSymbolModule * self, GumAddress base);
+static GArray * gum_elf_symbol_module_get_functions (
+    GumElfSymbolModule * self);
+static GArray * gum_elf_symbol_module_get_functions_by_name (
+    GumElfSymbolModule * self);
+static void gum_elf_symbol_module_add_functions (GumElfSymbolModule * self,
+    GumElfImage * image, guint section_type);
+static const GumElfFunction * gum_elf_symbol_module_find_function (
+    GumElfSymbolModule * self, GumAddress address);
+static gboolean gum_elf_symbol_module_find_line (GumElfSymbolModule * self,
+    GumAddress address, const gchar ** file_name, guint * line_number);
+static GArray * gum_elf_symbol_module_get_units (GumElfSymbolModule * self);
+
+static GumElfImage * gum_elf_image_open (const gchar * path);
+static void gum_elf_image_close (GumElfImage * image);
+static const GumElfSHeader * gum_elf_image_find_section (GumElfImage * self,
+    const gchar * name);
+static const guint8 * gum_elf_image_get_section_data (GumElfImage * self,
+    const GumElfSHeader * shdr, gsize * size);
+static const guint8 * gum_elf_image_find_section_data (GumElfImage * self,
+    const gchar * name, gsize * size);
+
+static gint gum_elf_function_compare_by_address (const GumElfFunction * lhs,
+    const GumElfFunction * rhs);
+static gint gum_elf_function_compare_by_name (const guint * lhs,
+    const guint * rhs, GArray * functions);
+
+static gboolean gum_dwarf_unit_decode (GumDwarfUnit * unit,
+    GumElfImage * image);
+static void gum_dwarf_unit_clear (GumDwarfUnit * unit);
+static const GumDwarfLineRange * gum_dwarf_unit_find_range (
+    GumDwarfUnit * self, GumAddress address);
+static gint gum_dwarf_line_range_compare (const GumDwarfLineRange * lhs,
+    const GumDwarfLineRange * rhs);
+
+static gboolean gum_dwarf_line_program_parse (GumDwarfLineProgram * program,
+    const guint8 * data, const guint8 * end);
+static gboolean gum_dwarf_line_program_read_files (
+    GumDwarfLineProgram * self, GumElfImage * image, GPtrArray * files);
+static gboolean gum_dwarf_line_program_read_entry_table (
+    GumDwarfLineProgram * self, GumDwarfReader * reader, GumElfImage * image,
+    GPtrArray * directories, GPtrArray * files);
+static gboolean gum_dwarf_line_program_run (GumDwarfLineProgram * self,
+    GArray * ranges, GumAddress * low, GumAddress * high);
+
+static guint64 gum_dwarf_reader_read_u8 (GumDwarfReader * self);
+static guint64 gum_dwarf_reader_read_u16 (GumDwarfReader * self);
+static guint64 gum_dwarf_reader_read_u32 (GumDwarfReader * self);
+static guint64 gum_dwarf_reader_read_u64 (GumDwarfReader * self);
+static guint64 gum_dwarf_reader_read_uint (GumDwarfReader * self, guint size);
+static guint64 gum_dwarf_reader_read_uleb128 (GumDwarfReader * self);
+static gint64 gum_dwarf_reader_read_sleb128 (GumDwarfReader * self);
+static const gchar * gum_dwarf_reader_read_string (GumDwarfReader * self);
+static void gum_dwarf_reader_skip (GumDwarfReader * self, guint64 n);
+static gboolean gum_dwarf_reader_read_form (GumDwarfReader * self,
+    guint form, guint offset_size, GumElfImage * image, guint64 * value,
+    const gchar ** str);
+static const gchar * gum_dwarf_lookup_string (GumElfImage * image,
+    const gchar * section_name, guint64 offset);
+
+G_LOCK_DEFINE_STATIC (gum_elf_symbol_modules);
+static GHashTable * gum_elf_symbol_module_by_path = NULL;
+
+static void
+gum_symbol_util_init (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+
+  g_once (&init_once, do_init, NULL);
+}
+
+static gpointer
+do_init (gpointer data)
+{
+  gum_elf_symbol_module_by_path = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) gum_elf_symbol_module_free);
+
+  _gum_register_destructor (do_deinit);
+
+  return NULL;
+}
+
+static void
+do_deinit (void)
+{
+  g_hash_table_unref (gum_elf_symbol_module_by_path);
+  gum_elf_symbol_module_by_path = NULL;
+}
+
+gboolean
+gum_symbol_details_from_address (gpointer address,
+                                 GumSymbolDetails * details)
+{
+  Dl_info dl_info;
+
+  gum_symbol_util_init ();
+
+  if (!dladdr (address, &dl_info))
+    return FALSE;
+
+  G_LOCK (gum_elf_symbol_modules);
+  gum_symbol_details_resolve (address, &dl_info,
+      gum_elf_symbol_module_obtain (dl_info.dli_fname,
+          GUM_ADDRESS (dl_info.dli_fbase)),
+      details);
+  G_UNLOCK (gum_elf_symbol_modules);
+
+  return TRUE;
+}
+
+/*
+ * All of the addresses must belong to the same module, which is looked up
+ * and loaded only once for all of them.
+ */
+void
+_gum_symbol_details_from_module_addresses (const GumAddress * addresses,
+                                           guint n_addresses,
+                                           GumSymbolDetails * details,
+                                           gboolean * resolved)
+{
+  Dl_info dl_info;
+  GumElfSymbolModule * module;
+  guint i;
+
+  gum_symbol_util_init ();
+
+  if (!dladdr (GSIZE_TO_POINTER (addresses[0]), &dl_info))
+  {
+    for (i = 0; i != n_addresses; i++)
+      resolved[i] = FALSE;
+    return;
+  }
+
+  G_LOCK (gum_elf_symbol_modules);
+
+  module = gum_elf_symbol_module_obtain (dl_info.dli_fname,
+      GUM_ADDRESS (dl_info.dli_fbase));
+  for (i = 0; i != n_addresses; i++)
+  {
+    gum_symbol_details_resolve (GSIZE_TO_POINTER (addresses[i]), &dl_info,
+        module, &details[i]);
+    resolved[i] = TRUE;
+  }
+
+  G_UNLOCK (gum_elf_symbol_modules);
+}
+
+static void
+gum_symbol_details_resolve (gpointer address,
+                            const Dl_info * dl_info,
+                            GumElfSymbolModule * module,
+                            GumSymbolDetails * details)
+{
+  const gchar * module_name;
+  GumAddress base, relative_address;
+  const GumElfFunction * function;
+  const gchar * file_name;
+  guint line_number;
+
+  memset (details, 0, sizeof (GumSymbolDetails));
+
+  details->address = GUM_ADDRESS (address);
+
+  module_name = g_strrstr (dl_info->dli_fname, "/");
+  if (module_name != NULL)
+    module_name++;
+  else
+    module_name = dl_info->dli_fname;
+  g_strlcpy (details->module_name, module_name, sizeof (details->module_name));
+
+  if (module == NULL)
+    return;
+
+  base = GUM_ADDRESS (dl_info->dli_fbase);
+
+  relative_address = GUM_ADDRESS (address) - base + module->preferred_address;
+
+  function = gum_elf_symbol_module_find_function (module, relative_address);
+  if (function != NULL)
+  {
+    g_strlcpy (details->symbol_name, function->name,
+        sizeof (details->symbol_name));
+  }
+
+  if (gum_elf_symbol_module_find_line (module, relative_address, &file_name,
+      &line_number))
+  {
+    g_strlcpy (details->file_name, file_name, sizeof (details->file_name));
+    details->line_number = line_number;
+  }
+}
+
+gchar *
+gum_symbol_name_from_address (gpointer address)
+{
+  GumSymbolDetails details;
+
+  if (gum_symbol_details_from_address (address, &details))
+    return g_strdup (details.symbol_name);
+  else
+    return NULL;
+}
+
+gpointer
+gum_find_function (const gchar * name)
+{
+  gpointer address = NULL;
+  GArray * matches;
+
+  matches = gum_find_functions_named (name);
+  if (matches->len != 0)
+    address = g_array_index (matches, gpointer, 0);
+  g_array_free (matches, TRUE);
+
+  return address;
+}
+
+GArray *
+gum_find_functions_named (const gchar * name)
+{
+  return gum_find_functions (name, NULL);
+}
+
+GArray *
+gum_find_functions_matching (const gchar * str)
+{
+  GArray * matches;
+  GPatternSpec * spec;
+
+  spec = g_pattern_spec_new (str);
+  matches = gum_find_functions (NULL, spec);
+  g_pattern_spec_free (spec);
+
+  return matches;
+}
+
+/*
+ * Symbol tables are only parsed for modules that get looked at, and the
+ * loaded modules are enumerated before taking our lock, so that we never
+ * wait for it while holding the dynamic linker's lock.
+ */
+static GArray *
+gum_find_functions (const gchar * name,
+                    GPatternSpec * spec)
+{
+  GArray * matches, * loaded_modules;
+  GHashTable * seen;
+  guint i;
+
+  gum_symbol_util_init ();
+
+  matches = g_array_new (FALSE, FALSE, sizeof (gpointer));
+  seen = g_hash_table_new (NULL, NULL);
+
+  loaded_modules = g_array_new (FALSE, FALSE, sizeof (GumLoadedModule));
+  gum_process_enumerate_modules (gum_collect_loaded_module, loaded_modules);
+
+  G_LOCK (gum_elf_symbol_modules);
+
+  for (i = 0; i != loaded_modules->len; i++)
+  {
+    GumLoadedModule * loaded =
+        &g_array_index (loaded_modules, GumLoadedModule, i);
+    GumElfSymbolModule * module;
+    GArray * functions, * by_name;
+    guint lo, hi, j;
+
+    module = gum_elf_symbol_module_obtain (loaded->path, loaded->base);
+    if (module == NULL)
+      continue;
+
+    functions = gum_elf_symbol_module_get_functions (module);
+    by_name = gum_elf_symbol_module_get_functions_by_name (module);
+
+    lo = 0;
+    hi = by_name->len;
+    if (name != NULL)
+    {
+      while (lo < hi)
+      {
+        guint mid = lo + ((hi - lo) / 2);
+        const GumElfFunction * f = &g_array_index (functions, GumElfFunction,
+            g_array_index (by_name, guint, mid));
+
+        if (strcmp (f->name, name) < 0)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      hi = by_name->len;
+    }
+
+    for (j = lo; j != hi; j++)
+    {
+      const GumElfFunction * f = &g_array_index (functions, GumElfFunction,
+          g_array_index (by_name, guint, j));
+      gpointer address;
+
+      if (name != NULL)
+      {
+        if (strcmp (f->name, name) != 0)
+          break;
+      }
+      else if (!g_pattern_match_string (spec, f->name))
+      {
+        continue;
+      }
+
+      address = GSIZE_TO_POINTER (loaded->base - module->preferred_address +
+          f->value);
+      if (!g_hash_table_contains (seen, address))
+      {
+        g_hash_table_add (seen, address);
+        g_array_append_val (matches, address);
+      }
+    }
+  }
+
+  G_UNLOCK (gum_elf_symbol_modules);
+
+  for (i = 0; i != loaded_modules->len; i++)
+    g_free (g_array_index (loaded_modules, GumLoadedModule, i).path);
+  g_array_free (loaded_modules, TRUE);
+
+  g_hash_table_unref (seen);
+
+  return matches;
+}
+
+static gboolean
+gum_collect_loaded_module (const GumModuleDetails * details,
+                           gpointer user_data)
+{
+  GArray * loaded_modules = user_data;
+  GumLoadedModule loaded;
+
+  loaded.path = g_strdup (details->path);
+  loaded.base = details->range->base_address;
+  g_array_append_val (loaded_modules, loaded);
+
+  return TRUE;
+}
+
+/* Called with the lock held. */
+static GumElfSymbolModule *
+gum_elf_symbol_module_obtain (const gchar * path,
+                              GumAddress base)
+{
+  GumElfSymbolModule * module;
+
+  if (g_hash_table_lookup_extended (gum_elf_symbol_module_by_path, path, NULL,
+      (gpointer *) &module))
+    return module;
+
+  module = gum_elf_symbol_module_new (path, base);
+
+  /* Remember failures too, so we don't keep trying to open the file. */
+  g_hash_table_insert (gum_elf_symbol_module_by_path, g_strdup (path),
+      module);
+
+  return module;
+}
+
+static GumElfSymbolModule *
+gum_elf_symbol_module_new (const gchar * path,
+                           GumAddress base)
+{
+  GumElfSymbolModule * module;
+  GumElfImage * image;
+  const GumElfPHeader * phdrs;
+  guint i;
+
+  image = gum_elf_image_open (path);
+  if (image == NULL)
+    return NULL;
+
+  module = g_slice_new0 (GumElfSymbolModule);
+  module->path = g_strdup (path);
+  module->image = image;
+
+  phdrs = (const GumElfPHeader *) ((const guint8 *) image->data +
+      image->ehdr->e_phoff);
+  for (i = 0; i != image->ehdr->e_phnum; i++)
+  {
+    if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_offset == 0)
+    {
+      module->preferred_address = phdrs[i].p_vaddr;
+      break;
+    }
+  }
+
+  if (gum_elf_image_find_section (image, ".symtab") == NULL ||
+      gum_elf_image_find_section (image, ".debug_line") == NULL)
+  {
+    module->debug_image = gum_elf_symbol_module_open_debug_image (module,
+        base);
+  }
+
+  return module;
+}
+
+static void
+gum_elf_symbol_module_free (GumElfSymbolModule * module)
+{
+  guint i;
+
+  if (module == NULL)
+    return;
+
+  if (module->units != NULL)
+  {
+    for (i = 0; i != module->units->len; i++)
+      gum_dwarf_unit_clear (&g_array_index (module->units, GumDwarfUnit, i));
+    g_array_free (module->units, TRUE);
+  }
+
+  if (module->functions_by_name != NULL)
+    g_array_free (module->functions_by_name, TRUE);
+  if (module->functions != NULL)
+    g_array_free (module->functions, TRUE);
+
+  if (module->debug_image != NULL)
+    gum_elf_image_close (module->debug_image);
+  gum_elf_image_close (module->image);
+
+  g_free (module->path);
+
+  g_slice_free (GumElfSymbolModule, module);
+}
+
+/*
+ * Looks for separate debug information the way GDB does, first by build ID
+ * and then through the .gnu_debuglink section.
+ */
+static GumElfImage *
+gum_elf_symbol_module_open_debug_image (GumElfSymbolModule * self,
+                                        GumAddress base)
+{
+  GumElfImage * image = NULL;
+  gchar * build_id;
+  const gchar * link;
+  gsize link_size;
+
+  build_id = _gum_process_query_module_build_id (base);
+  if (build_id != NULL && strlen (build_id) > 2)
+  {
+    gchar * path;
+
+    path = g_strdup_printf (GUM_DEBUG_FILE_DIRECTORY "/.build-id/%c%c/%s.debug",
+        build_id[0], build_id[1], build_id + 2);
+    image = gum_elf_image_open (path);
+    g_free (path);
+  }
+  g_free (build_id);
+
+  link = (const gchar *) gum_elf_image_find_section_data (self->image,
+      ".gnu_debuglink", &link_size);
+  if (image == NULL && link != NULL && memchr (link, '\0', link_size) != NULL)
+  {
+    gchar * dir;
+    gchar * candidates[3];
+    guint i;
+
+    dir = g_path_get_dirname (self->path);
+    candidates[0] = g_build_filename (GUM_DEBUG_FILE_DIRECTORY, dir, link,
+        NULL);
+    candidates[1] = g_build_filename (dir, ".debug", link, NULL);
+    candidates[2] = g_build_filename (dir, link, NULL);
+
+    for (i = 0; i != G_N_ELEMENTS (candidates); i++)
+    {
+      if (image == NULL && strcmp (candidates[i], self->path) != 0)
+        image = gum_elf_image_open (candidates[i]);
+      g_free (candidates[i]);
+    }
+
+    g_free (dir);
+  }
+
+  return image;
+}
+
+static GArray *
+gum_elf_symbol_module_get_functions (GumElfSymbolModule * self)
+{
+  GArray * functions;
+
+  if (self->functions != NULL)
+    return self->functions;
+
+  functions = g_array_new (FALSE, FALSE, sizeof (GumElfFunction));
+  self->functions = functions;
+
+  if (gum_elf_image_find_section (self->image, ".symtab") != NULL)
+    gum_elf_symbol_module_add_functions (self, self->image, SHT_SYMTAB);
+  else if (self->debug_image != NULL)
+    gum_elf_symbol_module_add_functions (self, self->debug_image, SHT_SYMTAB);
+  gum_elf_symbol_module_add_functions (self, self->image, SHT_DYNSYM);
+
+  g_array_sort (functions, (GCompareFunc) gum_elf_function_compare_by_address);
+
+  return functions;
+}
+
+static GArray *
+gum_elf_symbol_module_get_functions_by_name (GumElfSymbolModule * self)
+{
+  GArray * functions, * by_name;
+  guint i;
+
+  if (self->functions_by_name != NULL)
+    return self->functions_by_name;
+
+  functions = gum_elf_symbol_module_get_functions (self);
+
+  by_name = g_array_sized_new (FALSE, FALSE, sizeof (guint), functions->len);
+  for (i = 0; i != functions->len; i++)
+    g_array_append_val (by_name, i);
+  g_array_sort_with_data (by_name,
+      (GCompareDataFunc) gum_elf_function_compare_by_name, functions);
+
+  self->functions_by_name = by_name;
+
+  return by_name;
+}
+
+static void
+gum_elf_symbol_module_add_functions (GumElfSymbolModule * self,
+                                     GumElfImage * image,
+                                     guint section_type)
+{
+  const GumElfEHeader * ehdr = image->ehdr;
+  guint i;
+
+  for (i = 0; i != ehdr->e_shnum; i++)
+  {
+    const GumElfSHeader * shdr, * strtab_shdr;
+    const GumElfSymbol * symbols;
+    const gchar * strings;
+    gsize symbols_size, strings_size;
+    guint j, n;
+
+    shdr = (const GumElfSHeader *) ((const guint8 *) image->data +
+        ehdr->e_shoff + (i * ehdr->e_shentsize));
+    if (shdr->sh_type != section_type || shdr->sh_link >= ehdr->e_shnum)
+      continue;
+
+    strtab_shdr = (const GumElfSHeader *) ((const guint8 *) image->data +
+        ehdr->e_shoff + (shdr->sh_link * ehdr->e_shentsize));
+
+    symbols = (const GumElfSymbol *) gum_elf_image_get_section_data (image,
+        shdr, &symbols_size);
+    strings = (const gchar *) gum_elf_image_get_section_data (image,
+        strtab_shdr, &strings_size);
+    if (symbols == NULL || strings == NULL)
+      continue;
+
+    n = symbols_size / sizeof (GumElfSymbol);
+    for (j = 0; j != n; j++)
+    {
+      const GumElfSymbol * sym = &symbols[j];
+      guint type = GUM_ELF_ST_TYPE (sym->st_info);
+      GumElfFunction function;
+
+      if (type != STT_FUNC && type != STT_GNU_IFUNC)
+        continue;
+      if (sym->st_shndx == SHN_UNDEF || sym->st_value == 0)
+        continue;
+      if (sym->st_name == 0 || sym->st_name >= strings_size)
+        continue;
+
+      function.value = sym->st_value;
+#ifdef HAVE_ARM
+      function.address = sym->st_value & ~((GumAddress) 1);
+#else
+      function.address = sym->st_value;
+#endif
+      function.size = sym->st_size;
+      function.name = strings + sym->st_name;
+      function.bind = GUM_ELF_ST_BIND (sym->st_info);
+
+      g_array_append_val (self->functions, function);
+    }
+  }
+}
+
+static const GumElfFunction *
+gum_elf_symbol_module_find_function (GumElfSymbolModule * self,
+                                     GumAddress address)
+{
+  GArray * functions;
+  const GumElfFunction * function;
+  guint lo, hi;
+
+  functions = gum_elf_symbol_module_get_functions (self);
+
+  lo = 0;
+  hi = functions->len;
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (g_array_index (functions, GumElfFunction, mid).address <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return NULL;
+
+  /* Aliases are sorted with the preferred name first. */
+  lo--;
+  while (lo != 0 && g_array_index (functions, GumElfFunction, lo - 1).address ==
+      g_array_index (functions, GumElfFunction, lo).address)
+    lo--;
+
+  function = &g_array_index (functions, GumElfFunction, lo);
+  if (function->size != 0 && address >= function->address + function->size)
+    return NULL;
+
+  return function;
+}
+
+static gboolean
+gum_elf_symbol_module_find_line (GumElfSymbolModule * self,
+                                 GumAddress address,
+                                 const gchar ** file_name,
+                                 guint * line_number)
+{
+  GArray * units;
+  guint i;
+
+  units = gum_elf_symbol_module_get_units (self);
+
+  for (i = 0; i != units->len; i++)
+  {
+    GumDwarfUnit * unit = &g_array_index (units, GumDwarfUnit, i);
+    const GumDwarfLineRange * range;
+
+    if (address < unit->low || address >= unit->high)
+      continue;
+
+    if (unit->ranges == NULL && !gum_dwarf_unit_decode (unit, self->line_image))
+      continue;
+
+    range = gum_dwarf_unit_find_range (unit, address);
+    if (range == NULL)
+      continue;
+
+    if (range->file >= unit->files->len ||
+        g_ptr_array_index (unit->files, range->file) == NULL)
+      return FALSE;
+
+    *file_name = g_ptr_array_index (unit->files, range->file);
+    *line_number = range->line;
+
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * Only the address span of each line number program is computed up front.
+ * Its rows and file table are decoded the first time an address falls
+ * inside that span.
+ */
+static GArray *
+gum_elf_symbol_module_get_units (GumElfSymbolModule * self)
+{
+  GArray * units;
+  const guint8 * data, * cursor, * end;
+  gsize size;
+
+  if (self->units != NULL)
+    return self->units;
+
+  units = g_array_new (FALSE, FALSE, sizeof (GumDwarfUnit));
+  self->units = units;
+
+  self->line_image = self->image;
+  data = gum_elf_image_find_section_data (self->image, ".debug_line", &size);
+  if (data == NULL && self->debug_image != NULL)
+  {
+    self->line_image = self->debug_image;
+    data = gum_elf_image_find_section_data (self->debug_image, ".debug_line",
+        &size);
+  }
+  if (data == NULL)
+    return units;
+
+  end = data + size;
+  for (cursor = data; cursor < end;)
+  {
+    GumDwarfLineProgram program;
+    GumDwarfUnit unit;
+
+    if (!gum_dwarf_line_program_parse (&program, cursor, end))
+      break;
+
+    unit.offset = cursor - data;
+    unit.low = G_MAXUINT64;
+    unit.high = 0;
+    unit.ranges = NULL;
+    unit.files = NULL;
+
+    if (gum_dwarf_line_program_run (&program, NULL, &unit.low, &unit.high) &&
+        unit.low < unit.high)
+    {
+      g_array_append_val (units, unit);
+    }
+
+    cursor = program.end;
+  }
+
+  return units;
+}
+
+static GumElfImage *
+gum_elf_image_open (const gchar * path)
+{
+  GumElfImage * image;
+  gint fd;
+  struct stat st;
+  gpointer data;
+  const GumElfEHeader * ehdr;
+
+  fd = open (path, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+
+  if (fstat (fd, &st) != 0 || (gsize) st.st_size < sizeof (GumElfEHeader))
+  {
+    close (fd);
+    return NULL;
+  }
+
+  data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    return NULL;
+
+  ehdr = data;
+  if (memcmp (ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != GUM_ELF_CLASS ||
+      (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) ||
+      ehdr->e_shoff + ((gsize) ehdr->e_shnum * ehdr->e_shentsize) >
+          (gsize) st.st_size ||
+      ehdr->e_phoff + ((gsize) ehdr->e_phnum * ehdr->e_phentsize) >
+          (gsize) st.st_size ||
+      ehdr->e_shstrndx >= ehdr->e_shnum)
+  {
+    munmap (data, st.st_size);
+    return NULL;
+  }
+
+  image = g_slice_new (GumElfImage);
+  image->data = data;
+  image->size = st.st_size;
+  image->ehdr = ehdr;
+
+  return image;
+}
+
+static void
+gum_elf_image_close (GumElfImage * image)
+{
+  munmap (image->data, image->size);
+
+  g_slice_free (GumElfImage, image);
+}
+
+static const GumElfSHeader *
+gum_elf_image_find_section (GumElfImage * self,
+                            const gchar * name)
+{
+  const GumElfEHeader * ehdr = self->ehdr;
+  const GumElfSHeader * shstrtab;
+  const gchar * names;
+  gsize names_size;
+  guint i;
+
+  shstrtab = (const GumElfSHeader *) ((const guint8 *) self->data +
+      ehdr->e_shoff + (ehdr->e_shstrndx * ehdr->e_shentsize));
+  names = (const gchar *) gum_elf_image_get_section_data (self, shstrtab,
+      &names_size);
+  if (names == NULL)
+    return NULL;
+
+  for (i = 0; i != ehdr->e_shnum; i++)
+  {
+    const GumElfSHeader * shdr = (const GumElfSHeader *) (
+        (const guint8 *) self->data + ehdr->e_shoff + (i * ehdr->e_shentsize));
+
+    if (shdr->sh_name < names_size &&
+        strncmp (names + shdr->sh_name, name, names_size - shdr->sh_name) == 0)
+    {
+      return shdr;
+    }
+  }
+
+  return NULL;
+}
+
+static const guint8 *
+gum_elf_image_get_section_data (GumElfImage * self,
+                                const GumElfSHeader * shdr,
+                                gsize * size)
+{
+  if (shdr->sh_type == SHT_NOBITS || (shdr->sh_flags & SHF_COMPRESSED) != 0)
+    return NULL;
+
+  if (shdr->sh_offset > self->size ||
+      shdr->sh_size > self->size - shdr->sh_offset)
+    return NULL;
+
+  *size = shdr->sh_size;
+
+  return (const guint8 *) self->data + shdr->sh_offset;
+}
+
+static const guint8 *
+gum_elf_image_find_section_data (GumElfImage * self,
+                                 const gchar * name,
+                                 gsize * size)
+{
+  const GumElfSHeader * shdr;
+
+  shdr = gum_elf_image_find_section (self, name);
+  if (shdr == NULL)
+    return NULL;
+
+  return gum_elf_image_get_section_data (self, shdr, size);
+}
+
+static gint
+gum_elf_function_compare_by_address (const GumElfFunction * lhs,
+                                     const GumElfFunction * rhs)
+{
+  if (lhs->address != rhs->address)
+    return (lhs->address < rhs->address) ? -1 : 1;
+
+  /* Prefer global symbols over local aliases, then sized over unsized. */
+  if ((lhs->bind == STB_LOCAL) != (rhs->bind == STB_LOCAL))
+    return (lhs->bind == STB_LOCAL) ? 1 : -1;
+  if (lhs->size != rhs->size)
+    return (lhs->size > rhs->size) ? -1 : 1;
+
+  return strcmp (lhs->name, rhs->name);
+}
+
+static gint
+gum_elf_function_compare_by_name (const guint * lhs,
+                                  const guint * rhs,
+                                  GArray * functions)
+{
+  return strcmp (g_array_index (functions, GumElfFunction, *lhs).name,
+      g_array_index (functions, GumElfFunction, *rhs).name);
+}
+
+static gboolean
+gum_dwarf_unit_decode (GumDwarfUnit * unit,
+                       GumElfImage * image)
+{
+  const guint8 * data;
+  gsize size;
+  GumDwarfLineProgram program;
+  GumAddress low, high;
+
+  data = gum_elf_image_find_section_data (image, ".debug_line", &size);
+
+  unit->ranges = g_array_new (FALSE, FALSE, sizeof (GumDwarfLineRange));
+  unit->files = g_ptr_array_new_with_free_func (g_free);
+
+  if (!gum_dwarf_line_program_parse (&program, data + unit->offset,
+      data + size))
+    return FALSE;
+
+  if (!gum_dwarf_line_program_read_files (&program, image, unit->files))
+    return FALSE;
+
+  if (!gum_dwarf_line_program_run (&program, unit->ranges, &low, &high))
+    return FALSE;
+
+  g_array_sort (unit->ranges, (GCompareFunc) gum_dwarf_line_range_compare);
+
+  return TRUE;
+}
+
+static void
+gum_dwarf_unit_clear (GumDwarfUnit * unit)
+{
+  if (unit->files != NULL)
+    g_ptr_array_unref (unit->files);
+  if (unit->ranges != NULL)
+    g_array_free (unit->ranges, TRUE);
+}
+
+static const GumDwarfLineRange *
+gum_dwarf_unit_find_range (GumDwarfUnit * self,
+                           GumAddress address)
+{
+  GArray * ranges = self->ranges;
+  const GumDwarfLineRange * range;
+  guint lo, hi;
+
+  lo = 0;
+  hi = ranges->len;
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (g_array_index (ranges, GumDwarfLineRange, mid).start <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return NULL;
+
+  range = &g_array_index (ranges, GumDwarfLineRange, lo - 1);
+  if (address >= range->end)
+    return NULL;
+
+  return range;
+}
+
+static gint
+gum_dwarf_line_range_compare (const GumDwarfLineRange * lhs,
+                              const GumDwarfLineRange * rhs)
+{
+  if (lhs->start < rhs->start)
+    return -1;
+  else if (lhs->start > rhs->start)
+    return 1;
+  else
+    return 0;
+}
+
+static gboolean
+gum_dwarf_line_program_parse (GumDwarfLineProgram * program,
+                              const guint8 * data,
+                              const guint8 * end)
+{
+  GumDwarfReader reader = { data, end, FALSE };
+  guint64 unit_length, header_length;
+
+  unit_length = gum_dwarf_reader_read_u32 (&reader);
+  program->offset_size = 4;
+  if (unit_length == 0xffffffff)
+  {
+    unit_length = gum_dwarf_reader_read_u64 (&reader);
+    program->offset_size = 8;
+  }
+  if (reader.failed || unit_length > (guint64) (end - reader.cursor))
+    return FALSE;
+  program->end = reader.cursor + unit_length;
+  reader.end = program->end;
+
+  program->version = gum_dwarf_reader_read_u16 (&reader);
+  if (program->version < 2 || program->version > 5)
+    return FALSE;
+  if (program->version >= 5)
+    gum_dwarf_reader_skip (&reader, 2);
+
+  header_length = gum_dwarf_reader_read_uint (&reader, program->offset_size);
+  if (reader.failed || header_length > (guint64) (reader.end - reader.cursor))
+    return FALSE;
+  program->program = reader.cursor + header_length;
+
+  program->minimum_instruction_length = gum_dwarf_reader_read_u8 (&reader);
+  if (program->version >= 4)
+    gum_dwarf_reader_skip (&reader, 1);
+  program->default_is_stmt = gum_dwarf_reader_read_u8 (&reader) != 0;
+  program->line_base = (gint8) gum_dwarf_reader_read_u8 (&reader);
+  program->line_range = gum_dwarf_reader_read_u8 (&reader);
+  program->opcode_base = gum_dwarf_reader_read_u8 (&reader);
+  program->standard_opcode_lengths = reader.cursor;
+  gum_dwarf_reader_skip (&reader, MAX (program->opcode_base, 1) - 1);
+  program->header = reader.cursor;
+
+  return !reader.failed && program->line_range != 0 &&
+      program->opcode_base != 0;
+}
+
+static gboolean
+gum_dwarf_line_program_read_files (GumDwarfLineProgram * self,
+                                   GumElfImage * image,
+                                   GPtrArray * files)
+{
+  GumDwarfReader reader = { self->header, self->program, FALSE };
+  GPtrArray * directories;
+  gboolean success = FALSE;
+
+  directories = g_ptr_array_new_with_free_func (g_free);
+
+  if (self->version >= 5)
+  {
+    if (!gum_dwarf_line_program_read_entry_table (self, &reader, image, NULL,
+        directories))
+      goto beach;
+
+    if (!gum_dwarf_line_program_read_entry_table (self, &reader, image,
+        directories, files))
+      goto beach;
+  }
+  else
+  {
+    const gchar * name;
+
+    /* Index 0 refers to the compilation directory, which we don't know. */
+    g_ptr_array_add (directories, g_strdup (""));
+    while ((name = gum_dwarf_reader_read_string (&reader)) != NULL &&
+        name[0] != '\0')
+    {
+      g_ptr_array_add (directories, g_strdup (name));
+    }
+
+    g_ptr_array_add (files, NULL);
+    while ((name = gum_dwarf_reader_read_string (&reader)) != NULL &&
+        name[0] != '\0')
+    {
+      guint64 dir_index;
+      const gchar * dir;
+
+      dir_index = gum_dwarf_reader_read_uleb128 (&reader);
+      gum_dwarf_reader_read_uleb128 (&reader);
+      gum_dwarf_reader_read_uleb128 (&reader);
+
+      dir = (dir_index < directories->len)
+          ? g_ptr_array_index (directories, dir_index)
+          : "";
+      g_ptr_array_add (files, (name[0] == '/' || dir[0] == '\0')
+          ? g_strdup (name)
+          : g_build_filename (dir, name, NULL));
+    }
+  }
+
+  success = !reader.failed;
+
+beach:
+  g_ptr_array_unref (directories);
+
+  return success;
+}
+
+static gboolean
+gum_dwarf_line_program_read_entry_table (GumDwarfLineProgram * self,
+                                         GumDwarfReader * reader,
+                                         GumElfImage * image,
+                                         GPtrArray * directories,
+                                         GPtrArray * entries)
+{
+  guint format_count, i, j;
+  guint64 formats[16][2];
+  guint64 count;
+
+  format_count = gum_dwarf_reader_read_u8 (reader);
+  if (format_count > G_N_ELEMENTS (formats))
+    return FALSE;
+  for (i = 0; i != format_count; i++)
+  {
+    formats[i][0] = gum_dwarf_reader_read_uleb128 (reader);
+    formats[i][1] = gum_dwarf_reader_read_uleb128 (reader);
+  }
+
+  count = gum_dwarf_reader_read_uleb128 (reader);
+  for (j = 0; j != count && !reader->failed; j++)
+  {
+    const gchar * path = NULL;
+    guint64 dir_index = 0;
+
+    for (i = 0; i != format_count; i++)
+    {
+      guint64 value = 0;
+      const gchar * str = NULL;
+
+      if (!gum_dwarf_reader_read_form (reader, formats[i][1],
+          self->offset_size, image, &value, &str))
+        return FALSE;
+
+      if (formats[i][0] == GUM_DW_LNCT_path)
+        path = str;
+      else if (formats[i][0] == GUM_DW_LNCT_directory_index)
+        dir_index = value;
+    }
+
+    if (path == NULL)
+    {
+      g_ptr_array_add (entries, NULL);
+    }
+    else if (directories != NULL && path[0] != '/' &&
+        dir_index < directories->len)
+    {
+      g_ptr_array_add (entries, g_build_filename (
+          g_ptr_array_index (directories, dir_index), path, NULL));
+    }
+    else
+    {
+      g_ptr_array_add (entries, g_strdup (path));
+    }
+  }
+
+  return !reader->failed;
+}
+
+/*
+ * Runs the line number state machine. When ranges is NULL only the address
+ * span is computed. Sequences starting at address zero belong to code that
+ * the linker discarded, and are ignored.
+ */
+static gboolean
+gum_dwarf_line_program_run (GumDwarfLineProgram * self,
+                            GArray * ranges,
+                            GumAddress * low,
+                            GumAddress * high)
+{
+  GumDwarfReader reader = { self->program, self->end, FALSE };
+  GumAddress address = 0;
+  guint file = 1, line = 1;
+  gboolean have_row = FALSE;
+  GumAddress sequence_start = 0;
+  GumDwarfLineRange row = { 0, };
+  guint8 min_inst = self->minimum_instruction_length;
+
+  *low = G_MAXUINT64;
+  *high = 0;
+
+  while (reader.cursor < reader.end && !reader.failed)
+  {
+    guint8 opcode;
+    gboolean emit = FALSE, end_sequence = FALSE;
+
+    opcode = gum_dwarf_reader_read_u8 (&reader);
+
+    if (opcode >= self->opcode_base)
+    {
+      guint adjusted = opcode - self->opcode_base;
+
+      address += (adjusted / self->line_range) * min_inst;
+      line += self->line_base + (gint) (adjusted % self->line_range);
+      emit = TRUE;
+    }
+    else if (opcode == 0)
+    {
+      guint64 length;
+      const guint8 * next;
+      guint8 sub_opcode;
+
+      length = gum_dwarf_reader_read_uleb128 (&reader);
+      if (reader.failed || length == 0 ||
+          length > (guint64) (reader.end - reader.cursor))
+        return FALSE;
+      next = reader.cursor + length;
+
+      sub_opcode = gum_dwarf_reader_read_u8 (&reader);
+      switch (sub_opcode)
+      {
+        case GUM_DW_LNE_end_sequence:
+          emit = TRUE;
+          end_sequence = TRUE;
+          break;
+        case GUM_DW_LNE_set_address:
+          address = gum_dwarf_reader_read_uint (&reader, length - 1);
+          break;
+        default:
+          break;
+      }
+
+      reader.cursor = next;
+    }
+    else
+    {
+      switch (opcode)
+      {
+        case GUM_DW_LNS_copy:
+          emit = TRUE;
+          break;
+        case GUM_DW_LNS_advance_pc:
+          address += gum_dwarf_reader_read_uleb128 (&reader) * min_inst;
+          break;
+        case GUM_DW_LNS_advance_line:
+          line += gum_dwarf_reader_read_sleb128 (&reader);
+          break;
+        case GUM_DW_LNS_set_file:
+          file = gum_dwarf_reader_read_uleb128 (&reader);
+          break;
+        case GUM_DW_LNS_const_add_pc:
+          address += ((255 - self->opcode_base) / self->line_range) * min_inst;
+          break;
+        case GUM_DW_LNS_fixed_advance_pc:
+          address += gum_dwarf_reader_read_u16 (&reader);
+          break;
+        default:
+        {
+          guint n = self->standard_opcode_lengths[opcode - 1];
+
+          while (n-- != 0)
+            gum_dwarf_reader_read_uleb128 (&reader);
+
+          break;
+        }
+      }
+    }
+
+    if (!emit)
+      continue;
+
+    if (have_row && address > row.start && sequence_start != 0)
+    {
+      row.end = address;
+
+      *low = MIN (*low, row.start);
+      *high = MAX (*high, row.end);
+
+      if (ranges != NULL)
+        g_array_append_val (ranges, row);
+    }
+
+    if (end_sequence)
+    {
+      have_row = FALSE;
+      address = 0;
+      file = 1;
+      line = 1;
+    }
+    else
+    {
+      if (!have_row)
+        sequence_start = address;
+      row.start = address;
+      row.file = file;
+      row.line = line;
+      have_row = TRUE;
+    }
+  }
+
+  return !reader.failed;
+}
+
+static guint64
+gum_dwarf_reader_read_u8 (GumDwarfReader * self)
+{
+  return gum_dwarf_reader_read_uint (self, 1);
+}
+
+static guint64
+gum_dwarf_reader_read_u16 (GumDwarfReader * self)
+{
+  return gum_dwarf_reader_read_uint (self, 2);
+}
+
+static guint64
+gum_dwarf_reader_read_u32 (GumDwarfReader * self)
+{
+  return gum_dwarf_reader_read_uint (self, 4);
+}
+
+static guint64
+gum_dwarf_reader_read_u64 (GumDwarfReader * self)
+{
+  return gum_dwarf_reader_read_uint (self, 8);
+}
+
+static guint64
+gum_dwarf_reader_read_uint (GumDwarfReader * self,
+                            guint size)
+{
+  guint64 value = 0;
+  guint i;
+
+  if (size > 8 || (gsize) (self->end - self->cursor) < size)
+  {
+    self->failed = TRUE;
+    return 0;
+  }
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  for (i = 0; i != size; i++)
+    value |= (guint64) self->cursor[i] << (8 * i);
+#else
+  for (i = 0; i != size; i++)
+    value = (value << 8) | self->cursor[i];
+#endif
+  self->cursor += size;
+
+  return value;
+}
+
+static guint64
+gum_dwarf_reader_read_uleb128 (GumDwarfReader * self)
+{
+  guint64 value = 0;
+  guint shift = 0;
+
+  while (self->cursor < self->end)
+  {
+    guint8 b = *self->cursor++;
+
+    if (shift < 64)
+      value |= (guint64) (b & 0x7f) << shift;
+    shift += 7;
+
+    if ((b & 0x80) == 0)
+      return value;
+  }
+
+  self->failed = TRUE;
+  return 0;
+}
+
+static gint64
+gum_dwarf_reader_read_sleb128 (GumDwarfReader * self)
+{
+  gint64 value = 0;
+  guint shift = 0;
+
+  while (self->cursor < self->end)
+  {
+    guint8 b = *self->cursor++;
+
+    if (shift < 64)
+      value |= (gint64) (b & 0x7f) << shift;
+    shift += 7;
+
+    if ((b & 0x80) == 0)
+    {
+      if (shift < 64 && (b & 0x40) != 0)
+        value |= -((gint64) 1 << shift);
+      return value;
+    }
+  }
+
+  self->failed = TRUE;
+  return 0;
+}
+
+static const gchar *
+gum_dwarf_reader_read_string (GumDwarfReader * self)
+{
+  const gchar * str = (const gchar *) self->cursor;
+  const guint8 * terminator;
+
+  terminator = memchr (self->cursor, '\0', self->end - self->cursor);
+  if (terminator == NULL)
+  {
+    self->failed = TRUE;
+    return NULL;
+  }
+  self->cursor = terminator + 1;
+
+  return str;
+}
+
+static void
+gum_dwarf_reader_skip (GumDwarfReader * self,
+                       guint64 n)
+{
+  if ((guint64) (self->end - self->cursor) < n)
+  {
+    self->failed = TRUE;
+    return;
+  }
+
+  self->cursor += n;
+}
+
+static gboolean
+gum_dwarf_reader_read_form (GumDwarfReader * self,
+                            guint form,
+                            guint offset_size,
+                            GumElfImage * image,
+                            guint64 * value,
+                            const gchar ** str)
+{
+  switch (form)
+  {
+    case GUM_DW_FORM_string:
+      *str = gum_dwarf_reader_read_string (self);
+      break;
+    case GUM_DW_FORM_line_strp:
+      *str = gum_dwarf_lookup_string (image, ".debug_line_str",
+          gum_dwarf_reader_read_uint (self, offset_size));
+      break;
+    case GUM_DW_FORM_strp:
+      *str = gum_dwarf_lookup_string (image, ".debug_str",
+          gum_dwarf_reader_read_uint (self, offset_size));
+      break;
+    case GUM_DW_FORM_udata:
+      *value = gum_dwarf_reader_read_uleb128 (self);
+      break;
+    case GUM_DW_FORM_sdata:
+      *value = gum_dwarf_reader_read_sleb128 (self);
+      break;
+    case GUM_DW_FORM_data1:
+      *value = gum_dwarf_reader_read_u8 (self);
+      break;
+    case GUM_DW_FORM_data2:
+      *value = gum_dwarf_reader_read_u16 (self);
+      break;
+    case GUM_DW_FORM_data4:
+      *value = gum_dwarf_reader_read_u32 (self);
+      break;
+    case GUM_DW_FORM_data8:
+      *value = gum_dwarf_reader_read_u64 (self);
+      break;
+    case GUM_DW_FORM_data16:
+      gum_dwarf_reader_skip (self, 16);
+      break;
+    case GUM_DW_FORM_block:
+      gum_dwarf_reader_skip (self, gum_dwarf_reader_read_uleb128 (self));
+      break;
+    case GUM_DW_FORM_block1:
+      gum_dwarf_reader_skip (self, gum_dwarf_reader_read_u8 (self));
+      break;
+    case GUM_DW_FORM_block2:
+      gum_dwarf_reader_skip (self, gum_dwarf_reader_read_u16 (self));
+      break;
+    case GUM_DW_FORM_block4:
+      gum_dwarf_reader_skip (self, gum_dwarf_reader_read_u32 (self));
+      break;
+    default:
+      return FALSE;
+  }
+
+  return !self->failed;
+}
+
+static const gchar *
+gum_dwarf_lookup_string (GumElfImage * image,
+                         const gchar * section_name,
+                         guint64 offset)
+{
+  const gchar * strings;
+  gsize size;
+
+  strings = (const gchar *) gum_elf_image_find_section_data (image,
+      section_name, &size);
+  if (strings == NULL || offset >= size ||
+      memchr (strings + offset, '\0', size - offset) == NULL)
+    return NULL;
+
+  return strings + offset;
+}
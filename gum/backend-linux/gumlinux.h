@@ -18,6 +18,8 @@ GUM_API GumCpuType gum_linux_cpu_type_from_file (const gchar * path,
 GUM_API GumCpuType gum_linux_cpu_type_from_pid (pid_t pid, GError ** error);
 GUM_API void gum_linux_enumerate_ranges (pid_t pid, GumPageProtection prot,
     GumFoundRangeFunc func, gpointer user_data);
+GUM_API gboolean gum_linux_find_nearest_export (GumAddress address,
+    GumExportDetails * details);
 
 GUM_API void gum_linux_parse_ucontext (const ucontext_t * uc,
     GumCpuContext * ctx);
@@ -0,0 +1,1535 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumlinuxbacktracer.h"
+
+#include "gum-init.h"
+#include "gumlinux.h"
+#include "gumprocess-priv.h"
+
+#include <link.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GUM_UNWIND_CACHE_BITS 12
+#define GUM_UNWIND_CACHE_SIZE (1 << GUM_UNWIND_CACHE_BITS)
+#define GUM_CFI_MAX_STATES    8
+
+#if GLIB_SIZEOF_VOID_P == 8
+# define GUM_DWARF_REG_FP 6
+# define GUM_DWARF_REG_SP 7
+# define GUM_DWARF_REG_RA 16
+#else
+# define GUM_DWARF_REG_FP 5
+# define GUM_DWARF_REG_SP 4
+# define GUM_DWARF_REG_RA 8
+#endif
+
+/*
+ * Unwind rules are packed into 32 bits: the CFA offset, which register the
+ * CFA is relative to, and the slot below the CFA where the caller's frame
+ * pointer was saved, if any. The return address is always right below the
+ * CFA. Two values are reserved: walk the frame pointer chain instead, and
+ * stop as the return address is undefined.
+ */
+#define GUM_UNWIND_RULE_FRAME_POINTER   0
+#define GUM_UNWIND_RULE_END             1
+#define GUM_UNWIND_RULE_CFA_OFFSET_MASK 0xffffff
+#define GUM_UNWIND_RULE_FP_SLOT_SHIFT   24
+#define GUM_UNWIND_RULE_FP_SLOT_MASK    0x7f
+#define GUM_UNWIND_RULE_CFA_IS_FP       (1U << 31)
+
+#define GUM_DW_EH_PE_absptr   0x00
+#define GUM_DW_EH_PE_uleb128  0x01
+#define GUM_DW_EH_PE_udata2   0x02
+#define GUM_DW_EH_PE_udata4   0x03
+#define GUM_DW_EH_PE_udata8   0x04
+#define GUM_DW_EH_PE_sleb128  0x09
+#define GUM_DW_EH_PE_sdata2   0x0a
+#define GUM_DW_EH_PE_sdata4   0x0b
+#define GUM_DW_EH_PE_sdata8   0x0c
+#define GUM_DW_EH_PE_pcrel    0x10
+#define GUM_DW_EH_PE_datarel  0x30
+#define GUM_DW_EH_PE_indirect 0x80
+#define GUM_DW_EH_PE_omit     0xff
+
+#define GUM_DW_CFA_advance_loc        0x40
+#define GUM_DW_CFA_offset             0x80
+#define GUM_DW_CFA_restore            0xc0
+#define GUM_DW_CFA_nop                0x00
+#define GUM_DW_CFA_set_loc            0x01
+#define GUM_DW_CFA_advance_loc1       0x02
+#define GUM_DW_CFA_advance_loc2       0x03
+#define GUM_DW_CFA_advance_loc4       0x04
+#define GUM_DW_CFA_offset_extended    0x05
+#define GUM_DW_CFA_restore_extended   0x06
+#define GUM_DW_CFA_undefined          0x07
+#define GUM_DW_CFA_same_value         0x08
+#define GUM_DW_CFA_register           0x09
+#define GUM_DW_CFA_remember_state     0x0a
+#define GUM_DW_CFA_restore_state      0x0b
+#define GUM_DW_CFA_def_cfa            0x0c
+#define GUM_DW_CFA_def_cfa_register   0x0d
+#define GUM_DW_CFA_def_cfa_offset     0x0e
+#define GUM_DW_CFA_def_cfa_expression 0x0f
+#define GUM_DW_CFA_expression         0x10
+#define GUM_DW_CFA_offset_extended_sf 0x11
+#define GUM_DW_CFA_def_cfa_sf         0x12
+#define GUM_DW_CFA_def_cfa_offset_sf  0x13
+#define GUM_DW_CFA_val_offset         0x14
+#define GUM_DW_CFA_val_offset_sf      0x15
+#define GUM_DW_CFA_val_expression     0x16
+#define GUM_DW_CFA_GNU_args_size      0x2e
+
+typedef struct _GumStackBounds GumStackBounds;
+typedef struct _GumUnwindCacheEntry GumUnwindCacheEntry;
+typedef struct _GumFrameState GumFrameState;
+typedef struct _GumCfiRegisterRule GumCfiRegisterRule;
+typedef struct _GumCfiRow GumCfiRow;
+typedef struct _GumCie GumCie;
+typedef struct _GumEhFrameTable GumEhFrameTable;
+typedef struct _GumFindEhFrameContext GumFindEhFrameContext;
+typedef struct _GumUnwindSnapshot GumUnwindSnapshot;
+typedef struct _GumUnwindModule GumUnwindModule;
+
+struct _GumStackBounds
+{
+  GumAddress bottom;
+  GumAddress top;
+};
+
+struct _GumUnwindCacheEntry
+{
+  volatile gpointer pc;
+  volatile gint rule;
+  volatile gint check;
+};
+
+struct _GumFrameState
+{
+  GumAddress pc;
+  GumAddress sp;
+  GumAddress fp;
+};
+
+struct _GumCfiRegisterRule
+{
+  gboolean saved;
+  gboolean undefined;
+  gint64 offset;
+};
+
+struct _GumCfiRow
+{
+  guint cfa_register;
+  gint64 cfa_offset;
+  gboolean cfa_unsupported;
+
+  GumCfiRegisterRule fp;
+  GumCfiRegisterRule ra;
+};
+
+struct _GumCie
+{
+  guint64 code_alignment_factor;
+  gint64 data_alignment_factor;
+  guint64 return_address_register;
+  guint8 fde_encoding;
+  gboolean has_augmentation_data;
+  gboolean is_signal_frame;
+
+  const guint8 * instructions;
+  const guint8 * end;
+};
+
+/*
+ * Where a module's .eh_frame_hdr lives, and the extent of the PT_LOAD
+ * segment containing it, which .eh_frame must also lie within. Every offset
+ * and length read from the tables is checked against these bounds, so a
+ * corrupt table makes the unwinder fall back instead of reading stray memory.
+ */
+struct _GumEhFrameTable
+{
+  const guint8 * hdr;
+  const guint8 * hdr_end;
+  const guint8 * segment;
+  const guint8 * segment_end;
+};
+
+struct _GumFindEhFrameContext
+{
+  GumAddress pc;
+  GumEhFrameTable table;
+  gboolean found;
+};
+
+/*
+ * What the async-signal-safe path needs to know about the process, gathered
+ * up front by gum_linux_backtracer_prepare(): the loaded modules and where
+ * their unwind tables live, plus every writable mapping, any of which may
+ * be the stack a signal interrupted. Both arrays are sorted by address.
+ */
+struct _GumUnwindSnapshot
+{
+  GumUnwindModule * modules;
+  guint num_modules;
+
+  GumStackBounds * writable_ranges;
+  guint num_writable_ranges;
+};
+
+struct _GumUnwindModule
+{
+  GumAddress start;
+  GumAddress end;
+  GumEhFrameTable eh_frame;
+};
+
+static void gum_linux_backtracer_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static void gum_linux_backtracer_generate (GumBacktracer * backtracer,
+    const GumCpuContext * cpu_context,
+    GumReturnAddressArray * return_addresses);
+
+static guint gum_frame_state_walk (GumFrameState * frame,
+    gboolean pc_is_exact, const GumStackBounds * bounds,
+    const GumUnwindSnapshot * snapshot,
+    GumReturnAddressArray * return_addresses, guint i);
+
+static const GumStackBounds * gum_stack_bounds_get_current (void);
+
+static gboolean gum_frame_state_step (GumFrameState * frame,
+    gboolean pc_is_exact, const GumStackBounds * bounds,
+    const GumUnwindSnapshot * snapshot);
+
+static guint32 gum_unwind_rule_lookup (GumAddress pc,
+    const GumUnwindSnapshot * snapshot);
+static guint32 gum_unwind_rule_compute (GumAddress pc,
+    const GumUnwindSnapshot * snapshot);
+static guint32 gum_unwind_rule_encode (const GumCfiRow * row);
+static guint32 gum_unwind_rule_checksum (GumAddress pc, guint32 rule,
+    guint32 epoch);
+static void gum_unwind_cache_sync (guint64 generation);
+
+static GumUnwindSnapshot * gum_unwind_snapshot_new (void);
+static void gum_unwind_snapshot_free (GumUnwindSnapshot * snapshot);
+static const GumUnwindSnapshot * gum_unwind_snapshot_acquire (void);
+static void gum_unwind_snapshot_release (void);
+static void gum_unwind_snapshot_deinit (void);
+static int gum_collect_unwind_module (struct dl_phdr_info * info, size_t size,
+    void * data);
+static gboolean gum_collect_writable_range (const GumRangeDetails * details,
+    gpointer user_data);
+static gint gum_unwind_module_compare (const void * a, const void * b);
+static const GumUnwindModule * gum_unwind_snapshot_find_module (
+    const GumUnwindSnapshot * snapshot, GumAddress pc);
+static const GumStackBounds * gum_unwind_snapshot_find_writable_range (
+    const GumUnwindSnapshot * snapshot, GumAddress address);
+
+static int gum_find_eh_frame_table (struct dl_phdr_info * info, size_t size,
+    void * data);
+static gboolean gum_eh_frame_table_init (GumEhFrameTable * table,
+    const struct dl_phdr_info * info);
+static const guint8 * gum_eh_frame_table_find_fde (
+    const GumEhFrameTable * table, GumAddress pc);
+static gboolean gum_fde_compute_row (const GumEhFrameTable * table,
+    const guint8 * fde, GumAddress pc, GumCfiRow * row);
+static gboolean gum_cie_parse (const GumEhFrameTable * table,
+    const guint8 * cie, GumCie * result);
+static gboolean gum_cfi_execute (const GumCie * cie, const guint8 * cursor,
+    const guint8 * end, GumAddress loc, GumAddress pc,
+    const GumCfiRow * initial_row, GumCfiRow * row);
+static GumCfiRegisterRule * gum_cfi_row_get_rule (GumCfiRow * row,
+    guint64 reg);
+static void gum_cfi_row_restore_rule (GumCfiRow * row,
+    const GumCfiRow * initial_row, guint64 reg);
+
+static gboolean gum_read_encoded (const guint8 ** cursor, const guint8 * end,
+    guint8 encoding, GumAddress datarel_base, GumAddress * value);
+static gboolean gum_read_uleb128 (const guint8 ** cursor, const guint8 * end,
+    guint64 * value);
+static gboolean gum_read_sleb128 (const guint8 ** cursor, const guint8 * end,
+    gint64 * value);
+
+static GPrivate gum_stack_bounds_key = G_PRIVATE_INIT (g_free);
+static GumUnwindCacheEntry gum_unwind_cache[GUM_UNWIND_CACHE_SIZE];
+G_LOCK_DEFINE_STATIC (gum_unwind_cache);
+static guint64 gum_unwind_cache_generation = 0;
+static volatile gint gum_unwind_cache_epoch = 0;
+
+G_LOCK_DEFINE_STATIC (gum_unwind_snapshot);
+static GumUnwindSnapshot * volatile gum_unwind_snapshot = NULL;
+static volatile gint gum_unwind_snapshot_readers = 0;
+
+G_DEFINE_TYPE_EXTENDED (GumLinuxBacktracer,
+                        gum_linux_backtracer,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_BACKTRACER,
+                                               gum_linux_backtracer_iface_init));
+
+static void
+gum_linux_backtracer_class_init (GumLinuxBacktracerClass * klass)
+{
+}
+
+static void
+gum_linux_backtracer_iface_init (gpointer g_iface,
+                                 gpointer iface_data)
+{
+  GumBacktracerIface * iface = (GumBacktracerIface *) g_iface;
+
+  iface->generate = gum_linux_backtracer_generate;
+}
+
+static void
+gum_linux_backtracer_init (GumLinuxBacktracer * self)
+{
+}
+
+GumBacktracer *
+gum_linux_backtracer_new (void)
+{
+  return g_object_new (GUM_TYPE_LINUX_BACKTRACER, NULL);
+}
+
+/*
+ * Each frame is unwound using the rule cached for its PC. Rules are computed
+ * from the module's .eh_frame the first time a PC is seen, and frames without
+ * CFI fall back to following the frame pointer. Only the current thread's
+ * stack is ever read from.
+ */
+static void
+gum_linux_backtracer_generate (GumBacktracer * backtracer,
+                               const GumCpuContext * cpu_context,
+                               GumReturnAddressArray * return_addresses)
+{
+  const GumStackBounds * bounds;
+  GumFrameState frame;
+  gboolean pc_is_exact;
+  guint64 generation;
+  guint i = 0;
+
+  bounds = gum_stack_bounds_get_current ();
+
+  generation = _gum_process_query_module_generation ();
+  if (generation != 0)
+    gum_unwind_cache_sync (generation);
+
+  if (cpu_context != NULL)
+  {
+    frame.pc = GUM_CPU_CONTEXT_XIP (cpu_context);
+    frame.sp = GUM_CPU_CONTEXT_XSP (cpu_context);
+    frame.fp = GUM_CPU_CONTEXT_XBP (cpu_context);
+    pc_is_exact = TRUE;
+  }
+  else
+  {
+    gsize * fp = __builtin_frame_address (0);
+
+    frame.pc = fp[1];
+    frame.sp = GPOINTER_TO_SIZE (fp + 2);
+    frame.fp = fp[0];
+    pc_is_exact = FALSE;
+
+    return_addresses->items[i++] = GSIZE_TO_POINTER (frame.pc);
+  }
+
+  return_addresses->len = gum_frame_state_walk (&frame, pc_is_exact, bounds,
+      NULL, return_addresses, i);
+}
+
+/*
+ * Prepares for gum_linux_backtracer_generate_async_safe() by snapshotting
+ * the loaded modules and the writable mappings. Must be called again after
+ * threads are created or modules are loaded for their frames to be unwound
+ * from a signal handler. Not async-signal-safe itself.
+ */
+void
+gum_linux_backtracer_prepare (GumLinuxBacktracer * self)
+{
+  GumUnwindSnapshot * snapshot, * previous;
+
+  gum_unwind_cache_sync (_gum_process_query_module_generation ());
+
+  snapshot = gum_unwind_snapshot_new ();
+
+  G_LOCK (gum_unwind_snapshot);
+
+  previous = g_atomic_pointer_get (&gum_unwind_snapshot);
+  g_atomic_pointer_set (&gum_unwind_snapshot, snapshot);
+
+  if (previous != NULL)
+  {
+    while (g_atomic_int_get (&gum_unwind_snapshot_readers) != 0)
+      g_thread_yield ();
+    gum_unwind_snapshot_free (previous);
+  }
+  else
+  {
+    _gum_register_destructor (gum_unwind_snapshot_deinit);
+  }
+
+  G_UNLOCK (gum_unwind_snapshot);
+}
+
+/*
+ * Like generate(), but safe to call from a signal handler on the thread that
+ * was interrupted: it never allocates, takes locks or calls into the dynamic
+ * linker. Stack bounds are taken from the writable mapping containing the
+ * interrupted stack pointer, and PCs outside the modules known at the last
+ * gum_linux_backtracer_prepare() are unwound through the frame pointer.
+ */
+void
+gum_linux_backtracer_generate_async_safe (
+    GumLinuxBacktracer * self,
+    const GumCpuContext * cpu_context,
+    GumReturnAddressArray * return_addresses)
+{
+  const GumUnwindSnapshot * snapshot;
+  const GumStackBounds * bounds = NULL;
+  GumFrameState frame;
+
+  frame.pc = GUM_CPU_CONTEXT_XIP (cpu_context);
+  frame.sp = GUM_CPU_CONTEXT_XSP (cpu_context);
+  frame.fp = GUM_CPU_CONTEXT_XBP (cpu_context);
+
+  snapshot = gum_unwind_snapshot_acquire ();
+
+  if (snapshot != NULL)
+    bounds = gum_unwind_snapshot_find_writable_range (snapshot, frame.sp);
+
+  return_addresses->len = (bounds != NULL)
+      ? gum_frame_state_walk (&frame, TRUE, bounds, snapshot, return_addresses,
+          0)
+      : 0;
+
+  gum_unwind_snapshot_release ();
+}
+
+static guint
+gum_frame_state_walk (GumFrameState * frame,
+                      gboolean pc_is_exact,
+                      const GumStackBounds * bounds,
+                      const GumUnwindSnapshot * snapshot,
+                      GumReturnAddressArray * return_addresses,
+                      guint i)
+{
+  if (frame->sp < bounds->bottom || frame->sp >= bounds->top)
+    return i;
+
+  while (i != G_N_ELEMENTS (return_addresses->items) &&
+      gum_frame_state_step (frame, pc_is_exact, bounds, snapshot))
+  {
+    return_addresses->items[i++] = GSIZE_TO_POINTER (frame->pc);
+    pc_is_exact = FALSE;
+  }
+
+  return i;
+}
+
+static const GumStackBounds *
+gum_stack_bounds_get_current (void)
+{
+  GumStackBounds * bounds;
+  pthread_attr_t attr;
+  gpointer stack_addr;
+  size_t stack_size;
+
+  bounds = g_private_get (&gum_stack_bounds_key);
+  if (bounds != NULL)
+    return bounds;
+
+  bounds = g_new0 (GumStackBounds, 1);
+
+  if (pthread_getattr_np (pthread_self (), &attr) == 0)
+  {
+    if (pthread_attr_getstack (&attr, &stack_addr, &stack_size) == 0)
+    {
+      bounds->bottom = GUM_ADDRESS (stack_addr);
+      bounds->top = bounds->bottom + stack_size;
+    }
+    pthread_attr_destroy (&attr);
+  }
+
+  g_private_set (&gum_stack_bounds_key, bounds);
+
+  return bounds;
+}
+
+static gboolean
+gum_frame_state_step (GumFrameState * frame,
+                      gboolean pc_is_exact,
+                      const GumStackBounds * bounds,
+                      const GumUnwindSnapshot * snapshot)
+{
+  guint32 rule;
+  GumAddress cfa, fp_slot, fp;
+
+  /* Return addresses may point past the end of a noreturn call's function. */
+  rule = gum_unwind_rule_lookup (pc_is_exact ? frame->pc : frame->pc - 1,
+      snapshot);
+
+  if (rule == GUM_UNWIND_RULE_END)
+    return FALSE;
+
+  if (rule == GUM_UNWIND_RULE_FRAME_POINTER)
+  {
+    if (frame->fp % sizeof (gpointer) != 0)
+      return FALSE;
+    cfa = frame->fp + (2 * sizeof (gpointer));
+    fp_slot = frame->fp;
+  }
+  else
+  {
+    guint slot = (rule >> GUM_UNWIND_RULE_FP_SLOT_SHIFT) &
+        GUM_UNWIND_RULE_FP_SLOT_MASK;
+
+    cfa = ((rule & GUM_UNWIND_RULE_CFA_IS_FP) ? frame->fp : frame->sp) +
+        (rule & GUM_UNWIND_RULE_CFA_OFFSET_MASK);
+    fp_slot = (slot != 0) ? cfa - (slot * sizeof (gpointer)) : 0;
+  }
+
+  if (cfa <= frame->sp || cfa > bounds->top ||
+      cfa - sizeof (gpointer) < bounds->bottom ||
+      (fp_slot != 0 && fp_slot < bounds->bottom))
+    return FALSE;
+
+  fp = (fp_slot != 0) ? *((gsize *) GSIZE_TO_POINTER (fp_slot)) : frame->fp;
+
+  frame->pc = *((gsize *) GSIZE_TO_POINTER (cfa - sizeof (gpointer)));
+  frame->sp = cfa;
+  frame->fp = fp;
+
+  return frame->pc != 0;
+}
+
+/*
+ * The cache is shared by all threads without locking. A writer clears the
+ * PC before updating an entry, and readers check that the rule they read
+ * matches both the PC and the checksum, so torn entries are never used.
+ * The checksum also covers the cache epoch, so rules computed before modules
+ * were last loaded or unloaded are ignored.
+ */
+static guint32
+gum_unwind_rule_lookup (GumAddress pc,
+                        const GumUnwindSnapshot * snapshot)
+{
+  GumUnwindCacheEntry * entry;
+  guint32 epoch, rule;
+
+  epoch = (guint32) g_atomic_int_get (&gum_unwind_cache_epoch);
+
+  entry = &gum_unwind_cache[((guint64) pc * G_GUINT64_CONSTANT (
+      0x9e3779b97f4a7c15)) >> (64 - GUM_UNWIND_CACHE_BITS)];
+
+  if (GPOINTER_TO_SIZE (g_atomic_pointer_get (&entry->pc)) == pc)
+  {
+    guint32 check;
+
+    rule = (guint32) g_atomic_int_get (&entry->rule);
+    check = (guint32) g_atomic_int_get (&entry->check);
+
+    if (check == gum_unwind_rule_checksum (pc, rule, epoch) &&
+        GPOINTER_TO_SIZE (g_atomic_pointer_get (&entry->pc)) == pc)
+      return rule;
+  }
+
+  /* Modules loaded since the snapshot was taken may still have CFI. */
+  if (snapshot != NULL &&
+      gum_unwind_snapshot_find_module (snapshot, pc) == NULL)
+    return GUM_UNWIND_RULE_FRAME_POINTER;
+
+  rule = gum_unwind_rule_compute (pc, snapshot);
+
+  g_atomic_pointer_set (&entry->pc, NULL);
+  g_atomic_int_set (&entry->rule, (gint) rule);
+  g_atomic_int_set (&entry->check,
+      (gint) gum_unwind_rule_checksum (pc, rule, epoch));
+  g_atomic_pointer_set (&entry->pc, GSIZE_TO_POINTER (pc));
+
+  return rule;
+}
+
+static guint32
+gum_unwind_rule_compute (GumAddress pc,
+                         const GumUnwindSnapshot * snapshot)
+{
+  GumFindEhFrameContext ctx;
+  const GumEhFrameTable * table;
+  const guint8 * fde;
+  GumCfiRow row;
+
+  if (snapshot != NULL)
+  {
+    const GumUnwindModule * module;
+
+    module = gum_unwind_snapshot_find_module (snapshot, pc);
+    table = (module != NULL) ? &module->eh_frame : NULL;
+  }
+  else
+  {
+    ctx.pc = pc;
+    ctx.found = FALSE;
+    dl_iterate_phdr (gum_find_eh_frame_table, &ctx);
+    table = ctx.found ? &ctx.table : NULL;
+  }
+  if (table == NULL)
+    return GUM_UNWIND_RULE_FRAME_POINTER;
+
+  fde = gum_eh_frame_table_find_fde (table, pc);
+  if (fde == NULL)
+    return GUM_UNWIND_RULE_FRAME_POINTER;
+
+  if (!gum_fde_compute_row (table, fde, pc, &row))
+    return GUM_UNWIND_RULE_FRAME_POINTER;
+
+  return gum_unwind_rule_encode (&row);
+}
+
+static guint32
+gum_unwind_rule_encode (const GumCfiRow * row)
+{
+  guint32 rule;
+
+  if (row->ra.undefined)
+    return GUM_UNWIND_RULE_END;
+
+  if (row->cfa_unsupported ||
+      (row->cfa_register != GUM_DWARF_REG_SP &&
+       row->cfa_register != GUM_DWARF_REG_FP) ||
+      row->cfa_offset < (gint64) sizeof (gpointer) ||
+      row->cfa_offset > GUM_UNWIND_RULE_CFA_OFFSET_MASK)
+    return GUM_UNWIND_RULE_FRAME_POINTER;
+
+  if (!row->ra.saved || row->ra.offset != -(gint64) sizeof (gpointer))
+    return GUM_UNWIND_RULE_FRAME_POINTER;
+
+  rule = (guint32) row->cfa_offset;
+  if (row->cfa_register == GUM_DWARF_REG_FP)
+    rule |= GUM_UNWIND_RULE_CFA_IS_FP;
+
+  if (row->fp.saved)
+  {
+    gint64 slot = -row->fp.offset / (gint64) sizeof (gpointer);
+
+    if (row->fp.offset >= 0 || row->fp.offset % sizeof (gpointer) != 0 ||
+        slot > GUM_UNWIND_RULE_FP_SLOT_MASK)
+      return GUM_UNWIND_RULE_FRAME_POINTER;
+
+    rule |= (guint32) slot << GUM_UNWIND_RULE_FP_SLOT_SHIFT;
+  }
+
+  return rule;
+}
+
+static guint32
+gum_unwind_rule_checksum (GumAddress pc,
+                          guint32 rule,
+                          guint32 epoch)
+{
+  return (guint32) (((guint64) pc * G_GUINT64_CONSTANT (0xc2b2ae3d27d4eb4f))
+      >> 32) ^ rule ^ (epoch * 0x9e3779b1U) ^ 0x5bd1e995;
+}
+
+/*
+ * Moves the cache on to a new epoch when the loader's generation differs
+ * from the one seen last, or is unknown.
+ */
+static void
+gum_unwind_cache_sync (guint64 generation)
+{
+  if (generation != 0 && generation == gum_unwind_cache_generation)
+    return;
+
+  G_LOCK (gum_unwind_cache);
+  if (generation == 0 || generation != gum_unwind_cache_generation)
+  {
+    gum_unwind_cache_generation = generation;
+    g_atomic_int_inc (&gum_unwind_cache_epoch);
+  }
+  G_UNLOCK (gum_unwind_cache);
+}
+
+static GumUnwindSnapshot *
+gum_unwind_snapshot_new (void)
+{
+  GumUnwindSnapshot * snapshot;
+  GArray * modules, * writable_ranges;
+
+  modules = g_array_new (FALSE, FALSE, sizeof (GumUnwindModule));
+  dl_iterate_phdr (gum_collect_unwind_module, modules);
+  qsort (modules->data, modules->len, sizeof (GumUnwindModule),
+      gum_unwind_module_compare);
+
+  writable_ranges = g_array_new (FALSE, FALSE, sizeof (GumStackBounds));
+  gum_linux_enumerate_ranges (getpid (), GUM_PAGE_RW,
+      gum_collect_writable_range, writable_ranges);
+
+  snapshot = g_slice_new (GumUnwindSnapshot);
+  snapshot->num_modules = modules->len;
+  snapshot->modules = (GumUnwindModule *) g_array_free (modules, FALSE);
+  snapshot->num_writable_ranges = writable_ranges->len;
+  snapshot->writable_ranges =
+      (GumStackBounds *) g_array_free (writable_ranges, FALSE);
+
+  return snapshot;
+}
+
+static void
+gum_unwind_snapshot_free (GumUnwindSnapshot * snapshot)
+{
+  g_free (snapshot->writable_ranges);
+  g_free (snapshot->modules);
+
+  g_slice_free (GumUnwindSnapshot, snapshot);
+}
+
+/*
+ * Readers announce themselves before loading the pointer, so once a new
+ * snapshot is published and the reader count drops to zero, nobody can
+ * still be looking at the previous one.
+ */
+static const GumUnwindSnapshot *
+gum_unwind_snapshot_acquire (void)
+{
+  g_atomic_int_inc (&gum_unwind_snapshot_readers);
+
+  return g_atomic_pointer_get (&gum_unwind_snapshot);
+}
+
+static void
+gum_unwind_snapshot_release (void)
+{
+  g_atomic_int_add (&gum_unwind_snapshot_readers, -1);
+}
+
+static void
+gum_unwind_snapshot_deinit (void)
+{
+  GumUnwindSnapshot * snapshot;
+
+  snapshot = g_atomic_pointer_get (&gum_unwind_snapshot);
+  g_atomic_pointer_set (&gum_unwind_snapshot, NULL);
+
+  if (snapshot != NULL)
+    gum_unwind_snapshot_free (snapshot);
+}
+
+static int
+gum_collect_unwind_module (struct dl_phdr_info * info,
+                           size_t size,
+                           void * data)
+{
+  GArray * modules = data;
+  GumUnwindModule module;
+  guint i;
+
+  if (!gum_eh_frame_table_init (&module.eh_frame, info))
+    return 0;
+
+  module.start = G_MAXUINT64;
+  module.end = 0;
+
+  for (i = 0; i != info->dlpi_phnum; i++)
+  {
+    const ElfW(Phdr) * phdr = &info->dlpi_phdr[i];
+
+    if (phdr->p_type == PT_LOAD)
+    {
+      GumAddress start = info->dlpi_addr + phdr->p_vaddr;
+
+      module.start = MIN (module.start, start);
+      module.end = MAX (module.end, start + phdr->p_memsz);
+    }
+  }
+
+  if (module.start < module.end)
+    g_array_append_val (modules, module);
+
+  return 0;
+}
+
+static gboolean
+gum_collect_writable_range (const GumRangeDetails * details,
+                            gpointer user_data)
+{
+  GArray * writable_ranges = user_data;
+  GumStackBounds range;
+
+  range.bottom = details->range->base_address;
+  range.top = range.bottom + details->range->size;
+  g_array_append_val (writable_ranges, range);
+
+  return TRUE;
+}
+
+static gint
+gum_unwind_module_compare (const void * a,
+                           const void * b)
+{
+  const GumUnwindModule * module_a = a;
+  const GumUnwindModule * module_b = b;
+
+  if (module_a->start != module_b->start)
+    return (module_a->start < module_b->start) ? -1 : 1;
+
+  return 0;
+}
+
+static const GumUnwindModule *
+gum_unwind_snapshot_find_module (const GumUnwindSnapshot * snapshot,
+                                 GumAddress pc)
+{
+  guint lo = 0, hi = snapshot->num_modules;
+
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (snapshot->modules[mid].start <= pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0 || pc >= snapshot->modules[lo - 1].end)
+    return NULL;
+
+  return &snapshot->modules[lo - 1];
+}
+
+static const GumStackBounds *
+gum_unwind_snapshot_find_writable_range (const GumUnwindSnapshot * snapshot,
+                                         GumAddress address)
+{
+  guint lo = 0, hi = snapshot->num_writable_ranges;
+
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (snapshot->writable_ranges[mid].bottom <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0 || address >= snapshot->writable_ranges[lo - 1].top)
+    return NULL;
+
+  return &snapshot->writable_ranges[lo - 1];
+}
+
+static int
+gum_find_eh_frame_table (struct dl_phdr_info * info,
+                         size_t size,
+                         void * data)
+{
+  GumFindEhFrameContext * ctx = data;
+  gboolean contains_pc = FALSE;
+  guint i;
+
+  for (i = 0; i != info->dlpi_phnum && !contains_pc; i++)
+  {
+    const ElfW(Phdr) * phdr = &info->dlpi_phdr[i];
+
+    if (phdr->p_type == PT_LOAD)
+    {
+      GumAddress start = info->dlpi_addr + phdr->p_vaddr;
+
+      if (ctx->pc >= start && ctx->pc < start + phdr->p_memsz)
+        contains_pc = TRUE;
+    }
+  }
+
+  if (!contains_pc)
+    return 0;
+
+  ctx->found = gum_eh_frame_table_init (&ctx->table, info);
+
+  return 1;
+}
+
+static gboolean
+gum_eh_frame_table_init (GumEhFrameTable * table,
+                         const struct dl_phdr_info * info)
+{
+  const ElfW(Phdr) * eh_frame_phdr = NULL;
+  guint i;
+
+  for (i = 0; i != info->dlpi_phnum; i++)
+  {
+    const ElfW(Phdr) * phdr = &info->dlpi_phdr[i];
+
+    if (phdr->p_type == PT_GNU_EH_FRAME)
+      eh_frame_phdr = phdr;
+  }
+  if (eh_frame_phdr == NULL)
+    return FALSE;
+
+  table->hdr = GSIZE_TO_POINTER (info->dlpi_addr + eh_frame_phdr->p_vaddr);
+  table->hdr_end = table->hdr + eh_frame_phdr->p_memsz;
+  table->segment = NULL;
+  table->segment_end = NULL;
+
+  for (i = 0; i != info->dlpi_phnum; i++)
+  {
+    const ElfW(Phdr) * phdr = &info->dlpi_phdr[i];
+
+    if (phdr->p_type == PT_LOAD &&
+        eh_frame_phdr->p_vaddr >= phdr->p_vaddr &&
+        eh_frame_phdr->p_vaddr + eh_frame_phdr->p_memsz <=
+            phdr->p_vaddr + phdr->p_memsz)
+    {
+      table->segment = GSIZE_TO_POINTER (info->dlpi_addr + phdr->p_vaddr);
+      table->segment_end = table->segment + phdr->p_memsz;
+      break;
+    }
+  }
+
+  return table->segment != NULL;
+}
+
+static const guint8 *
+gum_eh_frame_table_find_fde (const GumEhFrameTable * table,
+                             GumAddress pc)
+{
+  const guint8 * hdr = table->hdr;
+  const guint8 * cursor = hdr + 4;
+  GumAddress hdr_address = GUM_ADDRESS (hdr);
+  GumAddress eh_frame, fde_count;
+  const gint32 * entries;
+  gint32 target;
+  guint lo, hi;
+  gssize fde_offset;
+
+  if (table->hdr_end - hdr < 4)
+    return NULL;
+
+  if (hdr[0] != 1 || hdr[3] != (GUM_DW_EH_PE_datarel | GUM_DW_EH_PE_sdata4))
+    return NULL;
+
+  if (!gum_read_encoded (&cursor, table->hdr_end, hdr[1], hdr_address,
+          &eh_frame) ||
+      !gum_read_encoded (&cursor, table->hdr_end, hdr[2], hdr_address,
+          &fde_count))
+    return NULL;
+  if (fde_count > (GumAddress) (table->hdr_end - cursor) / 8)
+    return NULL;
+
+  /* The table is sorted by initial location, relative to the header. */
+  entries = (const gint32 *) cursor;
+  target = (gint32) (pc - hdr_address);
+
+  lo = 0;
+  hi = fde_count;
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (entries[mid * 2] <= target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return NULL;
+
+  fde_offset = entries[((lo - 1) * 2) + 1];
+  if (fde_offset < table->segment - hdr ||
+      fde_offset >= table->segment_end - hdr)
+    return NULL;
+
+  return hdr + fde_offset;
+}
+
+static gboolean
+gum_fde_compute_row (const GumEhFrameTable * table,
+                     const guint8 * fde,
+                     GumAddress pc,
+                     GumCfiRow * row)
+{
+  const guint8 * cursor = fde;
+  const guint8 * end, * cie_pointer;
+  guint32 length, cie_offset;
+  GumCie cie;
+  GumAddress pc_begin, pc_range;
+  GumCfiRow initial_row;
+
+  if (table->segment_end - cursor < 8)
+    return FALSE;
+
+  length = *((const guint32 *) cursor);
+  if (length == 0 || length == 0xffffffff)
+    return FALSE;
+  cursor += 4;
+  if (length < 4 || length > (guint32) (table->segment_end - cursor))
+    return FALSE;
+  end = cursor + length;
+
+  cie_pointer = cursor;
+  cie_offset = *((const guint32 *) cursor);
+  cursor += 4;
+  if (cie_offset == 0 || cie_offset > (guint32) (cie_pointer - table->segment))
+    return FALSE;
+
+  if (!gum_cie_parse (table, cie_pointer - cie_offset, &cie))
+    return FALSE;
+
+  if (!gum_read_encoded (&cursor, end, cie.fde_encoding, 0, &pc_begin) ||
+      !gum_read_encoded (&cursor, end, cie.fde_encoding & 0x0f, 0,
+          &pc_range))
+    return FALSE;
+  if (pc < pc_begin || pc >= pc_begin + pc_range)
+    return FALSE;
+
+  if (cie.has_augmentation_data)
+  {
+    guint64 augmentation_length;
+
+    if (!gum_read_uleb128 (&cursor, end, &augmentation_length) ||
+        augmentation_length > (guint64) (end - cursor))
+      return FALSE;
+    cursor += augmentation_length;
+  }
+
+  memset (&initial_row, 0, sizeof (initial_row));
+  if (!gum_cfi_execute (&cie, cie.instructions, cie.end, pc_begin, pc_begin,
+      NULL, &initial_row))
+    return FALSE;
+
+  *row = initial_row;
+  if (!gum_cfi_execute (&cie, cursor, end, pc_begin, pc, &initial_row, row))
+    return FALSE;
+
+  return !cie.is_signal_frame;
+}
+
+static gboolean
+gum_cie_parse (const GumEhFrameTable * table,
+               const guint8 * cie,
+               GumCie * result)
+{
+  const guint8 * cursor = cie;
+  const guint8 * end;
+  guint32 length;
+  guint8 version;
+  const gchar * augmentation;
+  const guint8 * augmentation_terminator;
+  guint64 return_address_register;
+
+  if (table->segment_end - cursor < 4)
+    return FALSE;
+
+  length = *((const guint32 *) cursor);
+  if (length == 0 || length == 0xffffffff)
+    return FALSE;
+  cursor += 4;
+  if (length < 5 || length > (guint32) (table->segment_end - cursor))
+    return FALSE;
+  end = cursor + length;
+  result->end = end;
+
+  if (*((const guint32 *) cursor) != 0)
+    return FALSE;
+  cursor += 4;
+
+  version = *cursor++;
+  if (version != 1 && version != 3)
+    return FALSE;
+
+  augmentation = (const gchar *) cursor;
+  augmentation_terminator = memchr (cursor, '\0', end - cursor);
+  if (augmentation_terminator == NULL)
+    return FALSE;
+  cursor = augmentation_terminator + 1;
+  if (augmentation[0] == 'e' && augmentation[1] == 'h')
+  {
+    if (end - cursor < (gssize) sizeof (gpointer))
+      return FALSE;
+    cursor += sizeof (gpointer);
+    augmentation += 2;
+  }
+
+  if (!gum_read_uleb128 (&cursor, end, &result->code_alignment_factor) ||
+      !gum_read_sleb128 (&cursor, end, &result->data_alignment_factor))
+    return FALSE;
+  if (version == 1)
+  {
+    if (cursor == end)
+      return FALSE;
+    return_address_register = *cursor++;
+  }
+  else if (!gum_read_uleb128 (&cursor, end, &return_address_register))
+  {
+    return FALSE;
+  }
+  result->return_address_register = return_address_register;
+  result->fde_encoding = GUM_DW_EH_PE_absptr;
+  result->has_augmentation_data = augmentation[0] == 'z';
+  result->is_signal_frame = FALSE;
+
+  if (result->return_address_register != GUM_DWARF_REG_RA)
+    return FALSE;
+
+  if (result->has_augmentation_data)
+  {
+    guint64 augmentation_length;
+    const guint8 * augmentation_end;
+    const gchar * ch;
+
+    if (!gum_read_uleb128 (&cursor, end, &augmentation_length) ||
+        augmentation_length > (guint64) (end - cursor))
+      return FALSE;
+    augmentation_end = cursor + augmentation_length;
+
+    for (ch = augmentation + 1; *ch != '\0'; ch++)
+    {
+      switch (*ch)
+      {
+        case 'L':
+          if (cursor == augmentation_end)
+            return FALSE;
+          cursor++;
+          break;
+        case 'P':
+        {
+          guint8 encoding;
+          GumAddress personality;
+
+          if (cursor == augmentation_end)
+            return FALSE;
+          encoding = *cursor++;
+
+          if (!gum_read_encoded (&cursor, augmentation_end,
+              encoding & ~GUM_DW_EH_PE_indirect, 0, &personality))
+            return FALSE;
+
+          break;
+        }
+        case 'R':
+          if (cursor == augmentation_end)
+            return FALSE;
+          result->fde_encoding = *cursor++;
+          break;
+        case 'S':
+          result->is_signal_frame = TRUE;
+          break;
+        default:
+          break;
+      }
+    }
+
+    cursor = augmentation_end;
+  }
+
+  result->instructions = cursor;
+
+  return TRUE;
+}
+
+/*
+ * Executes call frame instructions until the location passes pc. Only the
+ * CFA and the rules for the frame pointer and return address are tracked.
+ */
+static gboolean
+gum_cfi_execute (const GumCie * cie,
+                 const guint8 * cursor,
+                 const guint8 * end,
+                 GumAddress loc,
+                 GumAddress pc,
+                 const GumCfiRow * initial_row,
+                 GumCfiRow * row)
+{
+  GumCfiRow states[GUM_CFI_MAX_STATES];
+  guint n_states = 0;
+  guint64 caf = cie->code_alignment_factor;
+  gint64 daf = cie->data_alignment_factor;
+
+  while (cursor < end)
+  {
+    guint8 opcode = *cursor++;
+    guint8 operand = opcode & 0x3f;
+    guint64 reg, value;
+    gint64 svalue;
+    GumCfiRegisterRule * rule;
+
+    switch (opcode & 0xc0)
+    {
+      case GUM_DW_CFA_advance_loc:
+        loc += operand * caf;
+        if (loc > pc)
+          return TRUE;
+        continue;
+      case GUM_DW_CFA_offset:
+        if (!gum_read_uleb128 (&cursor, end, &value))
+          return FALSE;
+        rule = gum_cfi_row_get_rule (row, operand);
+        if (rule != NULL)
+        {
+          rule->saved = TRUE;
+          rule->undefined = FALSE;
+          rule->offset = (gint64) value * daf;
+        }
+        continue;
+      case GUM_DW_CFA_restore:
+        gum_cfi_row_restore_rule (row, initial_row, operand);
+        continue;
+      default:
+        break;
+    }
+
+    switch (opcode)
+    {
+      case GUM_DW_CFA_nop:
+        break;
+      case GUM_DW_CFA_set_loc:
+        if (!gum_read_encoded (&cursor, end, cie->fde_encoding, 0, &loc))
+          return FALSE;
+        if (loc > pc)
+          return TRUE;
+        break;
+      case GUM_DW_CFA_advance_loc1:
+        if (end - cursor < 1)
+          return FALSE;
+        loc += *cursor * caf;
+        cursor += 1;
+        if (loc > pc)
+          return TRUE;
+        break;
+      case GUM_DW_CFA_advance_loc2:
+        if (end - cursor < 2)
+          return FALSE;
+        loc += *((const guint16 *) cursor) * caf;
+        cursor += 2;
+        if (loc > pc)
+          return TRUE;
+        break;
+      case GUM_DW_CFA_advance_loc4:
+        if (end - cursor < 4)
+          return FALSE;
+        loc += *((const guint32 *) cursor) * caf;
+        cursor += 4;
+        if (loc > pc)
+          return TRUE;
+        break;
+      case GUM_DW_CFA_offset_extended:
+      case GUM_DW_CFA_offset_extended_sf:
+        if (!gum_read_uleb128 (&cursor, end, &reg))
+          return FALSE;
+        if (opcode == GUM_DW_CFA_offset_extended)
+        {
+          if (!gum_read_uleb128 (&cursor, end, &value))
+            return FALSE;
+          svalue = (gint64) value * daf;
+        }
+        else
+        {
+          if (!gum_read_sleb128 (&cursor, end, &svalue))
+            return FALSE;
+          svalue *= daf;
+        }
+        rule = gum_cfi_row_get_rule (row, reg);
+        if (rule != NULL)
+        {
+          rule->saved = TRUE;
+          rule->undefined = FALSE;
+          rule->offset = svalue;
+        }
+        break;
+      case GUM_DW_CFA_restore_extended:
+        if (!gum_read_uleb128 (&cursor, end, &reg))
+          return FALSE;
+        gum_cfi_row_restore_rule (row, initial_row, reg);
+        break;
+      case GUM_DW_CFA_undefined:
+      case GUM_DW_CFA_same_value:
+        if (!gum_read_uleb128 (&cursor, end, &reg))
+          return FALSE;
+        rule = gum_cfi_row_get_rule (row, reg);
+        if (rule != NULL)
+        {
+          rule->saved = FALSE;
+          rule->undefined = opcode == GUM_DW_CFA_undefined;
+        }
+        break;
+      case GUM_DW_CFA_register:
+        if (!gum_read_uleb128 (&cursor, end, &reg) ||
+            !gum_read_uleb128 (&cursor, end, &value))
+          return FALSE;
+        if (gum_cfi_row_get_rule (row, reg) != NULL)
+          return FALSE;
+        break;
+      case GUM_DW_CFA_remember_state:
+        if (n_states == GUM_CFI_MAX_STATES)
+          return FALSE;
+        states[n_states++] = *row;
+        break;
+      case GUM_DW_CFA_restore_state:
+        if (n_states == 0)
+          return FALSE;
+        *row = states[--n_states];
+        break;
+      case GUM_DW_CFA_def_cfa:
+        if (!gum_read_uleb128 (&cursor, end, &reg) ||
+            !gum_read_uleb128 (&cursor, end, &value))
+          return FALSE;
+        row->cfa_register = reg;
+        row->cfa_offset = value;
+        row->cfa_unsupported = FALSE;
+        break;
+      case GUM_DW_CFA_def_cfa_sf:
+        if (!gum_read_uleb128 (&cursor, end, &reg) ||
+            !gum_read_sleb128 (&cursor, end, &svalue))
+          return FALSE;
+        row->cfa_register = reg;
+        row->cfa_offset = svalue * daf;
+        row->cfa_unsupported = FALSE;
+        break;
+      case GUM_DW_CFA_def_cfa_register:
+        if (!gum_read_uleb128 (&cursor, end, &reg))
+          return FALSE;
+        row->cfa_register = reg;
+        break;
+      case GUM_DW_CFA_def_cfa_offset:
+        if (!gum_read_uleb128 (&cursor, end, &value))
+          return FALSE;
+        row->cfa_offset = value;
+        break;
+      case GUM_DW_CFA_def_cfa_offset_sf:
+        if (!gum_read_sleb128 (&cursor, end, &svalue))
+          return FALSE;
+        row->cfa_offset = svalue * daf;
+        break;
+      case GUM_DW_CFA_def_cfa_expression:
+        if (!gum_read_uleb128 (&cursor, end, &value) ||
+            value > (guint64) (end - cursor))
+          return FALSE;
+        row->cfa_unsupported = TRUE;
+        cursor += value;
+        break;
+      case GUM_DW_CFA_expression:
+      case GUM_DW_CFA_val_expression:
+        if (!gum_read_uleb128 (&cursor, end, &reg) ||
+            !gum_read_uleb128 (&cursor, end, &value) ||
+            value > (guint64) (end - cursor))
+          return FALSE;
+        cursor += value;
+        if (gum_cfi_row_get_rule (row, reg) != NULL)
+          return FALSE;
+        break;
+      case GUM_DW_CFA_val_offset:
+        if (!gum_read_uleb128 (&cursor, end, &reg) ||
+            !gum_read_uleb128 (&cursor, end, &value))
+          return FALSE;
+        if (gum_cfi_row_get_rule (row, reg) != NULL)
+          return FALSE;
+        break;
+      case GUM_DW_CFA_val_offset_sf:
+        if (!gum_read_uleb128 (&cursor, end, &reg) ||
+            !gum_read_sleb128 (&cursor, end, &svalue))
+          return FALSE;
+        if (gum_cfi_row_get_rule (row, reg) != NULL)
+          return FALSE;
+        break;
+      case GUM_DW_CFA_GNU_args_size:
+        if (!gum_read_uleb128 (&cursor, end, &value))
+          return FALSE;
+        break;
+      default:
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static GumCfiRegisterRule *
+gum_cfi_row_get_rule (GumCfiRow * row,
+                      guint64 reg)
+{
+  if (reg == GUM_DWARF_REG_FP)
+    return &row->fp;
+  else if (reg == GUM_DWARF_REG_RA)
+    return &row->ra;
+  else
+    return NULL;
+}
+
+static void
+gum_cfi_row_restore_rule (GumCfiRow * row,
+                          const GumCfiRow * initial_row,
+                          guint64 reg)
+{
+  GumCfiRegisterRule * rule;
+
+  rule = gum_cfi_row_get_rule (row, reg);
+  if (rule == NULL)
+    return;
+
+  if (initial_row != NULL)
+    *rule = *gum_cfi_row_get_rule ((GumCfiRow *) initial_row, reg);
+  else
+    memset (rule, 0, sizeof (GumCfiRegisterRule));
+}
+
+/*
+ * Indirect encodings are rejected, as following them would dereference an
+ * arbitrary pointer read from the table.
+ */
+static gboolean
+gum_read_encoded (const guint8 ** cursor,
+                  const guint8 * end,
+                  guint8 encoding,
+                  GumAddress datarel_base,
+                  GumAddress * value)
+{
+  const guint8 * start = *cursor;
+  gssize available = end - start;
+  GumAddress base, result;
+
+  if (encoding == GUM_DW_EH_PE_omit)
+  {
+    *value = 0;
+    return TRUE;
+  }
+
+  if ((encoding & GUM_DW_EH_PE_indirect) != 0)
+    return FALSE;
+
+  switch (encoding & 0x70)
+  {
+    case 0:
+      base = 0;
+      break;
+    case GUM_DW_EH_PE_pcrel:
+      base = GUM_ADDRESS (start);
+      break;
+    case GUM_DW_EH_PE_datarel:
+      base = datarel_base;
+      break;
+    default:
+      return FALSE;
+  }
+
+  switch (encoding & 0x0f)
+  {
+    case GUM_DW_EH_PE_absptr:
+      if (available < (gssize) sizeof (gsize))
+        return FALSE;
+      result = *((const gsize *) start);
+      *cursor += sizeof (gsize);
+      break;
+    case GUM_DW_EH_PE_uleb128:
+      if (!gum_read_uleb128 (cursor, end, &result))
+        return FALSE;
+      break;
+    case GUM_DW_EH_PE_sleb128:
+    {
+      gint64 svalue;
+
+      if (!gum_read_sleb128 (cursor, end, &svalue))
+        return FALSE;
+      result = svalue;
+      break;
+    }
+    case GUM_DW_EH_PE_udata2:
+      if (available < 2)
+        return FALSE;
+      result = *((const guint16 *) start);
+      *cursor += 2;
+      break;
+    case GUM_DW_EH_PE_sdata2:
+      if (available < 2)
+        return FALSE;
+      result = *((const gint16 *) start);
+      *cursor += 2;
+      break;
+    case GUM_DW_EH_PE_udata4:
+      if (available < 4)
+        return FALSE;
+      result = *((const guint32 *) start);
+      *cursor += 4;
+      break;
+    case GUM_DW_EH_PE_sdata4:
+      if (available < 4)
+        return FALSE;
+      result = *((const gint32 *) start);
+      *cursor += 4;
+      break;
+    case GUM_DW_EH_PE_udata8:
+    case GUM_DW_EH_PE_sdata8:
+      if (available < 8)
+        return FALSE;
+      result = *((const guint64 *) start);
+      *cursor += 8;
+      break;
+    default:
+      return FALSE;
+  }
+
+  *value = result + base;
+
+  return TRUE;
+}
+
+static gboolean
+gum_read_uleb128 (const guint8 ** cursor,
+                  const guint8 * end,
+                  guint64 * value)
+{
+  const guint8 * p = *cursor;
+  guint64 result = 0;
+  guint shift = 0;
+  guint8 b;
+
+  do
+  {
+    if (p == end)
+      return FALSE;
+    b = *p++;
+    if (shift < 64)
+      result |= (guint64) (b & 0x7f) << shift;
+    shift += 7;
+  }
+  while ((b & 0x80) != 0);
+
+  *cursor = p;
+  *value = result;
+
+  return TRUE;
+}
+
+static gboolean
+gum_read_sleb128 (const guint8 ** cursor,
+                  const guint8 * end,
+                  gint64 * value)
+{
+  const guint8 * p = *cursor;
+  gint64 result = 0;
+  guint shift = 0;
+  guint8 b;
+
+  do
+  {
+    if (p == end)
+      return FALSE;
+    b = *p++;
+    if (shift < 64)
+      result |= (gint64) (b & 0x7f) << shift;
+    shift += 7;
+  }
+  while ((b & 0x80) != 0);
+
+  if (shift < 64 && (b & 0x40) != 0)
+    result |= -((gint64) 1 << shift);
+
+  *cursor = p;
+  *value = result;
+
+  return TRUE;
+}
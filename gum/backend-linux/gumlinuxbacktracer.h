@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_LINUX_BACKTRACER_H__
+#define __GUM_LINUX_BACKTRACER_H__
+
+#include <glib-object.h>
+#include <gum/gumbacktracer.h>
+
+#define GUM_TYPE_LINUX_BACKTRACER (gum_linux_backtracer_get_type ())
+#define GUM_LINUX_BACKTRACER(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj),\
+    GUM_TYPE_LINUX_BACKTRACER, GumLinuxBacktracer))
+#define GUM_LINUX_BACKTRACER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass),\
+    GUM_TYPE_LINUX_BACKTRACER, GumLinuxBacktracerClass))
+#define GUM_IS_LINUX_BACKTRACER(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj),\
+    GUM_TYPE_LINUX_BACKTRACER))
+#define GUM_IS_LINUX_BACKTRACER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE (\
+    (klass), GUM_TYPE_LINUX_BACKTRACER))
+#define GUM_LINUX_BACKTRACER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS (\
+    (obj), GUM_TYPE_LINUX_BACKTRACER, GumLinuxBacktracerClass))
+
+typedef struct _GumLinuxBacktracer GumLinuxBacktracer;
+typedef struct _GumLinuxBacktracerClass GumLinuxBacktracerClass;
+
+struct _GumLinuxBacktracer
+{
+  GObject parent;
+};
+
+struct _GumLinuxBacktracerClass
+{
+  GObjectClass parent_class;
+};
+
+G_BEGIN_DECLS
+
+GType gum_linux_backtracer_get_type (void) G_GNUC_CONST;
+
+GumBacktracer * gum_linux_backtracer_new (void);
+
+void gum_linux_backtracer_prepare (GumLinuxBacktracer * self);
+void gum_linux_backtracer_generate_async_safe (GumLinuxBacktracer * self,
+    const GumCpuContext * cpu_context,
+    GumReturnAddressArray * return_addresses);
+
+G_END_DECLS
+
+#endif
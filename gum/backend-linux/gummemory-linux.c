@@ -6,41 +6,71 @@
 
 #include "gummemory.h"
 
+#include "gum-init.h"
 #include "gummemory-priv.h"
+#include "gumprocess.h"
 #include "valgrind.h"
 
-#include <stdio.h>
+#include <errno.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
-static gboolean gum_memory_get_protection (GumAddress address, gsize n,
-    gsize * size, GumPageProtection * prot);
+#define GUM_VM_IO_MAX_IOVECS 64
 
-gboolean
-gum_memory_is_readable (GumAddress address,
-                        gsize len)
+typedef struct _GumMappedRange GumMappedRange;
+typedef enum _GumVmIoResult GumVmIoResult;
+
+struct _GumMappedRange
 {
-  gsize size;
+  GumAddress start;
+  GumAddress end;
   GumPageProtection prot;
+};
 
-  if (!gum_memory_get_protection (address, len, &size, &prot))
-    return FALSE;
-
-  return size >= len && (prot & GUM_PAGE_READ) != 0;
-}
+enum _GumVmIoResult
+{
+  GUM_VM_IO_OK,
+  GUM_VM_IO_FAULT,
+  GUM_VM_IO_UNSUPPORTED
+};
+
+static gsize gum_memory_query_accessible (GumAddress address, gsize len,
+    GumPageProtection prot, gboolean refresh);
+static gsize gum_mapped_ranges_lookup (GArray * ranges, GumAddress address,
+    gsize len, GumPageProtection prot);
+static void gum_mapped_ranges_refresh (gint generation);
+static gboolean gum_collect_mapped_range (const GumRangeDetails * details,
+    gpointer user_data);
+static void gum_mapped_ranges_deinit (void);
+
+static GumVmIoResult gum_vm_read (GumAddress address, gpointer data,
+    gsize len);
+static GumVmIoResult gum_vm_write (GumAddress address, gconstpointer data,
+    gsize len);
+static GumVmIoResult gum_vm_probe (GumAddress address, gsize len);
+static GumVmIoResult gum_vm_io_result_from_errno (void);
+
+G_LOCK_DEFINE_STATIC (gum_mapped_ranges);
+static GArray * gum_mapped_ranges = NULL;
+static gint gum_mapped_ranges_generation = 0;
+static volatile gint gum_memory_generation = 1;
+
+static volatile gint gum_vm_io_supported = TRUE;
 
-static gboolean
-gum_memory_is_writable (GumAddress address,
+gboolean
+gum_memory_is_readable (GumAddress address,
                         gsize len)
 {
-  gsize size;
-  GumPageProtection prot;
-
-  if (!gum_memory_get_protection (address, len, &size, &prot))
-    return FALSE;
+  if (gum_memory_query_accessible (address, len, GUM_PAGE_READ, FALSE) == len)
+  {
+    if (gum_vm_probe (address, len) == GUM_VM_IO_OK)
+      return TRUE;
+  }
 
-  return size >= len && (prot & GUM_PAGE_WRITE) != 0;
+  return gum_memory_query_accessible (address, len, GUM_PAGE_READ, TRUE) == len;
 }
 
 guint8 *
@@ -49,15 +79,30 @@ gum_memory_read (GumAddress address,
                  gsize * n_bytes_read)
 {
   guint8 * result = NULL;
-  gsize result_len = 0;
-  gsize size;
-  GumPageProtection prot;
+  gsize result_len;
+
+  /*
+   * The snapshot may be stale if the process changed its mappings behind our
+   * back, so we only trust it for the fast path when the kernel can fail the
+   * copy gracefully. Anything else gets a fresh snapshot, just like before.
+   */
+  result_len = gum_memory_query_accessible (address, len, GUM_PAGE_READ, FALSE);
+  if (result_len == len)
+  {
+    result = g_malloc (result_len);
+    if (gum_vm_read (address, result, result_len) != GUM_VM_IO_OK)
+    {
+      g_free (result);
+      result = NULL;
+    }
+  }
 
-  if (gum_memory_get_protection (address, len, &size, &prot)
-      && (prot & GUM_PAGE_READ) != 0)
+  if (result == NULL)
   {
-    result_len = MIN (len, size);
-    result = g_memdup (GSIZE_TO_POINTER (address), result_len);
+    result_len =
+        gum_memory_query_accessible (address, len, GUM_PAGE_READ, TRUE);
+    if (result_len != 0)
+      result = g_memdup (GSIZE_TO_POINTER (address), result_len);
   }
 
   if (n_bytes_read != NULL)
@@ -71,15 +116,18 @@ gum_memory_write (GumAddress address,
                   const guint8 * bytes,
                   gsize len)
 {
-  gboolean success = FALSE;
-
-  if (gum_memory_is_writable (address, len))
+  if (gum_memory_query_accessible (address, len, GUM_PAGE_WRITE, FALSE) == len)
   {
-    memcpy (GSIZE_TO_POINTER (address), bytes, len);
-    success = TRUE;
+    if (gum_vm_write (address, bytes, len) == GUM_VM_IO_OK)
+      return TRUE;
   }
 
-  return success;
+  if (gum_memory_query_accessible (address, len, GUM_PAGE_WRITE, TRUE) != len)
+    return FALSE;
+
+  memcpy (GSIZE_TO_POINTER (address), bytes, len);
+
+  return TRUE;
 }
 
 gboolean
@@ -104,6 +152,8 @@ gum_try_mprotect (gpointer address,
 
   result = mprotect (aligned_address, aligned_size, posix_page_prot);
 
+  _gum_memory_invalidate_protection_cache ();
+
   return result == 0;
 }
 
@@ -118,97 +168,273 @@ gum_clear_cache (gpointer address,
   VALGRIND_DISCARD_TRANSLATIONS (address, size);
 }
 
-static gboolean
-gum_memory_get_protection (GumAddress address,
-                           gsize n,
-                           gsize * size,
-                           GumPageProtection * prot)
+void
+_gum_memory_invalidate_protection_cache (void)
 {
-  gboolean success;
-  FILE * fp;
-  gchar line[1024 + 1];
+  g_atomic_int_inc (&gum_memory_generation);
+}
 
-  if (size == NULL || prot == NULL)
+static gsize
+gum_memory_query_accessible (GumAddress address,
+                             gsize len,
+                             GumPageProtection prot,
+                             gboolean refresh)
+{
+  gsize accessible;
+  gint generation;
+
+  generation = g_atomic_int_get (&gum_memory_generation);
+
+  G_LOCK (gum_mapped_ranges);
+  if (!refresh && gum_mapped_ranges != NULL &&
+      gum_mapped_ranges_generation == generation)
   {
-    gsize ignored_size;
-    GumPageProtection ignored_prot;
+    accessible =
+        gum_mapped_ranges_lookup (gum_mapped_ranges, address, len, prot);
+    G_UNLOCK (gum_mapped_ranges);
 
-    return gum_memory_get_protection (address, n,
-        (size != NULL) ? size : &ignored_size,
-        (prot != NULL) ? prot : &ignored_prot);
+    return accessible;
   }
+  G_UNLOCK (gum_mapped_ranges);
 
-  if (n > 1)
-  {
-    GumAddress page_size, start_page, end_page, cur_page;
+  gum_mapped_ranges_refresh (generation);
 
-    page_size = gum_query_page_size ();
+  G_LOCK (gum_mapped_ranges);
+  accessible = gum_mapped_ranges_lookup (gum_mapped_ranges, address, len, prot);
+  G_UNLOCK (gum_mapped_ranges);
 
-    start_page = address & ~(page_size - 1);
-    end_page = (address + n - 1) & ~(page_size - 1);
+  return accessible;
+}
 
-    success = gum_memory_get_protection (start_page, 1, NULL, prot);
-    if (success)
+static gsize
+gum_mapped_ranges_lookup (GArray * ranges,
+                          GumAddress address,
+                          gsize len,
+                          GumPageProtection prot)
+{
+  const GumMappedRange * r;
+  gint lower, upper;
+  guint i;
+  GumAddress end;
+  GumPageProtection combined_prot;
+
+  lower = 0;
+  upper = (gint) ranges->len - 1;
+  r = NULL;
+  while (lower <= upper)
+  {
+    gint mid;
+    const GumMappedRange * cur;
+
+    mid = lower + ((upper - lower) / 2);
+    cur = &g_array_index (ranges, GumMappedRange, mid);
+
+    if (address < cur->start)
+    {
+      upper = mid - 1;
+    }
+    else if (address >= cur->end)
+    {
+      lower = mid + 1;
+    }
+    else
     {
-      *size = page_size - (address - start_page);
-      for (cur_page = start_page + page_size;
-          cur_page != end_page + page_size;
-          cur_page += page_size)
-      {
-        GumPageProtection cur_prot;
-
-        if (gum_memory_get_protection (cur_page, 1, NULL, &cur_prot)
-            && (cur_prot != GUM_PAGE_NO_ACCESS || *prot == GUM_PAGE_NO_ACCESS))
-        {
-          *size += page_size;
-          *prot &= cur_prot;
-        }
-        else
-        {
-          break;
-        }
-      }
-      *size = MIN (*size, n);
+      r = cur;
+      break;
     }
+  }
+  if (r == NULL)
+    return 0;
+
+  combined_prot = r->prot;
+  end = r->end;
+  for (i = (r - (const GumMappedRange *) ranges->data) + 1;
+      i != ranges->len && end - address < len;
+      i++)
+  {
+    const GumMappedRange * next = &g_array_index (ranges, GumMappedRange, i);
+
+    if (next->start != end)
+      break;
+    if (next->prot == GUM_PAGE_NO_ACCESS && combined_prot != GUM_PAGE_NO_ACCESS)
+      break;
 
-    return success;
+    combined_prot &= next->prot;
+    end = next->end;
   }
 
-  success = FALSE;
-  *size = 0;
-  *prot = GUM_PAGE_NO_ACCESS;
+  if ((combined_prot & prot) != prot)
+    return 0;
 
-  fp = fopen ("/proc/self/maps", "r");
-  g_assert (fp != NULL);
+  return MIN (end - address, len);
+}
+
+static void
+gum_mapped_ranges_refresh (gint generation)
+{
+  static volatile gint destructor_registered = FALSE;
+  GArray * ranges, * old_ranges;
+
+  ranges = g_array_sized_new (FALSE, FALSE, sizeof (GumMappedRange), 256);
+  gum_process_enumerate_ranges (GUM_PAGE_NO_ACCESS, gum_collect_mapped_range,
+      ranges);
 
-  while (fgets (line, sizeof (line), fp) != NULL)
+  G_LOCK (gum_mapped_ranges);
+  old_ranges = gum_mapped_ranges;
+  gum_mapped_ranges = ranges;
+  gum_mapped_ranges_generation = generation;
+  G_UNLOCK (gum_mapped_ranges);
+
+  if (g_atomic_int_compare_and_exchange (&destructor_registered, FALSE, TRUE))
+    _gum_register_destructor (gum_mapped_ranges_deinit);
+
+  if (old_ranges != NULL)
+    g_array_free (old_ranges, TRUE);
+}
+
+static gboolean
+gum_collect_mapped_range (const GumRangeDetails * details,
+                          gpointer user_data)
+{
+  GArray * ranges = user_data;
+  GumMappedRange r;
+
+  r.start = details->range->base_address;
+  r.end = r.start + details->range->size;
+  r.prot = details->prot;
+  g_array_append_val (ranges, r);
+
+  return TRUE;
+}
+
+static void
+gum_mapped_ranges_deinit (void)
+{
+  G_LOCK (gum_mapped_ranges);
+  if (gum_mapped_ranges != NULL)
   {
-    gint n_items;
-    gpointer start, end;
-    gchar protection[16];
+    g_array_free (gum_mapped_ranges, TRUE);
+    gum_mapped_ranges = NULL;
+  }
+  G_UNLOCK (gum_mapped_ranges);
+}
 
-    n_items = sscanf (line, "%p-%p %s ", &start, &end, protection);
-    g_assert_cmpint (n_items, ==, 3);
+static GumVmIoResult
+gum_vm_read (GumAddress address,
+             gpointer data,
+             gsize len)
+{
+#ifdef __NR_process_vm_readv
+  struct iovec local, remote;
+  gssize n;
 
-    if (GUM_ADDRESS (start) > address)
-      break;
-    else if (address >= GUM_ADDRESS (start) &&
-        address + n - 1 < GUM_ADDRESS (end))
+  if (!g_atomic_int_get (&gum_vm_io_supported) || RUNNING_ON_VALGRIND)
+    return GUM_VM_IO_UNSUPPORTED;
+
+  local.iov_base = data;
+  local.iov_len = len;
+  remote.iov_base = GSIZE_TO_POINTER (address);
+  remote.iov_len = len;
+
+  n = syscall (__NR_process_vm_readv, getpid (), &local, 1, &remote, 1, 0);
+  if (n == -1)
+    return gum_vm_io_result_from_errno ();
+
+  return ((gsize) n == len) ? GUM_VM_IO_OK : GUM_VM_IO_FAULT;
+#else
+  return GUM_VM_IO_UNSUPPORTED;
+#endif
+}
+
+static GumVmIoResult
+gum_vm_write (GumAddress address,
+              gconstpointer data,
+              gsize len)
+{
+#ifdef __NR_process_vm_writev
+  struct iovec local, remote;
+  gssize n;
+
+  if (!g_atomic_int_get (&gum_vm_io_supported) || RUNNING_ON_VALGRIND)
+    return GUM_VM_IO_UNSUPPORTED;
+
+  local.iov_base = (gpointer) data;
+  local.iov_len = len;
+  remote.iov_base = GSIZE_TO_POINTER (address);
+  remote.iov_len = len;
+
+  n = syscall (__NR_process_vm_writev, getpid (), &local, 1, &remote, 1, 0);
+  if (n == -1)
+    return gum_vm_io_result_from_errno ();
+
+  return ((gsize) n == len) ? GUM_VM_IO_OK : GUM_VM_IO_FAULT;
+#else
+  return GUM_VM_IO_UNSUPPORTED;
+#endif
+}
+
+static GumVmIoResult
+gum_vm_probe (GumAddress address,
+              gsize len)
+{
+#ifdef __NR_process_vm_readv
+  guint8 scratch[GUM_VM_IO_MAX_IOVECS];
+  struct iovec local[GUM_VM_IO_MAX_IOVECS], remote[GUM_VM_IO_MAX_IOVECS];
+  GumAddress page_size, cur, end;
+  pid_t pid;
+
+  if (!g_atomic_int_get (&gum_vm_io_supported) || RUNNING_ON_VALGRIND)
+    return GUM_VM_IO_UNSUPPORTED;
+
+  if (len == 0)
+    return GUM_VM_IO_OK;
+
+  /* Touching one byte per page is enough to know the page is readable. */
+  page_size = gum_query_page_size ();
+  pid = getpid ();
+  cur = address;
+  end = address + len;
+  while (cur < end)
+  {
+    guint n;
+    gssize result;
+
+    for (n = 0; n != GUM_VM_IO_MAX_IOVECS && cur < end; n++)
     {
-      success = TRUE;
-      *size = 1;
-      if (protection[0] == 'r')
-        *prot |= GUM_PAGE_READ;
-      if (protection[1] == 'w')
-        *prot |= GUM_PAGE_WRITE;
-      if (protection[2] == 'x')
-        *prot |= GUM_PAGE_EXECUTE;
-      break;
+      local[n].iov_base = &scratch[n];
+      local[n].iov_len = 1;
+      remote[n].iov_base = GSIZE_TO_POINTER (cur);
+      remote[n].iov_len = 1;
+
+      cur = (cur & ~(page_size - 1)) + page_size;
     }
-  }
 
-  fclose (fp);
+    result = syscall (__NR_process_vm_readv, pid, local, n, remote, n, 0);
+    if (result == -1)
+      return gum_vm_io_result_from_errno ();
+    if ((guint) result != n)
+      return GUM_VM_IO_FAULT;
+  }
 
-  return success;
+  return GUM_VM_IO_OK;
+#else
+  return GUM_VM_IO_UNSUPPORTED;
+#endif
 }
 
+static GumVmIoResult
+gum_vm_io_result_from_errno (void)
+{
+  switch (errno)
+  {
+    case EFAULT:
+      return GUM_VM_IO_FAULT;
+    case ENOSYS:
+    case EPERM:
+    case EINVAL:
+      g_atomic_int_set (&gum_vm_io_supported, FALSE);
+      return GUM_VM_IO_UNSUPPORTED;
+    default:
+      return GUM_VM_IO_UNSUPPORTED;
+  }
+}
@@ -6,8 +6,10 @@
 
 #include "gumprocess.h"
 
+#include "gum-init.h"
 #include "gumlinux.h"
 #include "gummodulemap.h"
+#include "gumprocess-priv.h"
 #include "valgrind.h"
 
 #include <dlfcn.h>
@@ -67,6 +69,21 @@
 #ifndef NT_PRSTATUS
 # define NT_PRSTATUS 1
 #endif
+#ifndef DT_GNU_HASH
+# define DT_GNU_HASH 0x6ffffef5
+#endif
+#ifndef DT_VERSYM
+# define DT_VERSYM 0x6ffffff0
+#endif
+#ifndef STT_GNU_IFUNC
+# define STT_GNU_IFUNC 10
+#endif
+#ifndef STB_GNU_UNIQUE
+# define STB_GNU_UNIQUE 10
+#endif
+#ifndef NT_GNU_BUILD_ID
+# define NT_GNU_BUILD_ID 3
+#endif
 
 #define GUM_TEMP_FAILURE_RETRY(expression) \
   ({ \
@@ -81,6 +98,14 @@
 typedef struct _GumModifyThreadContext GumModifyThreadContext;
 typedef guint8 GumModifyThreadAck;
 
+#ifndef HAVE_ANDROID
+typedef struct _GumModuleSnapshot GumModuleSnapshot;
+typedef struct _GumModuleEntry GumModuleEntry;
+typedef struct _GumCollectModulesContext GumCollectModulesContext;
+typedef struct _GumElfExportIndex GumElfExportIndex;
+typedef struct _GumElfExport GumElfExport;
+#endif
+
 typedef struct _GumEnumerateImportsContext GumEnumerateImportsContext;
 typedef struct _GumDependencyExport GumDependencyExport;
 typedef struct _GumEnumerateModuleRangesContext GumEnumerateModuleRangesContext;
@@ -111,6 +136,7 @@ typedef Elf32_Phdr GumElfPHeader;
 typedef Elf32_Shdr GumElfSHeader;
 typedef Elf32_Dyn GumElfDynamic;
 typedef Elf32_Sym GumElfSymbol;
+typedef Elf32_Nhdr GumElfNoteHeader;
 # define GUM_ELF_ST_BIND(val) ELF32_ST_BIND(val)
 # define GUM_ELF_ST_TYPE(val) ELF32_ST_TYPE(val)
 #else
@@ -119,6 +145,7 @@ typedef Elf64_Phdr GumElfPHeader;
 typedef Elf64_Shdr GumElfSHeader;
 typedef Elf64_Dyn GumElfDynamic;
 typedef Elf64_Sym GumElfSymbol;
+typedef Elf64_Nhdr GumElfNoteHeader;
 # define GUM_ELF_ST_BIND(val) ELF64_ST_BIND(val)
 # define GUM_ELF_ST_TYPE(val) ELF64_ST_TYPE(val)
 #endif
@@ -143,6 +170,58 @@ struct _GumModifyThreadContext
   GumCpuContext cpu_context;
 };
 
+#ifndef HAVE_ANDROID
+
+struct _GumModuleSnapshot
+{
+  volatile gint ref_count;
+  guint64 generation;
+  GArray * entries;
+};
+
+struct _GumModuleEntry
+{
+  gchar * dl_name;
+  GumAddress dl_addr;
+
+  gchar * name;
+  gchar * path;
+  GumMemoryRange range;
+
+  GumElfExportIndex * exports;
+};
+
+struct _GumCollectModulesContext
+{
+  GumModuleSnapshot * snapshot;
+  GumModuleSnapshot * previous;
+  guint previous_index;
+  guint n_visited;
+};
+
+struct _GumElfExportIndex
+{
+  volatile gint ref_count;
+
+  GumAddress base;
+  const GumElfSymbol * symbols;
+  guint n_symbols;
+  const gchar * strings;
+  const guint16 * versions;
+  const guint32 * gnu_hash;
+  const guint32 * hash;
+
+  GArray * volatile sorted;
+};
+
+struct _GumElfExport
+{
+  GumAddress address;
+  guint index;
+};
+
+#endif
+
 struct _GumEnumerateImportsContext
 {
   GumFoundImportFunc func;
@@ -227,6 +306,49 @@ static gint gum_do_modify_thread (gpointer data);
 static gboolean gum_await_ack (gint fd, GumModifyThreadAck expected_ack);
 static void gum_put_ack (gint fd, GumModifyThreadAck ack);
 
+#ifndef HAVE_ANDROID
+static void gum_process_enumerate_loaded_modules (GumFoundModuleFunc func,
+    gpointer user_data);
+static GumModuleSnapshot * gum_module_snapshot_obtain (void);
+static GumModuleSnapshot * gum_module_snapshot_ref (
+    GumModuleSnapshot * snapshot);
+static void gum_module_snapshot_unref (GumModuleSnapshot * snapshot);
+static int gum_collect_module_entry (struct dl_phdr_info * info, size_t size,
+    void * data);
+static const GumModuleEntry * gum_module_snapshot_find_entry (
+    GumModuleSnapshot * self, const gchar * dl_name, GumAddress dl_addr,
+    guint * hint);
+static const GumModuleEntry * gum_module_snapshot_find_entry_by_name (
+    GumModuleSnapshot * self, const gchar * name);
+static const GumModuleEntry * gum_module_snapshot_find_entry_by_address (
+    GumModuleSnapshot * self, GumAddress address);
+static void gum_module_snapshot_deinit (void);
+static GumElfExportIndex * gum_elf_export_index_new (GumAddress base,
+    const GumElfPHeader * phdrs, guint n_phdrs, const GumMemoryRange * range);
+static GumElfExportIndex * gum_elf_export_index_ref (
+    GumElfExportIndex * index);
+static void gum_elf_export_index_unref (GumElfExportIndex * index);
+static const GumElfSymbol * gum_elf_export_index_lookup (
+    GumElfExportIndex * self, const gchar * name);
+static gboolean gum_elf_export_index_is_export (GumElfExportIndex * self,
+    guint index);
+static GArray * gum_elf_export_index_get_sorted (GumElfExportIndex * self);
+static gint gum_elf_export_compare (const GumElfExport * lhs,
+    const GumElfExport * rhs);
+static gconstpointer gum_elf_resolve_dynamic_pointer (GumAddress value,
+    GumAddress base, const GumMemoryRange * range);
+static guint32 gum_elf_gnu_hash (const gchar * name);
+static guint32 gum_elf_sysv_hash (const gchar * name);
+# ifdef HAVE_GLIBC
+static int gum_store_module_generation (struct dl_phdr_info * info,
+    size_t size, void * data);
+static guint64 gum_module_generation_from_phdr_info (
+    const struct dl_phdr_info * info, size_t size);
+# endif
+#else
+static void gum_process_enumerate_mapped_modules (GumFoundModuleFunc func,
+    gpointer user_data);
+#endif
 static void gum_store_cpu_context (GumThreadId thread_id,
     GumCpuContext * cpu_context, gpointer user_data);
 
@@ -297,6 +419,11 @@ static int setcontext (const ucontext_t * ucp);
 
 static gboolean gum_is_regset_supported = TRUE;
 
+#ifndef HAVE_ANDROID
+G_LOCK_DEFINE_STATIC (gum_module_snapshot);
+static GumModuleSnapshot * gum_module_snapshot = NULL;
+#endif
+
 gboolean
 gum_process_is_debugger_attached (void)
 {
@@ -590,6 +717,655 @@ gum_store_cpu_context (GumThreadId thread_id,
 void
 gum_process_enumerate_modules (GumFoundModuleFunc func,
                                gpointer user_data)
+{
+#ifndef HAVE_ANDROID
+  gum_process_enumerate_loaded_modules (func, user_data);
+#else
+  gum_process_enumerate_mapped_modules (func, user_data);
+#endif
+}
+
+guint64
+_gum_process_query_module_generation (void)
+{
+#if !defined (HAVE_ANDROID) && defined (HAVE_GLIBC)
+  guint64 generation = 0;
+
+  dl_iterate_phdr (gum_store_module_generation, &generation);
+
+  return generation;
+#else
+  return 0;
+#endif
+}
+
+#ifndef HAVE_ANDROID
+
+static void
+gum_process_enumerate_loaded_modules (GumFoundModuleFunc func,
+                                      gpointer user_data)
+{
+  GumModuleSnapshot * snapshot;
+  gboolean carry_on = TRUE;
+  guint i;
+
+  snapshot = gum_module_snapshot_obtain ();
+
+  for (i = 0; i != snapshot->entries->len && carry_on; i++)
+  {
+    const GumModuleEntry * entry =
+        &g_array_index (snapshot->entries, GumModuleEntry, i);
+    GumModuleDetails details;
+
+    details.name = entry->name;
+    details.range = &entry->range;
+    details.path = entry->path;
+
+    carry_on = func (&details, user_data);
+  }
+
+  gum_module_snapshot_unref (snapshot);
+}
+
+/*
+ * The loader's list of objects is walked with dl_iterate_phdr(), and the
+ * result is kept around until its add/remove counters change. Entries for
+ * objects that are still loaded are carried over on rebuild, so that their
+ * paths don't have to be canonicalized again. Checking the counters stops at
+ * the first object, and lookups always go through it so that they never read
+ * the tables of an object that has been unloaded since.
+ */
+static GumModuleSnapshot *
+gum_module_snapshot_obtain (void)
+{
+  static volatile gint destructor_registered = FALSE;
+  guint64 generation;
+  GumModuleSnapshot * snapshot, * previous, * replaced;
+  GumCollectModulesContext ctx;
+
+  generation = _gum_process_query_module_generation ();
+
+  G_LOCK (gum_module_snapshot);
+  previous = (gum_module_snapshot != NULL)
+      ? gum_module_snapshot_ref (gum_module_snapshot)
+      : NULL;
+  G_UNLOCK (gum_module_snapshot);
+
+  if (previous != NULL && generation != 0 &&
+      previous->generation == generation)
+    return previous;
+
+  snapshot = g_slice_new (GumModuleSnapshot);
+  snapshot->ref_count = 1;
+  snapshot->generation = 0;
+  snapshot->entries = g_array_new (FALSE, FALSE, sizeof (GumModuleEntry));
+
+  ctx.snapshot = snapshot;
+  ctx.previous = previous;
+  ctx.previous_index = 0;
+  ctx.n_visited = 0;
+  dl_iterate_phdr (gum_collect_module_entry, &ctx);
+
+  G_LOCK (gum_module_snapshot);
+  replaced = gum_module_snapshot;
+  gum_module_snapshot = gum_module_snapshot_ref (snapshot);
+  G_UNLOCK (gum_module_snapshot);
+
+  if (g_atomic_int_compare_and_exchange (&destructor_registered, FALSE, TRUE))
+    _gum_register_destructor (gum_module_snapshot_deinit);
+
+  if (replaced != NULL)
+    gum_module_snapshot_unref (replaced);
+  if (previous != NULL)
+    gum_module_snapshot_unref (previous);
+
+  return snapshot;
+}
+
+static GumModuleSnapshot *
+gum_module_snapshot_ref (GumModuleSnapshot * snapshot)
+{
+  g_atomic_int_inc (&snapshot->ref_count);
+
+  return snapshot;
+}
+
+static void
+gum_module_snapshot_unref (GumModuleSnapshot * snapshot)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  for (i = 0; i != snapshot->entries->len; i++)
+  {
+    GumModuleEntry * entry =
+        &g_array_index (snapshot->entries, GumModuleEntry, i);
+
+    g_free (entry->dl_name);
+    g_free (entry->name);
+    g_free (entry->path);
+    if (entry->exports != NULL)
+      gum_elf_export_index_unref (entry->exports);
+  }
+  g_array_free (snapshot->entries, TRUE);
+
+  g_slice_free (GumModuleSnapshot, snapshot);
+}
+
+static int
+gum_collect_module_entry (struct dl_phdr_info * info,
+                          size_t size,
+                          void * data)
+{
+  GumCollectModulesContext * ctx = data;
+  GumModuleSnapshot * snapshot = ctx->snapshot;
+  gboolean is_main_program;
+  const GumModuleEntry * previous_entry;
+  GumModuleEntry entry;
+  GumAddress lowest, highest;
+  gsize page_size;
+  guint i;
+
+  is_main_program = ctx->n_visited++ == 0 && info->dlpi_name[0] == '\0';
+#ifdef HAVE_GLIBC
+  if (ctx->n_visited == 1)
+    snapshot->generation = gum_module_generation_from_phdr_info (info, size);
+#endif
+
+  if (!is_main_program && info->dlpi_name[0] == '\0')
+    return 0;
+
+  previous_entry = (ctx->previous != NULL)
+      ? gum_module_snapshot_find_entry (ctx->previous, info->dlpi_name,
+          info->dlpi_addr, &ctx->previous_index)
+      : NULL;
+  if (previous_entry != NULL)
+  {
+    entry = *previous_entry;
+    entry.dl_name = g_strdup (entry.dl_name);
+    entry.name = g_strdup (entry.name);
+    entry.path = g_strdup (entry.path);
+    if (entry.exports != NULL)
+      gum_elf_export_index_ref (entry.exports);
+    g_array_append_val (snapshot->entries, entry);
+
+    return 0;
+  }
+
+  lowest = G_MAXUINT64;
+  highest = 0;
+  for (i = 0; i != info->dlpi_phnum; i++)
+  {
+    const GumElfPHeader * phdr = &info->dlpi_phdr[i];
+
+    if (phdr->p_type != PT_LOAD)
+      continue;
+
+    lowest = MIN (lowest, phdr->p_vaddr);
+    highest = MAX (highest, phdr->p_vaddr + phdr->p_memsz);
+  }
+  if (highest == 0)
+    return 0;
+
+  if (is_main_program)
+  {
+    entry.path = g_file_read_link ("/proc/self/exe", NULL);
+  }
+  else
+  {
+    gchar * path;
+
+    /* Objects without a real file behind them, like the vDSO, fail here. */
+    path = realpath (info->dlpi_name, NULL);
+    entry.path = g_strdup (path);
+    free (path);
+  }
+  if (entry.path == NULL)
+    return 0;
+
+  if (RUNNING_ON_VALGRIND && strstr (entry.path, "/valgrind/") != NULL)
+  {
+    g_free (entry.path);
+    return 0;
+  }
+
+  page_size = gum_query_page_size ();
+
+  entry.dl_name = g_strdup (info->dlpi_name);
+  entry.dl_addr = info->dlpi_addr;
+  entry.name = g_path_get_basename (entry.path);
+  entry.range.base_address = (info->dlpi_addr + lowest) & ~(page_size - 1);
+  entry.range.size = ((info->dlpi_addr + highest + page_size - 1) &
+      ~(page_size - 1)) - entry.range.base_address;
+  entry.exports = gum_elf_export_index_new (info->dlpi_addr, info->dlpi_phdr,
+      info->dlpi_phnum, &entry.range);
+
+  g_array_append_val (snapshot->entries, entry);
+
+  return 0;
+}
+
+static const GumModuleEntry *
+gum_module_snapshot_find_entry (GumModuleSnapshot * self,
+                                const gchar * dl_name,
+                                GumAddress dl_addr,
+                                guint * hint)
+{
+  GArray * entries = self->entries;
+  guint n, i;
+
+  /* The loader keeps objects in load order, so the hint is usually right. */
+  n = entries->len;
+  for (i = 0; i != n; i++)
+  {
+    guint index = (*hint + i) % n;
+    const GumModuleEntry * entry =
+        &g_array_index (entries, GumModuleEntry, index);
+
+    if (entry->dl_addr == dl_addr && strcmp (entry->dl_name, dl_name) == 0)
+    {
+      *hint = index + 1;
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static const GumModuleEntry *
+gum_module_snapshot_find_entry_by_name (GumModuleSnapshot * self,
+                                        const gchar * name)
+{
+  guint i;
+
+  for (i = 0; i != self->entries->len; i++)
+  {
+    const GumModuleEntry * entry =
+        &g_array_index (self->entries, GumModuleEntry, i);
+
+    if (gum_module_path_equals (entry->path, name) ||
+        gum_module_path_equals (entry->dl_name, name))
+      return entry;
+  }
+
+  return NULL;
+}
+
+static const GumModuleEntry *
+gum_module_snapshot_find_entry_by_address (GumModuleSnapshot * self,
+                                           GumAddress address)
+{
+  guint i;
+
+  for (i = 0; i != self->entries->len; i++)
+  {
+    const GumModuleEntry * entry =
+        &g_array_index (self->entries, GumModuleEntry, i);
+
+    if (GUM_MEMORY_RANGE_INCLUDES (&entry->range, address))
+      return entry;
+  }
+
+  return NULL;
+}
+
+static void
+gum_module_snapshot_deinit (void)
+{
+  GumModuleSnapshot * snapshot;
+
+  G_LOCK (gum_module_snapshot);
+  snapshot = gum_module_snapshot;
+  gum_module_snapshot = NULL;
+  G_UNLOCK (gum_module_snapshot);
+
+  if (snapshot != NULL)
+    gum_module_snapshot_unref (snapshot);
+}
+
+/*
+ * Indexes a loaded object's dynamic symbols straight from its image, using
+ * the DT_GNU_HASH or DT_HASH table for lookups by name. The loader is only
+ * asked whether its list of objects changed, not to resolve the symbol.
+ */
+static GumElfExportIndex *
+gum_elf_export_index_new (GumAddress base,
+                          const GumElfPHeader * phdrs,
+                          guint n_phdrs,
+                          const GumMemoryRange * range)
+{
+  GumElfExportIndex * index;
+  const GumElfDynamic * dyn = NULL;
+  const GumElfDynamic * entry;
+  guint i;
+
+  for (i = 0; i != n_phdrs; i++)
+  {
+    if (phdrs[i].p_type == PT_DYNAMIC)
+      dyn = GSIZE_TO_POINTER (base + phdrs[i].p_vaddr);
+  }
+  if (dyn == NULL)
+    return NULL;
+
+  index = g_slice_new0 (GumElfExportIndex);
+  index->ref_count = 1;
+  index->base = base;
+
+  for (entry = dyn; entry->d_tag != DT_NULL; entry++)
+  {
+    gconstpointer ptr =
+        gum_elf_resolve_dynamic_pointer (entry->d_un.d_ptr, base, range);
+
+    switch (entry->d_tag)
+    {
+      case DT_SYMTAB:
+        index->symbols = ptr;
+        break;
+      case DT_STRTAB:
+        index->strings = ptr;
+        break;
+      case DT_VERSYM:
+        index->versions = ptr;
+        break;
+      case DT_GNU_HASH:
+        index->gnu_hash = ptr;
+        break;
+      case DT_HASH:
+        index->hash = ptr;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (index->symbols == NULL || index->strings == NULL ||
+      (index->gnu_hash == NULL && index->hash == NULL))
+  {
+    g_slice_free (GumElfExportIndex, index);
+    return NULL;
+  }
+
+  if (index->hash != NULL)
+  {
+    index->n_symbols = index->hash[1];
+  }
+  else
+  {
+    const guint32 * gnu_hash = index->gnu_hash;
+    guint32 n_buckets, symbol_offset, bloom_size, last;
+    const guint32 * buckets, * chain;
+
+    n_buckets = gnu_hash[0];
+    symbol_offset = gnu_hash[1];
+    bloom_size = gnu_hash[2];
+    buckets = (const guint32 *) ((const gsize *) &gnu_hash[4] + bloom_size);
+    chain = buckets + n_buckets;
+
+    last = 0;
+    for (i = 0; i != n_buckets; i++)
+      last = MAX (last, buckets[i]);
+
+    if (last >= symbol_offset)
+    {
+      while ((chain[last - symbol_offset] & 1) == 0)
+        last++;
+      index->n_symbols = last + 1;
+    }
+    else
+    {
+      index->n_symbols = symbol_offset;
+    }
+  }
+
+  return index;
+}
+
+static GumElfExportIndex *
+gum_elf_export_index_ref (GumElfExportIndex * index)
+{
+  g_atomic_int_inc (&index->ref_count);
+
+  return index;
+}
+
+static void
+gum_elf_export_index_unref (GumElfExportIndex * index)
+{
+  GArray * sorted;
+
+  if (!g_atomic_int_dec_and_test (&index->ref_count))
+    return;
+
+  sorted = g_atomic_pointer_get (&index->sorted);
+  if (sorted != NULL)
+    g_array_free (sorted, TRUE);
+
+  g_slice_free (GumElfExportIndex, index);
+}
+
+static const GumElfSymbol *
+gum_elf_export_index_lookup (GumElfExportIndex * self,
+                             const gchar * name)
+{
+  if (self->gnu_hash != NULL)
+  {
+    const guint32 * gnu_hash = self->gnu_hash;
+    const guint bits_per_word = GLIB_SIZEOF_VOID_P * 8;
+    guint32 n_buckets, symbol_offset, bloom_size, bloom_shift, hash, i;
+    const gsize * bloom;
+    const guint32 * buckets, * chain;
+    gsize word, mask;
+
+    n_buckets = gnu_hash[0];
+    symbol_offset = gnu_hash[1];
+    bloom_size = gnu_hash[2];
+    bloom_shift = gnu_hash[3];
+    bloom = (const gsize *) &gnu_hash[4];
+    buckets = (const guint32 *) (bloom + bloom_size);
+    chain = buckets + n_buckets;
+
+    hash = gum_elf_gnu_hash (name);
+
+    word = bloom[(hash / bits_per_word) % bloom_size];
+    mask = ((gsize) 1 << (hash % bits_per_word)) |
+        ((gsize) 1 << ((hash >> bloom_shift) % bits_per_word));
+    if ((word & mask) != mask)
+      return NULL;
+
+    i = buckets[hash % n_buckets];
+    if (i < symbol_offset)
+      return NULL;
+
+    while (TRUE)
+    {
+      guint32 chain_hash = chain[i - symbol_offset];
+
+      if ((chain_hash | 1) == (hash | 1) &&
+          strcmp (self->strings + self->symbols[i].st_name, name) == 0 &&
+          gum_elf_export_index_is_export (self, i))
+        return &self->symbols[i];
+
+      if ((chain_hash & 1) != 0)
+        break;
+      i++;
+    }
+  }
+  else
+  {
+    const guint32 * hash_table = self->hash;
+    guint32 n_buckets, i;
+    const guint32 * buckets, * chain;
+
+    n_buckets = hash_table[0];
+    buckets = &hash_table[2];
+    chain = buckets + n_buckets;
+
+    for (i = buckets[gum_elf_sysv_hash (name) % n_buckets];
+        i != STN_UNDEF;
+        i = chain[i])
+    {
+      if (strcmp (self->strings + self->symbols[i].st_name, name) == 0 &&
+          gum_elf_export_index_is_export (self, i))
+        return &self->symbols[i];
+    }
+  }
+
+  return NULL;
+}
+
+static gboolean
+gum_elf_export_index_is_export (GumElfExportIndex * self,
+                                guint index)
+{
+  const GumElfSymbol * symbol = &self->symbols[index];
+  GumElfSymbolType type;
+  GumElfSymbolBind bind;
+
+  if (symbol->st_shndx == SHN_UNDEF || symbol->st_shndx == SHN_ABS)
+    return FALSE;
+
+  type = GUM_ELF_ST_TYPE (symbol->st_info);
+  if (type != STT_FUNC && type != STT_OBJECT && type != STT_GNU_IFUNC)
+    return FALSE;
+
+  bind = GUM_ELF_ST_BIND (symbol->st_info);
+  if (bind != STB_GLOBAL && bind != STB_WEAK && bind != STB_GNU_UNIQUE)
+    return FALSE;
+
+  /* Skip non-default versions, just like the loader does. */
+  if (self->versions != NULL && (self->versions[index] & 0x8000) != 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+static GArray *
+gum_elf_export_index_get_sorted (GumElfExportIndex * self)
+{
+  GArray * sorted;
+  guint i;
+
+  sorted = g_atomic_pointer_get (&self->sorted);
+  if (sorted != NULL)
+    return sorted;
+
+  sorted = g_array_new (FALSE, FALSE, sizeof (GumElfExport));
+  for (i = 0; i != self->n_symbols; i++)
+  {
+    GumElfExport e;
+
+    if (!gum_elf_export_index_is_export (self, i))
+      continue;
+
+    e.address = self->base + self->symbols[i].st_value;
+    e.index = i;
+    g_array_append_val (sorted, e);
+  }
+  g_array_sort (sorted, (GCompareFunc) gum_elf_export_compare);
+
+  if (!g_atomic_pointer_compare_and_exchange (&self->sorted, NULL, sorted))
+  {
+    g_array_free (sorted, TRUE);
+    sorted = g_atomic_pointer_get (&self->sorted);
+  }
+
+  return sorted;
+}
+
+static gint
+gum_elf_export_compare (const GumElfExport * lhs,
+                        const GumElfExport * rhs)
+{
+  if (lhs->address < rhs->address)
+    return -1;
+  else if (lhs->address > rhs->address)
+    return 1;
+  else
+    return (gint) lhs->index - (gint) rhs->index;
+}
+
+static gconstpointer
+gum_elf_resolve_dynamic_pointer (GumAddress value,
+                                 GumAddress base,
+                                 const GumMemoryRange * range)
+{
+  /*
+   * Some loaders relocate the dynamic section in place and some don't, so
+   * treat anything that already points into the image as absolute.
+   */
+  if (GUM_MEMORY_RANGE_INCLUDES (range, value))
+    return GSIZE_TO_POINTER (value);
+
+  return GSIZE_TO_POINTER (base + value);
+}
+
+static guint32
+gum_elf_gnu_hash (const gchar * name)
+{
+  guint32 hash = 5381;
+  const guint8 * p;
+
+  for (p = (const guint8 *) name; *p != '\0'; p++)
+    hash = (hash << 5) + hash + *p;
+
+  return hash;
+}
+
+static guint32
+gum_elf_sysv_hash (const gchar * name)
+{
+  guint32 hash = 0;
+  const guint8 * p;
+
+  for (p = (const guint8 *) name; *p != '\0'; p++)
+  {
+    guint32 high;
+
+    hash = (hash << 4) + *p;
+    high = hash & 0xf0000000;
+    if (high != 0)
+      hash ^= high >> 24;
+    hash &= ~high;
+  }
+
+  return hash;
+}
+
+# ifdef HAVE_GLIBC
+
+static int
+gum_store_module_generation (struct dl_phdr_info * info,
+                             size_t size,
+                             void * data)
+{
+  guint64 * generation = data;
+
+  *generation = gum_module_generation_from_phdr_info (info, size);
+
+  return 1;
+}
+
+static guint64
+gum_module_generation_from_phdr_info (const struct dl_phdr_info * info,
+                                      size_t size)
+{
+  if (size < G_STRUCT_OFFSET (struct dl_phdr_info, dlpi_subs) +
+      sizeof (info->dlpi_subs))
+    return 0;
+
+  /* Both counters only ever grow, so their sum changes on every event. */
+  return info->dlpi_adds + info->dlpi_subs;
+}
+
+# endif
+
+#else
+
+static void
+gum_process_enumerate_mapped_modules (GumFoundModuleFunc func,
+                                      gpointer user_data)
 {
   FILE * fp;
   const guint line_size = GUM_MAPS_LINE_SIZE;
@@ -665,6 +1441,8 @@ gum_process_enumerate_modules (GumFoundModuleFunc func,
   fclose (fp);
 }
 
+#endif
+
 void
 gum_process_enumerate_ranges (GumPageProtection prot,
                               GumFoundRangeFunc func,
@@ -931,6 +1709,72 @@ gum_emit_range_if_module_name_matches (const GumRangeDetails * details,
   return ctx->func (details, ctx->user_data);
 }
 
+gchar *
+_gum_process_query_module_build_id (GumAddress base)
+{
+  const guint8 elf_magic[] = { 0x7f, 'E', 'L', 'F' };
+  const GumElfEHeader * ehdr = GSIZE_TO_POINTER (base);
+  const GumElfPHeader * phdrs;
+  GumAddress bias;
+  guint i;
+
+  if (memcmp (ehdr, elf_magic, sizeof (elf_magic)) != 0)
+    return NULL;
+
+  phdrs = GSIZE_TO_POINTER (base + ehdr->e_phoff);
+
+  bias = base;
+  for (i = 0; i != ehdr->e_phnum; i++)
+  {
+    if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_offset == 0)
+    {
+      bias = base - phdrs[i].p_vaddr;
+      break;
+    }
+  }
+
+  for (i = 0; i != ehdr->e_phnum; i++)
+  {
+    const GumElfPHeader * phdr = &phdrs[i];
+    const guint8 * cursor, * end;
+
+    if (phdr->p_type != PT_NOTE)
+      continue;
+
+    cursor = GSIZE_TO_POINTER (bias + phdr->p_vaddr);
+    end = cursor + phdr->p_memsz;
+
+    while (cursor + sizeof (GumElfNoteHeader) <= end)
+    {
+      const GumElfNoteHeader * note = (const GumElfNoteHeader *) cursor;
+      const gchar * name;
+      const guint8 * desc;
+
+      name = (const gchar *) (note + 1);
+      desc = (const guint8 *) name + GUM_ALIGN_SIZE (note->n_namesz, 4);
+      if (desc + note->n_descsz > end)
+        break;
+
+      if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+          memcmp (name, "GNU", 4) == 0)
+      {
+        GString * id;
+        guint j;
+
+        id = g_string_sized_new (2 * note->n_descsz);
+        for (j = 0; j != note->n_descsz; j++)
+          g_string_append_printf (id, "%02x", desc[j]);
+
+        return g_string_free (id, FALSE);
+      }
+
+      cursor = desc + GUM_ALIGN_SIZE (note->n_descsz, 4);
+    }
+  }
+
+  return NULL;
+}
+
 GumAddress
 gum_module_find_base_address (const gchar * module_name)
 {
@@ -952,6 +1796,35 @@ gum_module_find_export_by_name (const gchar * module_name,
   GumAddress result;
   void * module;
 
+#ifndef HAVE_ANDROID
+  if (module_name != NULL)
+  {
+    GumModuleSnapshot * snapshot;
+    const GumModuleEntry * entry;
+    const GumElfSymbol * symbol = NULL;
+
+    snapshot = gum_module_snapshot_obtain ();
+
+    entry = gum_module_snapshot_find_entry_by_name (snapshot, module_name);
+    if (entry != NULL && entry->exports != NULL)
+      symbol = gum_elf_export_index_lookup (entry->exports, symbol_name);
+
+    /*
+     * IFUNCs need their resolver run, and symbols not defined by the module
+     * itself are looked up in its dependencies, so leave those to dlsym().
+     */
+    if (symbol != NULL && GUM_ELF_ST_TYPE (symbol->st_info) != STT_GNU_IFUNC)
+      result = entry->exports->base + symbol->st_value;
+    else
+      result = 0;
+
+    gum_module_snapshot_unref (snapshot);
+
+    if (result != 0)
+      return result;
+  }
+#endif
+
   if (module_name != NULL)
   {
     gchar * name;
@@ -978,6 +1851,61 @@ gum_module_find_export_by_name (const gchar * module_name,
   return result;
 }
 
+gboolean
+gum_linux_find_nearest_export (GumAddress address,
+                               GumExportDetails * details)
+{
+#ifndef HAVE_ANDROID
+  gboolean found = FALSE;
+  GumModuleSnapshot * snapshot;
+  const GumModuleEntry * entry;
+
+  snapshot = gum_module_snapshot_obtain ();
+
+  entry = gum_module_snapshot_find_entry_by_address (snapshot, address);
+  if (entry != NULL && entry->exports != NULL)
+  {
+    GumElfExportIndex * index = entry->exports;
+    GArray * sorted;
+    guint lo, hi;
+
+    sorted = gum_elf_export_index_get_sorted (index);
+
+    lo = 0;
+    hi = sorted->len;
+    while (lo < hi)
+    {
+      guint mid = lo + ((hi - lo) / 2);
+
+      if (g_array_index (sorted, GumElfExport, mid).address <= address)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    if (lo != 0)
+    {
+      const GumElfExport * e = &g_array_index (sorted, GumElfExport, lo - 1);
+      const GumElfSymbol * symbol = &index->symbols[e->index];
+
+      details->type = (GUM_ELF_ST_TYPE (symbol->st_info) == STT_OBJECT)
+          ? GUM_EXPORT_VARIABLE
+          : GUM_EXPORT_FUNCTION;
+      details->name = index->strings + symbol->st_name;
+      details->address = e->address;
+
+      found = TRUE;
+    }
+  }
+
+  gum_module_snapshot_unref (snapshot);
+
+  return found;
+#else
+  return FALSE;
+#endif
+}
+
 GumCpuType
 gum_linux_cpu_type_from_file (const gchar * path,
                               GError ** error)
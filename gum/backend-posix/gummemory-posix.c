@@ -60,6 +60,9 @@ gum_alloc_n_pages (guint n_pages,
 
   result = mmap (NULL, size, posix_page_prot, flags, -1, 0);
   g_assert (result != NULL);
+#ifdef HAVE_LINUX
+  _gum_memory_invalidate_protection_cache ();
+#endif
 
   gum_mprotect (result, page_size, GUM_PAGE_RW);
   *((gsize *) result) = size;
@@ -122,9 +125,16 @@ gum_try_alloc_in_range_if_near_enough (const GumRangeDetails * details,
   ctx->result = mmap (GSIZE_TO_POINTER (base_address), ctx->size,
       ctx->posix_page_prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
   if (ctx->result == MAP_FAILED)
+  {
     ctx->result = NULL;
+  }
   else
+  {
+#ifdef HAVE_LINUX
+    _gum_memory_invalidate_protection_cache ();
+#endif
     return FALSE;
+  }
 
   return TRUE;
 }
@@ -141,6 +151,9 @@ gum_free_pages (gpointer mem)
 
   result = munmap (start, size);
   g_assert_cmpint (result, ==, 0);
+#ifdef HAVE_LINUX
+  _gum_memory_invalidate_protection_cache ();
+#endif
 }
 
 static void
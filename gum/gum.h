@@ -29,6 +29,7 @@
 #include <gum/gumprocess.h>
 #include <gum/gumreturnaddress.h>
 #include <gum/gumspinlock.h>
+#include <gum/gumstackdepot.h>
 #include <gum/gumstalker.h>
 #include <gum/gumsymbolutil.h>
 #include <gum/gumsysinternals.h>
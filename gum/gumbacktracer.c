@@ -11,6 +11,8 @@
 # include "arch-x86/gumx86backtracer.h"
 #elif defined (HAVE_DARWIN)
 # include "backend-darwin/gumdarwinbacktracer.h"
+#elif defined (HAVE_LINUX) && defined (HAVE_I386)
+# include "backend-linux/gumlinuxbacktracer.h"
 #elif defined (HAVE_LIBUNWIND)
 # include "backend-libunwind/gumunwbacktracer.h"
 #endif
@@ -56,6 +58,8 @@ gum_backtracer_make_accurate (void)
   return gum_dbghelp_backtracer_new (dbghelp);
 #elif defined (HAVE_DARWIN)
   return gum_darwin_backtracer_new ();
+#elif defined (HAVE_LINUX) && defined (HAVE_I386)
+  return gum_linux_backtracer_new ();
 #elif defined (HAVE_LIBUNWIND)
   return gum_unw_backtracer_new ();
 #else
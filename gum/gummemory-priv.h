@@ -18,6 +18,18 @@ struct _GumMatchPattern
   guint size;
 };
 
+struct _GumMatchPatternSet
+{
+  GPtrArray * patterns;
+  GPtrArray * anchors;
+
+  GMutex mutex;
+  volatile gint dirty;
+  GArray * transitions;
+  GArray * states;
+  GArray * outputs;
+};
+
 enum _GumMatchType
 {
   GUM_MATCH_EXACT,
@@ -34,5 +46,8 @@ struct _GumMatchToken
 G_GNUC_INTERNAL guint _gum_memory_backend_query_page_size (void);
 G_GNUC_INTERNAL gint _gum_page_protection_to_posix (
     GumPageProtection page_prot);
+#ifdef HAVE_LINUX
+G_GNUC_INTERNAL void _gum_memory_invalidate_protection_cache (void);
+#endif
 
 #endif
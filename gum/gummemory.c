@@ -8,8 +8,14 @@
 
 #include "gumlibc.h"
 #include "gummemory-priv.h"
+#include "gumtls.h"
 
 #include <string.h>
+#if defined (HAVE_I386) && defined (__GNUC__)
+# define GUM_HAVE_SIMD_SCAN 1
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
 
 #ifdef G_OS_UNIX
 # include <unistd.h>
@@ -27,7 +33,7 @@
 #define MSPACES       1
 #define ONLY_MSPACES  1
 #define USE_LOCKS     1
-#define FOOTERS       0
+#define FOOTERS       1
 #define INSECURE      1
 #define NO_MALLINFO   0
 #ifdef _MSC_VER
@@ -39,6 +45,75 @@
 # pragma warning (pop)
 #endif
 
+#define GUM_MAX_ARENAS 8
+#define GUM_ARENA_PADDING_SIZE (64 - (2 * sizeof (gpointer)))
+
+#define GUM_SCAN_HORSPOOL_MIN_NEEDLE_SIZE 8
+
+#define GUM_MATCH_STATE_NONE G_MAXUINT
+
+typedef struct _GumArena GumArena;
+typedef struct _GumScanNeedle GumScanNeedle;
+typedef struct _GumMatchState GumMatchState;
+typedef enum _GumScanStrategy GumScanStrategy;
+
+typedef const guint8 * (* GumScanFindFunc) (const guint8 * cur,
+    const guint8 * end, const GumScanNeedle * needle);
+
+/*
+ * Threads are spread across a small set of arenas, each with its own mspace,
+ * so that threads allocating at the same time rarely contend on the same
+ * lock. A block freed by a thread using a different arena is pushed onto
+ * the owning arena's lock-free remote-free list, which is drained by the
+ * next allocation made from that arena.
+ */
+struct _GumArena
+{
+  mspace space;
+  volatile gpointer remote_frees;
+  guint8 padding[GUM_ARENA_PADDING_SIZE];
+};
+
+G_STATIC_ASSERT (sizeof (GumArena) == 64);
+
+struct _GumScanNeedle
+{
+  const guint8 * data;
+  gsize size;
+  gsize skip[256];
+};
+
+struct _GumMatchState
+{
+  guint failure;
+  guint first_output;
+  guint n_outputs;
+};
+
+enum _GumScanStrategy
+{
+  GUM_SCAN_SCALAR,
+  GUM_SCAN_SSE2,
+  GUM_SCAN_AVX2
+};
+
+static void gum_arenas_ensure_initialized (void);
+static GumArena * gum_arena_get_current (void);
+static GumArena * gum_arena_find_owner (gpointer mem);
+static void gum_arena_drain_remote_frees (GumArena * self);
+
+static GumScanStrategy gum_scan_strategy_detect (void);
+static const guint8 * gum_scan_find_scalar (const guint8 * cur,
+    const guint8 * end, const GumScanNeedle * needle);
+static const guint8 * gum_scan_find_horspool (const guint8 * cur,
+    const guint8 * end, const GumScanNeedle * needle);
+#ifdef GUM_HAVE_SIMD_SCAN
+static const guint8 * gum_scan_find_sse2 (const guint8 * cur,
+    const guint8 * end, const GumScanNeedle * needle);
+static const guint8 * gum_scan_find_avx2 (const guint8 * cur,
+    const guint8 * end, const GumScanNeedle * needle);
+#endif
+
 static GumMatchPattern * gum_match_pattern_new (void);
 static void gum_match_pattern_update_computed_size (GumMatchPattern * self);
 static GumMatchToken * gum_match_pattern_get_longest_token (
@@ -49,36 +124,57 @@ static GumMatchToken * gum_match_pattern_push_token (GumMatchPattern * self,
     GumMatchType type);
 static gboolean gum_match_pattern_seal (GumMatchPattern * self);
 
+static void gum_match_pattern_set_ensure_compiled (
+    const GumMatchPatternSet * self);
+static void gum_match_pattern_set_compile (GumMatchPatternSet * self);
+
 static GumMatchToken * gum_match_token_new (GumMatchType type);
 static void gum_match_token_free (GumMatchToken * token);
 static void gum_match_token_append (GumMatchToken * self, guint8 byte);
 
-static mspace gum_mspace = NULL;
+/* Aligned so that each padded arena occupies exactly one cache line */
+#ifdef _MSC_VER
+static __declspec (align (64)) GumArena gum_arenas[GUM_MAX_ARENAS];
+#else
+static GumArena gum_arenas[GUM_MAX_ARENAS] __attribute__ ((aligned (64)));
+#endif
+static volatile gsize gum_arenas_initialized = 0;
+static guint gum_arena_count = 0;
+static volatile gint gum_arena_next_index = 0;
+static GumTlsKey gum_arena_key;
 static guint gum_cached_page_size;
-
-static mspace
-gum_mspace_get (void)
-{
-  if (gum_mspace == NULL)
-    gum_mspace = create_mspace (0, TRUE);
-  return gum_mspace;
-}
+static GumScanStrategy gum_scan_strategy = GUM_SCAN_SCALAR;
 
 void
 gum_memory_init (void)
 {
-  gum_mspace_get ();
+  gum_arenas_ensure_initialized ();
 
   gum_cached_page_size = _gum_memory_backend_query_page_size ();
+  gum_scan_strategy = gum_scan_strategy_detect ();
 }
 
 void
 gum_memory_deinit (void)
 {
-  if (gum_mspace != NULL)
+  if (gum_arena_count != 0)
   {
-    destroy_mspace (gum_mspace);
-    gum_mspace = NULL;
+    guint i;
+
+    for (i = 0; i != gum_arena_count; i++)
+    {
+      GumArena * arena = &gum_arenas[i];
+
+      destroy_mspace (arena->space);
+      arena->space = NULL;
+      arena->remote_frees = NULL;
+    }
+    gum_arena_count = 0;
+    gum_arena_next_index = 0;
+
+    gum_tls_key_free (gum_arena_key);
+
+    gum_arenas_initialized = 0;
 
     DESTROY_MORECORE_LOCK ();
     DESTROY_MAGIC_INIT_LOCK ();
@@ -152,37 +248,306 @@ gum_memory_scan (const GumMemoryRange * range,
                  GumMemoryScanMatchFunc func,
                  gpointer user_data)
 {
-  GumMatchToken * needle;
-  guint8 * needle_data;
-  guint needle_len;
-  guint8 * cur, * end_address;
+  GumMatchToken * token;
+  GumScanNeedle needle;
+  GumScanFindFunc find;
+  const guint8 * base, * cur, * end;
 
-  needle = gum_match_pattern_get_longest_token (pattern, GUM_MATCH_EXACT);
-  needle_data = (guint8 *) needle->bytes->data;
-  needle_len = needle->bytes->len;
+  if (range->size < pattern->size)
+    return;
 
-  cur = GSIZE_TO_POINTER (range->base_address);
-  end_address = cur + range->size - (pattern->size - needle->offset) + 1;
+  token = gum_match_pattern_get_longest_token (pattern, GUM_MATCH_EXACT);
+  needle.data = (const guint8 *) token->bytes->data;
+  needle.size = token->bytes->len;
 
-  for (; cur < end_address; cur++)
+  switch (gum_scan_strategy)
   {
-    guint8 * start;
+#ifdef GUM_HAVE_SIMD_SCAN
+    case GUM_SCAN_AVX2:
+      find = gum_scan_find_avx2;
+      break;
+    case GUM_SCAN_SSE2:
+      find = gum_scan_find_sse2;
+      break;
+#endif
+    default:
+      if (needle.size >= GUM_SCAN_HORSPOOL_MIN_NEEDLE_SIZE)
+      {
+        gsize i;
 
-    if (cur[0] != needle_data[0] || memcmp (cur, needle_data, needle_len) != 0)
-      continue;
+        for (i = 0; i != G_N_ELEMENTS (needle.skip); i++)
+          needle.skip[i] = needle.size;
+        for (i = 0; i != needle.size - 1; i++)
+          needle.skip[needle.data[i]] = needle.size - 1 - i;
 
-    start = cur - needle->offset;
+        find = gum_scan_find_horspool;
+      }
+      else
+      {
+        find = gum_scan_find_scalar;
+      }
+      break;
+  }
+
+  /*
+   * We search for the longest exact token and verify the rest of the pattern
+   * around each hit, so candidate positions are limited to those where the
+   * whole pattern fits inside the range.
+   */
+  base = GSIZE_TO_POINTER (range->base_address);
+  cur = base + token->offset;
+  end = base + range->size - pattern->size + token->offset + 1;
 
-    if (gum_match_pattern_try_match_on (pattern, start))
+  while (cur < end && (cur = find (cur, end, &needle)) != NULL)
+  {
+    const guint8 * start = cur - token->offset;
+
+    if (gum_match_pattern_try_match_on (pattern, (guint8 *) start))
     {
       if (!func (GUM_ADDRESS (start), pattern->size, user_data))
         return;
 
-      cur = start + pattern->size - 1;
+      cur = start + pattern->size + token->offset;
+    }
+    else
+    {
+      cur++;
     }
   }
 }
 
+void
+gum_memory_scan_multi (const GumMemoryRange * range,
+                       const GumMatchPatternSet * set,
+                       GumMemoryScanMultiMatchFunc func,
+                       gpointer user_data)
+{
+  const guint * transitions;
+  const GumMatchState * states;
+  const guint * outputs;
+  gsize * next_start;
+  const guint8 * base;
+  gsize offset;
+  guint state;
+
+  if (set->patterns->len == 0)
+    return;
+
+  gum_match_pattern_set_ensure_compiled (set);
+
+  transitions = (const guint *) set->transitions->data;
+  states = (const GumMatchState *) set->states->data;
+  outputs = (const guint *) set->outputs->data;
+
+  next_start = g_new0 (gsize, set->patterns->len);
+
+  base = GSIZE_TO_POINTER (range->base_address);
+  state = 0;
+
+  for (offset = 0; offset != range->size; offset++)
+  {
+    const GumMatchState * s;
+    guint i;
+
+    state = transitions[(state << 8) | base[offset]];
+
+    s = &states[state];
+    for (i = 0; i != s->n_outputs; i++)
+    {
+      guint id;
+      const GumMatchPattern * pattern;
+      const GumMatchToken * anchor;
+      gsize anchor_end, start;
+
+      id = outputs[s->first_output + i];
+      pattern = g_ptr_array_index (set->patterns, id);
+      anchor = g_ptr_array_index (set->anchors, id);
+
+      anchor_end = offset + 1;
+      if (anchor_end < anchor->offset + anchor->bytes->len)
+        continue;
+      start = anchor_end - anchor->bytes->len - anchor->offset;
+      if (start < next_start[id] || range->size - start < pattern->size)
+        continue;
+
+      if (gum_match_pattern_try_match_on (pattern, (guint8 *) base + start))
+      {
+        if (!func (id, GUM_ADDRESS (base + start), pattern->size, user_data))
+          goto beach;
+
+        next_start[id] = start + pattern->size;
+      }
+    }
+  }
+
+beach:
+  g_free (next_start);
+}
+
+static GumScanStrategy
+gum_scan_strategy_detect (void)
+{
+#ifdef GUM_HAVE_SIMD_SCAN
+  guint eax, ebx, ecx, edx;
+  gboolean os_saves_ymm = FALSE;
+
+  if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+    return GUM_SCAN_SCALAR;
+
+  if ((ecx & bit_OSXSAVE) != 0 && (ecx & bit_AVX) != 0)
+  {
+    guint xcr0_lo, xcr0_hi;
+
+    __asm__ __volatile__ ("xgetbv"
+        : "=a" (xcr0_lo), "=d" (xcr0_hi)
+        : "c" (0));
+    os_saves_ymm = (xcr0_lo & 0x6) == 0x6;
+  }
+
+  if (os_saves_ymm && __get_cpuid_max (0, NULL) >= 7)
+  {
+    guint leaf7_eax, leaf7_ebx, leaf7_ecx, leaf7_edx;
+
+    __cpuid_count (7, 0, leaf7_eax, leaf7_ebx, leaf7_ecx, leaf7_edx);
+    if ((leaf7_ebx & bit_AVX2) != 0)
+      return GUM_SCAN_AVX2;
+  }
+
+  if ((edx & bit_SSE2) != 0)
+    return GUM_SCAN_SSE2;
+#endif
+
+  return GUM_SCAN_SCALAR;
+}
+
+/*
+ * Each find function returns the first position in [cur, end) where the
+ * needle matches, or NULL. Callers guarantee that needle->size bytes are
+ * readable starting at any position before end.
+ */
+
+static const guint8 *
+gum_scan_find_scalar (const guint8 * cur,
+                      const guint8 * end,
+                      const GumScanNeedle * needle)
+{
+  const guint8 first = needle->data[0];
+
+  while (cur < end)
+  {
+    cur = memchr (cur, first, end - cur);
+    if (cur == NULL)
+      return NULL;
+
+    if (memcmp (cur, needle->data, needle->size) == 0)
+      return cur;
+
+    cur++;
+  }
+
+  return NULL;
+}
+
+static const guint8 *
+gum_scan_find_horspool (const guint8 * cur,
+                        const guint8 * end,
+                        const GumScanNeedle * needle)
+{
+  const gsize last_index = needle->size - 1;
+  const guint8 last = needle->data[last_index];
+
+  while (cur < end)
+  {
+    guint8 b = cur[last_index];
+
+    if (b == last && memcmp (cur, needle->data, last_index) == 0)
+      return cur;
+
+    cur += needle->skip[b];
+  }
+
+  return NULL;
+}
+
+#ifdef GUM_HAVE_SIMD_SCAN
+
+/*
+ * Compare the first and last byte of the needle against a whole block of
+ * candidate positions at once, and only memcmp() where both anchors agree.
+ */
+
+__attribute__ ((target ("sse2"))) static const guint8 *
+gum_scan_find_sse2 (const guint8 * cur,
+                    const guint8 * end,
+                    const GumScanNeedle * needle)
+{
+  const gsize last_index = needle->size - 1;
+  const __m128i first = _mm_set1_epi8 ((gchar) needle->data[0]);
+  const __m128i last = _mm_set1_epi8 ((gchar) needle->data[last_index]);
+
+  for (; end - cur >= 16; cur += 16)
+  {
+    __m128i block_first, block_last;
+    guint mask;
+
+    block_first = _mm_loadu_si128 ((const __m128i *) cur);
+    block_last = _mm_loadu_si128 ((const __m128i *) (cur + last_index));
+
+    mask = (guint) _mm_movemask_epi8 (_mm_and_si128 (
+        _mm_cmpeq_epi8 (block_first, first),
+        _mm_cmpeq_epi8 (block_last, last)));
+
+    while (mask != 0)
+    {
+      const guint8 * candidate = cur + __builtin_ctz (mask);
+
+      if (memcmp (candidate, needle->data, needle->size) == 0)
+        return candidate;
+
+      mask &= mask - 1;
+    }
+  }
+
+  return gum_scan_find_scalar (cur, end, needle);
+}
+
+__attribute__ ((target ("avx2"))) static const guint8 *
+gum_scan_find_avx2 (const guint8 * cur,
+                    const guint8 * end,
+                    const GumScanNeedle * needle)
+{
+  const gsize last_index = needle->size - 1;
+  const __m256i first = _mm256_set1_epi8 ((gchar) needle->data[0]);
+  const __m256i last = _mm256_set1_epi8 ((gchar) needle->data[last_index]);
+
+  for (; end - cur >= 32; cur += 32)
+  {
+    __m256i block_first, block_last;
+    guint mask;
+
+    block_first = _mm256_loadu_si256 ((const __m256i *) cur);
+    block_last = _mm256_loadu_si256 ((const __m256i *) (cur + last_index));
+
+    mask = (guint) _mm256_movemask_epi8 (_mm256_and_si256 (
+        _mm256_cmpeq_epi8 (block_first, first),
+        _mm256_cmpeq_epi8 (block_last, last)));
+
+    while (mask != 0)
+    {
+      const guint8 * candidate = cur + __builtin_ctz (mask);
+
+      if (memcmp (candidate, needle->data, needle->size) == 0)
+        return candidate;
+
+      mask &= mask - 1;
+    }
+  }
+
+  return gum_scan_find_sse2 (cur, end, needle);
+}
+
+#endif
+
 GumMatchPattern *
 gum_match_pattern_new_from_string (const gchar * match_str)
 {
@@ -257,6 +622,12 @@ gum_match_pattern_free (GumMatchPattern * pattern)
   g_slice_free (GumMatchPattern, pattern);
 }
 
+guint
+gum_match_pattern_get_size (const GumMatchPattern * pattern)
+{
+  return pattern->size;
+}
+
 static void
 gum_match_pattern_update_computed_size (GumMatchPattern * self)
 {
@@ -386,6 +757,208 @@ gum_match_token_append (GumMatchToken * self,
   g_array_append_val (self->bytes, byte);
 }
 
+GumMatchPatternSet *
+gum_match_pattern_set_new (void)
+{
+  GumMatchPatternSet * set;
+
+  set = g_slice_new (GumMatchPatternSet);
+  set->patterns =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gum_match_pattern_free);
+  set->anchors = g_ptr_array_new ();
+
+  g_mutex_init (&set->mutex);
+  set->dirty = FALSE;
+  set->transitions = g_array_new (FALSE, FALSE, sizeof (guint));
+  set->states = g_array_new (FALSE, FALSE, sizeof (GumMatchState));
+  set->outputs = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  return set;
+}
+
+void
+gum_match_pattern_set_free (GumMatchPatternSet * set)
+{
+  g_array_free (set->outputs, TRUE);
+  g_array_free (set->states, TRUE);
+  g_array_free (set->transitions, TRUE);
+  g_mutex_clear (&set->mutex);
+
+  g_ptr_array_free (set->anchors, TRUE);
+  g_ptr_array_free (set->patterns, TRUE);
+
+  g_slice_free (GumMatchPatternSet, set);
+}
+
+guint
+gum_match_pattern_set_add (GumMatchPatternSet * self,
+                           GumMatchPattern * pattern)
+{
+  guint id;
+
+  id = self->patterns->len;
+
+  g_ptr_array_add (self->patterns, pattern);
+  g_ptr_array_add (self->anchors,
+      gum_match_pattern_get_longest_token (pattern, GUM_MATCH_EXACT));
+
+  g_atomic_int_set (&self->dirty, TRUE);
+
+  return id;
+}
+
+guint
+gum_match_pattern_set_size (const GumMatchPatternSet * self)
+{
+  return self->patterns->len;
+}
+
+/*
+ * The automaton is rebuilt on the first scan after patterns were added, so
+ * that populating a set stays linear. Concurrent scans of the same set are
+ * fine, but adding patterns while scanning is not.
+ */
+static void
+gum_match_pattern_set_ensure_compiled (const GumMatchPatternSet * self)
+{
+  GumMatchPatternSet * set = (GumMatchPatternSet *) self;
+
+  if (!g_atomic_int_get (&set->dirty))
+    return;
+
+  g_mutex_lock (&set->mutex);
+  if (set->dirty)
+  {
+    gum_match_pattern_set_compile (set);
+    g_atomic_int_set (&set->dirty, FALSE);
+  }
+  g_mutex_unlock (&set->mutex);
+}
+
+/*
+ * Builds an Aho-Corasick automaton over the longest exact token of each
+ * pattern, with the failure links folded into a full transition table so
+ * that scanning costs one lookup per byte. Each state's outputs include
+ * those of its failure state, so no chain walking is needed at scan time.
+ */
+static void
+gum_match_pattern_set_compile (GumMatchPatternSet * self)
+{
+  GArray * transitions = self->transitions;
+  GArray * states = self->states;
+  guint * own_next;
+  GArray * queue;
+  guint id, head;
+  GumMatchState root = { 0, 0, 0 };
+
+  g_array_set_size (transitions, 0);
+  g_array_set_size (states, 0);
+  g_array_set_size (self->outputs, 0);
+
+  g_array_append_val (states, root);
+  g_array_set_size (transitions, 256);
+  memset (transitions->data, 0xff, 256 * sizeof (guint));
+
+  /*
+   * While building the trie, first_output holds a 1-based index into
+   * own_next, chaining together the patterns whose anchor ends there.
+   */
+  own_next = g_new (guint, self->patterns->len);
+
+  for (id = self->anchors->len; id-- != 0;)
+  {
+    const GumMatchToken * anchor;
+    guint state, i;
+
+    anchor = g_ptr_array_index (self->anchors, id);
+
+    state = 0;
+    for (i = 0; i != anchor->bytes->len; i++)
+    {
+      guint8 b = g_array_index (anchor->bytes, guint8, i);
+      guint * next = &g_array_index (transitions, guint, (state << 8) | b);
+
+      if (*next == GUM_MATCH_STATE_NONE)
+      {
+        *next = states->len;
+
+        g_array_append_val (states, root);
+        g_array_set_size (transitions, transitions->len + 256);
+        memset (&g_array_index (transitions, guint, transitions->len - 256),
+            0xff, 256 * sizeof (guint));
+
+        next = &g_array_index (transitions, guint, (state << 8) | b);
+      }
+
+      state = *next;
+    }
+
+    own_next[id] = g_array_index (states, GumMatchState, state).first_output;
+    g_array_index (states, GumMatchState, state).first_output = id + 1;
+  }
+
+  queue = g_array_new (FALSE, FALSE, sizeof (guint));
+  head = 0;
+  g_array_append_val (queue, head);
+
+  for (head = 0; head != queue->len; head++)
+  {
+    guint state, failure, c;
+    GumMatchState * s;
+    guint own, first_output;
+
+    state = g_array_index (queue, guint, head);
+    s = &g_array_index (states, GumMatchState, state);
+    failure = s->failure;
+
+    first_output = self->outputs->len;
+    for (own = s->first_output; own != 0; own = own_next[own - 1])
+    {
+      guint pattern_id = own - 1;
+
+      g_array_append_val (self->outputs, pattern_id);
+    }
+    if (state != 0)
+    {
+      const GumMatchState * f = &g_array_index (states, GumMatchState, failure);
+      guint i;
+
+      for (i = 0; i != f->n_outputs; i++)
+      {
+        guint pattern_id =
+            g_array_index (self->outputs, guint, f->first_output + i);
+
+        g_array_append_val (self->outputs, pattern_id);
+      }
+    }
+    s->first_output = first_output;
+    s->n_outputs = self->outputs->len - first_output;
+
+    for (c = 0; c != 256; c++)
+    {
+      guint * next = &g_array_index (transitions, guint, (state << 8) | c);
+      guint fallback;
+
+      fallback = (state != 0)
+          ? g_array_index (transitions, guint, (failure << 8) | c)
+          : 0;
+
+      if (*next == GUM_MATCH_STATE_NONE)
+      {
+        *next = fallback;
+      }
+      else
+      {
+        g_array_index (states, GumMatchState, *next).failure = fallback;
+        g_array_append_val (queue, *next);
+      }
+    }
+  }
+
+  g_array_free (queue, TRUE);
+  g_free (own_next);
+}
+
 void
 gum_mprotect (gpointer address,
               gsize size,
@@ -400,36 +973,49 @@ gum_mprotect (gpointer address,
 guint
 gum_peek_private_memory_usage (void)
 {
-  struct mallinfo info;
+  gsize total = 0;
+  guint i;
+
+  gum_arenas_ensure_initialized ();
 
-  info = mspace_mallinfo (gum_mspace_get ());
+  for (i = 0; i != gum_arena_count; i++)
+  {
+    GumArena * arena = &gum_arenas[i];
+    struct mallinfo info;
+
+    gum_arena_drain_remote_frees (arena);
+
+    info = mspace_mallinfo (arena->space);
+    total += info.uordblks;
+  }
 
-  return (guint) info.uordblks;
+  return (guint) total;
 }
 
 gpointer
 gum_malloc (gsize size)
 {
-  return mspace_malloc (gum_mspace_get (), size);
+  return mspace_malloc (gum_arena_get_current ()->space, size);
 }
 
 gpointer
 gum_malloc0 (gsize size)
 {
-  return mspace_calloc (gum_mspace_get (), 1, size);
+  return mspace_calloc (gum_arena_get_current ()->space, 1, size);
 }
 
 gpointer
 gum_calloc (gsize count, gsize size)
 {
-  return mspace_calloc (gum_mspace_get (), count, size);
+  return mspace_calloc (gum_arena_get_current ()->space, count, size);
 }
 
 gpointer
 gum_realloc (gpointer mem,
              gsize size)
 {
-  return mspace_realloc (gum_mspace_get (), mem, size);
+  /* With FOOTERS the block is resized within the mspace that owns it */
+  return mspace_realloc (gum_arena_get_current ()->space, mem, size);
 }
 
 gpointer
@@ -438,7 +1024,7 @@ gum_memdup (gconstpointer mem,
 {
   gpointer result;
 
-  result = mspace_malloc (gum_mspace_get (), byte_size);
+  result = mspace_malloc (gum_arena_get_current ()->space, byte_size);
   memcpy (result, mem, byte_size);
 
   return result;
@@ -447,7 +1033,114 @@ gum_memdup (gconstpointer mem,
 void
 gum_free (gpointer mem)
 {
-  mspace_free (gum_mspace_get (), mem);
+  GumArena * owner;
+  gpointer head;
+
+  if (mem == NULL)
+    return;
+
+  owner = gum_arena_find_owner (mem);
+  if (owner == gum_arena_get_current ())
+  {
+    mspace_free (owner->space, mem);
+    return;
+  }
+
+  do
+  {
+    head = g_atomic_pointer_get (&owner->remote_frees);
+    *((gpointer *) mem) = head;
+  }
+  while (!g_atomic_pointer_compare_and_exchange (&owner->remote_frees, head,
+      mem));
+}
+
+static void
+gum_arenas_ensure_initialized (void)
+{
+  if (g_once_init_enter (&gum_arenas_initialized))
+  {
+    guint count, i;
+
+    count = MIN (MAX (g_get_num_processors (), 1), GUM_MAX_ARENAS);
+    for (i = 0; i != count; i++)
+    {
+      GumArena * arena = &gum_arenas[i];
+
+      arena->space = create_mspace (0, TRUE);
+      arena->remote_frees = NULL;
+    }
+
+    gum_arena_key = gum_tls_key_new ();
+
+    gum_arena_count = count;
+
+    g_once_init_leave (&gum_arenas_initialized, TRUE);
+  }
+}
+
+static GumArena *
+gum_arena_get_current (void)
+{
+  GumArena * arena;
+
+  gum_arenas_ensure_initialized ();
+
+  arena = gum_tls_key_get_value (gum_arena_key);
+  if (G_UNLIKELY (arena == NULL))
+  {
+    guint index;
+
+    index = (guint) g_atomic_int_add (&gum_arena_next_index, 1);
+    arena = &gum_arenas[index % gum_arena_count];
+    gum_tls_key_set_value (gum_arena_key, arena);
+  }
+
+  if (G_UNLIKELY (g_atomic_pointer_get (&arena->remote_frees) != NULL))
+    gum_arena_drain_remote_frees (arena);
+
+  return arena;
+}
+
+static GumArena *
+gum_arena_find_owner (gpointer mem)
+{
+  mstate owner_space;
+  guint i;
+
+  owner_space = get_mstate_for (mem2chunk (mem));
+
+  for (i = 0; i != gum_arena_count; i++)
+  {
+    if (gum_arenas[i].space == (mspace) owner_space)
+      return &gum_arenas[i];
+  }
+
+  g_assert_not_reached ();
+
+  return NULL;
+}
+
+static void
+gum_arena_drain_remote_frees (GumArena * self)
+{
+  gpointer block;
+
+  do
+  {
+    block = g_atomic_pointer_get (&self->remote_frees);
+  }
+  while (!g_atomic_pointer_compare_and_exchange (&self->remote_frees, block,
+      NULL));
+
+  while (block != NULL)
+  {
+    gpointer next = *((gpointer *) block);
+
+    mspace_free (self->space, block);
+
+    block = next;
+  }
 }
 
 gpointer
@@ -15,6 +15,7 @@ typedef guint GumPageProtection;
 typedef struct _GumAddressSpec GumAddressSpec;
 typedef struct _GumMemoryRange GumMemoryRange;
 typedef struct _GumMatchPattern GumMatchPattern;
+typedef struct _GumMatchPatternSet GumMatchPatternSet;
 
 typedef gboolean (* GumMemoryIsNearFunc) (gpointer memory, gpointer address);
 
@@ -57,6 +58,8 @@ G_BEGIN_DECLS
 
 typedef gboolean (* GumMemoryScanMatchFunc) (GumAddress address, gsize size,
     gpointer user_data);
+typedef gboolean (* GumMemoryScanMultiMatchFunc) (guint pattern_id,
+    GumAddress address, gsize size, gpointer user_data);
 
 void gum_memory_init (void);
 void gum_memory_deinit (void);
@@ -73,6 +76,17 @@ void gum_memory_scan (const GumMemoryRange * range,
 
 GumMatchPattern * gum_match_pattern_new_from_string (const gchar * match_str);
 void gum_match_pattern_free (GumMatchPattern * pattern);
+guint gum_match_pattern_get_size (const GumMatchPattern * pattern);
+
+void gum_memory_scan_multi (const GumMemoryRange * range,
+    const GumMatchPatternSet * set,
+    GumMemoryScanMultiMatchFunc func, gpointer user_data);
+
+GumMatchPatternSet * gum_match_pattern_set_new (void);
+void gum_match_pattern_set_free (GumMatchPatternSet * set);
+guint gum_match_pattern_set_add (GumMatchPatternSet * self,
+    GumMatchPattern * pattern);
+guint gum_match_pattern_set_size (const GumMatchPatternSet * self);
 
 void gum_mprotect (gpointer address, gsize size, GumPageProtection page_prot);
 gboolean gum_try_mprotect (gpointer address, gsize size, GumPageProtection page_prot);
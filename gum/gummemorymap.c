@@ -8,8 +8,6 @@
 
 #include "gumprocess.h"
 
-typedef struct _GumUpdateMemoryRangesContext GumUpdateMemoryRangesContext;
-
 struct _GumMemoryMapPrivate
 {
   GumPageProtection prot;
@@ -18,16 +16,19 @@ struct _GumMemoryMapPrivate
   gsize ranges_max;
 };
 
-struct _GumUpdateMemoryRangesContext
-{
-  GArray * ranges;
-  gint prev_range_index;
-};
-
 static void gum_memory_map_finalize (GObject * object);
 
 static gboolean gum_memory_map_add_range (const GumRangeDetails * details,
     gpointer user_data);
+static gint gum_memory_range_compare_base (const GumMemoryRange * lhs,
+    const GumMemoryRange * rhs);
+
+/*
+ * The index of the range each thread last hit, plus one, so that lookups
+ * don't write to memory shared with other threads. It is only a hint: the
+ * range is always checked, so it is fine for it to refer to another map.
+ */
+static GPrivate gum_memory_map_last_hit = G_PRIVATE_INIT (NULL);
 
 G_DEFINE_TYPE (GumMemoryMap, gum_memory_map, G_TYPE_OBJECT);
 
@@ -78,47 +79,115 @@ gum_memory_map_contains (GumMemoryMap * self,
                          const GumMemoryRange * range)
 {
   GumMemoryMapPrivate * priv = self->priv;
+  GArray * ranges = priv->ranges;
   const GumAddress start = range->base_address;
   const GumAddress end = range->base_address + range->size;
-  guint i;
+  const GumMemoryRange * r;
+  guint last_hit;
+  guint lo, hi;
 
   if (start < priv->ranges_min)
     return FALSE;
   else if (end > priv->ranges_max)
     return FALSE;
 
-  for (i = 0; i < priv->ranges->len; i++)
+  last_hit = GPOINTER_TO_UINT (g_private_get (&gum_memory_map_last_hit));
+  if (last_hit != 0 && last_hit <= ranges->len)
   {
-    GumMemoryRange * r = &g_array_index (priv->ranges, GumMemoryRange, i);
+    r = &g_array_index (ranges, GumMemoryRange, last_hit - 1);
     if (start >= r->base_address && end <= r->base_address + r->size)
       return TRUE;
   }
 
-  return FALSE;
+  /*
+   * The ranges are sorted and adjacent ones are merged, so the only
+   * candidate is the last range starting at or below the start address.
+   */
+  lo = 0;
+  hi = ranges->len;
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (g_array_index (ranges, GumMemoryRange, mid).base_address <= start)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    return FALSE;
+
+  r = &g_array_index (ranges, GumMemoryRange, lo - 1);
+  if (end > r->base_address + r->size)
+    return FALSE;
+
+  g_private_set (&gum_memory_map_last_hit, GUINT_TO_POINTER (lo));
+
+  return TRUE;
+}
+
+guint
+gum_memory_map_contains_many (GumMemoryMap * self,
+                              const GumMemoryRange * ranges,
+                              guint n_ranges,
+                              gboolean * results)
+{
+  guint n_contained, i;
+
+  n_contained = 0;
+
+  for (i = 0; i != n_ranges; i++)
+  {
+    results[i] = gum_memory_map_contains (self, &ranges[i]);
+    if (results[i])
+      n_contained++;
+  }
+
+  return n_contained;
 }
 
 void
 gum_memory_map_update (GumMemoryMap * self)
 {
   GumMemoryMapPrivate * priv = self->priv;
-  GumUpdateMemoryRangesContext ctx;
-
-  ctx.ranges = priv->ranges;
-  ctx.prev_range_index = -1;
+  GArray * ranges = priv->ranges;
 
-  g_array_set_size (priv->ranges, 0);
+  g_array_set_size (ranges, 0);
 
-  gum_process_enumerate_ranges (priv->prot, gum_memory_map_add_range, &ctx);
+  gum_process_enumerate_ranges (priv->prot, gum_memory_map_add_range, ranges);
 
-  if (priv->ranges->len > 0)
+  if (ranges->len > 0)
   {
-    GumMemoryRange * first_range, * last_range;
-
-    first_range = &g_array_index (priv->ranges, GumMemoryRange, 0);
-    last_range = &g_array_index (priv->ranges, GumMemoryRange,
-        priv->ranges->len - 1);
-
-    priv->ranges_min = first_range->base_address;
+    guint i, n;
+    GumMemoryRange * last_range;
+
+    g_array_sort (ranges, (GCompareFunc) gum_memory_range_compare_base);
+
+    n = 1;
+    for (i = 1; i != ranges->len; i++)
+    {
+      GumMemoryRange * prev = &g_array_index (ranges, GumMemoryRange, n - 1);
+      GumMemoryRange * cur = &g_array_index (ranges, GumMemoryRange, i);
+      GumAddress prev_end = prev->base_address + prev->size;
+
+      if (cur->base_address <= prev_end)
+      {
+        GumAddress cur_end = cur->base_address + cur->size;
+
+        if (cur_end > prev_end)
+          prev->size = cur_end - prev->base_address;
+      }
+      else
+      {
+        g_array_index (ranges, GumMemoryRange, n++) = *cur;
+      }
+    }
+    g_array_set_size (ranges, n);
+
+    last_range = &g_array_index (ranges, GumMemoryRange, n - 1);
+
+    priv->ranges_min = g_array_index (ranges, GumMemoryRange, 0).base_address;
     priv->ranges_max = last_range->base_address + last_range->size;
   }
   else
@@ -132,24 +201,21 @@ static gboolean
 gum_memory_map_add_range (const GumRangeDetails * details,
                           gpointer user_data)
 {
-  GumUpdateMemoryRangesContext * ctx =
-      (GumUpdateMemoryRangesContext *) user_data;
-  GArray * ranges = ctx->ranges;
-  const GumMemoryRange * cur = details->range;
-  GumMemoryRange * prev;
-
-  if (ctx->prev_range_index >= 0)
-    prev = &g_array_index (ranges, GumMemoryRange, ctx->prev_range_index);
-  else
-    prev = NULL;
-
-  if (prev != NULL && cur->base_address == prev->base_address + prev->size)
-    prev->size += cur->size;
-  else
-    g_array_append_val (ranges, *cur);
+  GArray * ranges = (GArray *) user_data;
 
-  ctx->prev_range_index = ranges->len - 1;
+  g_array_append_val (ranges, *details->range);
 
   return TRUE;
 }
 
+static gint
+gum_memory_range_compare_base (const GumMemoryRange * lhs,
+                               const GumMemoryRange * rhs)
+{
+  if (lhs->base_address < rhs->base_address)
+    return -1;
+  else if (lhs->base_address > rhs->base_address)
+    return 1;
+  else
+    return 0;
+}
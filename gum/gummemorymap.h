@@ -48,6 +48,8 @@ GUM_API GumMemoryMap * gum_memory_map_new (GumPageProtection prot);
 
 GUM_API gboolean gum_memory_map_contains (GumMemoryMap * self,
     const GumMemoryRange * range);
+GUM_API guint gum_memory_map_contains_many (GumMemoryMap * self,
+    const GumMemoryRange * ranges, guint n_ranges, gboolean * results);
 
 GUM_API void gum_memory_map_update (GumMemoryMap * self);
 
@@ -6,12 +6,27 @@
 
 #include "gummoduleapiresolver.h"
 
+#include "gum-init.h"
 #include "gumprocess.h"
+#include "gumprocess-priv.h"
 
+#include <string.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#define GUM_EXPORT_INDEX_CACHE_FORMAT "a{sa(st)}"
+#define GUM_TRIGRAM(s) \
+    (((guint32) (guint8) (s)[0] << 16) | \
+     ((guint32) (guint8) (s)[1] << 8) | \
+      (guint32) (guint8) (s)[2])
 
 typedef struct _GumModuleMetadata GumModuleMetadata;
 typedef struct _GumFunctionMetadata GumFunctionMetadata;
+typedef struct _GumExportIndex GumExportIndex;
+typedef struct _GumExportIndexEntry GumExportIndexEntry;
+
+typedef gboolean (* GumFoundExportIndexEntryFunc) (
+    const GumExportIndexEntry * entry, gpointer user_data);
 
 struct _GumModuleApiResolver
 {
@@ -19,6 +34,7 @@ struct _GumModuleApiResolver
 
   GRegex * query_pattern;
 
+  GPtrArray * modules;
   GHashTable * module_by_name;
 };
 
@@ -28,9 +44,10 @@ struct _GumModuleMetadata
 
   gchar * name;
   gchar * path;
+  GumAddress base;
 
   GHashTable * import_by_name;
-  GHashTable * export_by_name;
+  GumExportIndex * exports;
 };
 
 struct _GumFunctionMetadata
@@ -40,32 +57,87 @@ struct _GumFunctionMetadata
   gchar * module;
 };
 
+struct _GumExportIndex
+{
+  volatile gint ref_count;
+
+  gchar * key;
+  gboolean persistent;
+
+  GStringChunk * names;
+  GArray * entries;
+  GHashTable * volatile trigrams;
+};
+
+struct _GumExportIndexEntry
+{
+  const gchar * name;
+  GumAddress offset;
+};
+
 static void gum_module_api_resolver_iface_init (gpointer g_iface,
     gpointer iface_data);
 static void gum_module_api_resolver_finalize (GObject * object);
 static void gum_module_api_resolver_enumerate_matches (
     GumApiResolver * resolver, const gchar * query, GumFoundApiFunc func,
     gpointer user_data, GError ** error);
+static gboolean gum_module_api_resolver_emit_functions (
+    GumModuleMetadata * module, gboolean imports, const gchar * pattern,
+    GPatternSpec * spec, GumFoundApiFunc func, gpointer user_data);
+static gboolean gum_module_api_resolver_emit_export (
+    const GumExportIndexEntry * entry, gpointer user_data);
 
-static GPatternSpec * gum_pattern_spec_from_match_info (GMatchInfo * match_info,
-    gint match_num);
+static gboolean gum_pattern_is_literal (const gchar * pattern);
 
-static GHashTable * gum_module_api_resolver_create_snapshot (void);
+static void gum_module_api_resolver_create_snapshot (
+    GumModuleApiResolver * self);
 static gboolean gum_module_api_resolver_collect_module (
     const GumModuleDetails * details, gpointer user_data);
 
 static void gum_module_metadata_unref (GumModuleMetadata * module);
 static GHashTable * gum_module_metadata_get_imports (GumModuleMetadata * self);
-static GHashTable * gum_module_metadata_get_exports (GumModuleMetadata * self);
+static GumExportIndex * gum_module_metadata_get_exports (
+    GumModuleMetadata * self);
 static gboolean gum_module_metadata_collect_import (
     const GumImportDetails * details, gpointer user_data);
-static gboolean gum_module_metadata_collect_export (
-    const GumExportDetails * details, gpointer user_data);
 
 static GumFunctionMetadata * gum_function_metadata_new (const gchar * name,
     GumAddress address, const gchar * module);
 static void gum_function_metadata_free (GumFunctionMetadata * function);
 
+static GumExportIndex * gum_export_index_obtain (const gchar * path,
+    GumAddress base);
+static GumExportIndex * gum_export_index_new_from_module (const gchar * path,
+    GumAddress base);
+static GumExportIndex * gum_export_index_new_from_variant (GVariant * exports);
+static GumExportIndex * gum_export_index_new (void);
+static void gum_export_index_add (GumExportIndex * self, const gchar * name,
+    GumAddress offset);
+static void gum_export_index_seal (GumExportIndex * self);
+static GumExportIndex * gum_export_index_ref (GumExportIndex * index);
+static void gum_export_index_unref (GumExportIndex * index);
+static gboolean gum_collect_export (const GumExportDetails * details,
+    gpointer user_data);
+static gboolean gum_export_index_foreach_match (GumExportIndex * self,
+    const gchar * pattern, GPatternSpec * spec,
+    GumFoundExportIndexEntryFunc func, gpointer user_data);
+static guint gum_export_index_lower_bound (GumExportIndex * self,
+    const gchar * prefix, gsize prefix_length);
+static GHashTable * gum_export_index_get_trigrams (GumExportIndex * self);
+static GVariant * gum_export_index_to_variant (GumExportIndex * self);
+static gint gum_export_index_entry_compare (const GumExportIndexEntry * lhs,
+    const GumExportIndexEntry * rhs);
+
+static void gum_export_index_cache_evict (GumExportIndex * index);
+static void gum_export_index_cache_save (void);
+static void gum_export_index_cache_deinit (void);
+
+G_LOCK_DEFINE_STATIC (gum_export_index_cache);
+static GHashTable * gum_export_index_cache = NULL;
+static gchar * gum_export_index_cache_file = NULL;
+static GHashTable * gum_export_index_cache_stored = NULL;
+static gboolean gum_export_index_cache_dirty = FALSE;
+
 G_DEFINE_TYPE_EXTENDED (GumModuleApiResolver,
                         gum_module_api_resolver,
                         G_TYPE_OBJECT,
@@ -97,7 +169,7 @@ gum_module_api_resolver_init (GumModuleApiResolver * self)
 {
   self->query_pattern = g_regex_new ("(imports|exports):(.+)!(.+)", 0, 0, NULL);
 
-  self->module_by_name = gum_module_api_resolver_create_snapshot ();
+  gum_module_api_resolver_create_snapshot (self);
 }
 
 static void
@@ -106,9 +178,12 @@ gum_module_api_resolver_finalize (GObject * object)
   GumModuleApiResolver * self = GUM_MODULE_API_RESOLVER (object);
 
   g_hash_table_unref (self->module_by_name);
+  g_ptr_array_unref (self->modules);
 
   g_regex_unref (self->query_pattern);
 
+  gum_export_index_cache_save ();
+
   G_OBJECT_CLASS (gum_module_api_resolver_parent_class)->finalize (object);
 }
 
@@ -118,6 +193,54 @@ gum_module_api_resolver_new (void)
   return g_object_new (GUM_TYPE_MODULE_API_RESOLVER, NULL);
 }
 
+/*
+ * Exports of modules with an ELF build ID are written to this file when a
+ * resolver is finalized, and loaded from it instead of being enumerated
+ * again, also by later processes. Pass NULL to stop using a file.
+ */
+void
+gum_module_api_resolver_set_cache_file (const gchar * path)
+{
+  GHashTable * stored = NULL;
+  gchar * contents;
+  gsize length;
+
+  if (path != NULL && g_file_get_contents (path, &contents, &length, NULL))
+  {
+    GVariant * cache;
+    GVariantIter iter;
+    gchar * key;
+    GVariant * exports;
+
+    cache = g_variant_new_from_data (
+        G_VARIANT_TYPE (GUM_EXPORT_INDEX_CACHE_FORMAT), contents, length,
+        FALSE, g_free, contents);
+    g_variant_ref_sink (cache);
+
+    stored = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) g_variant_unref);
+
+    g_variant_iter_init (&iter, cache);
+    while (g_variant_iter_next (&iter, "{s@a(st)}", &key, &exports))
+      g_hash_table_insert (stored, key, exports);
+
+    g_variant_unref (cache);
+  }
+
+  G_LOCK (gum_export_index_cache);
+
+  g_free (gum_export_index_cache_file);
+  gum_export_index_cache_file = g_strdup (path);
+
+  if (gum_export_index_cache_stored != NULL)
+    g_hash_table_unref (gum_export_index_cache_stored);
+  gum_export_index_cache_stored = stored;
+
+  gum_export_index_cache_dirty = FALSE;
+
+  G_UNLOCK (gum_export_index_cache);
+}
+
 static void
 gum_module_api_resolver_enumerate_matches (GumApiResolver * resolver,
                                            const gchar * query,
@@ -127,117 +250,186 @@ gum_module_api_resolver_enumerate_matches (GumApiResolver * resolver,
 {
   GumModuleApiResolver * self = GUM_MODULE_API_RESOLVER (resolver);
   GMatchInfo * query_info;
-  gchar * collection;
+  gchar * collection, * module_pattern, * function_pattern;
   GPatternSpec * module_spec, * function_spec;
-  GHashTableIter module_iter;
-  gboolean carry_on;
-  GumModuleMetadata * module;
+  gboolean imports, carry_on;
+  guint i;
 
   g_regex_match (self->query_pattern, query, 0, &query_info);
   if (!g_match_info_matches (query_info))
     goto invalid_query;
 
   collection = g_match_info_fetch (query_info, 1);
-  module_spec = gum_pattern_spec_from_match_info (query_info, 2);
-  function_spec = gum_pattern_spec_from_match_info (query_info, 3);
+  module_pattern = g_match_info_fetch (query_info, 2);
+  function_pattern = g_match_info_fetch (query_info, 3);
+  module_spec = g_pattern_spec_new (module_pattern);
+  function_spec = g_pattern_spec_new (function_pattern);
 
-  g_hash_table_iter_init (&module_iter, self->module_by_name);
-  carry_on = TRUE;
-  while (carry_on &&
-      g_hash_table_iter_next (&module_iter, NULL, (gpointer *) &module))
+  imports = collection[0] == 'i';
+
+  if (gum_pattern_is_literal (module_pattern))
   {
-    if (g_pattern_match_string (module_spec, module->name) ||
-        g_pattern_match_string (module_spec, module->path))
-    {
-      GHashTable * functions;
-      GHashTableIter function_iter;
-      GumFunctionMetadata * function;
+    GumModuleMetadata * module;
 
-      functions = (collection[0] == 'i')
-          ? gum_module_metadata_get_imports (module)
-          : gum_module_metadata_get_exports (module);
+    module = g_hash_table_lookup (self->module_by_name, module_pattern);
+    if (module != NULL)
+    {
+      gum_module_api_resolver_emit_functions (module, imports,
+          function_pattern, function_spec, func, user_data);
+    }
+  }
+  else
+  {
+    carry_on = TRUE;
+    for (i = 0; i != self->modules->len && carry_on; i++)
+    {
+      GumModuleMetadata * module = g_ptr_array_index (self->modules, i);
 
-      g_hash_table_iter_init (&function_iter, functions);
-      while (carry_on &&
-          g_hash_table_iter_next (&function_iter, NULL, (gpointer *) &function))
+      if (g_pattern_match_string (module_spec, module->name) ||
+          g_pattern_match_string (module_spec, module->path))
       {
-        if (g_pattern_match_string (function_spec, function->name))
-        {
-          GumApiDetails details;
-
-          details.name = g_strconcat (
-              (function->module != NULL) ? function->module : module->path,
-              "!",
-              function->name,
-              NULL);
-          details.address = function->address;
-
-          carry_on = func (&details, user_data);
-
-          g_free ((gpointer) details.name);
-        }
+        carry_on = gum_module_api_resolver_emit_functions (module, imports,
+            function_pattern, function_spec, func, user_data);
       }
     }
   }
 
   g_pattern_spec_free (function_spec);
   g_pattern_spec_free (module_spec);
+  g_free (function_pattern);
+  g_free (module_pattern);
   g_free (collection);
 
+  g_match_info_free (query_info);
+
   return;
 
 invalid_query:
   {
+    g_match_info_free (query_info);
+
     g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
         "invalid query; format is: "
         "exports:*!open*, exports:libc.so!* or imports:notepad.exe!*");
   }
 }
 
-static GPatternSpec *
-gum_pattern_spec_from_match_info (GMatchInfo * match_info,
-                                  gint match_num)
+typedef struct _GumEmitExportContext GumEmitExportContext;
+
+struct _GumEmitExportContext
+{
+  GumModuleMetadata * module;
+  GumFoundApiFunc func;
+  gpointer user_data;
+};
+
+static gboolean
+gum_module_api_resolver_emit_functions (GumModuleMetadata * module,
+                                        gboolean imports,
+                                        const gchar * pattern,
+                                        GPatternSpec * spec,
+                                        GumFoundApiFunc func,
+                                        gpointer user_data)
+{
+  gboolean carry_on = TRUE;
+
+  if (imports)
+  {
+    GHashTableIter function_iter;
+    GumFunctionMetadata * function;
+
+    g_hash_table_iter_init (&function_iter,
+        gum_module_metadata_get_imports (module));
+    while (carry_on &&
+        g_hash_table_iter_next (&function_iter, NULL, (gpointer *) &function))
+    {
+      if (g_pattern_match_string (spec, function->name))
+      {
+        GumApiDetails details;
+
+        details.name = g_strconcat (
+            (function->module != NULL) ? function->module : module->path,
+            "!",
+            function->name,
+            NULL);
+        details.address = function->address;
+
+        carry_on = func (&details, user_data);
+
+        g_free ((gpointer) details.name);
+      }
+    }
+  }
+  else
+  {
+    GumEmitExportContext ctx;
+
+    ctx.module = module;
+    ctx.func = func;
+    ctx.user_data = user_data;
+
+    carry_on = gum_export_index_foreach_match (
+        gum_module_metadata_get_exports (module), pattern, spec,
+        gum_module_api_resolver_emit_export, &ctx);
+  }
+
+  return carry_on;
+}
+
+static gboolean
+gum_module_api_resolver_emit_export (const GumExportIndexEntry * entry,
+                                     gpointer user_data)
 {
-  gchar * pattern;
-  GPatternSpec * spec;
+  GumEmitExportContext * ctx = user_data;
+  GumApiDetails details;
+  gboolean carry_on;
+
+  details.name = g_strconcat (ctx->module->path, "!", entry->name, NULL);
+  details.address = ctx->module->base + entry->offset;
+
+  carry_on = ctx->func (&details, ctx->user_data);
 
-  pattern = g_match_info_fetch (match_info, match_num);
-  spec = g_pattern_spec_new (pattern);
-  g_free (pattern);
+  g_free ((gpointer) details.name);
 
-  return spec;
+  return carry_on;
 }
 
-static GHashTable *
-gum_module_api_resolver_create_snapshot (void)
+static gboolean
+gum_pattern_is_literal (const gchar * pattern)
 {
-  GHashTable * module_by_name;
+  return strpbrk (pattern, "*?") == NULL;
+}
 
-  module_by_name = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+static void
+gum_module_api_resolver_create_snapshot (GumModuleApiResolver * self)
+{
+  self->modules = g_ptr_array_new_with_free_func (
       (GDestroyNotify) gum_module_metadata_unref);
+  self->module_by_name = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) gum_module_metadata_unref);
 
   gum_process_enumerate_modules (gum_module_api_resolver_collect_module,
-      module_by_name);
-
-  return module_by_name;
+      self);
 }
 
 static gboolean
 gum_module_api_resolver_collect_module (const GumModuleDetails * details,
                                         gpointer user_data)
 {
-  GHashTable * module_by_name = user_data;
+  GumModuleApiResolver * self = user_data;
   GumModuleMetadata * module;
 
   module = g_slice_new (GumModuleMetadata);
-  module->ref_count = 2;
+  module->ref_count = 3;
   module->name = g_strdup (details->name);
   module->path = g_strdup (details->path);
+  module->base = details->range->base_address;
   module->import_by_name = NULL;
-  module->export_by_name = NULL;
+  module->exports = NULL;
 
-  g_hash_table_insert (module_by_name, g_strdup (module->name), module);
-  g_hash_table_insert (module_by_name, g_strdup (module->path), module);
+  g_ptr_array_add (self->modules, module);
+  g_hash_table_insert (self->module_by_name, g_strdup (module->name), module);
+  g_hash_table_insert (self->module_by_name, g_strdup (module->path), module);
 
   return TRUE;
 }
@@ -248,8 +440,8 @@ gum_module_metadata_unref (GumModuleMetadata * module)
   module->ref_count--;
   if (module->ref_count == 0)
   {
-    if (module->export_by_name != NULL)
-      g_hash_table_unref (module->export_by_name);
+    if (module->exports != NULL)
+      gum_export_index_unref (module->exports);
 
     if (module->import_by_name != NULL)
       g_hash_table_unref (module->import_by_name);
@@ -275,18 +467,13 @@ gum_module_metadata_get_imports (GumModuleMetadata * self)
   return self->import_by_name;
 }
 
-static GHashTable *
+static GumExportIndex *
 gum_module_metadata_get_exports (GumModuleMetadata * self)
 {
-  if (self->export_by_name == NULL)
-  {
-    self->export_by_name = g_hash_table_new_full (g_str_hash, g_str_equal,
-        g_free, (GDestroyNotify) gum_function_metadata_free);
-    gum_module_enumerate_exports (self->path,
-        gum_module_metadata_collect_export, self->export_by_name);
-  }
+  if (self->exports == NULL)
+    self->exports = gum_export_index_obtain (self->path, self->base);
 
-  return self->export_by_name;
+  return self->exports;
 }
 
 static gboolean
@@ -307,24 +494,6 @@ gum_module_metadata_collect_import (const GumImportDetails * details,
   return TRUE;
 }
 
-static gboolean
-gum_module_metadata_collect_export (const GumExportDetails * details,
-                                    gpointer user_data)
-{
-  GHashTable * export_by_name = user_data;
-
-  if (details->type == GUM_EXPORT_FUNCTION)
-  {
-    GumFunctionMetadata * function;
-
-    function = gum_function_metadata_new (details->name, details->address,
-        NULL);
-    g_hash_table_insert (export_by_name, g_strdup (function->name), function);
-  }
-
-  return TRUE;
-}
-
 static GumFunctionMetadata *
 gum_function_metadata_new (const gchar * name,
                            GumAddress address,
@@ -348,3 +517,567 @@ gum_function_metadata_free (GumFunctionMetadata * function)
 
   g_slice_free (GumFunctionMetadata, function);
 }
+
+/*
+ * Export indexes are shared by all resolvers in the process. They store
+ * offsets relative to the module base, and are keyed by the module's path
+ * plus its ELF build ID when it has one. Otherwise the base address and the
+ * file's size and modification time are used, so that a module reloaded at
+ * the same base with different contents gets a fresh index. The cache does
+ * not own its indexes: the last resolver to release one removes it.
+ */
+static GumExportIndex *
+gum_export_index_obtain (const gchar * path,
+                         GumAddress base)
+{
+  static volatile gint destructor_registered = FALSE;
+  gchar * build_id = NULL;
+  gchar * key;
+  GStatBuf st;
+  GumExportIndex * index, * existing;
+  GVariant * stored = NULL;
+
+#ifdef HAVE_LINUX
+  build_id = _gum_process_query_module_build_id (base);
+#endif
+  if (build_id != NULL)
+  {
+    key = g_strconcat (path, "\n", build_id, NULL);
+  }
+  else if (g_stat (path, &st) == 0)
+  {
+    key = g_strdup_printf ("%s\n@%" G_GINT64_MODIFIER "x\n%" G_GINT64_FORMAT
+        ":%" G_GINT64_FORMAT, path, base, (gint64) st.st_size,
+        (gint64) st.st_mtime);
+  }
+  else
+  {
+    key = g_strdup_printf ("%s\n@%" G_GINT64_MODIFIER "x", path, base);
+  }
+
+  G_LOCK (gum_export_index_cache);
+  if (gum_export_index_cache == NULL)
+    gum_export_index_cache = g_hash_table_new (g_str_hash, g_str_equal);
+  index = g_hash_table_lookup (gum_export_index_cache, key);
+  if (index != NULL)
+    gum_export_index_ref (index);
+  else if (build_id != NULL && gum_export_index_cache_stored != NULL)
+    stored = g_hash_table_lookup (gum_export_index_cache_stored, key);
+  if (stored != NULL)
+    g_variant_ref (stored);
+  G_UNLOCK (gum_export_index_cache);
+
+  if (g_atomic_int_compare_and_exchange (&destructor_registered, FALSE, TRUE))
+    _gum_register_destructor (gum_export_index_cache_deinit);
+
+  if (index != NULL)
+    goto beach;
+
+  if (stored != NULL)
+  {
+    index = gum_export_index_new_from_variant (stored);
+    g_variant_unref (stored);
+  }
+  else
+  {
+    index = gum_export_index_new_from_module (path, base);
+  }
+  index->persistent = build_id != NULL;
+
+  G_LOCK (gum_export_index_cache);
+  existing = g_hash_table_lookup (gum_export_index_cache, key);
+  if (existing != NULL)
+  {
+    gum_export_index_ref (existing);
+  }
+  else
+  {
+    index->key = key;
+    key = NULL;
+    g_hash_table_insert (gum_export_index_cache, index->key, index);
+    if (index->persistent && stored == NULL)
+      gum_export_index_cache_dirty = TRUE;
+  }
+  G_UNLOCK (gum_export_index_cache);
+
+  if (existing != NULL)
+  {
+    gum_export_index_unref (index);
+    index = existing;
+  }
+
+beach:
+  g_free (key);
+  g_free (build_id);
+
+  return index;
+}
+
+typedef struct _GumCollectExportsContext GumCollectExportsContext;
+
+struct _GumCollectExportsContext
+{
+  GumExportIndex * index;
+  GumAddress base;
+};
+
+static GumExportIndex *
+gum_export_index_new_from_module (const gchar * path,
+                                  GumAddress base)
+{
+  GumCollectExportsContext ctx;
+
+  ctx.index = gum_export_index_new ();
+  ctx.base = base;
+
+  gum_module_enumerate_exports (path, gum_collect_export, &ctx);
+
+  gum_export_index_seal (ctx.index);
+
+  return ctx.index;
+}
+
+static GumExportIndex *
+gum_export_index_new_from_variant (GVariant * exports)
+{
+  GumExportIndex * index;
+  GVariantIter iter;
+  const gchar * name;
+  guint64 offset;
+
+  index = gum_export_index_new ();
+
+  g_variant_iter_init (&iter, exports);
+  while (g_variant_iter_next (&iter, "(&st)", &name, &offset))
+    gum_export_index_add (index, name, offset);
+
+  gum_export_index_seal (index);
+
+  return index;
+}
+
+static GumExportIndex *
+gum_export_index_new (void)
+{
+  GumExportIndex * index;
+
+  index = g_slice_new (GumExportIndex);
+  index->ref_count = 1;
+  index->key = NULL;
+  index->persistent = FALSE;
+  index->names = g_string_chunk_new (4096);
+  index->entries = g_array_new (FALSE, FALSE, sizeof (GumExportIndexEntry));
+  index->trigrams = NULL;
+
+  return index;
+}
+
+static void
+gum_export_index_add (GumExportIndex * self,
+                      const gchar * name,
+                      GumAddress offset)
+{
+  GumExportIndexEntry entry;
+
+  entry.name = g_string_chunk_insert_const (self->names, name);
+  entry.offset = offset;
+  g_array_append_val (self->entries, entry);
+}
+
+static void
+gum_export_index_seal (GumExportIndex * self)
+{
+  GArray * entries = self->entries;
+  guint i, n;
+
+  g_array_sort (entries, (GCompareFunc) gum_export_index_entry_compare);
+
+  /* Names were interned, so duplicates share the same pointer. */
+  n = 0;
+  for (i = 0; i != entries->len; i++)
+  {
+    GumExportIndexEntry * entry =
+        &g_array_index (entries, GumExportIndexEntry, i);
+
+    if (n != 0 &&
+        g_array_index (entries, GumExportIndexEntry, n - 1).name == entry->name)
+      continue;
+
+    g_array_index (entries, GumExportIndexEntry, n++) = *entry;
+  }
+  g_array_set_size (entries, n);
+}
+
+static GumExportIndex *
+gum_export_index_ref (GumExportIndex * index)
+{
+  g_atomic_int_inc (&index->ref_count);
+
+  return index;
+}
+
+static void
+gum_export_index_unref (GumExportIndex * index)
+{
+  GHashTable * trigrams;
+
+  /* Lookups take their reference with the lock held, so this can't race. */
+  G_LOCK (gum_export_index_cache);
+  if (!g_atomic_int_dec_and_test (&index->ref_count))
+  {
+    G_UNLOCK (gum_export_index_cache);
+    return;
+  }
+  if (index->key != NULL)
+    gum_export_index_cache_evict (index);
+  G_UNLOCK (gum_export_index_cache);
+
+  trigrams = g_atomic_pointer_get (&index->trigrams);
+  if (trigrams != NULL)
+    g_hash_table_unref (trigrams);
+
+  g_array_free (index->entries, TRUE);
+  g_string_chunk_free (index->names);
+  g_free (index->key);
+
+  g_slice_free (GumExportIndex, index);
+}
+
+static gboolean
+gum_collect_export (const GumExportDetails * details,
+                    gpointer user_data)
+{
+  GumCollectExportsContext * ctx = user_data;
+
+  if (details->type == GUM_EXPORT_FUNCTION)
+    gum_export_index_add (ctx->index, details->name,
+        details->address - ctx->base);
+
+  return TRUE;
+}
+
+/*
+ * Literal names are looked up with a binary search, and so are patterns
+ * with a literal prefix. Other patterns only consider names sharing the
+ * rarest trigram of their longest literal run, when it has one.
+ */
+static gboolean
+gum_export_index_foreach_match (GumExportIndex * self,
+                                const gchar * pattern,
+                                GPatternSpec * spec,
+                                GumFoundExportIndexEntryFunc func,
+                                gpointer user_data)
+{
+  GArray * entries = self->entries;
+  gsize prefix_length;
+  const gchar * run, * best_run;
+  gsize run_length, best_run_length;
+  GArray * candidates;
+  gboolean carry_on = TRUE;
+  guint i;
+
+  prefix_length = strcspn (pattern, "*?");
+
+  if (prefix_length != 0)
+  {
+    gboolean literal = pattern[prefix_length] == '\0';
+
+    for (i = gum_export_index_lower_bound (self, pattern, prefix_length);
+        i != entries->len && carry_on;
+        i++)
+    {
+      const GumExportIndexEntry * entry =
+          &g_array_index (entries, GumExportIndexEntry, i);
+
+      if (strncmp (entry->name, pattern, prefix_length) != 0)
+        break;
+
+      if (literal)
+      {
+        if (entry->name[prefix_length] == '\0')
+          carry_on = func (entry, user_data);
+        break;
+      }
+
+      if (g_pattern_match_string (spec, entry->name))
+        carry_on = func (entry, user_data);
+    }
+
+    return carry_on;
+  }
+
+  best_run = NULL;
+  best_run_length = 0;
+  for (run = pattern; *run != '\0'; run += run_length)
+  {
+    run += strspn (run, "*?");
+    run_length = strcspn (run, "*?");
+    if (run_length > best_run_length)
+    {
+      best_run = run;
+      best_run_length = run_length;
+    }
+  }
+
+  candidates = NULL;
+  if (best_run_length >= 3)
+  {
+    GHashTable * trigrams = gum_export_index_get_trigrams (self);
+    gsize offset;
+
+    for (offset = 0; offset + 3 <= best_run_length; offset++)
+    {
+      GArray * postings;
+
+      postings = g_hash_table_lookup (trigrams,
+          GUINT_TO_POINTER (GUM_TRIGRAM (best_run + offset)));
+      if (postings == NULL)
+        return TRUE;
+
+      if (candidates == NULL || postings->len < candidates->len)
+        candidates = postings;
+    }
+  }
+
+  if (candidates != NULL)
+  {
+    for (i = 0; i != candidates->len && carry_on; i++)
+    {
+      const GumExportIndexEntry * entry = &g_array_index (entries,
+          GumExportIndexEntry, g_array_index (candidates, guint, i));
+
+      if (g_pattern_match_string (spec, entry->name))
+        carry_on = func (entry, user_data);
+    }
+  }
+  else
+  {
+    for (i = 0; i != entries->len && carry_on; i++)
+    {
+      const GumExportIndexEntry * entry =
+          &g_array_index (entries, GumExportIndexEntry, i);
+
+      if (g_pattern_match_string (spec, entry->name))
+        carry_on = func (entry, user_data);
+    }
+  }
+
+  return carry_on;
+}
+
+static guint
+gum_export_index_lower_bound (GumExportIndex * self,
+                              const gchar * prefix,
+                              gsize prefix_length)
+{
+  GArray * entries = self->entries;
+  guint lo, hi;
+
+  lo = 0;
+  hi = entries->len;
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+    const gchar * name = g_array_index (entries, GumExportIndexEntry, mid).name;
+
+    if (strncmp (name, prefix, prefix_length) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+static GHashTable *
+gum_export_index_get_trigrams (GumExportIndex * self)
+{
+  GHashTable * trigrams;
+  guint i;
+
+  trigrams = g_atomic_pointer_get (&self->trigrams);
+  if (trigrams != NULL)
+    return trigrams;
+
+  trigrams = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_array_unref);
+
+  for (i = 0; i != self->entries->len; i++)
+  {
+    const gchar * name = g_array_index (self->entries, GumExportIndexEntry,
+        i).name;
+    gsize length, offset;
+
+    length = strlen (name);
+    for (offset = 0; offset + 3 <= length; offset++)
+    {
+      gpointer key = GUINT_TO_POINTER (GUM_TRIGRAM (name + offset));
+      GArray * postings;
+
+      postings = g_hash_table_lookup (trigrams, key);
+      if (postings == NULL)
+      {
+        postings = g_array_new (FALSE, FALSE, sizeof (guint));
+        g_hash_table_insert (trigrams, key, postings);
+      }
+
+      if (postings->len == 0 ||
+          g_array_index (postings, guint, postings->len - 1) != i)
+        g_array_append_val (postings, i);
+    }
+  }
+
+  if (!g_atomic_pointer_compare_and_exchange (&self->trigrams, NULL,
+      trigrams))
+  {
+    g_hash_table_unref (trigrams);
+    trigrams = g_atomic_pointer_get (&self->trigrams);
+  }
+
+  return trigrams;
+}
+
+static GVariant *
+gum_export_index_to_variant (GumExportIndex * self)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(st)"));
+  for (i = 0; i != self->entries->len; i++)
+  {
+    const GumExportIndexEntry * entry =
+        &g_array_index (self->entries, GumExportIndexEntry, i);
+
+    g_variant_builder_add (&builder, "(st)", entry->name,
+        (guint64) entry->offset);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+static gint
+gum_export_index_entry_compare (const GumExportIndexEntry * lhs,
+                                const GumExportIndexEntry * rhs)
+{
+  gint result;
+
+  result = strcmp (lhs->name, rhs->name);
+  if (result != 0)
+    return result;
+
+  /* Ties keep the lowest offset, whatever order they were enumerated in. */
+  if (lhs->offset != rhs->offset)
+    return (lhs->offset < rhs->offset) ? -1 : 1;
+
+  return 0;
+}
+
+/*
+ * Persistent indexes evicted before the cache file is written are kept in
+ * serialized form, so that they are still saved and can be loaded back
+ * without enumerating the module again.
+ */
+static void
+gum_export_index_cache_evict (GumExportIndex * index)
+{
+  if (gum_export_index_cache != NULL)
+    g_hash_table_remove (gum_export_index_cache, index->key);
+
+  if (!index->persistent || gum_export_index_cache_file == NULL)
+    return;
+
+  if (gum_export_index_cache_stored == NULL)
+  {
+    gum_export_index_cache_stored = g_hash_table_new_full (g_str_hash,
+        g_str_equal, g_free, (GDestroyNotify) g_variant_unref);
+  }
+
+  if (!g_hash_table_contains (gum_export_index_cache_stored, index->key))
+  {
+    g_hash_table_insert (gum_export_index_cache_stored, g_strdup (index->key),
+        g_variant_ref_sink (gum_export_index_to_variant (index)));
+  }
+}
+
+static void
+gum_export_index_cache_save (void)
+{
+  gchar * path = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const gchar * key;
+  gpointer value;
+  GVariant * cache;
+
+  G_LOCK (gum_export_index_cache);
+
+  if (gum_export_index_cache_file == NULL || !gum_export_index_cache_dirty)
+  {
+    G_UNLOCK (gum_export_index_cache);
+    return;
+  }
+
+  path = g_strdup (gum_export_index_cache_file);
+
+  g_variant_builder_init (&builder,
+      G_VARIANT_TYPE (GUM_EXPORT_INDEX_CACHE_FORMAT));
+
+  if (gum_export_index_cache_stored != NULL)
+  {
+    g_hash_table_iter_init (&iter, gum_export_index_cache_stored);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &key, &value))
+    {
+      if (!g_hash_table_contains (gum_export_index_cache, key))
+        g_variant_builder_add (&builder, "{s@a(st)}", key, value);
+    }
+  }
+
+  g_hash_table_iter_init (&iter, gum_export_index_cache);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &key, &value))
+  {
+    GumExportIndex * index = value;
+
+    if (index->persistent)
+    {
+      g_variant_builder_add (&builder, "{s@a(st)}", key,
+          gum_export_index_to_variant (index));
+    }
+  }
+
+  gum_export_index_cache_dirty = FALSE;
+
+  G_UNLOCK (gum_export_index_cache);
+
+  cache = g_variant_ref_sink (g_variant_builder_end (&builder));
+  g_file_set_contents (path, g_variant_get_data (cache),
+      g_variant_get_size (cache), NULL);
+  g_variant_unref (cache);
+
+  g_free (path);
+}
+
+static void
+gum_export_index_cache_deinit (void)
+{
+  gum_export_index_cache_save ();
+
+  G_LOCK (gum_export_index_cache);
+
+  if (gum_export_index_cache != NULL)
+  {
+    g_hash_table_unref (gum_export_index_cache);
+    gum_export_index_cache = NULL;
+  }
+
+  if (gum_export_index_cache_stored != NULL)
+  {
+    g_hash_table_unref (gum_export_index_cache_stored);
+    gum_export_index_cache_stored = NULL;
+  }
+
+  g_free (gum_export_index_cache_file);
+  gum_export_index_cache_file = NULL;
+
+  G_UNLOCK (gum_export_index_cache);
+}
@@ -18,6 +18,8 @@ G_DECLARE_FINAL_TYPE (GumModuleApiResolver, gum_module_api_resolver, GUM,
 
 GumApiResolver * gum_module_api_resolver_new (void);
 
+void gum_module_api_resolver_set_cache_file (const gchar * path);
+
 G_END_DECLS
 
 #endif
@@ -6,9 +6,14 @@
 
 #include "gummodulemap.h"
 
+#include "gumprocess-priv.h"
+
 struct _GumModuleMapPrivate
 {
   GArray * modules;
+#ifdef HAVE_LINUX
+  guint64 generation;
+#endif
 };
 
 static void gum_module_map_finalize (GObject * object);
@@ -16,6 +21,11 @@ static void gum_module_map_finalize (GObject * object);
 static void gum_module_map_clear (GumModuleMap * self);
 static gboolean gum_add_module (const GumModuleDetails * details,
     gpointer user_data);
+static gint gum_module_details_compare_base (const GumModuleDetails * lhs,
+    const GumModuleDetails * rhs);
+
+/* Per-thread index of the last module hit, plus one; only ever a hint. */
+static GPrivate gum_module_map_last_hit = G_PRIVATE_INIT (NULL);
 
 G_DEFINE_TYPE (GumModuleMap, gum_module_map, G_TYPE_OBJECT);
 
@@ -66,23 +76,76 @@ gum_module_map_find (GumModuleMap * self,
                      GumAddress address)
 {
   GumModuleMapPrivate * priv = self->priv;
-  guint i;
+  GArray * modules = priv->modules;
+  guint last_hit;
+  guint lo, hi;
 
-  for (i = 0; i < priv->modules->len; i++)
+  last_hit = GPOINTER_TO_UINT (g_private_get (&gum_module_map_last_hit));
+  if (last_hit != 0 && last_hit <= modules->len)
   {
-    GumModuleDetails * d = &g_array_index (priv->modules, GumModuleDetails, i);
+    GumModuleDetails * d =
+        &g_array_index (modules, GumModuleDetails, last_hit - 1);
+    if (GUM_MEMORY_RANGE_INCLUDES (d->range, address))
+      return d;
+  }
+
+  /* Find the last module whose base is at or below the address. */
+  lo = 0;
+  hi = modules->len;
+  while (lo < hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+    GumModuleDetails * d = &g_array_index (modules, GumModuleDetails, mid);
+
+    if (d->range->base_address <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo != 0)
+  {
+    GumModuleDetails * d = &g_array_index (modules, GumModuleDetails, lo - 1);
     if (GUM_MEMORY_RANGE_INCLUDES (d->range, address))
+    {
+      g_private_set (&gum_module_map_last_hit, GUINT_TO_POINTER (lo));
       return d;
+    }
   }
 
   return NULL;
 }
 
+void
+gum_module_map_find_many (GumModuleMap * self,
+                          const GumAddress * addresses,
+                          guint n_addresses,
+                          const GumModuleDetails ** modules)
+{
+  guint i;
+
+  for (i = 0; i != n_addresses; i++)
+    modules[i] = gum_module_map_find (self, addresses[i]);
+}
+
 void
 gum_module_map_update (GumModuleMap * self)
 {
+  GumModuleMapPrivate * priv = self->priv;
+#ifdef HAVE_LINUX
+  guint64 generation;
+
+  /* Nothing to do if no module has been loaded or unloaded since last time. */
+  generation = _gum_process_query_module_generation ();
+  if (generation != 0 && generation == priv->generation)
+    return;
+  priv->generation = generation;
+#endif
+
   gum_module_map_clear (self);
-  gum_process_enumerate_modules (gum_add_module, self->priv);
+  gum_process_enumerate_modules (gum_add_module, priv);
+  g_array_sort (priv->modules,
+      (GCompareFunc) gum_module_details_compare_base);
 }
 
 static void
@@ -116,3 +179,18 @@ gum_add_module (const GumModuleDetails * details,
 
   return TRUE;
 }
+
+static gint
+gum_module_details_compare_base (const GumModuleDetails * lhs,
+                                 const GumModuleDetails * rhs)
+{
+  GumAddress lhs_base = lhs->range->base_address;
+  GumAddress rhs_base = rhs->range->base_address;
+
+  if (lhs_base < rhs_base)
+    return -1;
+  else if (lhs_base > rhs_base)
+    return 1;
+  else
+    return 0;
+}
@@ -48,6 +48,9 @@ GUM_API GumModuleMap * gum_module_map_new (void);
 
 GUM_API const GumModuleDetails * gum_module_map_find (GumModuleMap * self,
     GumAddress address);
+GUM_API void gum_module_map_find_many (GumModuleMap * self,
+    const GumAddress * addresses, guint n_addresses,
+    const GumModuleDetails ** modules);
 
 GUM_API void gum_module_map_update (GumModuleMap * self);
 
@@ -0,0 +1,17 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_PROCESS_PRIV_H__
+#define __GUM_PROCESS_PRIV_H__
+
+#include <gum/gumdefs.h>
+
+#ifdef HAVE_LINUX
+G_GNUC_INTERNAL guint64 _gum_process_query_module_generation (void);
+G_GNUC_INTERNAL gchar * _gum_process_query_module_build_id (GumAddress base);
+#endif
+
+#endif
@@ -5,10 +5,26 @@
  */
 
 #include "gumreturnaddress.h"
+
+#include "gummodulemap.h"
 #include "gumsymbolutil.h"
+#include "gumsymbolutil-priv.h"
 
 #include <string.h>
 
+typedef struct _GumReturnAddressSlot GumReturnAddressSlot;
+
+struct _GumReturnAddressSlot
+{
+  GumReturnAddress address;
+  guint index;
+};
+
+static void gum_return_address_details_init (GumReturnAddressDetails * details,
+    GumReturnAddress address, const GumSymbolDetails * sd);
+static gint gum_return_address_slot_compare (const GumReturnAddressSlot * lhs,
+    const GumReturnAddressSlot * rhs);
+
 gboolean
 gum_return_address_details_from_address (GumReturnAddress address,
                                          GumReturnAddressDetails * details)
@@ -17,12 +33,7 @@ gum_return_address_details_from_address (GumReturnAddress address,
 
   if (gum_symbol_details_from_address (address, &sd))
   {
-    details->address = address;
-
-    strcpy (details->module_name, sd.module_name);
-    strcpy (details->function_name, sd.symbol_name);
-    strcpy (details->file_name, sd.file_name);
-    details->line_number = sd.line_number;
+    gum_return_address_details_init (details, address, &sd);
 
     return TRUE;
   }
@@ -30,6 +41,118 @@ gum_return_address_details_from_address (GumReturnAddress address,
   return FALSE;
 }
 
+/*
+ * Symbolizes every item of the given arrays, writing the results to details
+ * and resolved in the same order as the items appear. Each distinct address
+ * is only looked up once, and lookups happen in address order. The module is
+ * resolved once for each run of addresses that fall inside it, and shared by
+ * the lookups in that run.
+ */
+guint
+gum_return_address_details_from_arrays (
+    const GumReturnAddressArray * const * arrays,
+    guint n_arrays,
+    GumReturnAddressDetails * details,
+    gboolean * resolved)
+{
+  guint n_resolved = 0;
+  GArray * slots, * addresses, * firsts, * symbols, * successes;
+  GumModuleMap * modules;
+  guint i, j, k, l;
+
+  slots = g_array_new (FALSE, FALSE, sizeof (GumReturnAddressSlot));
+
+  for (i = 0; i != n_arrays; i++)
+  {
+    const GumReturnAddressArray * array = arrays[i];
+
+    for (j = 0; j != array->len; j++)
+    {
+      GumReturnAddressSlot slot;
+
+      slot.address = array->items[j];
+      slot.index = slots->len;
+      g_array_append_val (slots, slot);
+    }
+  }
+
+  g_array_sort (slots, (GCompareFunc) gum_return_address_slot_compare);
+
+  addresses = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+  firsts = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (i = 0; i != slots->len; i++)
+  {
+    GumAddress address =
+        GUM_ADDRESS (g_array_index (slots, GumReturnAddressSlot, i).address);
+
+    if (addresses->len != 0 &&
+        g_array_index (addresses, GumAddress, addresses->len - 1) == address)
+      continue;
+
+    g_array_append_val (addresses, address);
+    g_array_append_val (firsts, i);
+  }
+  g_array_append_val (firsts, slots->len);
+
+  modules = gum_module_map_new ();
+  symbols = g_array_new (FALSE, FALSE, sizeof (GumSymbolDetails));
+  successes = g_array_new (FALSE, FALSE, sizeof (gboolean));
+
+  for (i = 0; i != addresses->len; i = j)
+  {
+    const GumAddress * run = &g_array_index (addresses, GumAddress, i);
+    const GumModuleDetails * module;
+    GumAddress end = 0;
+
+    module = gum_module_map_find (modules, run[0]);
+    if (module != NULL)
+      end = module->range->base_address + module->range->size;
+
+    for (j = i + 1; j != addresses->len; j++)
+    {
+      if (g_array_index (addresses, GumAddress, j) >= end)
+        break;
+    }
+
+    g_array_set_size (symbols, j - i);
+    g_array_set_size (successes, j - i);
+    _gum_symbol_details_from_module_addresses (run, j - i,
+        (GumSymbolDetails *) symbols->data, (gboolean *) successes->data);
+
+    for (k = i; k != j; k++)
+    {
+      const GumSymbolDetails * sd =
+          &g_array_index (symbols, GumSymbolDetails, k - i);
+      gboolean success = g_array_index (successes, gboolean, k - i);
+      guint first = g_array_index (firsts, guint, k);
+      guint last = g_array_index (firsts, guint, k + 1);
+
+      for (l = first; l != last; l++)
+      {
+        const GumReturnAddressSlot * slot =
+            &g_array_index (slots, GumReturnAddressSlot, l);
+
+        if (success)
+          gum_return_address_details_init (&details[slot->index], slot->address,
+              sd);
+        resolved[slot->index] = success;
+      }
+
+      if (success)
+        n_resolved += last - first;
+    }
+  }
+
+  g_array_free (successes, TRUE);
+  g_array_free (symbols, TRUE);
+  g_object_unref (modules);
+  g_array_free (firsts, TRUE);
+  g_array_free (addresses, TRUE);
+  g_array_free (slots, TRUE);
+
+  return n_resolved;
+}
+
 gboolean
 gum_return_address_array_is_equal (const GumReturnAddressArray * array1,
                                    const GumReturnAddressArray * array2)
@@ -47,3 +170,28 @@ gum_return_address_array_is_equal (const GumReturnAddressArray * array1,
 
   return TRUE;
 }
+
+static void
+gum_return_address_details_init (GumReturnAddressDetails * details,
+                                 GumReturnAddress address,
+                                 const GumSymbolDetails * sd)
+{
+  details->address = address;
+
+  strcpy (details->module_name, sd->module_name);
+  strcpy (details->function_name, sd->symbol_name);
+  strcpy (details->file_name, sd->file_name);
+  details->line_number = sd->line_number;
+}
+
+static gint
+gum_return_address_slot_compare (const GumReturnAddressSlot * lhs,
+                                 const GumReturnAddressSlot * rhs)
+{
+  if (lhs->address < rhs->address)
+    return -1;
+  else if (lhs->address > rhs->address)
+    return 1;
+  else
+    return (gint) lhs->index - (gint) rhs->index;
+}
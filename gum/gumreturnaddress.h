@@ -32,6 +32,9 @@ G_BEGIN_DECLS
 
 GUM_API gboolean gum_return_address_details_from_address (
     GumReturnAddress address, GumReturnAddressDetails * details);
+GUM_API guint gum_return_address_details_from_arrays (
+    const GumReturnAddressArray * const * arrays, guint n_arrays,
+    GumReturnAddressDetails * details, gboolean * resolved);
 
 GUM_API gboolean gum_return_address_array_is_equal (
     const GumReturnAddressArray * array1,
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumstackdepot.h"
+
+#include "gum-init.h"
+
+#define GUM_STACK_DEPOT_BUCKET_BITS 16
+#define GUM_STACK_DEPOT_BUCKET_COUNT (1 << GUM_STACK_DEPOT_BUCKET_BITS)
+#define GUM_STACK_DEPOT_CHUNK_BITS 14
+#define GUM_STACK_DEPOT_CHUNK_SIZE (1 << GUM_STACK_DEPOT_CHUNK_BITS)
+#define GUM_STACK_DEPOT_MAX_CHUNKS 16384
+
+typedef struct _GumStackNode GumStackNode;
+
+/*
+ * Stacks are stored as a tree of frames, outermost first, so stacks sharing
+ * callers share nodes. A stack's id is the id of its innermost node.
+ */
+struct _GumStackNode
+{
+  GumReturnAddress address;
+  GumStackId parent;
+  GumStackId next;
+};
+
+static GumStackId gum_stack_depot_intern (GumReturnAddress address,
+    GumStackId parent);
+static GumStackId gum_stack_depot_alloc_node (void);
+static GumStackNode * gum_stack_depot_get_node (GumStackId id);
+static void gum_stack_depot_deinit (void);
+
+static volatile gint gum_stack_depot_buckets[GUM_STACK_DEPOT_BUCKET_COUNT];
+static GumStackNode * volatile
+    gum_stack_depot_chunks[GUM_STACK_DEPOT_MAX_CHUNKS];
+static volatile gint gum_stack_depot_next_id = 1;
+
+GumStackId
+gum_stack_depot_put (const GumReturnAddressArray * return_addresses)
+{
+  static volatile gint destructor_registered = FALSE;
+  GumStackId id = GUM_STACK_ID_NONE;
+  gint i;
+
+  if (!g_atomic_int_get (&destructor_registered) &&
+      g_atomic_int_compare_and_exchange (&destructor_registered, FALSE, TRUE))
+    _gum_register_destructor (gum_stack_depot_deinit);
+
+  for (i = (gint) return_addresses->len - 1; i >= 0; i--)
+  {
+    id = gum_stack_depot_intern (return_addresses->items[i], id);
+    if (id == GUM_STACK_ID_NONE)
+      break;
+  }
+
+  return id;
+}
+
+void
+gum_stack_depot_get (GumStackId id,
+                     GumReturnAddressArray * return_addresses)
+{
+  guint i = 0;
+
+  while (id != GUM_STACK_ID_NONE &&
+      i != G_N_ELEMENTS (return_addresses->items))
+  {
+    GumStackNode * node = gum_stack_depot_get_node (id);
+
+    return_addresses->items[i++] = node->address;
+    id = node->parent;
+  }
+
+  return_addresses->len = i;
+}
+
+/*
+ * Nodes are published by swinging the bucket head with a CAS, after being
+ * fully initialized. Nodes are never removed, so readers need no locking.
+ * A node allocated by a thread that loses the race to another thread
+ * interning the same frame is simply left unused.
+ */
+static GumStackId
+gum_stack_depot_intern (GumReturnAddress address,
+                        GumStackId parent)
+{
+  volatile gint * bucket;
+  GumStackId head, stop, id, new_id;
+  GumStackNode * node;
+
+  bucket = &gum_stack_depot_buckets[
+      (((guint64) GPOINTER_TO_SIZE (address) ^
+        ((guint64) parent << 32)) *
+       G_GUINT64_CONSTANT (0x9e3779b97f4a7c15)) >>
+      (64 - GUM_STACK_DEPOT_BUCKET_BITS)];
+
+  head = (GumStackId) g_atomic_int_get (bucket);
+  stop = GUM_STACK_ID_NONE;
+  new_id = GUM_STACK_ID_NONE;
+
+  while (TRUE)
+  {
+    for (id = head; id != stop; id = node->next)
+    {
+      node = gum_stack_depot_get_node (id);
+      if (node->address == address && node->parent == parent)
+        return id;
+    }
+
+    if (new_id == GUM_STACK_ID_NONE)
+    {
+      new_id = gum_stack_depot_alloc_node ();
+      if (new_id == GUM_STACK_ID_NONE)
+        return GUM_STACK_ID_NONE;
+
+      node = gum_stack_depot_get_node (new_id);
+      node->address = address;
+      node->parent = parent;
+    }
+
+    gum_stack_depot_get_node (new_id)->next = head;
+
+    if (g_atomic_int_compare_and_exchange (bucket, (gint) head, (gint) new_id))
+      return new_id;
+
+    stop = head;
+    head = (GumStackId) g_atomic_int_get (bucket);
+  }
+}
+
+static GumStackId
+gum_stack_depot_alloc_node (void)
+{
+  guint id, chunk_index;
+  GumStackNode * chunk;
+
+  id = (guint) g_atomic_int_add (&gum_stack_depot_next_id, 1);
+  chunk_index = id >> GUM_STACK_DEPOT_CHUNK_BITS;
+  if (chunk_index >= GUM_STACK_DEPOT_MAX_CHUNKS)
+  {
+    g_atomic_int_set (&gum_stack_depot_next_id,
+        GUM_STACK_DEPOT_MAX_CHUNKS << GUM_STACK_DEPOT_CHUNK_BITS);
+    return GUM_STACK_ID_NONE;
+  }
+
+  chunk = g_atomic_pointer_get (&gum_stack_depot_chunks[chunk_index]);
+  if (chunk == NULL)
+  {
+    chunk = g_new0 (GumStackNode, GUM_STACK_DEPOT_CHUNK_SIZE);
+    if (!g_atomic_pointer_compare_and_exchange (
+        &gum_stack_depot_chunks[chunk_index], NULL, chunk))
+    {
+      g_free (chunk);
+    }
+  }
+
+  return id;
+}
+
+static GumStackNode *
+gum_stack_depot_get_node (GumStackId id)
+{
+  GumStackNode * chunk;
+
+  chunk = g_atomic_pointer_get (
+      &gum_stack_depot_chunks[id >> GUM_STACK_DEPOT_CHUNK_BITS]);
+
+  return &chunk[id & (GUM_STACK_DEPOT_CHUNK_SIZE - 1)];
+}
+
+static void
+gum_stack_depot_deinit (void)
+{
+  guint i;
+
+  for (i = 0; i != GUM_STACK_DEPOT_MAX_CHUNKS; i++)
+  {
+    g_free (gum_stack_depot_chunks[i]);
+    gum_stack_depot_chunks[i] = NULL;
+  }
+
+  for (i = 0; i != GUM_STACK_DEPOT_BUCKET_COUNT; i++)
+    gum_stack_depot_buckets[i] = GUM_STACK_ID_NONE;
+
+  gum_stack_depot_next_id = 1;
+}
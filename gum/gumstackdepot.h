@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_STACK_DEPOT_H__
+#define __GUM_STACK_DEPOT_H__
+
+#include <gum/gumdefs.h>
+#include <gum/gumreturnaddress.h>
+
+#define GUM_STACK_ID_NONE 0
+
+typedef guint32 GumStackId;
+
+G_BEGIN_DECLS
+
+GUM_API GumStackId gum_stack_depot_put (
+    const GumReturnAddressArray * return_addresses);
+GUM_API void gum_stack_depot_get (GumStackId id,
+    GumReturnAddressArray * return_addresses);
+
+G_END_DECLS
+
+#endif
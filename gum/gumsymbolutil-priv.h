@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2010 Ole André Vadla Ravnås <ole.andre.ravnas@tillitech.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_SYMBOL_UTIL_PRIV_H__
+#define __GUM_SYMBOL_UTIL_PRIV_H__
+
+#include <gum/gumsymbolutil.h>
+
+G_GNUC_INTERNAL void _gum_symbol_details_from_module_addresses (
+    const GumAddress * addresses, guint n_addresses,
+    GumSymbolDetails * details, gboolean * resolved);
+
+#endif
@@ -17,6 +17,8 @@
 #include <gum/heap/gumcobject.h>
 #include <gum/heap/gumcobjecttracker.h>
 #include <gum/heap/gumheapapi.h>
+#include <gum/heap/gumheapprofile.h>
+#include <gum/heap/gumheapsnapshot.h>
 #include <gum/heap/guminstancetracker.h>
 #include <gum/heap/gumsanitychecker.h>
 
@@ -6,17 +6,26 @@
 
 #include "gumallocationtracker.h"
 
-#include <string.h>
-
 #include "gumallocationblock.h"
 #include "gumallocationgroup.h"
 #include "gummemory.h"
 #include "gumreturnaddress.h"
 #include "gumbacktracer.h"
+#include "gumstackdepot.h"
+
+#include <math.h>
 
 G_DEFINE_TYPE (GumAllocationTracker, gum_allocation_tracker, G_TYPE_OBJECT);
 
+#define GUM_ALLOCATION_TRACKER_SHARD_BITS 6
+#define GUM_ALLOCATION_TRACKER_SHARD_COUNT \
+    (1 << GUM_ALLOCATION_TRACKER_SHARD_BITS)
+
+typedef struct _GumAllocationTrackerShard GumAllocationTrackerShard;
 typedef struct _GumAllocationTrackerBlock GumAllocationTrackerBlock;
+typedef struct _GumAllocationTrackerSizeStats GumAllocationTrackerSizeStats;
+typedef struct _GumAllocationSamplerState GumAllocationSamplerState;
+typedef struct _GumHeapProfileEstimate GumHeapProfileEstimate;
 
 enum
 {
@@ -24,21 +33,39 @@ enum
   PROP_BACKTRACER,
 };
 
+/*
+ * Blocks live in the shard picked by their address. Each shard also counts
+ * the blocks it holds, and these totals are merged on read. Size group
+ * statistics are shared by all shards and updated atomically, so each shard
+ * only caches pointers to the ones it has used. That way tracking a block
+ * only ever takes its own shard's lock.
+ */
+struct _GumAllocationTrackerShard
+{
+  GMutex mutex;
+
+  GHashTable * known_blocks_ht;
+  GHashTable * size_stats_ht;
+
+  guint block_count;
+  guint block_total_size;
+};
+
 struct _GumAllocationTrackerPrivate
 {
   gboolean disposed;
 
-  GMutex mutex;
-
   volatile gint enabled;
 
   GumAllocationTrackerFilterFunction filter_func;
   gpointer filter_func_user_data;
 
-  guint block_count;
-  guint block_total_size;
-  GHashTable * known_blocks_ht;
-  GHashTable * block_groups_ht;
+  guint sample_interval;
+
+  GumAllocationTrackerShard shards[GUM_ALLOCATION_TRACKER_SHARD_COUNT];
+
+  GMutex size_stats_mutex;
+  GHashTable * size_stats_ht;
 
   GumBacktracerIface * backtracer_interface;
   GumBacktracer * backtracer_instance;
@@ -47,11 +74,38 @@ struct _GumAllocationTrackerPrivate
 struct _GumAllocationTrackerBlock
 {
   guint size;
-  GumReturnAddress return_addresses[1];
+  GumStackId stack_id;
+};
+
+struct _GumAllocationTrackerSizeStats
+{
+  guint size;
+  volatile gint alive_now;
+  volatile gint alive_peak;
+  volatile gint total_peak;
+};
+
+struct _GumAllocationSamplerState
+{
+  gint64 bytes_until_sample;
+  guint32 random_state;
+};
+
+/*
+ * A heap profile node whose sums are kept unrounded while sampled blocks are
+ * added, so that rounding only happens once per node.
+ */
+struct _GumHeapProfileEstimate
+{
+  GumReturnAddress address;
+  gdouble size;
+  gdouble count;
+
+  GList * children;
 };
 
-#define GUM_ALLOCATION_TRACKER_LOCK(t) g_mutex_lock (&t->priv->mutex)
-#define GUM_ALLOCATION_TRACKER_UNLOCK(t) g_mutex_unlock (&t->priv->mutex)
+#define GUM_ALLOCATION_TRACKER_SHARD_LOCK(s) g_mutex_lock (&(s)->mutex)
+#define GUM_ALLOCATION_TRACKER_SHARD_UNLOCK(s) g_mutex_unlock (&(s)->mutex)
 
 static void gum_allocation_tracker_constructed (GObject * object);
 static void gum_allocation_tracker_set_property (GObject * object,
@@ -61,10 +115,31 @@ static void gum_allocation_tracker_get_property (GObject * object,
 static void gum_allocation_tracker_dispose (GObject * object);
 static void gum_allocation_tracker_finalize (GObject * object);
 
-static void gum_allocation_tracker_size_stats_add_block (
+static void gum_allocation_tracker_reset (GumAllocationTracker * self,
+    gboolean remove_groups);
+static GumAllocationTrackerShard * gum_allocation_tracker_get_shard (
+    GumAllocationTracker * self, gsize key);
+static void gum_allocation_tracker_block_free (
+    GumAllocationTrackerBlock * block);
+static gboolean gum_allocation_tracker_should_sample (
     GumAllocationTracker * self, guint size);
+static gint64 gum_allocation_sampler_state_next_threshold (
+    GumAllocationSamplerState * state, guint interval);
+
+static void gum_allocation_tracker_size_stats_add_block (
+    GumAllocationTracker * self, GumAllocationTrackerShard * shard,
+    guint size);
 static void gum_allocation_tracker_size_stats_remove_block (
-    GumAllocationTracker * self, guint size);
+    GumAllocationTrackerShard * shard, guint size);
+
+static GumHeapProfileEstimate * gum_heap_profile_estimate_new (
+    GumReturnAddress address);
+static void gum_heap_profile_estimate_add_stack (GumHeapProfileEstimate * root,
+    const GumReturnAddressArray * stack, gdouble size, gdouble count);
+static GumHeapProfileNode * gum_heap_profile_estimate_round (
+    GumHeapProfileEstimate * self);
+
+static GPrivate gum_allocation_sampler_key = G_PRIVATE_INIT (g_free);
 
 static void
 gum_allocation_tracker_class_init (GumAllocationTrackerClass * klass)
@@ -90,12 +165,16 @@ static void
 gum_allocation_tracker_init (GumAllocationTracker * self)
 {
   GumAllocationTrackerPrivate * priv;
+  guint i;
 
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GUM_TYPE_ALLOCATION_TRACKER,
       GumAllocationTrackerPrivate);
   priv = self->priv;
 
-  g_mutex_init (&priv->mutex);
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
+    g_mutex_init (&priv->shards[i].mutex);
+
+  g_mutex_init (&priv->size_stats_mutex);
 }
 
 static void
@@ -103,18 +182,26 @@ gum_allocation_tracker_constructed (GObject * object)
 {
   GumAllocationTracker * self = GUM_ALLOCATION_TRACKER (object);
   GumAllocationTrackerPrivate * priv = self->priv;
+  guint i;
 
-  if (priv->backtracer_instance != NULL)
-  {
-    priv->known_blocks_ht = g_hash_table_new_full (NULL, NULL, NULL, g_free);
-  }
-  else
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
   {
-    priv->known_blocks_ht = g_hash_table_new (NULL, NULL);
+    GumAllocationTrackerShard * shard = &priv->shards[i];
+
+    if (priv->backtracer_instance != NULL)
+    {
+      shard->known_blocks_ht = g_hash_table_new_full (NULL, NULL, NULL,
+          (GDestroyNotify) gum_allocation_tracker_block_free);
+    }
+    else
+    {
+      shard->known_blocks_ht = g_hash_table_new (NULL, NULL);
+    }
+
+    shard->size_stats_ht = g_hash_table_new (NULL, NULL);
   }
 
-  priv->block_groups_ht = g_hash_table_new_full (NULL, NULL, NULL,
-      (GDestroyNotify) gum_allocation_group_free);
+  priv->size_stats_ht = g_hash_table_new_full (NULL, NULL, NULL, g_free);
 }
 
 static void
@@ -176,6 +263,8 @@ gum_allocation_tracker_dispose (GObject * object)
 
   if (!priv->disposed)
   {
+    guint i;
+
     priv->disposed = TRUE;
 
     if (priv->backtracer_instance != NULL)
@@ -185,11 +274,19 @@ gum_allocation_tracker_dispose (GObject * object)
     }
     priv->backtracer_interface = NULL;
 
-    g_hash_table_unref (priv->known_blocks_ht);
-    priv->known_blocks_ht = NULL;
+    for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
+    {
+      GumAllocationTrackerShard * shard = &priv->shards[i];
 
-    g_hash_table_unref (priv->block_groups_ht);
-    priv->block_groups_ht = NULL;
+      g_hash_table_unref (shard->known_blocks_ht);
+      shard->known_blocks_ht = NULL;
+
+      g_hash_table_unref (shard->size_stats_ht);
+      shard->size_stats_ht = NULL;
+    }
+
+    g_hash_table_unref (priv->size_stats_ht);
+    priv->size_stats_ht = NULL;
   }
 
   G_OBJECT_CLASS (gum_allocation_tracker_parent_class)->dispose (object);
@@ -199,8 +296,12 @@ static void
 gum_allocation_tracker_finalize (GObject * object)
 {
   GumAllocationTracker * self = GUM_ALLOCATION_TRACKER (object);
+  guint i;
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
+    g_mutex_clear (&self->priv->shards[i].mutex);
 
-  g_mutex_clear (&self->priv->mutex);
+  g_mutex_clear (&self->priv->size_stats_mutex);
 
   G_OBJECT_CLASS (gum_allocation_tracker_parent_class)->finalize (object);
 }
@@ -232,79 +333,136 @@ gum_allocation_tracker_set_filter_function (GumAllocationTracker * self,
   priv->filter_func_user_data = user_data;
 }
 
+/*
+ * When the interval is non-zero, only allocations that cross a byte
+ * threshold drawn from an exponential distribution with that mean are
+ * recorded. Block counts and sizes then only cover the sampled blocks, and
+ * gum_allocation_tracker_peek_heap_profile() scales them back up.
+ */
 void
-gum_allocation_tracker_begin (GumAllocationTracker * self)
+gum_allocation_tracker_set_sample_interval (GumAllocationTracker * self,
+                                            guint interval)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-  priv->block_count = 0;
-  priv->block_total_size = 0;
-  g_hash_table_remove_all (priv->known_blocks_ht);
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+  g_assert (g_atomic_int_get (&priv->enabled) == FALSE);
+
+  priv->sample_interval = interval;
+}
+
+void
+gum_allocation_tracker_begin (GumAllocationTracker * self)
+{
+  gum_allocation_tracker_reset (self, FALSE);
 
-  g_atomic_int_set (&priv->enabled, TRUE);
+  g_atomic_int_set (&self->priv->enabled, TRUE);
 }
 
 void
 gum_allocation_tracker_end (GumAllocationTracker * self)
+{
+  g_atomic_int_set (&self->priv->enabled, FALSE);
+
+  gum_allocation_tracker_reset (self, TRUE);
+}
+
+/*
+ * Size statistics are zeroed rather than freed when groups are removed, as
+ * shards keep pointers to them. Groups that are all zero are not reported.
+ */
+static void
+gum_allocation_tracker_reset (GumAllocationTracker * self,
+                              gboolean remove_groups)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
+  guint i;
 
-  g_atomic_int_set (&priv->enabled, FALSE);
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
+  {
+    GumAllocationTrackerShard * shard = &priv->shards[i];
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-  priv->block_count = 0;
-  priv->block_total_size = 0;
-  g_hash_table_remove_all (priv->known_blocks_ht);
-  g_hash_table_remove_all (priv->block_groups_ht);
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+    GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+    shard->block_count = 0;
+    shard->block_total_size = 0;
+    g_hash_table_remove_all (shard->known_blocks_ht);
+    GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+  }
+
+  if (remove_groups)
+  {
+    GHashTableIter iter;
+    gpointer value;
+
+    g_mutex_lock (&priv->size_stats_mutex);
+    g_hash_table_iter_init (&iter, priv->size_stats_ht);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GumAllocationTrackerSizeStats * stats = value;
+
+      g_atomic_int_set (&stats->alive_now, 0);
+      g_atomic_int_set (&stats->alive_peak, 0);
+      g_atomic_int_set (&stats->total_peak, 0);
+    }
+    g_mutex_unlock (&priv->size_stats_mutex);
+  }
 }
 
 guint
 gum_allocation_tracker_peek_block_count (GumAllocationTracker * self)
 {
-  return self->priv->block_count;
+  guint count = 0, i;
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
+    count += self->priv->shards[i].block_count;
+
+  return count;
 }
 
 guint
 gum_allocation_tracker_peek_block_total_size (GumAllocationTracker * self)
 {
-  return self->priv->block_total_size;
+  guint total_size = 0, i;
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
+    total_size += self->priv->shards[i].block_total_size;
+
+  return total_size;
 }
 
 GList *
 gum_allocation_tracker_peek_block_list (GumAllocationTracker * self)
 {
   GList * blocks = NULL;
-  GHashTableIter iter;
-  gpointer key, value;
+  guint i;
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-  g_hash_table_iter_init (&iter, self->priv->known_blocks_ht);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
   {
-    if (self->priv->backtracer_instance != NULL)
-    {
-      GumAllocationTrackerBlock * tb = (GumAllocationTrackerBlock *) value;
-      GumAllocationBlock * block;
-      guint i;
+    GumAllocationTrackerShard * shard = &self->priv->shards[i];
+    GHashTableIter iter;
+    gpointer key, value;
 
-      block = gum_allocation_block_new (key, tb->size);
+    GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+    g_hash_table_iter_init (&iter, shard->known_blocks_ht);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (self->priv->backtracer_instance != NULL)
+      {
+        GumAllocationTrackerBlock * tb = (GumAllocationTrackerBlock *) value;
+        GumAllocationBlock * block;
 
-      for (i = 0; tb->return_addresses[i] != NULL; i++)
-        block->return_addresses.items[i] = tb->return_addresses[i];
-      block->return_addresses.len = i;
+        block = gum_allocation_block_new (key, tb->size);
+        gum_stack_depot_get (tb->stack_id, &block->return_addresses);
 
-      blocks = g_list_prepend (blocks, block);
-    }
-    else
-    {
-      blocks = g_list_prepend (blocks,
-          gum_allocation_block_new (key, GPOINTER_TO_UINT (value)));
+        blocks = g_list_prepend (blocks, block);
+      }
+      else
+      {
+        blocks = g_list_prepend (blocks,
+            gum_allocation_block_new (key, GPOINTER_TO_UINT (value)));
+      }
     }
+    GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
   }
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
 
   return blocks;
 }
@@ -312,17 +470,137 @@ gum_allocation_tracker_peek_block_list (GumAllocationTracker * self)
 GList *
 gum_allocation_tracker_peek_block_groups (GumAllocationTracker * self)
 {
-  GList * groups, * cur;
+  GumAllocationTrackerPrivate * priv = self->priv;
+  GList * groups = NULL;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_mutex_lock (&priv->size_stats_mutex);
+  g_hash_table_iter_init (&iter, priv->size_stats_ht);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+  {
+    GumAllocationTrackerSizeStats * stats = value;
+    GumAllocationGroup * group;
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-  groups = g_hash_table_get_values (self->priv->block_groups_ht);
-  for (cur = groups; cur != NULL; cur = cur->next)
-    cur->data = gum_allocation_group_copy ((GumAllocationGroup *) cur->data);
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+    if (g_atomic_int_get (&stats->total_peak) == 0)
+      continue;
+
+    group = gum_allocation_group_new (stats->size);
+    group->alive_now = (guint) g_atomic_int_get (&stats->alive_now);
+    group->alive_peak = (guint) g_atomic_int_get (&stats->alive_peak);
+    group->total_peak = (guint) g_atomic_int_get (&stats->total_peak);
+    groups = g_list_prepend (groups, group);
+  }
+  g_mutex_unlock (&priv->size_stats_mutex);
 
   return groups;
 }
 
+GumHeapProfileNode *
+gum_allocation_tracker_peek_heap_profile (GumAllocationTracker * self)
+{
+  GumAllocationTrackerPrivate * priv = self->priv;
+  GumHeapProfileEstimate * root;
+  guint i;
+
+  root = gum_heap_profile_estimate_new (NULL);
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
+  {
+    GumAllocationTrackerShard * shard = &priv->shards[i];
+    GHashTableIter iter;
+    gpointer value;
+
+    GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+    g_hash_table_iter_init (&iter, shard->known_blocks_ht);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GumReturnAddressArray stack;
+      guint size;
+      gdouble weight = 1.0;
+
+      if (priv->backtracer_instance != NULL)
+      {
+        GumAllocationTrackerBlock * block = value;
+
+        size = block->size;
+        gum_stack_depot_get (block->stack_id, &stack);
+      }
+      else
+      {
+        size = GPOINTER_TO_UINT (value);
+        stack.len = 0;
+      }
+
+      if (priv->sample_interval != 0)
+      {
+        gdouble probability;
+
+        probability = 1.0 - exp (-(gdouble) size / priv->sample_interval);
+        if (probability > 0.0)
+          weight = 1.0 / probability;
+      }
+
+      gum_heap_profile_estimate_add_stack (root, &stack, size * weight,
+          weight);
+    }
+    GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+  }
+
+  return gum_heap_profile_estimate_round (root);
+}
+
+/*
+ * Each shard is locked only while its blocks are copied out; sorting and
+ * grouping happen afterwards, without any locks held. In sampling mode the
+ * counts are of sampled blocks only.
+ */
+GumHeapSnapshot *
+gum_allocation_tracker_take_snapshot (GumAllocationTracker * self)
+{
+  GumAllocationTrackerPrivate * priv = self->priv;
+  GArray * entries;
+  guint length, i;
+
+  entries = g_array_sized_new (FALSE, FALSE, sizeof (GumHeapSnapshotEntry),
+      gum_allocation_tracker_peek_block_count (self));
+
+  for (i = 0; i != GUM_ALLOCATION_TRACKER_SHARD_COUNT; i++)
+  {
+    GumAllocationTrackerShard * shard = &priv->shards[i];
+    GHashTableIter iter;
+    gpointer value;
+
+    GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+    g_hash_table_iter_init (&iter, shard->known_blocks_ht);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GumHeapSnapshotEntry entry;
+
+      if (priv->backtracer_instance != NULL)
+      {
+        GumAllocationTrackerBlock * block = value;
+
+        entry.stack_id = block->stack_id;
+        entry.size = block->size;
+      }
+      else
+      {
+        entry.stack_id = GUM_STACK_ID_NONE;
+        entry.size = GPOINTER_TO_UINT (value);
+      }
+      entry.count = 1;
+
+      g_array_append_val (entries, entry);
+    }
+    GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
+  }
+
+  length = entries->len;
+  return gum_heap_snapshot_new_take_entries (
+      (GumHeapSnapshotEntry *) g_array_free (entries, FALSE), length);
+}
+
 void
 gum_allocation_tracker_on_malloc (GumAllocationTracker * self,
                                   gpointer address,
@@ -355,15 +633,19 @@ gum_allocation_tracker_on_malloc_full (GumAllocationTracker * self,
                                        const GumCpuContext * cpu_context)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
+  GumAllocationTrackerShard * shard;
   gpointer value;
 
   if (!g_atomic_int_get (&priv->enabled))
     return;
 
+  if (priv->sample_interval != 0 &&
+      !gum_allocation_tracker_should_sample (self, size))
+    return;
+
   if (priv->backtracer_instance != NULL)
   {
     gboolean do_backtrace = TRUE;
-    GumReturnAddressArray return_addresses;
     GumAllocationTrackerBlock * block;
 
     if (priv->filter_func != NULL)
@@ -372,26 +654,17 @@ gum_allocation_tracker_on_malloc_full (GumAllocationTracker * self,
           priv->filter_func_user_data);
     }
 
+    block = g_slice_new (GumAllocationTrackerBlock);
+    block->size = size;
+    block->stack_id = GUM_STACK_ID_NONE;
+
     if (do_backtrace)
     {
+      GumReturnAddressArray return_addresses;
+
       priv->backtracer_interface->generate (priv->backtracer_instance,
           cpu_context, &return_addresses);
-    }
-    else
-    {
-      return_addresses.len = 0;
-    }
-
-    block = (GumAllocationTrackerBlock *)
-        g_malloc (sizeof (GumAllocationTrackerBlock) +
-            (return_addresses.len * sizeof (GumReturnAddress)));
-    block->size = size;
-    block->return_addresses[return_addresses.len] = NULL;
-
-    if (return_addresses.len > 0)
-    {
-      memcpy (block->return_addresses, &return_addresses.items,
-          return_addresses.len * sizeof (GumReturnAddress));
+      block->stack_id = gum_stack_depot_put (&return_addresses);
     }
 
     value = block;
@@ -401,13 +674,15 @@ gum_allocation_tracker_on_malloc_full (GumAllocationTracker * self,
     value = GUINT_TO_POINTER (size);
   }
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
-
-  g_hash_table_insert (priv->known_blocks_ht, address, value);
+  shard = gum_allocation_tracker_get_shard (self,
+      GPOINTER_TO_SIZE (address));
 
-  gum_allocation_tracker_size_stats_add_block (self, size);
-
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+  GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+  g_hash_table_insert (shard->known_blocks_ht, address, value);
+  shard->block_count++;
+  shard->block_total_size += size;
+  gum_allocation_tracker_size_stats_add_block (self, shard, size);
+  GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
 }
 
 void
@@ -416,31 +691,36 @@ gum_allocation_tracker_on_free_full (GumAllocationTracker * self,
                                      const GumCpuContext * cpu_context)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
+  GumAllocationTrackerShard * shard;
   gpointer value;
+  guint size = 0;
 
   (void) cpu_context;
 
   if (!g_atomic_int_get (&priv->enabled))
     return;
 
-  GUM_ALLOCATION_TRACKER_LOCK (self);
+  shard = gum_allocation_tracker_get_shard (self,
+      GPOINTER_TO_SIZE (address));
+
+  GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
 
-  value = g_hash_table_lookup (priv->known_blocks_ht, address);
+  value = g_hash_table_lookup (shard->known_blocks_ht, address);
   if (value != NULL)
   {
-    guint size;
-
     if (priv->backtracer_instance != NULL)
       size = ((GumAllocationTrackerBlock *) value)->size;
     else
       size = GPOINTER_TO_UINT (value);
 
-    gum_allocation_tracker_size_stats_remove_block (self, size);
+    shard->block_count--;
+    shard->block_total_size -= size;
+    gum_allocation_tracker_size_stats_remove_block (shard, size);
 
-    g_hash_table_remove (priv->known_blocks_ht, address);
+    g_hash_table_remove (shard->known_blocks_ht, address);
   }
 
-  GUM_ALLOCATION_TRACKER_UNLOCK (self);
+  GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
 }
 
 void
@@ -459,41 +739,57 @@ gum_allocation_tracker_on_realloc_full (GumAllocationTracker * self,
   {
     if (new_size != 0)
     {
+      GumAllocationTrackerShard * shard;
       gpointer value;
+      guint old_size;
+
+      shard = gum_allocation_tracker_get_shard (self,
+          GPOINTER_TO_SIZE (old_address));
 
-      GUM_ALLOCATION_TRACKER_LOCK (self);
+      GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
 
-      value = g_hash_table_lookup (priv->known_blocks_ht, old_address);
+      value = g_hash_table_lookup (shard->known_blocks_ht, old_address);
       if (value != NULL)
       {
-        guint old_size;
-
-        g_hash_table_steal (priv->known_blocks_ht, old_address);
+        g_hash_table_steal (shard->known_blocks_ht, old_address);
 
         if (priv->backtracer_instance != NULL)
-        {
-          GumAllocationTrackerBlock * block;
+          old_size = ((GumAllocationTrackerBlock *) value)->size;
+        else
+          old_size = GPOINTER_TO_UINT (value);
 
-          block = (GumAllocationTrackerBlock *) value;
+        shard->block_count--;
+        shard->block_total_size -= old_size;
+        gum_allocation_tracker_size_stats_remove_block (shard, old_size);
+      }
 
-          g_hash_table_insert (priv->known_blocks_ht, new_address, block);
+      GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
 
-          old_size = block->size;
-          block->size = new_size;
-        }
-        else
+      if (value == NULL)
+      {
+        if (priv->sample_interval != 0)
         {
-          g_hash_table_insert (priv->known_blocks_ht, new_address,
-              GUINT_TO_POINTER (new_size));
-
-          old_size = GPOINTER_TO_UINT (value);
+          gum_allocation_tracker_on_malloc_full (self, new_address, new_size,
+              cpu_context);
         }
 
-        gum_allocation_tracker_size_stats_remove_block (self, old_size);
-        gum_allocation_tracker_size_stats_add_block (self, new_size);
+        return;
       }
 
-      GUM_ALLOCATION_TRACKER_UNLOCK (self);
+      if (priv->backtracer_instance != NULL)
+        ((GumAllocationTrackerBlock *) value)->size = new_size;
+      else
+        value = GUINT_TO_POINTER (new_size);
+
+      shard = gum_allocation_tracker_get_shard (self,
+          GPOINTER_TO_SIZE (new_address));
+
+      GUM_ALLOCATION_TRACKER_SHARD_LOCK (shard);
+      g_hash_table_insert (shard->known_blocks_ht, new_address, value);
+      shard->block_count++;
+      shard->block_total_size += new_size;
+      gum_allocation_tracker_size_stats_add_block (self, shard, new_size);
+      GUM_ALLOCATION_TRACKER_SHARD_UNLOCK (shard);
     }
     else
     {
@@ -507,43 +803,192 @@ gum_allocation_tracker_on_realloc_full (GumAllocationTracker * self,
   }
 }
 
+static GumAllocationTrackerShard *
+gum_allocation_tracker_get_shard (GumAllocationTracker * self,
+                                  gsize key)
+{
+  guint index;
+
+  index = ((guint64) key * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15)) >>
+      (64 - GUM_ALLOCATION_TRACKER_SHARD_BITS);
+
+  return &self->priv->shards[index];
+}
+
+static void
+gum_allocation_tracker_block_free (GumAllocationTrackerBlock * block)
+{
+  g_slice_free (GumAllocationTrackerBlock, block);
+}
+
+static gboolean
+gum_allocation_tracker_should_sample (GumAllocationTracker * self,
+                                      guint size)
+{
+  guint interval = self->priv->sample_interval;
+  GumAllocationSamplerState * state;
+
+  state = g_private_get (&gum_allocation_sampler_key);
+  if (G_UNLIKELY (state == NULL))
+  {
+    state = g_new (GumAllocationSamplerState, 1);
+    state->random_state = g_random_int () | 1;
+    state->bytes_until_sample =
+        gum_allocation_sampler_state_next_threshold (state, interval);
+    g_private_set (&gum_allocation_sampler_key, state);
+  }
+
+  state->bytes_until_sample -= size;
+  if (G_LIKELY (state->bytes_until_sample > 0))
+    return FALSE;
+
+  state->bytes_until_sample =
+      gum_allocation_sampler_state_next_threshold (state, interval);
+
+  return TRUE;
+}
+
+static gint64
+gum_allocation_sampler_state_next_threshold (GumAllocationSamplerState * state,
+                                             guint interval)
+{
+  guint32 x = state->random_state;
+  gdouble u;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  state->random_state = x;
+
+  /* Uniform in (0, 1], so the logarithm is always finite. */
+  u = ((x >> 8) + 1) / 16777216.0;
+
+  return (gint64) (-log (u) * interval) + 1;
+}
+
+/*
+ * Must be called with the shard's lock held. The peak is raised with a
+ * compare-and-swap to the count each increment produced, so it is exact even
+ * though blocks of the same size are tracked under different shard locks.
+ */
 static void
 gum_allocation_tracker_size_stats_add_block (GumAllocationTracker * self,
+                                             GumAllocationTrackerShard * shard,
                                              guint size)
 {
   GumAllocationTrackerPrivate * priv = self->priv;
-  GumAllocationGroup * group;
+  GumAllocationTrackerSizeStats * stats;
+  gint alive, peak;
 
-  priv->block_count++;
-  priv->block_total_size += size;
+  stats = g_hash_table_lookup (shard->size_stats_ht, GUINT_TO_POINTER (size));
+  if (stats == NULL)
+  {
+    g_mutex_lock (&priv->size_stats_mutex);
+    stats = g_hash_table_lookup (priv->size_stats_ht, GUINT_TO_POINTER (size));
+    if (stats == NULL)
+    {
+      stats = g_new0 (GumAllocationTrackerSizeStats, 1);
+      stats->size = size;
+      g_hash_table_insert (priv->size_stats_ht, GUINT_TO_POINTER (size),
+          stats);
+    }
+    g_mutex_unlock (&priv->size_stats_mutex);
 
-  group = (GumAllocationGroup *)
-      g_hash_table_lookup (priv->block_groups_ht, GUINT_TO_POINTER (size));
+    g_hash_table_insert (shard->size_stats_ht, GUINT_TO_POINTER (size), stats);
+  }
 
-  if (group == NULL)
+  alive = g_atomic_int_add (&stats->alive_now, 1) + 1;
+  do
   {
-    group = gum_allocation_group_new (size);
-    g_hash_table_insert (priv->block_groups_ht, GUINT_TO_POINTER (size),
-        group);
+    peak = g_atomic_int_get (&stats->alive_peak);
   }
+  while (alive > peak &&
+      !g_atomic_int_compare_and_exchange (&stats->alive_peak, peak, alive));
+  g_atomic_int_inc (&stats->total_peak);
+}
+
+/* Must be called with the shard's lock held. */
+static void
+gum_allocation_tracker_size_stats_remove_block (
+    GumAllocationTrackerShard * shard,
+    guint size)
+{
+  GumAllocationTrackerSizeStats * stats;
 
-  group->alive_now++;
-  if (group->alive_now > group->alive_peak)
-    group->alive_peak = group->alive_now;
-  group->total_peak++;
+  stats = g_hash_table_lookup (shard->size_stats_ht, GUINT_TO_POINTER (size));
+  if (stats != NULL)
+    g_atomic_int_add (&stats->alive_now, -1);
+}
+
+static GumHeapProfileEstimate *
+gum_heap_profile_estimate_new (GumReturnAddress address)
+{
+  GumHeapProfileEstimate * estimate;
+
+  estimate = g_slice_new0 (GumHeapProfileEstimate);
+  estimate->address = address;
+
+  return estimate;
 }
 
 static void
-gum_allocation_tracker_size_stats_remove_block (GumAllocationTracker * self,
-                                                guint size)
+gum_heap_profile_estimate_add_stack (GumHeapProfileEstimate * root,
+                                     const GumReturnAddressArray * stack,
+                                     gdouble size,
+                                     gdouble count)
 {
-  GumAllocationTrackerPrivate * priv = self->priv;
-  GumAllocationGroup * group;
+  GumHeapProfileEstimate * node = root;
+  gint i;
+
+  root->size += size;
+  root->count += count;
+
+  for (i = (gint) stack->len - 1; i >= 0; i--)
+  {
+    GumHeapProfileEstimate * child = NULL;
+    GList * cur;
+
+    for (cur = node->children; cur != NULL; cur = cur->next)
+    {
+      if (((GumHeapProfileEstimate *) cur->data)->address == stack->items[i])
+      {
+        child = cur->data;
+        break;
+      }
+    }
+
+    if (child == NULL)
+    {
+      child = gum_heap_profile_estimate_new (stack->items[i]);
+      node->children = g_list_prepend (node->children, child);
+    }
+
+    node = child;
+    node->size += size;
+    node->count += count;
+  }
+}
+
+/* Frees the estimate, returning an equivalent tree with rounded sums. */
+static GumHeapProfileNode *
+gum_heap_profile_estimate_round (GumHeapProfileEstimate * self)
+{
+  GumHeapProfileNode * node;
+  GList * cur;
+
+  node = gum_heap_profile_node_new (self->address);
+  node->size = (guint64) (self->size + 0.5);
+  node->count = (guint64) (self->count + 0.5);
+
+  for (cur = self->children; cur != NULL; cur = cur->next)
+  {
+    node->children = g_list_prepend (node->children,
+        gum_heap_profile_estimate_round (cur->data));
+  }
+  node->children = g_list_reverse (node->children);
 
-  priv->block_count--;
-  priv->block_total_size -= size;
+  g_list_free (self->children);
+  g_slice_free (GumHeapProfileEstimate, self);
 
-  group = (GumAllocationGroup *) g_hash_table_lookup (priv->block_groups_ht,
-      GUINT_TO_POINTER (size));
-  group->alive_now--;
+  return node;
 }
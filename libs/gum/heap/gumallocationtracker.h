@@ -11,6 +11,9 @@
 #include <gum/gumdefs.h>
 #include <gum/gumbacktracer.h>
 
+#include "gumheapprofile.h"
+#include "gumheapsnapshot.h"
+
 #define GUM_TYPE_ALLOCATION_TRACKER (gum_allocation_tracker_get_type ())
 #define GUM_ALLOCATION_TRACKER(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj),\
     GUM_TYPE_ALLOCATION_TRACKER, GumAllocationTracker))
@@ -56,6 +59,9 @@ GUM_API void gum_allocation_tracker_set_filter_function (
     GumAllocationTracker * self, GumAllocationTrackerFilterFunction filter,
     gpointer user_data);
 
+GUM_API void gum_allocation_tracker_set_sample_interval (
+    GumAllocationTracker * self, guint interval);
+
 GUM_API void gum_allocation_tracker_begin (GumAllocationTracker * self);
 GUM_API void gum_allocation_tracker_end (GumAllocationTracker * self);
 
@@ -67,6 +73,10 @@ GUM_API GList * gum_allocation_tracker_peek_block_list (
     GumAllocationTracker * self);
 GUM_API GList * gum_allocation_tracker_peek_block_groups (
     GumAllocationTracker * self);
+GUM_API GumHeapProfileNode * gum_allocation_tracker_peek_heap_profile (
+    GumAllocationTracker * self);
+GUM_API GumHeapSnapshot * gum_allocation_tracker_take_snapshot (
+    GumAllocationTracker * self);
 
 /*< Internal API */
 void gum_allocation_tracker_on_malloc (GumAllocationTracker * self,
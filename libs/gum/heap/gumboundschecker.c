@@ -10,20 +10,18 @@
 #include "guminterceptor.h"
 #include "gumlibc.h"
 #include "gumpagepool.h"
+#include "gumstackdepot.h"
 
 #include <stdlib.h>
 #include <string.h>
 
 #define DEFAULT_POOL_SIZE       4096
 #define DEFAULT_FRONT_ALIGNMENT   16
+#define DEFAULT_SEGMENT_COUNT     16
+#define DEFAULT_QUARANTINE_SIZE   64
 
-#define GUM_BOUNDS_CHECKER_LOCK()   (g_mutex_lock (&self->priv->mutex))
-#define GUM_BOUNDS_CHECKER_UNLOCK() (g_mutex_unlock (&self->priv->mutex))
-
-#define BLOCK_ALLOC_RETADDRS(b) \
-    ((GumReturnAddressArray *) (b)->guard)
-#define BLOCK_FREE_RETADDRS(b) \
-    ((GumReturnAddressArray *) ((guint8 *) (b)->guard + ((b)->guard_size / 2)))
+#define BLOCK_ALLOC_STACK_ID(b) (((GumStackId *) (b)->guard)[0])
+#define BLOCK_FREE_STACK_ID(b) (((GumStackId *) (b)->guard)[1])
 
 enum
 {
@@ -37,8 +35,6 @@ struct _GumBoundsCheckerPrivate
 {
   gboolean disposed;
 
-  GMutex mutex;
-
   GumBacktracerIface * backtracer_interface;
   GumBacktracer * backtracer_instance;
   GumBoundsOutputFunc output;
@@ -59,7 +55,6 @@ struct _GumBoundsCheckerPrivate
 #define GUM_BOUNDS_CHECKER_GET_PRIVATE(o) ((o)->priv)
 
 static void gum_bounds_checker_dispose (GObject * object);
-static void gum_bounds_checker_finalize (GObject * object);
 
 static void gum_bounds_checker_get_property (GObject * object,
     guint property_id, GValue * value, GParamSpec * pspec);
@@ -92,7 +87,6 @@ gum_bounds_checker_class_init (GumBoundsCheckerClass * klass)
   g_type_class_add_private (klass, sizeof (GumBoundsCheckerPrivate));
 
   object_class->dispose = gum_bounds_checker_dispose;
-  object_class->finalize = gum_bounds_checker_finalize;
   object_class->get_property = gum_bounds_checker_get_property;
   object_class->set_property = gum_bounds_checker_set_property;
 
@@ -124,8 +118,6 @@ gum_bounds_checker_init (GumBoundsChecker * self)
 
   priv = GUM_BOUNDS_CHECKER_GET_PRIVATE (self);
 
-  g_mutex_init (&priv->mutex);
-
   priv->interceptor = gum_interceptor_obtain ();
   priv->exceptor = gum_exceptor_obtain ();
   priv->pool_size = DEFAULT_POOL_SIZE;
@@ -164,16 +156,6 @@ gum_bounds_checker_dispose (GObject * object)
   G_OBJECT_CLASS (gum_bounds_checker_parent_class)->dispose (object);
 }
 
-static void
-gum_bounds_checker_finalize (GObject * object)
-{
-  GumBoundsChecker * self = GUM_BOUNDS_CHECKER (object);
-
-  g_mutex_clear (&self->priv->mutex);
-
-  G_OBJECT_CLASS (gum_bounds_checker_parent_class)->finalize (object);
-}
-
 static void
 gum_bounds_checker_get_property (GObject * object,
                                  guint property_id,
@@ -303,9 +285,12 @@ gum_bounds_checker_attach_to_apis (GumBoundsChecker * self,
   priv->heap_apis = gum_heap_api_list_copy (apis);
 
   g_assert (priv->page_pool == NULL);
-  priv->page_pool = gum_page_pool_new (GUM_PROTECT_MODE_ABOVE,
-      priv->pool_size);
-  g_object_set (priv->page_pool, "front-alignment", priv->front_alignment,
+  priv->page_pool = g_object_new (GUM_TYPE_PAGE_POOL,
+      "protect-mode", GUM_PROTECT_MODE_ABOVE,
+      "size", priv->pool_size,
+      "front-alignment", priv->front_alignment,
+      "segment-count", DEFAULT_SEGMENT_COUNT,
+      "quarantine-size", DEFAULT_QUARANTINE_SIZE,
       NULL);
 
   gum_interceptor_begin_transaction (priv->interceptor);
@@ -387,9 +372,7 @@ replacement_malloc (gsize size)
   if (self->priv->detaching || self->priv->handled_invalid_access)
     goto fallback;
 
-  GUM_BOUNDS_CHECKER_LOCK ();
   result = gum_bounds_checker_try_alloc (self, MAX (size, 1), ctx);
-  GUM_BOUNDS_CHECKER_UNLOCK ();
   if (result == NULL)
     goto fallback;
 
@@ -413,9 +396,7 @@ replacement_calloc (gsize num,
   if (self->priv->detaching || self->priv->handled_invalid_access)
     goto fallback;
 
-  GUM_BOUNDS_CHECKER_LOCK ();
   result = gum_bounds_checker_try_alloc (self, MAX (num * size, 1), ctx);
-  GUM_BOUNDS_CHECKER_UNLOCK ();
   if (result != NULL)
     gum_memset (result, 0, num * size);
   else
@@ -452,30 +433,20 @@ replacement_realloc (gpointer old_address,
   if (self->priv->detaching || self->priv->handled_invalid_access)
     goto fallback;
 
-  GUM_BOUNDS_CHECKER_LOCK ();
-
   if (!gum_page_pool_query_block_details (self->priv->page_pool, old_address,
       &old_block))
-  {
-    GUM_BOUNDS_CHECKER_UNLOCK ();
-
     goto fallback;
-  }
 
   result = gum_bounds_checker_try_alloc (self, new_size, ctx);
 
-  GUM_BOUNDS_CHECKER_UNLOCK ();
-
   if (result == NULL)
     result = malloc (new_size);
 
   if (result != NULL)
     gum_memcpy (result, old_address, MIN (old_block.size, new_size));
 
-  GUM_BOUNDS_CHECKER_LOCK ();
   success = gum_bounds_checker_try_free (self, old_address, ctx);
   g_assert (success);
-  GUM_BOUNDS_CHECKER_UNLOCK ();
 
   return result;
 
@@ -493,9 +464,7 @@ replacement_free (gpointer address)
   ctx = gum_interceptor_get_current_invocation ();
   self = GUM_RINCTX_GET_FUNC_DATA (ctx, GumBoundsChecker *);
 
-  GUM_BOUNDS_CHECKER_LOCK ();
   freed = gum_bounds_checker_try_free (self, address, ctx);
-  GUM_BOUNDS_CHECKER_UNLOCK ();
 
   if (!freed)
     free (address);
@@ -514,17 +483,17 @@ gum_bounds_checker_try_alloc (GumBoundsChecker * self,
   if (result != NULL && priv->backtracer_instance != NULL)
   {
     GumBlockDetails block;
+    GumReturnAddressArray allocated_at;
+
+    priv->backtracer_interface->generate (priv->backtracer_instance,
+        ctx->cpu_context, &allocated_at);
 
     gum_page_pool_query_block_details (priv->page_pool, result, &block);
 
     gum_mprotect (block.guard, block.guard_size, GUM_PAGE_RW);
 
-    g_assert_cmpuint (block.guard_size / 2,
-        >=, sizeof (GumReturnAddressArray));
-    priv->backtracer_interface->generate (priv->backtracer_instance,
-        ctx->cpu_context, BLOCK_ALLOC_RETADDRS (&block));
-
-    BLOCK_FREE_RETADDRS (&block)->len = 0;
+    BLOCK_ALLOC_STACK_ID (&block) = gum_stack_depot_put (&allocated_at);
+    BLOCK_FREE_STACK_ID (&block) = GUM_STACK_ID_NONE;
 
     gum_mprotect (block.guard, block.guard_size, GUM_PAGE_NO_ACCESS);
   }
@@ -538,27 +507,30 @@ gum_bounds_checker_try_free (GumBoundsChecker * self,
                              GumInvocationContext * ctx)
 {
   GumBoundsCheckerPrivate * priv = self->priv;
-  gboolean freed;
+  GumBlockDetails block;
 
-  freed = gum_page_pool_try_free (priv->page_pool, address);
+  if (!gum_page_pool_query_block_details (priv->page_pool, address, &block))
+    return FALSE;
 
-  if (freed && priv->backtracer_instance != NULL)
+  /*
+   * Stamp the block while we still own it, as once freed its pages may be
+   * handed to another thread.
+   */
+  if (block.allocated && priv->backtracer_instance != NULL)
   {
-    GumBlockDetails block;
+    GumReturnAddressArray freed_at;
 
-    gum_page_pool_query_block_details (priv->page_pool, address, &block);
+    priv->backtracer_interface->generate (priv->backtracer_instance,
+        ctx->cpu_context, &freed_at);
 
     gum_mprotect (block.guard, block.guard_size, GUM_PAGE_RW);
 
-    g_assert_cmpuint (block.guard_size / 2,
-        >=, sizeof (GumReturnAddressArray));
-    priv->backtracer_interface->generate (priv->backtracer_instance,
-        ctx->cpu_context, BLOCK_FREE_RETADDRS (&block));
+    BLOCK_FREE_STACK_ID (&block) = gum_stack_depot_put (&freed_at);
 
     gum_mprotect (block.guard, block.guard_size, GUM_PAGE_NO_ACCESS);
   }
 
-  return freed;
+  return gum_page_pool_try_free (priv->page_pool, address);
 }
 
 static gboolean
@@ -620,25 +592,24 @@ gum_bounds_checker_on_exception (GumExceptionDetails * details,
 
   if (priv->backtracer_instance != NULL)
   {
-    GumReturnAddressArray * allocated_at, * freed_at;
+    GumReturnAddressArray allocated_at, freed_at;
 
     gum_mprotect (block.guard, block.guard_size, GUM_PAGE_READ);
+    gum_stack_depot_get (BLOCK_ALLOC_STACK_ID (&block), &allocated_at);
+    gum_stack_depot_get (BLOCK_FREE_STACK_ID (&block), &freed_at);
+    gum_mprotect (block.guard, block.guard_size, GUM_PAGE_NO_ACCESS);
 
-    allocated_at = BLOCK_ALLOC_RETADDRS (&block);
-    if (allocated_at->len > 0)
+    if (allocated_at.len > 0)
     {
       g_string_append (message, "Allocated at:\n");
-      gum_bounds_checker_append_backtrace (allocated_at, message);
+      gum_bounds_checker_append_backtrace (&allocated_at, message);
     }
 
-    freed_at = BLOCK_FREE_RETADDRS (&block);
-    if (freed_at->len > 0)
+    if (freed_at.len > 0)
     {
       g_string_append (message, "Freed at:\n");
-      gum_bounds_checker_append_backtrace (freed_at, message);
+      gum_bounds_checker_append_backtrace (&freed_at, message);
     }
-
-    gum_mprotect (block.guard, block.guard_size, GUM_PAGE_NO_ACCESS);
   }
 
   priv->output (message->str, priv->output_user_data);
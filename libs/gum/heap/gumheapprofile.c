@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumheapprofile.h"
+
+static GumHeapProfileNode * gum_heap_profile_node_obtain_child (
+    GumHeapProfileNode * self, GumReturnAddress address);
+
+GumHeapProfileNode *
+gum_heap_profile_node_new (GumReturnAddress address)
+{
+  GumHeapProfileNode * node;
+
+  node = g_slice_new0 (GumHeapProfileNode);
+  node->address = address;
+
+  return node;
+}
+
+void
+gum_heap_profile_node_free (GumHeapProfileNode * node)
+{
+  GList * cur;
+
+  for (cur = node->children; cur != NULL; cur = cur->next)
+    gum_heap_profile_node_free (cur->data);
+  g_list_free (node->children);
+
+  g_slice_free (GumHeapProfileNode, node);
+}
+
+void
+gum_heap_profile_node_add_stack (GumHeapProfileNode * root,
+                                 const GumReturnAddressArray * stack,
+                                 guint64 size,
+                                 guint64 count)
+{
+  GumHeapProfileNode * node = root;
+  gint i;
+
+  root->size += size;
+  root->count += count;
+
+  for (i = (gint) stack->len - 1; i >= 0; i--)
+  {
+    node = gum_heap_profile_node_obtain_child (node, stack->items[i]);
+    node->size += size;
+    node->count += count;
+  }
+}
+
+static GumHeapProfileNode *
+gum_heap_profile_node_obtain_child (GumHeapProfileNode * self,
+                                    GumReturnAddress address)
+{
+  GumHeapProfileNode * child;
+  GList * cur;
+
+  for (cur = self->children; cur != NULL; cur = cur->next)
+  {
+    child = cur->data;
+    if (child->address == address)
+      return child;
+  }
+
+  child = gum_heap_profile_node_new (address);
+  self->children = g_list_prepend (self->children, child);
+
+  return child;
+}
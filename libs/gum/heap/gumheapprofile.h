@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_HEAP_PROFILE_H__
+#define __GUM_HEAP_PROFILE_H__
+
+#include <gum/gumdefs.h>
+#include <gum/gumreturnaddress.h>
+
+typedef struct _GumHeapProfileNode GumHeapProfileNode;
+
+/*
+ * A node in a tree of call stacks, rooted at the outermost frame. The size
+ * and count cover every live allocation made from this frame or below, and
+ * are estimates when the tracker is sampling.
+ */
+struct _GumHeapProfileNode
+{
+  GumReturnAddress address;
+  guint64 size;
+  guint64 count;
+
+  GList * children;
+};
+
+G_BEGIN_DECLS
+
+GUM_API GumHeapProfileNode * gum_heap_profile_node_new (
+    GumReturnAddress address);
+GUM_API void gum_heap_profile_node_free (GumHeapProfileNode * node);
+
+GUM_API void gum_heap_profile_node_add_stack (GumHeapProfileNode * root,
+    const GumReturnAddressArray * stack, guint64 size, guint64 count);
+
+G_END_DECLS
+
+#endif
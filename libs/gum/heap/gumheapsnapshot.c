@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumheapsnapshot.h"
+
+#include <stdlib.h>
+
+static GumHeapSnapshot * gum_heap_snapshot_new (GumHeapSnapshotEntry * entries,
+    guint length);
+static gint gum_heap_snapshot_entry_compare (const void * a, const void * b);
+
+GumHeapSnapshot *
+gum_heap_snapshot_new_take_entries (GumHeapSnapshotEntry * entries,
+                                    guint length)
+{
+  guint src, dst;
+
+  if (length > 1)
+  {
+    qsort (entries, length, sizeof (GumHeapSnapshotEntry),
+        gum_heap_snapshot_entry_compare);
+  }
+
+  dst = 0;
+  for (src = 0; src != length; src++)
+  {
+    GumHeapSnapshotEntry * previous = (dst != 0) ? &entries[dst - 1] : NULL;
+
+    if (previous != NULL &&
+        gum_heap_snapshot_entry_compare (previous, &entries[src]) == 0)
+    {
+      previous->count += entries[src].count;
+    }
+    else
+    {
+      entries[dst++] = entries[src];
+    }
+  }
+
+  return gum_heap_snapshot_new (entries, dst);
+}
+
+void
+gum_heap_snapshot_free (GumHeapSnapshot * snapshot)
+{
+  g_free (snapshot->entries);
+  g_slice_free (GumHeapSnapshot, snapshot);
+}
+
+GumHeapSnapshot *
+gum_heap_snapshot_diff (const GumHeapSnapshot * older,
+                        const GumHeapSnapshot * newer)
+{
+  GumHeapSnapshotEntry * entries;
+  guint length = 0, i = 0, j = 0;
+
+  entries = g_new (GumHeapSnapshotEntry,
+      MAX (older->length + newer->length, 1));
+
+  while (i != older->length || j != newer->length)
+  {
+    const GumHeapSnapshotEntry * a, * b;
+    gint order;
+
+    a = (i != older->length) ? &older->entries[i] : NULL;
+    b = (j != newer->length) ? &newer->entries[j] : NULL;
+
+    if (a == NULL)
+      order = 1;
+    else if (b == NULL)
+      order = -1;
+    else
+      order = gum_heap_snapshot_entry_compare (a, b);
+
+    if (order < 0)
+    {
+      entries[length] = *a;
+      entries[length].count = -a->count;
+      length++;
+      i++;
+    }
+    else if (order > 0)
+    {
+      entries[length++] = *b;
+      j++;
+    }
+    else
+    {
+      if (b->count != a->count)
+      {
+        entries[length] = *b;
+        entries[length].count = b->count - a->count;
+        length++;
+      }
+      i++;
+      j++;
+    }
+  }
+
+  return gum_heap_snapshot_new (entries, length);
+}
+
+static GumHeapSnapshot *
+gum_heap_snapshot_new (GumHeapSnapshotEntry * entries,
+                       guint length)
+{
+  GumHeapSnapshot * snapshot;
+  guint i;
+
+  snapshot = g_slice_new0 (GumHeapSnapshot);
+  snapshot->entries = entries;
+  snapshot->length = length;
+
+  for (i = 0; i != length; i++)
+  {
+    snapshot->total_count += entries[i].count;
+    snapshot->total_size += (gint64) entries[i].size * entries[i].count;
+  }
+
+  return snapshot;
+}
+
+static gint
+gum_heap_snapshot_entry_compare (const void * a,
+                                 const void * b)
+{
+  const GumHeapSnapshotEntry * entry_a = a;
+  const GumHeapSnapshotEntry * entry_b = b;
+
+  if (entry_a->stack_id != entry_b->stack_id)
+    return (entry_a->stack_id < entry_b->stack_id) ? -1 : 1;
+
+  if (entry_a->size != entry_b->size)
+    return (entry_a->size < entry_b->size) ? -1 : 1;
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_HEAP_SNAPSHOT_H__
+#define __GUM_HEAP_SNAPSHOT_H__
+
+#include <gum/gumdefs.h>
+#include <gum/gumstackdepot.h>
+
+typedef struct _GumHeapSnapshot GumHeapSnapshot;
+typedef struct _GumHeapSnapshotEntry GumHeapSnapshotEntry;
+
+/*
+ * Live blocks grouped by allocation stack and size. Entries are sorted by
+ * (stack_id, size) with no duplicates, so two snapshots can be diffed with a
+ * single merge pass. In a diff the counts are signed deltas.
+ */
+struct _GumHeapSnapshotEntry
+{
+  GumStackId stack_id;
+  guint size;
+  gint count;
+};
+
+struct _GumHeapSnapshot
+{
+  GumHeapSnapshotEntry * entries;
+  guint length;
+
+  gint64 total_count;
+  gint64 total_size;
+};
+
+G_BEGIN_DECLS
+
+GUM_API void gum_heap_snapshot_free (GumHeapSnapshot * snapshot);
+
+GUM_API GumHeapSnapshot * gum_heap_snapshot_diff (
+    const GumHeapSnapshot * older, const GumHeapSnapshot * newer);
+
+/*< Internal API */
+GumHeapSnapshot * gum_heap_snapshot_new_take_entries (
+    GumHeapSnapshotEntry * entries, guint length);
+
+G_END_DECLS
+
+#endif
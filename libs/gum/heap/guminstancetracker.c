@@ -21,15 +21,31 @@ G_DEFINE_TYPE_EXTENDED (GumInstanceTracker,
                         G_IMPLEMENT_INTERFACE (GUM_TYPE_INVOCATION_LISTENER,
                                                gum_instance_tracker_listener_iface_init))
 
+#define GUM_INSTANCE_TRACKER_SHARD_BITS 6
+#define GUM_INSTANCE_TRACKER_SHARD_COUNT \
+    (1 << GUM_INSTANCE_TRACKER_SHARD_BITS)
+
+typedef struct _GumInstanceTrackerShard GumInstanceTrackerShard;
 typedef enum _FunctionId FunctionId;
 
-struct _GumInstanceTrackerPrivate
+/*
+ * Instances live in the shard picked by their address, and each shard keeps
+ * per-type counts for the instances it holds, so that construction and
+ * finalization in different threads rarely contend. Totals are summed on
+ * read.
+ */
+struct _GumInstanceTrackerShard
 {
-  gboolean disposed;
-
   GMutex mutex;
   GHashTable * counter_ht;
   GHashTable * instances_ht;
+};
+
+struct _GumInstanceTrackerPrivate
+{
+  gboolean disposed;
+
+  GumInstanceTrackerShard shards[GUM_INSTANCE_TRACKER_SHARD_COUNT];
   GumInterceptor * interceptor;
 
   gboolean is_active;
@@ -45,13 +61,13 @@ enum _FunctionId
   FUNCTION_ID_FREE_INSTANCE
 };
 
-#define GUM_INSTANCE_TRACKER_LOCK()   g_mutex_lock   (&priv->mutex)
-#define GUM_INSTANCE_TRACKER_UNLOCK() g_mutex_unlock (&priv->mutex)
+#define GUM_INSTANCE_TRACKER_SHARD_LOCK(s) g_mutex_lock (&(s)->mutex)
+#define GUM_INSTANCE_TRACKER_SHARD_UNLOCK(s) g_mutex_unlock (&(s)->mutex)
 
-#define COUNTER_TABLE_GET(gtype) GPOINTER_TO_UINT (g_hash_table_lookup (\
-    priv->counter_ht, GUINT_TO_POINTER (gtype)))
-#define COUNTER_TABLE_SET(gtype, count) g_hash_table_insert (\
-    priv->counter_ht, GUINT_TO_POINTER (gtype), GUINT_TO_POINTER (count))
+#define COUNTER_TABLE_GET(s, gtype) GPOINTER_TO_UINT (g_hash_table_lookup (\
+    (s)->counter_ht, GUINT_TO_POINTER (gtype)))
+#define COUNTER_TABLE_SET(s, gtype, count) g_hash_table_insert (\
+    (s)->counter_ht, GUINT_TO_POINTER (gtype), GUINT_TO_POINTER (count))
 
 static void gum_instance_tracker_dispose (GObject * object);
 static void gum_instance_tracker_finalize (GObject * object);
@@ -61,6 +77,9 @@ static void gum_instance_tracker_on_enter (GumInvocationListener * listener,
 static void gum_instance_tracker_on_leave (GumInvocationListener * listener,
     GumInvocationContext * context);
 
+static GumInstanceTrackerShard * gum_instance_tracker_get_shard (
+    GumInstanceTracker * self, gconstpointer instance);
+
 static void
 gum_instance_tracker_class_init (GumInstanceTrackerClass * klass)
 {
@@ -88,20 +107,26 @@ static void
 gum_instance_tracker_init (GumInstanceTracker * self)
 {
   GumInstanceTrackerPrivate * priv;
+  guint i;
 
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
       GUM_TYPE_INSTANCE_TRACKER, GumInstanceTrackerPrivate);
 
   priv = self->priv;
 
-  g_mutex_init (&priv->mutex);
+  for (i = 0; i != GUM_INSTANCE_TRACKER_SHARD_COUNT; i++)
+  {
+    GumInstanceTrackerShard * shard = &priv->shards[i];
+
+    g_mutex_init (&shard->mutex);
 
-  priv->counter_ht = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-      NULL, NULL);
-  g_assert (priv->counter_ht != NULL);
+    shard->counter_ht = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+        NULL, NULL);
+    g_assert (shard->counter_ht != NULL);
 
-  priv->instances_ht = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-      NULL, NULL);
+    shard->instances_ht = g_hash_table_new_full (g_direct_hash,
+        g_direct_equal, NULL, NULL);
+  }
 
   priv->interceptor = gum_interceptor_obtain ();
 }
@@ -114,6 +139,8 @@ gum_instance_tracker_dispose (GObject * object)
 
   if (!priv->disposed)
   {
+    guint i;
+
     priv->disposed = TRUE;
 
     if (priv->is_active)
@@ -121,11 +148,16 @@ gum_instance_tracker_dispose (GObject * object)
 
     g_object_unref (priv->interceptor);
 
-    g_hash_table_unref (priv->counter_ht);
-    priv->counter_ht = NULL;
+    for (i = 0; i != GUM_INSTANCE_TRACKER_SHARD_COUNT; i++)
+    {
+      GumInstanceTrackerShard * shard = &priv->shards[i];
+
+      g_hash_table_unref (shard->counter_ht);
+      shard->counter_ht = NULL;
 
-    g_hash_table_unref (priv->instances_ht);
-    priv->instances_ht = NULL;
+      g_hash_table_unref (shard->instances_ht);
+      shard->instances_ht = NULL;
+    }
   }
 
   G_OBJECT_CLASS (gum_instance_tracker_parent_class)->dispose (object);
@@ -137,8 +169,10 @@ gum_instance_tracker_finalize (GObject * object)
   GumInstanceTracker * self = GUM_INSTANCE_TRACKER (object);
   GumInstanceTrackerPrivate * priv =
       self->priv;
+  guint i;
 
-  g_mutex_clear (&priv->mutex);
+  for (i = 0; i != GUM_INSTANCE_TRACKER_SHARD_COUNT; i++)
+    g_mutex_clear (&priv->shards[i].mutex);
 
   G_OBJECT_CLASS (gum_instance_tracker_parent_class)->finalize (object);
 }
@@ -267,24 +301,26 @@ gum_instance_tracker_peek_total_count (GumInstanceTracker * self,
                                        const gchar * type_name)
 {
   GumInstanceTrackerPrivate * priv = self->priv;
-  guint result = 0;
+  GType gtype = 0;
+  guint result = 0, i;
 
   if (type_name != NULL)
   {
-    GType gtype = g_type_from_name (type_name);
-
-    if (gtype != 0)
-    {
-      GUM_INSTANCE_TRACKER_LOCK ();
-      result = COUNTER_TABLE_GET (gtype);
-      GUM_INSTANCE_TRACKER_UNLOCK ();
-    }
+    gtype = g_type_from_name (type_name);
+    if (gtype == 0)
+      return 0;
   }
-  else
+
+  for (i = 0; i != GUM_INSTANCE_TRACKER_SHARD_COUNT; i++)
   {
-    GUM_INSTANCE_TRACKER_LOCK ();
-    result = g_hash_table_size (priv->instances_ht);
-    GUM_INSTANCE_TRACKER_UNLOCK ();
+    GumInstanceTrackerShard * shard = &priv->shards[i];
+
+    GUM_INSTANCE_TRACKER_SHARD_LOCK (shard);
+    if (gtype != 0)
+      result += COUNTER_TABLE_GET (shard, gtype);
+    else
+      result += g_hash_table_size (shard->instances_ht);
+    GUM_INSTANCE_TRACKER_SHARD_UNLOCK (shard);
   }
 
   return result;
@@ -294,11 +330,21 @@ GList *
 gum_instance_tracker_peek_instances (GumInstanceTracker * self)
 {
   GumInstanceTrackerPrivate * priv = self->priv;
-  GList * result;
+  GList * result = NULL;
+  guint i;
 
-  GUM_INSTANCE_TRACKER_LOCK ();
-  result = g_hash_table_get_keys (priv->instances_ht);
-  GUM_INSTANCE_TRACKER_UNLOCK ();
+  for (i = 0; i != GUM_INSTANCE_TRACKER_SHARD_COUNT; i++)
+  {
+    GumInstanceTrackerShard * shard = &priv->shards[i];
+    GHashTableIter iter;
+    gpointer key;
+
+    GUM_INSTANCE_TRACKER_SHARD_LOCK (shard);
+    g_hash_table_iter_init (&iter, shard->instances_ht);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+      result = g_list_prepend (result, key);
+    GUM_INSTANCE_TRACKER_SHARD_UNLOCK (shard);
+  }
 
   return result;
 }
@@ -309,34 +355,40 @@ gum_instance_tracker_walk_instances (GumInstanceTracker * self,
                                      gpointer user_data)
 {
   GumInstanceTrackerPrivate * priv = self->priv;
-  GHashTableIter iter;
-  gpointer key, value;
   GType gobject_type;
+  guint i;
 
   gobject_type = G_TYPE_OBJECT;
 
-  GUM_INSTANCE_TRACKER_LOCK ();
-
-  g_hash_table_iter_init (&iter, priv->instances_ht);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for (i = 0; i != GUM_INSTANCE_TRACKER_SHARD_COUNT; i++)
   {
-    const GTypeInstance * instance = (const GTypeInstance *) key;
-    GType type;
-    GumInstanceDetails details;
+    GumInstanceTrackerShard * shard = &priv->shards[i];
+    GHashTableIter iter;
+    gpointer key, value;
 
-    type = G_TYPE_FROM_INSTANCE (instance);
+    GUM_INSTANCE_TRACKER_SHARD_LOCK (shard);
 
-    details.address = instance;
-    if (g_type_is_a (type, gobject_type))
-      details.ref_count = ((const GObject *) instance)->ref_count;
-    else
-      details.ref_count = 1;
-    details.type_name = priv->vtable.type_id_to_name (type);
+    g_hash_table_iter_init (&iter, shard->instances_ht);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const GTypeInstance * instance = (const GTypeInstance *) key;
+      GType type;
+      GumInstanceDetails details;
 
-    func (&details, user_data);
-  }
+      type = G_TYPE_FROM_INSTANCE (instance);
+
+      details.address = instance;
+      if (g_type_is_a (type, gobject_type))
+        details.ref_count = ((const GObject *) instance)->ref_count;
+      else
+        details.ref_count = 1;
+      details.type_name = priv->vtable.type_id_to_name (type);
 
-  GUM_INSTANCE_TRACKER_UNLOCK ();
+      func (&details, user_data);
+    }
+
+    GUM_INSTANCE_TRACKER_SHARD_UNLOCK (shard);
+  }
 }
 
 void
@@ -345,6 +397,7 @@ gum_instance_tracker_add_instance (GumInstanceTracker * self,
                                    GType instance_type)
 {
   GumInstanceTrackerPrivate * priv = self->priv;
+  GumInstanceTrackerShard * shard;
   guint count;
 
   if (instance_type == G_TYPE_FROM_INSTANCE (self))
@@ -359,15 +412,17 @@ gum_instance_tracker_add_instance (GumInstanceTracker * self,
     }
   }
 
-  GUM_INSTANCE_TRACKER_LOCK ();
+  shard = gum_instance_tracker_get_shard (self, instance);
 
-  g_assert (g_hash_table_lookup (priv->instances_ht, instance) == NULL);
-  g_hash_table_insert (priv->instances_ht, instance, instance);
+  GUM_INSTANCE_TRACKER_SHARD_LOCK (shard);
 
-  count = COUNTER_TABLE_GET (instance_type);
-  COUNTER_TABLE_SET (instance_type, count + 1);
+  g_assert (g_hash_table_lookup (shard->instances_ht, instance) == NULL);
+  g_hash_table_insert (shard->instances_ht, instance, instance);
 
-  GUM_INSTANCE_TRACKER_UNLOCK ();
+  count = COUNTER_TABLE_GET (shard, instance_type);
+  COUNTER_TABLE_SET (shard, instance_type, count + 1);
+
+  GUM_INSTANCE_TRACKER_SHARD_UNLOCK (shard);
 }
 
 void
@@ -375,19 +430,34 @@ gum_instance_tracker_remove_instance (GumInstanceTracker * self,
                                       gpointer instance,
                                       GType instance_type)
 {
-  GumInstanceTrackerPrivate * priv = self->priv;
+  GumInstanceTrackerShard * shard;
   guint count;
 
-  GUM_INSTANCE_TRACKER_LOCK ();
+  shard = gum_instance_tracker_get_shard (self, instance);
+
+  GUM_INSTANCE_TRACKER_SHARD_LOCK (shard);
 
-  if (g_hash_table_remove (priv->instances_ht, instance))
+  if (g_hash_table_remove (shard->instances_ht, instance))
   {
-    count = COUNTER_TABLE_GET (instance_type);
+    count = COUNTER_TABLE_GET (shard, instance_type);
     if (count > 0)
-      COUNTER_TABLE_SET (instance_type, count - 1);
+      COUNTER_TABLE_SET (shard, instance_type, count - 1);
   }
 
-  GUM_INSTANCE_TRACKER_UNLOCK ();
+  GUM_INSTANCE_TRACKER_SHARD_UNLOCK (shard);
+}
+
+static GumInstanceTrackerShard *
+gum_instance_tracker_get_shard (GumInstanceTracker * self,
+                                gconstpointer instance)
+{
+  guint index;
+
+  index = ((guint64) GPOINTER_TO_SIZE (instance) *
+      G_GUINT64_CONSTANT (0x9e3779b97f4a7c15)) >>
+      (64 - GUM_INSTANCE_TRACKER_SHARD_BITS);
+
+  return &self->priv->shards[index];
 }
 
 static void
@@ -6,12 +6,17 @@
 
 #include "gumpagepool.h"
 #include "gummemory.h"
+#include "gumprocess.h"
 
 #define DEFAULT_PROTECT_MODE    GUM_PROTECT_MODE_ABOVE
 #define MIN_POOL_SIZE           2
 #define MAX_POOL_SIZE           G_MAXUINT32
 #define DEFAULT_POOL_SIZE       G_MAXUINT16
 #define DEFAULT_FRONT_ALIGNMENT 16
+#define DEFAULT_SEGMENT_COUNT   1
+#define MIN_SEGMENT_SIZE        64
+#define MAX_SEGMENT_COUNT       256
+#define DEFAULT_QUARANTINE_SIZE 0
 
 enum
 {
@@ -19,11 +24,14 @@ enum
   PROP_PAGE_SIZE,
   PROP_PROTECT_MODE,
   PROP_SIZE,
-  PROP_FRONT_ALIGNMENT
+  PROP_FRONT_ALIGNMENT,
+  PROP_SEGMENT_COUNT,
+  PROP_QUARANTINE_SIZE
 };
 
 G_DEFINE_TYPE (GumPagePool, gum_page_pool, G_TYPE_OBJECT);
 
+typedef struct _GumPagePoolSegment GumPagePoolSegment;
 typedef struct _AlignmentCriteria AlignmentCriteria;
 typedef struct _TailAlignResult   TailAlignResult;
 
@@ -36,13 +44,38 @@ struct _GumPagePoolPrivate
   GumProtectMode protect_mode;
   guint size;
   guint front_alignment;
+  guint segment_count;
+  guint quarantine_size;
 
   /*< state */
-  guint available;
-  guint cur_offset;
   guint8 * pool;
   guint8 * pool_end;
   GumBlockDetails * block_details;
+  guint8 * page_busy;
+  guint segment_size;
+  GumPagePoolSegment * segments;
+};
+
+/*
+ * The pool is split into segments of contiguous pages, each with its own lock,
+ * and threads allocate from the segment picked by their thread id. Freed
+ * blocks are protected right away, but may be held back in their segment's
+ * quarantine so that their pages are not handed out again until later frees
+ * push them out, a batch at a time.
+ */
+struct _GumPagePoolSegment
+{
+  GMutex mutex;
+
+  guint start;
+  guint end;
+  guint cur_offset;
+  guint available;
+  guint used;
+
+  guint * quarantine;
+  guint quarantine_head;
+  guint quarantine_length;
 };
 
 struct _AlignmentCriteria
@@ -68,16 +101,28 @@ static void gum_page_pool_get_property (GObject * object,
 static void gum_page_pool_set_property (GObject * object,
     guint property_id, const GValue * value, GParamSpec * pspec);
 
+static GumPagePoolSegment * get_segment_for_index (GumPagePool * self,
+    guint index);
+
+static gint try_alloc_in_segment (GumPagePool * self,
+    GumPagePoolSegment * segment, guint n_pages);
+static void quarantine_block_at (GumPagePool * self,
+    GumPagePoolSegment * segment, guint start_index);
+static void flush_quarantine (GumPagePool * self,
+    GumPagePoolSegment * segment, guint n_blocks);
+
 static gint find_start_index_with_n_free_pages (GumPagePool * self,
-    guint n_pages);
+    GumPagePoolSegment * segment, guint n_pages);
 static gint find_start_index_for_address (GumPagePool * self, const guint8 * p);
 
 static guint num_pages_needed_for (GumPagePool * self, guint size);
 
-static gpointer claim_n_pages_at (GumPagePool * self, guint n_pages,
-    guint start_index);
-static gpointer release_n_pages_at (GumPagePool * self, guint n_pages,
+static gpointer claim_n_pages_at (GumPagePool * self,
+    GumPagePoolSegment * segment, guint n_pages, guint start_index);
+static void protect_n_pages_at (GumPagePool * self, guint n_pages,
     guint start_index);
+static void release_n_pages_at (GumPagePool * self,
+    GumPagePoolSegment * segment, guint n_pages, guint start_index);
 
 static void tail_align (gpointer ptr, gsize size,
     const AlignmentCriteria * criteria, TailAlignResult * result);
@@ -114,6 +159,18 @@ gum_page_pool_class_init (GumPagePoolClass * klass)
       "Front alignment requirement",
       1, 64, DEFAULT_FRONT_ALIGNMENT,
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SEGMENT_COUNT,
+      g_param_spec_uint ("segment-count", "Segment Count",
+      "Number of independently locked segments",
+      1, MAX_SEGMENT_COUNT, DEFAULT_SEGMENT_COUNT,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_QUARANTINE_SIZE,
+      g_param_spec_uint ("quarantine-size", "Quarantine Size",
+      "Number of freed blocks held back from reuse per segment",
+      0, G_MAXUINT16, DEFAULT_QUARANTINE_SIZE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -130,6 +187,8 @@ gum_page_pool_init (GumPagePool * self)
   priv->protect_mode = DEFAULT_PROTECT_MODE;
   priv->size = DEFAULT_POOL_SIZE;
   priv->front_alignment = DEFAULT_FRONT_ALIGNMENT;
+  priv->segment_count = DEFAULT_SEGMENT_COUNT;
+  priv->quarantine_size = DEFAULT_QUARANTINE_SIZE;
 }
 
 static void
@@ -137,11 +196,34 @@ gum_page_pool_constructed (GObject * object)
 {
   GumPagePool * self = GUM_PAGE_POOL (object);
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  guint i;
 
-  priv->available = priv->size;
   priv->pool = gum_alloc_n_pages (priv->size, GUM_PAGE_NO_ACCESS);
   priv->pool_end = priv->pool + (priv->size * priv->page_size);
   priv->block_details = g_malloc0 (priv->size * sizeof (GumBlockDetails));
+  priv->page_busy = g_malloc0 (priv->size);
+
+  priv->segment_count = MAX (MIN (priv->segment_count,
+      priv->size / MIN_SEGMENT_SIZE), 1);
+  priv->segment_size = priv->size / priv->segment_count;
+  priv->segments = g_new0 (GumPagePoolSegment, priv->segment_count);
+
+  for (i = 0; i != priv->segment_count; i++)
+  {
+    GumPagePoolSegment * segment = &priv->segments[i];
+
+    g_mutex_init (&segment->mutex);
+
+    segment->start = i * priv->segment_size;
+    segment->end = (i == priv->segment_count - 1)
+        ? priv->size
+        : segment->start + priv->segment_size;
+    segment->cur_offset = segment->start;
+    segment->available = segment->end - segment->start;
+
+    if (priv->quarantine_size != 0)
+      segment->quarantine = g_new (guint, priv->quarantine_size);
+  }
 }
 
 static void
@@ -149,7 +231,18 @@ gum_page_pool_finalize (GObject * object)
 {
   GumPagePool * self = GUM_PAGE_POOL (object);
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  guint i;
+
+  for (i = 0; i != priv->segment_count; i++)
+  {
+    GumPagePoolSegment * segment = &priv->segments[i];
+
+    g_free (segment->quarantine);
+    g_mutex_clear (&segment->mutex);
+  }
+  g_free (priv->segments);
 
+  g_free (priv->page_busy);
   g_free (priv->block_details);
   gum_free_pages (priv->pool);
 
@@ -179,6 +272,12 @@ gum_page_pool_get_property (GObject * object,
     case PROP_FRONT_ALIGNMENT:
       g_value_set_uint (value, priv->front_alignment);
       break;
+    case PROP_SEGMENT_COUNT:
+      g_value_set_uint (value, priv->segment_count);
+      break;
+    case PROP_QUARANTINE_SIZE:
+      g_value_set_uint (value, priv->quarantine_size);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -204,6 +303,12 @@ gum_page_pool_set_property (GObject * object,
     case PROP_FRONT_ALIGNMENT:
       priv->front_alignment = g_value_get_uint (value);
       break;
+    case PROP_SEGMENT_COUNT:
+      priv->segment_count = g_value_get_uint (value);
+      break;
+    case PROP_QUARANTINE_SIZE:
+      priv->quarantine_size = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -224,47 +329,59 @@ gum_page_pool_try_alloc (GumPagePool * self,
                          guint size)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
-  gpointer result = NULL;
-  guint n_pages;
+  guint n_pages, first_segment, i;
 
   g_assert (size != 0);
 
   n_pages = num_pages_needed_for (self, size);
+  if (n_pages > priv->segment_size)
+    return NULL;
+
+  first_segment = gum_process_get_current_thread_id () % priv->segment_count;
 
-  if (n_pages <= priv->available)
+  for (i = 0; i != priv->segment_count; i++)
   {
+    GumPagePoolSegment * segment;
     gint start_index;
+    guint8 * page_start;
+    AlignmentCriteria align_criteria;
+    TailAlignResult align_result;
+    guint j;
 
-    start_index = find_start_index_with_n_free_pages (self, n_pages);
-    if (start_index >= 0)
-    {
-      guint8 * page_start;
-      AlignmentCriteria align_criteria;
-      TailAlignResult align_result;
-      guint i;
+    segment = &priv->segments[(first_segment + i) % priv->segment_count];
+
+    g_mutex_lock (&segment->mutex);
 
-      page_start = claim_n_pages_at (self, n_pages, start_index);
+    start_index = try_alloc_in_segment (self, segment, n_pages);
+    if (start_index < 0)
+    {
+      g_mutex_unlock (&segment->mutex);
+      continue;
+    }
 
-      align_criteria.front = priv->front_alignment;
-      align_criteria.tail = priv->page_size;
-      tail_align (page_start, size, &align_criteria, &align_result);
+    page_start = claim_n_pages_at (self, segment, n_pages, start_index);
 
-      for (i = start_index; i < start_index + n_pages; i++)
-      {
-        GumBlockDetails * details = &priv->block_details[i];
+    align_criteria.front = priv->front_alignment;
+    align_criteria.tail = priv->page_size;
+    tail_align (page_start, size, &align_criteria, &align_result);
 
-        details->address = align_result.aligned_ptr;
-        details->size = size;
+    for (j = start_index; j < start_index + n_pages; j++)
+    {
+      GumBlockDetails * details = &priv->block_details[j];
 
-        details->guard = page_start + ((n_pages - 1) * priv->page_size);
-        details->guard_size = priv->page_size;
-      }
+      details->address = align_result.aligned_ptr;
+      details->size = size;
 
-      result = align_result.aligned_ptr;
+      details->guard = page_start + ((n_pages - 1) * priv->page_size);
+      details->guard_size = priv->page_size;
     }
+
+    g_mutex_unlock (&segment->mutex);
+
+    return align_result.aligned_ptr;
   }
 
-  return result;
+  return NULL;
 }
 
 gboolean
@@ -272,15 +389,36 @@ gum_page_pool_try_free (GumPagePool * self,
                         gpointer mem)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
-  gint start_index;
-  guint n_pages;
+  gint index;
+  GumPagePoolSegment * segment;
+  GumBlockDetails * details;
 
-  start_index = find_start_index_for_address (self, mem);
-  if (start_index < 0)
+  index = find_start_index_for_address (self, mem);
+  if (index < 0)
     return FALSE;
 
-  n_pages = num_pages_needed_for (self, priv->block_details[start_index].size);
-  release_n_pages_at (self, n_pages, start_index);
+  segment = get_segment_for_index (self, index);
+
+  g_mutex_lock (&segment->mutex);
+
+  details = &priv->block_details[index];
+  if (details->allocated)
+  {
+    guint start_index, n_pages;
+
+    start_index = find_start_index_for_address (self, details->address);
+    n_pages = num_pages_needed_for (self, details->size);
+
+    protect_n_pages_at (self, n_pages, start_index);
+    segment->used -= n_pages;
+
+    if (priv->quarantine_size != 0)
+      quarantine_block_at (self, segment, start_index);
+    else
+      release_n_pages_at (self, segment, n_pages, start_index);
+  }
+
+  g_mutex_unlock (&segment->mutex);
 
   return TRUE;
 }
@@ -288,15 +426,39 @@ gum_page_pool_try_free (GumPagePool * self,
 guint
 gum_page_pool_peek_available (GumPagePool * self)
 {
-  return self->priv->available;
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  guint result = 0;
+  guint i;
+
+  for (i = 0; i != priv->segment_count; i++)
+  {
+    GumPagePoolSegment * segment = &priv->segments[i];
+
+    g_mutex_lock (&segment->mutex);
+    result += segment->available;
+    g_mutex_unlock (&segment->mutex);
+  }
+
+  return result;
 }
 
 guint
 gum_page_pool_peek_used (GumPagePool * self)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  guint result = 0;
+  guint i;
+
+  for (i = 0; i != priv->segment_count; i++)
+  {
+    GumPagePoolSegment * segment = &priv->segments[i];
 
-  return priv->size - priv->available;
+    g_mutex_lock (&segment->mutex);
+    result += segment->used;
+    g_mutex_unlock (&segment->mutex);
+  }
+
+  return result;
 }
 
 void
@@ -316,18 +478,93 @@ gum_page_pool_query_block_details (GumPagePool * self,
                                    GumBlockDetails * details)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
-  gint start_index;
+  gint index;
+  GumPagePoolSegment * segment;
 
-  start_index = find_start_index_for_address (self, mem);
-  if (start_index < 0)
+  index = find_start_index_for_address (self, mem);
+  if (index < 0)
     return FALSE;
 
-  *details = priv->block_details[start_index];
+  segment = get_segment_for_index (self, index);
+
+  g_mutex_lock (&segment->mutex);
+  *details = priv->block_details[index];
+  g_mutex_unlock (&segment->mutex);
+
   return TRUE;
 }
 
+static GumPagePoolSegment *
+get_segment_for_index (GumPagePool * self,
+                       guint index)
+{
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+
+  return &priv->segments[
+      MIN (index / priv->segment_size, priv->segment_count - 1)];
+}
+
+static gint
+try_alloc_in_segment (GumPagePool * self,
+                      GumPagePoolSegment * segment,
+                      guint n_pages)
+{
+  gint start_index = -1;
+
+  if (n_pages <= segment->available)
+    start_index = find_start_index_with_n_free_pages (self, segment, n_pages);
+
+  if (start_index < 0 && segment->quarantine_length != 0)
+  {
+    flush_quarantine (self, segment, segment->quarantine_length);
+    start_index = find_start_index_with_n_free_pages (self, segment, n_pages);
+  }
+
+  return start_index;
+}
+
+static void
+quarantine_block_at (GumPagePool * self,
+                     GumPagePoolSegment * segment,
+                     guint start_index)
+{
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+
+  if (segment->quarantine_length == priv->quarantine_size)
+    flush_quarantine (self, segment, MAX (priv->quarantine_size / 4, 1));
+
+  segment->quarantine[(segment->quarantine_head + segment->quarantine_length) %
+      priv->quarantine_size] = start_index;
+  segment->quarantine_length++;
+}
+
+static void
+flush_quarantine (GumPagePool * self,
+                  GumPagePoolSegment * segment,
+                  guint n_blocks)
+{
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+
+  n_blocks = MIN (n_blocks, segment->quarantine_length);
+
+  while (n_blocks-- != 0)
+  {
+    guint start_index;
+
+    start_index = segment->quarantine[segment->quarantine_head];
+    release_n_pages_at (self, segment,
+        num_pages_needed_for (self, priv->block_details[start_index].size),
+        start_index);
+
+    segment->quarantine_head =
+        (segment->quarantine_head + 1) % priv->quarantine_size;
+    segment->quarantine_length--;
+  }
+}
+
 static gint
 find_start_index_with_n_free_pages (GumPagePool * self,
+                                    GumPagePoolSegment * segment,
                                     guint n_pages)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
@@ -335,13 +572,13 @@ find_start_index_with_n_free_pages (GumPagePool * self,
   guint first_index;
   guint i, n;
 
-  first_index = priv->cur_offset;
+  first_index = segment->cur_offset;
 
 start_over:
 
-  for (i = first_index, n = 0; i < priv->size && n < n_pages; i++)
+  for (i = first_index, n = 0; i < segment->end && n < n_pages; i++)
   {
-    if (!priv->block_details[i].allocated)
+    if (!priv->page_busy[i])
       n++;
     else
       n = 0;
@@ -351,9 +588,9 @@ start_over:
   {
     result = i - n_pages;
   }
-  else if (first_index != 0)
+  else if (first_index != segment->start)
   {
-    first_index = 0;
+    first_index = segment->start;
     goto start_over;
   }
 
@@ -366,7 +603,7 @@ find_start_index_for_address (GumPagePool * self,
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
 
-  if (p < priv->pool || p > priv->pool_end)
+  if (p < priv->pool || p >= priv->pool_end)
     return -1;
 
   return (p - priv->pool) / priv->page_size;
@@ -390,6 +627,7 @@ num_pages_needed_for (GumPagePool * self,
 
 static gpointer
 claim_n_pages_at (GumPagePool * self,
+                  GumPagePoolSegment * segment,
                   guint n_pages,
                   guint start_index)
 {
@@ -399,14 +637,16 @@ claim_n_pages_at (GumPagePool * self,
 
   start_address = POOL_ADDRESS_FROM_PAGE_INDEX (start_index);
 
-  priv->cur_offset = start_index + n_pages;
-  priv->available -= n_pages;
+  segment->cur_offset = start_index + n_pages;
+  if (segment->cur_offset == segment->end)
+    segment->cur_offset = segment->start;
+  segment->available -= n_pages;
+  segment->used += n_pages;
 
   for (i = start_index; i < start_index + n_pages; i++)
   {
-    GumBlockDetails * details = &priv->block_details[i];
-
-    details->allocated = TRUE;
+    priv->page_busy[i] = TRUE;
+    priv->block_details[i].allocated = TRUE;
   }
 
   gum_mprotect (start_address, (n_pages - 1) * priv->page_size,
@@ -414,27 +654,34 @@ claim_n_pages_at (GumPagePool * self,
   return start_address;
 }
 
-static gpointer
-release_n_pages_at (GumPagePool * self,
+static void
+protect_n_pages_at (GumPagePool * self,
                     guint n_pages,
                     guint start_index)
 {
   GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
-  gpointer start_address;
   guint i;
 
-  priv->available += n_pages;
-
   for (i = start_index; i < start_index + n_pages; i++)
-  {
-    GumBlockDetails * details = &priv->block_details[i];
+    priv->block_details[i].allocated = FALSE;
 
-    details->allocated = FALSE;
-  }
+  gum_mprotect (POOL_ADDRESS_FROM_PAGE_INDEX (start_index),
+      (n_pages - 1) * priv->page_size, GUM_PAGE_NO_ACCESS);
+}
 
-  start_address = POOL_ADDRESS_FROM_PAGE_INDEX (start_index);
-  gum_mprotect (start_address, n_pages - 1, GUM_PAGE_NO_ACCESS);
-  return start_address;
+static void
+release_n_pages_at (GumPagePool * self,
+                    GumPagePoolSegment * segment,
+                    guint n_pages,
+                    guint start_index)
+{
+  GumPagePoolPrivate * priv = GUM_PAGE_POOL_GET_PRIVATE (self);
+  guint i;
+
+  segment->available += n_pages;
+
+  for (i = start_index; i < start_index + n_pages; i++)
+    priv->page_busy[i] = FALSE;
 }
 
 static void
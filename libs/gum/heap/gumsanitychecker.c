@@ -13,6 +13,7 @@
 #include "gumboundschecker.h"
 #include "guminstancetracker.h"
 #include "gummemory.h"
+#include "gumstackdepot.h"
 
 #include <string.h>
 
@@ -46,6 +47,8 @@ static void gum_sanity_checker_print_block_leaks_summary (
     GumSanityChecker * self, GList * block_groups);
 static void gum_sanity_checker_print_block_leaks_details (
     GumSanityChecker * self, GList * stale);
+static void gum_sanity_checker_print_growth_details (GumSanityChecker * self,
+    GPtrArray * grown);
 
 static GHashTable * gum_sanity_checker_count_leaks_by_type_name (
     GumSanityChecker * self, GList * instances);
@@ -61,6 +64,8 @@ static gint gum_sanity_checker_compare_groups (gconstpointer a,
     gconstpointer b, gpointer user_data);
 static gint gum_sanity_checker_compare_blocks (gconstpointer a,
     gconstpointer b, gpointer user_data);
+static gint gum_sanity_checker_compare_growth (gconstpointer a,
+    gconstpointer b);
 
 static void gum_sanity_checker_printf (GumSanityChecker * self,
     const gchar * format, ...);
@@ -326,6 +331,53 @@ gum_sanity_checker_end (GumSanityChecker * self)
   return all_checks_passed;
 }
 
+/*
+ * Snapshots can be taken while block leak checking is active, e.g. at
+ * intervals during a long-running sequence, and later compared with
+ * gum_sanity_checker_report_growth().
+ */
+GumHeapSnapshot *
+gum_sanity_checker_take_snapshot (GumSanityChecker * self)
+{
+  g_assert (self->priv->alloc_tracker != NULL);
+
+  return gum_allocation_tracker_take_snapshot (self->priv->alloc_tracker);
+}
+
+gboolean
+gum_sanity_checker_report_growth (GumSanityChecker * self,
+                                  const GumHeapSnapshot * older,
+                                  const GumHeapSnapshot * newer)
+{
+  GumHeapSnapshot * diff;
+  GPtrArray * grown;
+  guint i;
+  gboolean no_growth;
+
+  diff = gum_heap_snapshot_diff (older, newer);
+
+  grown = g_ptr_array_new ();
+  for (i = 0; i != diff->length; i++)
+  {
+    if (diff->entries[i].count > 0)
+      g_ptr_array_add (grown, &diff->entries[i]);
+  }
+
+  no_growth = grown->len == 0;
+  if (!no_growth)
+  {
+    g_ptr_array_sort (grown, gum_sanity_checker_compare_growth);
+
+    gum_sanity_checker_printf (self, "Block growth detected:\n\n");
+    gum_sanity_checker_print_growth_details (self, grown);
+  }
+
+  g_ptr_array_unref (grown);
+  gum_heap_snapshot_free (diff);
+
+  return no_growth;
+}
+
 static gboolean
 gum_sanity_checker_filter_out_gparam (GumInstanceTracker * tracker,
                                       GType gtype,
@@ -447,36 +499,56 @@ gum_sanity_checker_print_block_leaks_details (GumSanityChecker * self,
                                               GList * stale)
 {
   GList * blocks, * cur;
+  GPtrArray * arrays;
+  guint n_items, item_index, i;
+  GumReturnAddressDetails * details;
+  gboolean * resolved;
 
   blocks = g_list_copy (stale);
   blocks = g_list_sort_with_data (blocks,
       gum_sanity_checker_compare_blocks, self);
 
+  arrays = g_ptr_array_new ();
+  n_items = 0;
+  for (cur = blocks; cur != NULL; cur = cur->next)
+  {
+    GumAllocationBlock * block = (GumAllocationBlock *) cur->data;
+
+    g_ptr_array_add (arrays, &block->return_addresses);
+    n_items += block->return_addresses.len;
+  }
+
+  details = g_new (GumReturnAddressDetails, MAX (n_items, 1));
+  resolved = g_new (gboolean, MAX (n_items, 1));
+  gum_return_address_details_from_arrays (
+      (const GumReturnAddressArray * const *) arrays->pdata, arrays->len,
+      details, resolved);
+
   gum_sanity_checker_print (self, "\tAddress\t\tSize\n");
   gum_sanity_checker_print (self, "\t--------\t----\n");
 
+  item_index = 0;
   for (cur = blocks; cur != NULL; cur = cur->next)
   {
     GumAllocationBlock * block = (GumAllocationBlock *) cur->data;
-    guint i;
 
     gum_sanity_checker_printf (self, "\t%p\t%u\n",
         block->address, block->size);
 
-    for (i = 0; i != block->return_addresses.len; i++)
+    for (i = 0; i != block->return_addresses.len; i++, item_index++)
     {
       GumReturnAddress addr = block->return_addresses.items[i];
-      GumReturnAddressDetails rad;
+      const GumReturnAddressDetails * rad = &details[item_index];
 
-      if (gum_return_address_details_from_address (addr, &rad))
+      if (resolved[item_index])
       {
         gchar * file_basename;
 
-        file_basename = g_path_get_basename (rad.file_name);
+        file_basename = g_path_get_basename (rad->file_name);
         gum_sanity_checker_printf (self, "\t    %p %s!%s %s:%u\n",
-            rad.address,
-            rad.module_name, rad.function_name,
-            file_basename, rad.line_number);
+            rad->address,
+            rad->module_name, rad->function_name,
+            file_basename, rad->line_number);
         g_free (file_basename);
       }
       else
@@ -486,9 +558,84 @@ gum_sanity_checker_print_block_leaks_details (GumSanityChecker * self,
     }
   }
 
+  g_free (resolved);
+  g_free (details);
+  g_ptr_array_unref (arrays);
+
   g_list_free (blocks);
 }
 
+static void
+gum_sanity_checker_print_growth_details (GumSanityChecker * self,
+                                         GPtrArray * grown)
+{
+  GumReturnAddressArray * stacks;
+  GPtrArray * arrays;
+  guint n_items, item_index, i, j;
+  GumReturnAddressDetails * details;
+  gboolean * resolved;
+
+  stacks = g_new (GumReturnAddressArray, grown->len);
+  arrays = g_ptr_array_sized_new (grown->len);
+  n_items = 0;
+  for (i = 0; i != grown->len; i++)
+  {
+    const GumHeapSnapshotEntry * entry = g_ptr_array_index (grown, i);
+
+    if (entry->stack_id != GUM_STACK_ID_NONE)
+      gum_stack_depot_get (entry->stack_id, &stacks[i]);
+    else
+      stacks[i].len = 0;
+
+    g_ptr_array_add (arrays, &stacks[i]);
+    n_items += stacks[i].len;
+  }
+
+  details = g_new (GumReturnAddressDetails, MAX (n_items, 1));
+  resolved = g_new (gboolean, MAX (n_items, 1));
+  gum_return_address_details_from_arrays (
+      (const GumReturnAddressArray * const *) arrays->pdata, arrays->len,
+      details, resolved);
+
+  gum_sanity_checker_print (self, "\tCount\tSize\n");
+  gum_sanity_checker_print (self, "\t-----\t----\n");
+
+  item_index = 0;
+  for (i = 0; i != grown->len; i++)
+  {
+    const GumHeapSnapshotEntry * entry = g_ptr_array_index (grown, i);
+
+    gum_sanity_checker_printf (self, "\t+%d\t%u\n",
+        entry->count, entry->size);
+
+    for (j = 0; j != stacks[i].len; j++, item_index++)
+    {
+      const GumReturnAddressDetails * rad = &details[item_index];
+
+      if (resolved[item_index])
+      {
+        gchar * file_basename;
+
+        file_basename = g_path_get_basename (rad->file_name);
+        gum_sanity_checker_printf (self, "\t    %p %s!%s %s:%u\n",
+            rad->address,
+            rad->module_name, rad->function_name,
+            file_basename, rad->line_number);
+        g_free (file_basename);
+      }
+      else
+      {
+        gum_sanity_checker_printf (self, "\t    %p\n", stacks[i].items[j]);
+      }
+    }
+  }
+
+  g_free (resolved);
+  g_free (details);
+  g_ptr_array_unref (arrays);
+  g_free (stacks);
+}
+
 static GHashTable *
 gum_sanity_checker_count_leaks_by_type_name (GumSanityChecker * self,
                                              GList * instances)
@@ -636,6 +783,36 @@ gum_sanity_checker_compare_blocks (gconstpointer a,
     return 0;
 }
 
+static gint
+gum_sanity_checker_compare_growth (gconstpointer a,
+                                   gconstpointer b)
+{
+  const GumHeapSnapshotEntry * entry_a =
+      *((const GumHeapSnapshotEntry * const *) a);
+  const GumHeapSnapshotEntry * entry_b =
+      *((const GumHeapSnapshotEntry * const *) b);
+  gint64 bytes_a, bytes_b;
+
+  bytes_a = (gint64) entry_a->size * entry_a->count;
+  bytes_b = (gint64) entry_b->size * entry_b->count;
+  if (bytes_a > bytes_b)
+    return -1;
+  else if (bytes_a < bytes_b)
+    return 1;
+
+  /* g_ptr_array_sort() is not stable, so keep equal growth in order */
+  if (entry_a->stack_id < entry_b->stack_id)
+    return -1;
+  else if (entry_a->stack_id > entry_b->stack_id)
+    return 1;
+  else if (entry_a->size > entry_b->size)
+    return -1;
+  else if (entry_a->size < entry_b->size)
+    return 1;
+  else
+    return 0;
+}
+
 static void
 gum_sanity_checker_printf (GumSanityChecker * self,
                            const gchar * format,
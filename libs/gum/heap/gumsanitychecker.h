@@ -8,6 +8,7 @@
 #define __GUM_SANITY_CHECKER_H__
 
 #include "gumheapapi.h"
+#include "gumheapsnapshot.h"
 
 typedef guint GumSanityCheckFlags;
 
@@ -51,6 +52,11 @@ GUM_API gboolean gum_sanity_checker_run (GumSanityChecker * self,
 GUM_API void gum_sanity_checker_begin (GumSanityChecker * self, guint flags);
 GUM_API gboolean gum_sanity_checker_end (GumSanityChecker * self);
 
+GUM_API GumHeapSnapshot * gum_sanity_checker_take_snapshot (
+    GumSanityChecker * self);
+GUM_API gboolean gum_sanity_checker_report_growth (GumSanityChecker * self,
+    const GumHeapSnapshot * older, const GumHeapSnapshot * newer);
+
 G_END_DECLS
 
 #endif
@@ -6,6 +6,8 @@
 
 #include "gumbusycyclesampler.h"
 
+#include <time.h>
+
 static void gum_busy_cycle_sampler_iface_init (gpointer g_iface,
     gpointer iface_data);
 static GumSample gum_busy_cycle_sampler_sample (GumSampler * sampler);
@@ -49,12 +51,20 @@ gum_busy_cycle_sampler_new (void)
 gboolean
 gum_busy_cycle_sampler_is_available (GumBusyCycleSampler * self)
 {
-  return FALSE;
+  return TRUE;
 }
 
 static GumSample
 gum_busy_cycle_sampler_sample (GumSampler * sampler)
 {
-  /* TODO: implement */
-  return 0;
+  struct timespec t;
+
+  /*
+   * The calling thread's CPU clock only advances while it is on a CPU, so
+   * time spent blocked is excluded. Like on Darwin we don't bother
+   * converting to cycles as GumSample is an abstract unit anyway.
+   */
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &t);
+
+  return ((GumSample) t.tv_sec * G_GUINT64_CONSTANT (1000000000)) + t.tv_nsec;
 }
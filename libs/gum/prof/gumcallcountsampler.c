@@ -11,6 +11,10 @@
 #include "gumsymbolutil.h"
 #include "gumtls.h"
 
+#include <string.h>
+
+typedef struct _GumCallCountSlab GumCallCountSlab;
+
 static void gum_call_count_sampler_sampler_iface_init (gpointer g_iface,
     gpointer iface_data);
 static void gum_call_count_sampler_listener_iface_init (gpointer g_iface,
@@ -26,17 +30,34 @@ static void gum_call_count_sampler_on_enter (
 static void gum_call_count_sampler_on_leave (
     GumInvocationListener * listener, GumInvocationContext * context);
 
+static GumCallCountSlab * gum_call_count_sampler_add_slab (
+    GumCallCountSampler * self);
+static void gum_call_count_sampler_grow_slab (GumCallCountSampler * self,
+    GumCallCountSlab * slab);
+static void gum_call_count_slab_free (GumCallCountSlab * slab);
+
 struct _GumCallCountSamplerPrivate
 {
   gboolean disposed;
 
   GumInterceptor * interceptor;
 
-  volatile gint total_count;
-
   GumTlsKey tls_key;
   GMutex mutex;
-  GSList * counters;
+  guint function_count;
+  GPtrArray * slabs;
+};
+
+/*
+ * Each thread counts into its own slab, with one counter per function, so
+ * counting never writes to memory shared with other threads. The depth
+ * tracks how many counted calls the thread is currently inside.
+ */
+struct _GumCallCountSlab
+{
+  GumSample * counts;
+  guint capacity;
+  guint depth;
 };
 
 G_DEFINE_TYPE_EXTENDED (GumCallCountSampler,
@@ -95,6 +116,8 @@ gum_call_count_sampler_init (GumCallCountSampler * self)
 
   priv->tls_key = gum_tls_key_new ();
   g_mutex_init (&priv->mutex);
+  priv->slabs = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gum_call_count_slab_free);
 }
 
 static void
@@ -124,8 +147,7 @@ gum_call_count_sampler_finalize (GObject * object)
   gum_tls_key_free (priv->tls_key);
   g_mutex_clear (&priv->mutex);
 
-  g_slist_foreach (priv->counters, (GFunc) g_free, NULL);
-  g_slist_free (priv->counters);
+  g_ptr_array_unref (priv->slabs);
 
   G_OBJECT_CLASS (gum_call_count_sampler_parent_class)->finalize (object);
 }
@@ -225,58 +247,80 @@ gum_call_count_sampler_add_function (GumCallCountSampler * self,
                                      gpointer function)
 {
   GumCallCountSamplerPrivate * priv = self->priv;
+  guint slot;
   GumAttachReturn attach_ret;
 
+  g_mutex_lock (&priv->mutex);
+  slot = priv->function_count++;
+  g_mutex_unlock (&priv->mutex);
+
   attach_ret = gum_interceptor_attach_listener (priv->interceptor,
-      function, GUM_INVOCATION_LISTENER (self), NULL);
+      function, GUM_INVOCATION_LISTENER (self), GUINT_TO_POINTER (slot));
   g_assert (attach_ret == GUM_ATTACH_OK);
 }
 
 GumSample
 gum_call_count_sampler_peek_total_count (GumCallCountSampler * self)
 {
-  return g_atomic_int_get (&self->priv->total_count);
+  GumCallCountSamplerPrivate * priv = self->priv;
+  GumSample total = 0;
+  guint i, slot;
+
+  g_mutex_lock (&priv->mutex);
+  for (i = 0; i != priv->slabs->len; i++)
+  {
+    GumCallCountSlab * slab = g_ptr_array_index (priv->slabs, i);
+
+    for (slot = 0; slot != slab->capacity; slot++)
+      total += slab->counts[slot];
+  }
+  g_mutex_unlock (&priv->mutex);
+
+  return total;
 }
 
 static GumSample
 gum_call_count_sampler_sample (GumSampler * sampler)
 {
   GumCallCountSampler * self = GUM_CALL_COUNT_SAMPLER_CAST (sampler);
-  GumSample * counter;
+  GumCallCountSlab * slab;
+  GumSample total = 0;
+  guint slot;
+
+  slab = (GumCallCountSlab *) gum_tls_key_get_value (self->priv->tls_key);
+  if (slab != NULL)
+  {
+    for (slot = 0; slot != slab->capacity; slot++)
+      total += slab->counts[slot];
+  }
 
-  counter = (GumSample *) gum_tls_key_get_value (self->priv->tls_key);
-  if (counter != NULL)
-    return *counter;
-  else
-    return 0;
+  return total;
 }
 
+/*
+ * Only outermost calls are counted, so e.g. realloc (NULL, n) calling into
+ * malloc counts once when both are hooked.
+ */
 static void
 gum_call_count_sampler_on_enter (GumInvocationListener * listener,
                                  GumInvocationContext * context)
 {
   GumCallCountSampler * self = GUM_CALL_COUNT_SAMPLER_CAST (listener);
-  GumCallCountSamplerPrivate * priv = self->priv;
-  GumSample * counter;
+  GumCallCountSlab * slab;
+  guint slot;
 
-  (void) context;
+  slab = (GumCallCountSlab *) gum_tls_key_get_value (self->priv->tls_key);
+  if (G_UNLIKELY (slab == NULL))
+    slab = gum_call_count_sampler_add_slab (self);
 
-  gum_interceptor_ignore_current_thread (priv->interceptor);
+  if (slab->depth++ != 0)
+    return;
 
-  counter = (GumSample *) gum_tls_key_get_value (priv->tls_key);
-  if (counter == NULL)
-  {
-    counter = g_new0 (GumSample, 1);
+  slot = GPOINTER_TO_UINT (GUM_LINCTX_GET_FUNC_DATA (context, gpointer));
+  if (G_UNLIKELY (slot >= slab->capacity))
+    gum_call_count_sampler_grow_slab (self, slab);
 
-    g_mutex_lock (&priv->mutex);
-    priv->counters = g_slist_prepend (priv->counters, counter);
-    g_mutex_unlock (&priv->mutex);
-
-    gum_tls_key_set_value (priv->tls_key, counter);
-  }
-
-  g_atomic_int_inc (&priv->total_count);
-  (*counter)++;
+  slab->counts[slot]++;
 }
 
 static void
@@ -284,8 +328,52 @@ gum_call_count_sampler_on_leave (GumInvocationListener * listener,
                                  GumInvocationContext * context)
 {
   GumCallCountSampler * self = GUM_CALL_COUNT_SAMPLER_CAST (listener);
+  GumCallCountSlab * slab;
 
   (void) context;
 
-  gum_interceptor_unignore_current_thread (self->priv->interceptor);
+  slab = (GumCallCountSlab *) gum_tls_key_get_value (self->priv->tls_key);
+  slab->depth--;
+}
+
+static GumCallCountSlab *
+gum_call_count_sampler_add_slab (GumCallCountSampler * self)
+{
+  GumCallCountSamplerPrivate * priv = self->priv;
+  GumCallCountSlab * slab;
+
+  slab = g_slice_new0 (GumCallCountSlab);
+
+  g_mutex_lock (&priv->mutex);
+  g_ptr_array_add (priv->slabs, slab);
+  g_mutex_unlock (&priv->mutex);
+
+  gum_tls_key_set_value (priv->tls_key, slab);
+
+  return slab;
+}
+
+static void
+gum_call_count_sampler_grow_slab (GumCallCountSampler * self,
+                                  GumCallCountSlab * slab)
+{
+  GumCallCountSamplerPrivate * priv = self->priv;
+  guint capacity;
+
+  g_mutex_lock (&priv->mutex);
+
+  capacity = priv->function_count;
+  slab->counts = g_renew (GumSample, slab->counts, capacity);
+  memset (slab->counts + slab->capacity, 0,
+      (capacity - slab->capacity) * sizeof (GumSample));
+  slab->capacity = capacity;
+
+  g_mutex_unlock (&priv->mutex);
+}
+
+static void
+gum_call_count_slab_free (GumCallCountSlab * slab)
+{
+  g_free (slab->counts);
+  g_slice_free (GumCallCountSlab, slab);
 }
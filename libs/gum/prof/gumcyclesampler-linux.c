@@ -8,12 +8,20 @@
 
 #include "gumlibc.h"
 
+#include <pthread.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 
-# define PERF_TYPE_HARDWARE       0
-# define PERF_COUNT_HW_CPU_CYCLES 0
+# define PERF_TYPE_HARDWARE           0
+# define PERF_COUNT_HW_CPU_CYCLES     0
+# define PERF_COUNT_HW_INSTRUCTIONS   1
+# define PERF_COUNT_HW_CACHE_MISSES   3
+
+typedef enum _GumCycleSamplerMode GumCycleSamplerMode;
+typedef struct _GumPerfCounter GumPerfCounter;
+typedef struct _GumPerfEventMmapPage GumPerfEventMmapPage;
 
 struct perf_event_attr
 {
@@ -57,15 +65,72 @@ struct perf_event_attr
   guint64 __reserved_3;
 };
 
-struct _GumCycleSamplerPrivate
+/* The leading part of the kernel's struct perf_event_mmap_page. */
+struct _GumPerfEventMmapPage
+{
+  guint32 version;
+  guint32 compat_version;
+  volatile guint32 lock;
+  guint32 index;
+  gint64 offset;
+  guint64 time_enabled;
+  guint64 time_running;
+  guint64 capabilities;
+  guint16 pmc_width;
+};
+
+#define GUM_PERF_CAP_USER_RDPMC (1 << 2)
+
+enum _GumCycleSamplerMode
+{
+  GUM_CYCLE_SAMPLER_UNAVAILABLE,
+  GUM_CYCLE_SAMPLER_PERF,
+  GUM_CYCLE_SAMPLER_RDTSC
+};
+
+/*
+ * A perf counter only counts for the thread that opened it, and rdpmc can
+ * only read it while that thread is running, so each thread that samples
+ * gets its own. It is closed when the thread exits, or when its sampler is
+ * disposed, whichever happens first.
+ */
+struct _GumPerfCounter
 {
   gint device;
+  GumPerfEventMmapPage * page;
+  GumCycleSampler * owner;
+};
+
+struct _GumCycleSamplerPrivate
+{
+  GumCycleSamplerMode mode;
+  guint64 config;
+  GumCycleSampler * group_leader;
+
+  pthread_key_t counter_key;
+  GMutex mutex;
+  GSList * counters;
 };
 
 static void gum_cycle_sampler_iface_init (gpointer g_iface,
     gpointer iface_data);
 static void gum_cycle_sampler_dispose (GObject * object);
+static void gum_cycle_sampler_finalize (GObject * object);
+static void gum_cycle_sampler_open (GumCycleSampler * self,
+    GumCycleSamplerEvent event, GumCycleSampler * group_leader);
 static GumSample gum_cycle_sampler_sample (GumSampler * sampler);
+static GumPerfCounter * gum_cycle_sampler_get_counter (GumCycleSampler * self);
+
+static GumPerfCounter * gum_perf_counter_open (guint64 config,
+    GumPerfCounter * group_leader);
+static void gum_perf_counter_release (GumPerfCounter * counter);
+static void gum_perf_counter_close (GumPerfCounter * counter);
+static GumSample gum_perf_counter_sample (GumPerfCounter * counter);
+#if defined (HAVE_I386)
+static gboolean gum_perf_counter_try_rdpmc (GumPerfCounter * counter,
+    GumSample * sample);
+#endif
+static GumSample gum_perf_counter_read (GumPerfCounter * counter);
 
 G_DEFINE_TYPE_EXTENDED (GumCycleSampler,
                         gum_cycle_sampler,
@@ -80,6 +145,7 @@ gum_cycle_sampler_class_init (GumCycleSamplerClass * klass)
   GObjectClass * object_class = G_OBJECT_CLASS (klass);
 
   object_class->dispose = gum_cycle_sampler_dispose;
+  object_class->finalize = gum_cycle_sampler_finalize;
 
   g_type_class_add_private (klass, sizeof (GumCycleSamplerPrivate));
 }
@@ -97,16 +163,15 @@ static void
 gum_cycle_sampler_init (GumCycleSampler * self)
 {
   GumCycleSamplerPrivate * priv;
-  struct perf_event_attr attr;
 
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GUM_TYPE_CYCLE_SAMPLER,
       GumCycleSamplerPrivate);
+
   priv = self->priv;
 
-  gum_memset (&attr, 0, sizeof (attr));
-  attr.type = PERF_TYPE_HARDWARE;
-  attr.config = PERF_COUNT_HW_CPU_CYCLES;
-  priv->device = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  pthread_key_create (&priv->counter_key,
+      (void (*) (void *)) gum_perf_counter_release);
+  g_mutex_init (&priv->mutex);
 }
 
 static void
@@ -114,35 +179,300 @@ gum_cycle_sampler_dispose (GObject * object)
 {
   GumCycleSampler * self = GUM_CYCLE_SAMPLER (object);
   GumCycleSamplerPrivate * priv = self->priv;
+  GSList * counters;
+
+  g_mutex_lock (&priv->mutex);
+  counters = priv->counters;
+  priv->counters = NULL;
+  g_mutex_unlock (&priv->mutex);
+
+  g_slist_free_full (counters, (GDestroyNotify) gum_perf_counter_close);
 
-  if (priv->device != -1)
+  if (priv->group_leader != NULL)
   {
-    close (priv->device);
-    priv->device = -1;
+    g_object_unref (priv->group_leader);
+    priv->group_leader = NULL;
   }
 
   G_OBJECT_CLASS (gum_cycle_sampler_parent_class)->dispose (object);
 }
 
+static void
+gum_cycle_sampler_finalize (GObject * object)
+{
+  GumCycleSampler * self = GUM_CYCLE_SAMPLER (object);
+  GumCycleSamplerPrivate * priv = self->priv;
+
+  pthread_key_delete (priv->counter_key);
+  g_mutex_clear (&priv->mutex);
+
+  G_OBJECT_CLASS (gum_cycle_sampler_parent_class)->finalize (object);
+}
+
+/*
+ * On x86 this reads the timestamp counter, as it always has. Use
+ * gum_cycle_sampler_new_full () to count the thread's own cycles instead.
+ */
 GumSampler *
 gum_cycle_sampler_new (void)
 {
-  return GUM_SAMPLER_CAST (g_object_new (GUM_TYPE_CYCLE_SAMPLER, NULL));
+#if defined (HAVE_I386)
+  GumCycleSampler * sampler;
+
+  sampler = g_object_new (GUM_TYPE_CYCLE_SAMPLER, NULL);
+  sampler->priv->mode = GUM_CYCLE_SAMPLER_RDTSC;
+
+  return GUM_SAMPLER_CAST (sampler);
+#else
+  return gum_cycle_sampler_new_full (GUM_CYCLE_SAMPLER_EVENT_CYCLES, NULL);
+#endif
+}
+
+/*
+ * Samplers created with the same group leader count on the PMU together, so
+ * their samples can be compared with each other. Each thread is counted
+ * separately, from the first time it takes a sample.
+ */
+GumSampler *
+gum_cycle_sampler_new_full (GumCycleSamplerEvent event,
+                            GumCycleSampler * group_leader)
+{
+  GumCycleSampler * sampler;
+
+  sampler = g_object_new (GUM_TYPE_CYCLE_SAMPLER, NULL);
+  gum_cycle_sampler_open (sampler, event, group_leader);
+
+  return GUM_SAMPLER_CAST (sampler);
 }
 
 gboolean
 gum_cycle_sampler_is_available (GumCycleSampler * self)
 {
-  return self->priv->device != -1;
+  return self->priv->mode != GUM_CYCLE_SAMPLER_UNAVAILABLE;
+}
+
+static void
+gum_cycle_sampler_open (GumCycleSampler * self,
+                        GumCycleSamplerEvent event,
+                        GumCycleSampler * group_leader)
+{
+  GumCycleSamplerPrivate * priv = self->priv;
+
+  switch (event)
+  {
+    case GUM_CYCLE_SAMPLER_EVENT_CYCLES:
+      priv->config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case GUM_CYCLE_SAMPLER_EVENT_INSTRUCTIONS:
+      priv->config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case GUM_CYCLE_SAMPLER_EVENT_CACHE_MISSES:
+      priv->config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    default:
+      g_assert_not_reached ();
+  }
+
+  if (group_leader != NULL &&
+      group_leader->priv->mode == GUM_CYCLE_SAMPLER_PERF)
+  {
+    priv->group_leader = g_object_ref (group_leader);
+  }
+
+  /* Probe with a counter for the calling thread, which it gets to keep. */
+  priv->mode = GUM_CYCLE_SAMPLER_PERF;
+  if (gum_cycle_sampler_get_counter (self)->device == -1)
+  {
+    priv->mode = GUM_CYCLE_SAMPLER_UNAVAILABLE;
+#if defined (HAVE_I386)
+    if (event == GUM_CYCLE_SAMPLER_EVENT_CYCLES)
+      priv->mode = GUM_CYCLE_SAMPLER_RDTSC;
+#endif
+  }
 }
 
 static GumSample
 gum_cycle_sampler_sample (GumSampler * sampler)
 {
   GumCycleSampler * self = GUM_CYCLE_SAMPLER_CAST (sampler);
+
+  switch (self->priv->mode)
+  {
+    case GUM_CYCLE_SAMPLER_PERF:
+      return gum_perf_counter_sample (gum_cycle_sampler_get_counter (self));
+#if defined (HAVE_I386)
+    case GUM_CYCLE_SAMPLER_RDTSC:
+      __builtin_ia32_lfence ();
+      return __builtin_ia32_rdtsc ();
+#endif
+    default:
+      return 0;
+  }
+}
+
+static GumPerfCounter *
+gum_cycle_sampler_get_counter (GumCycleSampler * self)
+{
+  GumCycleSamplerPrivate * priv = self->priv;
+  GumPerfCounter * counter;
+
+  counter = pthread_getspecific (priv->counter_key);
+  if (counter != NULL)
+    return counter;
+
+  counter = gum_perf_counter_open (priv->config, (priv->group_leader != NULL)
+      ? gum_cycle_sampler_get_counter (priv->group_leader)
+      : NULL);
+  counter->owner = self;
+
+  g_mutex_lock (&priv->mutex);
+  priv->counters = g_slist_prepend (priv->counters, counter);
+  g_mutex_unlock (&priv->mutex);
+
+  pthread_setspecific (priv->counter_key, counter);
+
+  return counter;
+}
+
+/*
+ * Counters that fail to open are kept too, with a device of -1, so that a
+ * thread doesn't retry on every sample.
+ */
+static GumPerfCounter *
+gum_perf_counter_open (guint64 config,
+                       GumPerfCounter * group_leader)
+{
+  GumPerfCounter * counter;
+  struct perf_event_attr attr;
+  gpointer page;
+
+  counter = g_slice_new0 (GumPerfCounter);
+
+  gum_memset (&attr, 0, sizeof (attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = TRUE;
+  attr.exclude_hv = TRUE;
+
+  counter->device = syscall (__NR_perf_event_open, &attr, 0, -1,
+      (group_leader != NULL) ? group_leader->device : -1, 0);
+  if (counter->device == -1)
+    return counter;
+
+#if defined (HAVE_I386)
+  page = mmap (NULL, sysconf (_SC_PAGESIZE), PROT_READ, MAP_SHARED,
+      counter->device, 0);
+  if (page != MAP_FAILED)
+    counter->page = page;
+#else
+  (void) page;
+#endif
+
+  return counter;
+}
+
+/*
+ * Called when a thread that sampled exits. Counters that are no longer on
+ * their sampler's list were already closed when it was disposed.
+ */
+static void
+gum_perf_counter_release (GumPerfCounter * counter)
+{
+  GumCycleSamplerPrivate * priv = counter->owner->priv;
+  GSList * link;
+
+  g_mutex_lock (&priv->mutex);
+  link = g_slist_find (priv->counters, counter);
+  if (link != NULL)
+    priv->counters = g_slist_delete_link (priv->counters, link);
+  g_mutex_unlock (&priv->mutex);
+
+  if (link != NULL)
+    gum_perf_counter_close (counter);
+}
+
+static void
+gum_perf_counter_close (GumPerfCounter * counter)
+{
+  if (counter->page != NULL)
+    munmap (counter->page, sysconf (_SC_PAGESIZE));
+
+  if (counter->device != -1)
+    close (counter->device);
+
+  g_slice_free (GumPerfCounter, counter);
+}
+
+static GumSample
+gum_perf_counter_sample (GumPerfCounter * counter)
+{
+#if defined (HAVE_I386)
+  GumSample sample;
+
+  if (counter->page != NULL && gum_perf_counter_try_rdpmc (counter, &sample))
+    return sample;
+#endif
+
+  return gum_perf_counter_read (counter);
+}
+
+#if defined (HAVE_I386)
+
+/*
+ * The kernel bumps the lock around any update to the page, including when
+ * it revokes userspace access or the counter gets descheduled, so both are
+ * checked on every attempt until we get a consistent view.
+ */
+static gboolean
+gum_perf_counter_try_rdpmc (GumPerfCounter * counter,
+                            GumSample * sample)
+{
+  const GumPerfEventMmapPage * page = counter->page;
+  guint32 seq, index;
+  gboolean usable;
+  gint64 count;
+
+  do
+  {
+    seq = page->lock;
+    __sync_synchronize ();
+
+    index = page->index;
+    usable = (page->capabilities & GUM_PERF_CAP_USER_RDPMC) != 0 &&
+        index != 0;
+    count = page->offset;
+    if (usable)
+    {
+      guint shift = 64 - page->pmc_width;
+      gint64 pmc;
+
+      pmc = (gint64) __builtin_ia32_rdpmc (index - 1);
+      count += (pmc << shift) >> shift;
+    }
+
+    __sync_synchronize ();
+  }
+  while (page->lock != seq);
+
+  if (!usable)
+    return FALSE;
+
+  *sample = count;
+
+  return TRUE;
+}
+
+#endif
+
+static GumSample
+gum_perf_counter_read (GumPerfCounter * counter)
+{
   long long result = 0;
 
-  if (read (self->priv->device, &result, sizeof (result)) < sizeof (result))
+  if (counter->device == -1)
+    return 0;
+
+  if (read (counter->device, &result, sizeof (result)) < sizeof (result))
     return 0;
 
   return result;
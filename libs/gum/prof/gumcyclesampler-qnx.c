@@ -45,6 +45,16 @@ gum_cycle_sampler_new (void)
   return GUM_SAMPLER_CAST (g_object_new (GUM_TYPE_CYCLE_SAMPLER, NULL));
 }
 
+GumSampler *
+gum_cycle_sampler_new_full (GumCycleSamplerEvent event,
+                            GumCycleSampler * group_leader)
+{
+  if (event != GUM_CYCLE_SAMPLER_EVENT_CYCLES)
+    return NULL;
+
+  return gum_cycle_sampler_new ();
+}
+
 gboolean
 gum_cycle_sampler_is_available (GumCycleSampler * self)
 {
@@ -27,6 +27,13 @@ typedef struct _GumCycleSampler GumCycleSampler;
 typedef struct _GumCycleSamplerClass GumCycleSamplerClass;
 typedef struct _GumCycleSamplerPrivate GumCycleSamplerPrivate;
 
+typedef enum
+{
+  GUM_CYCLE_SAMPLER_EVENT_CYCLES,
+  GUM_CYCLE_SAMPLER_EVENT_INSTRUCTIONS,
+  GUM_CYCLE_SAMPLER_EVENT_CACHE_MISSES
+} GumCycleSamplerEvent;
+
 struct _GumCycleSampler
 {
   GObject parent;
@@ -44,6 +51,8 @@ G_BEGIN_DECLS
 GUM_API GType gum_cycle_sampler_get_type (void) G_GNUC_CONST;
 
 GUM_API GumSampler * gum_cycle_sampler_new (void);
+GUM_API GumSampler * gum_cycle_sampler_new_full (GumCycleSamplerEvent event,
+    GumCycleSampler * group_leader);
 
 GUM_API gboolean gum_cycle_sampler_is_available (GumCycleSampler * self);
 
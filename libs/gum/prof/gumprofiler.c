@@ -15,12 +15,23 @@
 #define GUM_PROFILER_LOCK()   (g_mutex_lock (&priv->mutex))
 #define GUM_PROFILER_UNLOCK() (g_mutex_unlock (&priv->mutex))
 
+#define GUM_PROFILER_CACHE_LINE_SIZE 64
+#define GUM_PROFILER_STATS_BLOCK_SIZE \
+    GUM_ALIGN_SIZE (sizeof (GumFunctionThreadContext), \
+        GUM_PROFILER_CACHE_LINE_SIZE)
+#define GUM_PROFILER_STATS_PER_CHUNK 32
+
+#define GUM_PROFILER_BINARY_MAGIC   "GUMPROF"
+#define GUM_PROFILER_BINARY_VERSION 1
+
 typedef struct _GumProfilerInvocation GumProfilerInvocation;
 typedef struct _GumProfilerContext GumProfilerContext;
+typedef struct _GumProfilerThread GumProfilerThread;
 typedef struct _GumFunctionContext GumFunctionContext;
-typedef struct _GumWorstCaseInfo GumWorstCaseInfo;
-typedef struct _GumWorstCase GumWorstCase;
 typedef struct _GumFunctionThreadContext GumFunctionThreadContext;
+typedef struct _GumProfilerEmitter GumProfilerEmitter;
+typedef struct _GumProfilerEmitNode GumProfilerEmitNode;
+typedef enum _GumProfilerRecordType GumProfilerRecordType;
 
 struct _GumProfilerPrivate
 {
@@ -30,7 +41,8 @@ struct _GumProfilerPrivate
 
   GumInterceptor * interceptor;
   GHashTable * function_by_address;
-  GSList * stacks;
+  guint function_count;
+  GPtrArray * threads;
 };
 
 struct _GumProfilerInvocation
@@ -44,34 +56,42 @@ struct _GumProfilerInvocation
 
 struct _GumProfilerContext
 {
-  GArray * stack;
+  GumProfilerThread * thread;
 };
 
-struct _GumWorstCaseInfo
+/*
+ * Statistics are kept per thread, in a table indexed by function index, and
+ * only merged when a report is generated. Entries are allocated the first
+ * time the thread enters a function, one cache line each, so threads never
+ * write to the same line.
+ */
+struct _GumProfilerThread
 {
-  gchar buf[GUM_MAX_WORST_CASE_INFO_SIZE];
-};
+  guint thread_id;
+  GArray * stack;
 
-struct _GumWorstCase
-{
-  GumSample duration;
-  GumWorstCaseInfo info;
+  GumFunctionThreadContext ** stats;
+  guint stats_capacity;
+
+  GSList * chunks;
+  guint8 * chunk_cursor;
+  guint chunk_remaining;
 };
 
 struct _GumFunctionThreadContext
 {
   GumFunctionContext * function_ctx;
-  guint thread_id;
 
   /* statistics */
   guint64 total_calls;
   GumSample total_duration;
-  GumWorstCase worst_case;
+  GumSample worst_case_duration;
+  gchar * worst_case_info;
 
   /* state */
   gboolean is_root_node;
   gint recurse_count;
-  GumWorstCaseInfo potential_info;
+  gchar * potential_info;
 
   GumFunctionThreadContext * child_ctx;
 };
@@ -79,14 +99,58 @@ struct _GumFunctionThreadContext
 struct _GumFunctionContext
 {
   gpointer function_address;
+  guint index;
+  gchar * name;
 
   GumSamplerIface * sampler_interface;
   GumSampler * sampler_instance;
   GumWorstCaseInspectorFunc inspector_func;
   gpointer inspector_user_data;
 
-  GumFunctionThreadContext thread_contexts[GUM_MAX_THREADS];
-  volatile gint thread_context_count;
+  /* in the order threads first entered the function, protected by mutex */
+  GPtrArray * thread_contexts;
+};
+
+struct _GumProfilerEmitter
+{
+  GDataOutputStream * output;
+  gboolean binary;
+  GHashTable * emitted_functions;
+  GString * line;
+};
+
+/*
+ * A copy of one node of a hottest-callee chain, taken under the lock so that
+ * symbolication and stream writes can happen without holding it. Chains are
+ * stored back to back, each starting at depth 0.
+ */
+struct _GumProfilerEmitNode
+{
+  guint thread_id;
+  guint depth;
+  GumFunctionContext * function_ctx;
+  const gchar * name;
+
+  guint64 total_calls;
+  GumSample total_duration;
+  GumSample worst_case_duration;
+};
+
+/*
+ * The binary form starts with an 8 byte magic and a guint32 version, and is
+ * followed by records that each start with a guint8 type. A function is
+ * described once, before the first node referring to it. All integers are
+ * little-endian.
+ */
+enum _GumProfilerRecordType
+{
+  /* guint32 index, guint64 address, guint16 name_length, gchar name[] */
+  GUM_PROFILER_RECORD_FUNCTION = 1,
+  /*
+   * guint32 thread_id, guint32 depth, guint32 function_index,
+   * guint64 total_calls, guint64 total_duration, guint64 worst_case_duration
+   */
+  GUM_PROFILER_RECORD_NODE
 };
 
 #define GUM_PROFILER_GET_PRIVATE(o) ((o)->priv)
@@ -104,8 +168,31 @@ static void gum_profiler_on_leave (GumInvocationListener * listener,
 static void unstrument_and_free_function (gpointer key, gpointer value,
     gpointer user_data);
 
-static void add_to_report_if_root_node (gpointer key, gpointer value,
-    gpointer user_data);
+static GumProfilerThread * gum_profiler_thread_new (guint thread_id);
+static void gum_profiler_thread_free (GumProfilerThread * thread);
+static GumFunctionThreadContext * gum_profiler_thread_lookup (
+    GumProfilerThread * thread, GumFunctionContext * function_ctx);
+static GumFunctionThreadContext * gum_profiler_thread_add (
+    GumProfilerThread * thread, GumFunctionContext * function_ctx,
+    GumProfilerPrivate * priv);
+static GumFunctionThreadContext * gum_profiler_find_nth_thread_context (
+    GumProfiler * self, guint thread_index, gpointer function_address);
+
+static void add_thread_root_nodes_to_report (GumProfileReport * report,
+    GumProfilerThread * thread);
+static gboolean gum_profiler_emit (GumProfiler * self, GOutputStream * stream,
+    gboolean binary, GError ** error);
+static void gum_profiler_collect_chain (GArray * nodes,
+    GumProfilerThread * thread, GumFunctionThreadContext * root_ctx);
+static void gum_profiler_resolve_names (GumProfiler * self, GArray * nodes);
+static gboolean gum_profiler_emitter_emit_node (GumProfilerEmitter * self,
+    const GumProfilerEmitNode * node, const GumProfilerEmitNode * next,
+    GError ** error);
+static void gum_profiler_append_collapsed_name (GString * line,
+    const gchar * name);
+static const gchar * gum_function_context_get_name (
+    GumFunctionContext * function_ctx);
+static gchar * gum_profiler_symbol_name_from_address (gpointer address);
 static GumProfileReportNode * make_node_from_thread_context (
     GumFunctionThreadContext * thread_ctx, GHashTable ** processed_nodes);
 static GumProfileReportNode * make_node (gchar * name, guint64 total_calls,
@@ -115,11 +202,6 @@ static void thread_context_register_child_timing (
     GumFunctionThreadContext * parent_ctx,
     GumFunctionThreadContext * child_ctx);
 
-static void get_number_of_threads_foreach (gpointer key, gpointer value,
-    gpointer user_data);
-
-static GumFunctionThreadContext * gum_function_context_get_current_thread (
-    GumFunctionContext * function_ctx, GumInvocationContext * context);
 
 G_DEFINE_TYPE_EXTENDED (GumProfiler,
                         gum_profiler,
@@ -165,6 +247,8 @@ gum_profiler_init (GumProfiler * self)
   priv->interceptor = gum_interceptor_obtain ();
   priv->function_by_address = g_hash_table_new_full (g_direct_hash,
       g_direct_equal, NULL, NULL);
+  priv->threads = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gum_profiler_thread_free);
 }
 
 static void
@@ -180,6 +264,10 @@ gum_profiler_dispose (GObject * object)
     gum_interceptor_detach_listener (priv->interceptor,
         GUM_INVOCATION_LISTENER (self));
 
+    GUM_PROFILER_LOCK ();
+    g_ptr_array_set_size (priv->threads, 0);
+    GUM_PROFILER_UNLOCK ();
+
     g_hash_table_foreach (priv->function_by_address,
         unstrument_and_free_function, self);
     g_hash_table_remove_all (priv->function_by_address);
@@ -197,12 +285,7 @@ gum_profiler_finalize (GObject * object)
   GumProfiler * self = GUM_PROFILER (object);
   GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
 
-  while (priv->stacks != NULL)
-  {
-    GArray * stack = (GArray *) priv->stacks->data;
-    g_array_free (stack, TRUE);
-    priv->stacks = g_slist_delete_link (priv->stacks, priv->stacks);
-  }
+  g_ptr_array_unref (priv->threads);
 
   g_hash_table_unref (priv->function_by_address);
 
@@ -215,33 +298,36 @@ static void
 gum_profiler_on_enter (GumInvocationListener * listener,
                        GumInvocationContext * context)
 {
+  GumProfilerPrivate * priv = GUM_PROFILER_CAST (listener)->priv;
   GumProfilerInvocation * inv;
+  GumProfilerThread * thread;
   GumFunctionContext * fctx;
   GumFunctionThreadContext * tctx;
 
   inv = GUM_LINCTX_GET_FUNC_INVDATA (context, GumProfilerInvocation);
 
   inv->profiler = GUM_LINCTX_GET_THREAD_DATA (context, GumProfilerContext);
-  if (inv->profiler->stack == NULL)
+  thread = inv->profiler->thread;
+  if (thread == NULL)
   {
-    GumProfilerPrivate * priv = GUM_PROFILER_CAST (listener)->priv;
-
-    inv->profiler->stack = g_array_sized_new (FALSE, FALSE,
-        sizeof (GumFunctionThreadContext *), GUM_MAX_CALL_DEPTH);
+    thread = gum_profiler_thread_new (
+        gum_invocation_context_get_thread_id (context));
+    inv->profiler->thread = thread;
 
     GUM_PROFILER_LOCK ();
-    priv->stacks = g_slist_prepend (priv->stacks, inv->profiler->stack);
+    g_ptr_array_add (priv->threads, thread);
     GUM_PROFILER_UNLOCK ();
   }
 
   inv->function = GUM_LINCTX_GET_FUNC_DATA (context, GumFunctionContext *);
-  inv->thread = gum_function_context_get_current_thread (inv->function,
-      context);
-
   fctx = inv->function;
-  tctx = inv->thread;
 
-  g_array_append_val (inv->profiler->stack, tctx);
+  tctx = gum_profiler_thread_lookup (thread, fctx);
+  if (tctx == NULL)
+    tctx = gum_profiler_thread_add (thread, fctx, priv);
+  inv->thread = tctx;
+
+  g_array_append_val (thread->stack, tctx);
 
   tctx->total_calls++;
 
@@ -251,8 +337,8 @@ gum_profiler_on_enter (GumInvocationListener * listener,
 
     if ((inspector_func = fctx->inspector_func) != NULL)
     {
-      inspector_func (context, tctx->potential_info.buf,
-          sizeof (tctx->potential_info.buf), fctx->inspector_user_data);
+      inspector_func (context, tctx->potential_info,
+          GUM_MAX_WORST_CASE_INFO_SIZE, fctx->inspector_user_data);
     }
 
     inv->start_time = fctx->sampler_interface->sample (fctx->sampler_instance);
@@ -276,7 +362,7 @@ gum_profiler_on_leave (GumInvocationListener * listener,
 
   fctx = inv->function;
   tctx = inv->thread;
-  stack = inv->profiler->stack;
+  stack = inv->profiler->thread->stack;
 
   if (tctx->recurse_count == 1)
   {
@@ -289,11 +375,14 @@ gum_profiler_on_leave (GumInvocationListener * listener,
 
     tctx->total_duration += duration;
 
-    if (duration > tctx->worst_case.duration)
+    if (duration > tctx->worst_case_duration)
     {
-      tctx->worst_case.duration = duration;
-      memcpy (&tctx->worst_case.info, &tctx->potential_info,
-          sizeof (tctx->potential_info));
+      tctx->worst_case_duration = duration;
+      if (tctx->worst_case_info != NULL)
+      {
+        memcpy (tctx->worst_case_info, tctx->potential_info,
+            GUM_MAX_WORST_CASE_INFO_SIZE);
+      }
     }
 
     parent = NULL;
@@ -349,7 +438,7 @@ gum_profiler_instrument_functions_matching (GumProfiler * self,
     {
       gchar * func_name;
 
-      func_name = gum_symbol_name_from_address (address);
+      func_name = gum_profiler_symbol_name_from_address (address);
       approved = filter (func_name, user_data);
       g_free (func_name);
     }
@@ -385,17 +474,21 @@ gum_profiler_instrument_function_with_inspector (GumProfiler * self,
   GumAttachReturn attach_ret;
 
   ctx = g_new0 (GumFunctionContext, 1);
-
-  attach_ret = gum_interceptor_attach_listener (priv->interceptor,
-      function_address, GUM_INVOCATION_LISTENER (self), ctx);
-  if (attach_ret != GUM_ATTACH_OK)
-    goto error;
-
   ctx->function_address = function_address;
   ctx->sampler_interface = GUM_SAMPLER_GET_INTERFACE (sampler);
   ctx->sampler_instance = g_object_ref (sampler);
   ctx->inspector_func = inspector_func;
   ctx->inspector_user_data = user_data;
+  ctx->thread_contexts = g_ptr_array_new ();
+
+  GUM_PROFILER_LOCK ();
+  ctx->index = priv->function_count++;
+  GUM_PROFILER_UNLOCK ();
+
+  attach_ret = gum_interceptor_attach_listener (priv->interceptor,
+      function_address, GUM_INVOCATION_LISTENER (self), ctx);
+  if (attach_ret != GUM_ATTACH_OK)
+    goto error;
 
   GUM_PROFILER_LOCK ();
   g_hash_table_insert (priv->function_by_address, function_address, ctx);
@@ -404,6 +497,8 @@ gum_profiler_instrument_function_with_inspector (GumProfiler * self,
   return result;
 
 error:
+  g_ptr_array_unref (ctx->thread_contexts);
+  g_object_unref (ctx->sampler_instance);
   g_free (ctx);
 
   if (attach_ret == GUM_ATTACH_WRONG_SIGNATURE)
@@ -426,7 +521,9 @@ unstrument_and_free_function (gpointer key,
   (void) key;
   (void) user_data;
 
+  g_ptr_array_unref (function_ctx->thread_contexts);
   g_object_unref (function_ctx->sampler_instance);
+  g_free (function_ctx->name);
   g_free (function_ctx);
 }
 
@@ -435,53 +532,340 @@ gum_profiler_generate_report (GumProfiler * self)
 {
   GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
   GumProfileReport * report;
+  guint i;
 
   report = gum_profile_report_new ();
-  g_hash_table_foreach (priv->function_by_address, add_to_report_if_root_node,
-      report);
+
+  GUM_PROFILER_LOCK ();
+  for (i = 0; i != priv->threads->len; i++)
+  {
+    add_thread_root_nodes_to_report (report,
+        g_ptr_array_index (priv->threads, i));
+  }
+  GUM_PROFILER_UNLOCK ();
+
   _gum_profile_report_sort (report);
 
   return report;
 }
 
 static void
-add_to_report_if_root_node (gpointer key,
-                            gpointer value,
-                            gpointer user_data)
+add_thread_root_nodes_to_report (GumProfileReport * report,
+                                 GumProfilerThread * thread)
 {
-  GumProfileReport * report = GUM_PROFILE_REPORT (user_data);
-  GumFunctionContext * function_ctx = (GumFunctionContext *) value;
+  guint i;
 
-  (void) key;
+  for (i = 0; i != thread->stats_capacity; i++)
+  {
+    GumFunctionThreadContext * thread_ctx = thread->stats[i];
+
+    if (thread_ctx != NULL && thread_ctx->is_root_node)
+    {
+      GHashTable * processed_nodes = NULL;
+      GumProfileReportNode * root_node;
+
+      root_node = make_node_from_thread_context (thread_ctx,
+          &processed_nodes);
+      _gum_profile_report_append_thread_root_node (report,
+          thread->thread_id, root_node);
+    }
+  }
+}
+
+/*
+ * Writes one line per node in the collapsed-stack format understood by flame
+ * graph tools, e.g. "main;parse;lex 42", where the count is the time spent
+ * in the innermost function excluding its hottest callee. Threads are
+ * merged. Pass a GUnixOutputStream to write straight to a file descriptor.
+ */
+gboolean
+gum_profiler_emit_collapsed_stacks (GumProfiler * self,
+                                    GOutputStream * stream,
+                                    GError ** error)
+{
+  return gum_profiler_emit (self, stream, FALSE, error);
+}
 
-  if (function_ctx->thread_context_count > 0)
+gboolean
+gum_profiler_emit_binary (GumProfiler * self,
+                          GOutputStream * stream,
+                          GError ** error)
+{
+  return gum_profiler_emit (self, stream, TRUE, error);
+}
+
+static gboolean
+gum_profiler_emit (GumProfiler * self,
+                   GOutputStream * stream,
+                   gboolean binary,
+                   GError ** error)
+{
+  GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
+  GArray * nodes;
+  GumProfilerEmitter emitter;
+  GOutputStream * buffered;
+  gboolean success = TRUE;
+  guint thread_index, i;
+
+  nodes = g_array_new (FALSE, FALSE, sizeof (GumProfilerEmitNode));
+
+  GUM_PROFILER_LOCK ();
+
+  for (thread_index = 0; thread_index != priv->threads->len; thread_index++)
   {
-    gint i;
+    GumProfilerThread * thread;
+
+    thread = g_ptr_array_index (priv->threads, thread_index);
 
-    for (i = 0; i != function_ctx->thread_context_count; i++)
+    for (i = 0; i != thread->stats_capacity; i++)
     {
-      GumFunctionThreadContext * thread_ctx =
-          &function_ctx->thread_contexts[i];
+      GumFunctionThreadContext * thread_ctx = thread->stats[i];
 
-      if (thread_ctx->is_root_node)
-      {
-        GHashTable * processed_nodes = NULL;
-        GumProfileReportNode * root_node;
+      if (thread_ctx != NULL && thread_ctx->is_root_node)
+        gum_profiler_collect_chain (nodes, thread, thread_ctx);
+    }
+  }
 
-        root_node = make_node_from_thread_context (thread_ctx,
-            &processed_nodes);
-        _gum_profile_report_append_thread_root_node (report,
-            thread_ctx->thread_id, root_node);
-      }
+  GUM_PROFILER_UNLOCK ();
+
+  gum_profiler_resolve_names (self, nodes);
+
+  buffered = g_buffered_output_stream_new (stream);
+  g_filter_output_stream_set_close_base_stream (
+      G_FILTER_OUTPUT_STREAM (buffered), FALSE);
+
+  emitter.output = g_data_output_stream_new (buffered);
+  g_filter_output_stream_set_close_base_stream (
+      G_FILTER_OUTPUT_STREAM (emitter.output), FALSE);
+  g_data_output_stream_set_byte_order (emitter.output,
+      G_DATA_STREAM_BYTE_ORDER_LITTLE_ENDIAN);
+  emitter.binary = binary;
+  emitter.emitted_functions = g_hash_table_new (NULL, NULL);
+  emitter.line = g_string_sized_new (256);
+
+  if (binary)
+  {
+    success = g_output_stream_write_all (G_OUTPUT_STREAM (emitter.output),
+        GUM_PROFILER_BINARY_MAGIC, sizeof (GUM_PROFILER_BINARY_MAGIC), NULL,
+        NULL, error) &&
+        g_data_output_stream_put_uint32 (emitter.output,
+            GUM_PROFILER_BINARY_VERSION, NULL, error);
+  }
+
+  for (i = 0; success && i != nodes->len; i++)
+  {
+    const GumProfilerEmitNode * node, * next;
+
+    node = &g_array_index (nodes, GumProfilerEmitNode, i);
+    next = (i + 1 != nodes->len)
+        ? &g_array_index (nodes, GumProfilerEmitNode, i + 1)
+        : NULL;
+    if (next != NULL && next->depth == 0)
+      next = NULL;
+
+    success = gum_profiler_emitter_emit_node (&emitter, node, next, error);
+  }
+
+  if (success)
+    success = g_output_stream_flush (buffered, NULL, error);
+
+  g_string_free (emitter.line, TRUE);
+  g_hash_table_unref (emitter.emitted_functions);
+  g_object_unref (emitter.output);
+  g_object_unref (buffered);
+
+  g_array_free (nodes, TRUE);
+
+  return success;
+}
+
+static void
+gum_profiler_collect_chain (GArray * nodes,
+                            GumProfilerThread * thread,
+                            GumFunctionThreadContext * root_ctx)
+{
+  GumFunctionThreadContext * chain[GUM_MAX_CALL_DEPTH];
+  GumFunctionThreadContext * cur;
+  guint depth, i;
+
+  /* Follow the hottest callees, stopping where the chain loops back */
+  depth = 0;
+  for (cur = root_ctx; cur != NULL && depth != G_N_ELEMENTS (chain);
+      cur = cur->child_ctx)
+  {
+    for (i = 0; i != depth; i++)
+    {
+      if (chain[i] == cur)
+        break;
+    }
+    if (i != depth)
+      break;
+
+    chain[depth++] = cur;
+  }
+
+  for (i = 0; i != depth; i++)
+  {
+    GumProfilerEmitNode node;
+
+    node.thread_id = thread->thread_id;
+    node.depth = i;
+    node.function_ctx = chain[i]->function_ctx;
+    node.name = node.function_ctx->name;
+    node.total_calls = chain[i]->total_calls;
+    node.total_duration = chain[i]->total_duration;
+    node.worst_case_duration = chain[i]->worst_case_duration;
+
+    g_array_append_val (nodes, node);
+  }
+}
+
+/*
+ * Symbolicates the functions that have not been named yet without holding
+ * the lock, then publishes the names so later reports can reuse them.
+ */
+static void
+gum_profiler_resolve_names (GumProfiler * self,
+                            GArray * nodes)
+{
+  GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
+  GHashTable * names;
+  GHashTableIter iter;
+  gpointer key, value;
+  guint i;
+
+  names = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i != nodes->len; i++)
+  {
+    GumProfilerEmitNode * node = &g_array_index (nodes, GumProfilerEmitNode, i);
+
+    if (node->name == NULL &&
+        !g_hash_table_contains (names, node->function_ctx))
+    {
+      g_hash_table_insert (names, node->function_ctx,
+          gum_profiler_symbol_name_from_address (
+              node->function_ctx->function_address));
     }
   }
+
+  if (g_hash_table_size (names) == 0)
+  {
+    g_hash_table_unref (names);
+    return;
+  }
+
+  GUM_PROFILER_LOCK ();
+  g_hash_table_iter_init (&iter, names);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+  {
+    GumFunctionContext * function_ctx = key;
+
+    if (function_ctx->name == NULL)
+      function_ctx->name = value;
+    else
+      g_free (value);
+    g_hash_table_iter_replace (&iter, function_ctx->name);
+  }
+  GUM_PROFILER_UNLOCK ();
+
+  for (i = 0; i != nodes->len; i++)
+  {
+    GumProfilerEmitNode * node = &g_array_index (nodes, GumProfilerEmitNode, i);
+
+    if (node->name == NULL)
+      node->name = g_hash_table_lookup (names, node->function_ctx);
+  }
+
+  g_hash_table_unref (names);
+}
+
+static gboolean
+gum_profiler_emitter_emit_node (GumProfilerEmitter * self,
+                                const GumProfilerEmitNode * node,
+                                const GumProfilerEmitNode * next,
+                                GError ** error)
+{
+  GDataOutputStream * output = self->output;
+  GumFunctionContext * function_ctx = node->function_ctx;
+
+  if (!self->binary)
+  {
+    GumSample self_duration = node->total_duration;
+
+    if (next != NULL)
+      self_duration -= MIN (self_duration, next->total_duration);
+
+    if (node->depth == 0)
+      g_string_truncate (self->line, 0);
+    else
+      g_string_append_c (self->line, ';');
+    gum_profiler_append_collapsed_name (self->line, node->name);
+
+    return g_data_output_stream_put_string (output, self->line->str, NULL,
+            error) &&
+        g_output_stream_printf (G_OUTPUT_STREAM (output), NULL, NULL, error,
+            " %" G_GUINT64_FORMAT "\n", self_duration);
+  }
+
+  if (!g_hash_table_contains (self->emitted_functions, function_ctx))
+  {
+    gsize name_length;
+
+    name_length = MIN (strlen (node->name), G_MAXUINT16);
+
+    if (!g_data_output_stream_put_byte (output, GUM_PROFILER_RECORD_FUNCTION,
+            NULL, error) ||
+        !g_data_output_stream_put_uint32 (output, function_ctx->index, NULL,
+            error) ||
+        !g_data_output_stream_put_uint64 (output,
+            GPOINTER_TO_SIZE (function_ctx->function_address), NULL, error) ||
+        !g_data_output_stream_put_uint16 (output, name_length, NULL, error) ||
+        !g_output_stream_write_all (G_OUTPUT_STREAM (output), node->name,
+            name_length, NULL, NULL, error))
+      return FALSE;
+
+    g_hash_table_add (self->emitted_functions, function_ctx);
+  }
+
+  return g_data_output_stream_put_byte (output, GUM_PROFILER_RECORD_NODE, NULL,
+          error) &&
+      g_data_output_stream_put_uint32 (output, node->thread_id, NULL,
+          error) &&
+      g_data_output_stream_put_uint32 (output, node->depth, NULL, error) &&
+      g_data_output_stream_put_uint32 (output, function_ctx->index, NULL,
+          error) &&
+      g_data_output_stream_put_uint64 (output, node->total_calls, NULL,
+          error) &&
+      g_data_output_stream_put_uint64 (output, node->total_duration,
+          NULL, error) &&
+      g_data_output_stream_put_uint64 (output,
+          node->worst_case_duration, NULL, error);
+}
+
+/*
+ * Frames are separated by ';' and the count follows the first space, so
+ * both are replaced in names, e.g. "operator new(unsigned long)".
+ */
+static void
+gum_profiler_append_collapsed_name (GString * line,
+                                    const gchar * name)
+{
+  const gchar * ch;
+
+  for (ch = name; *ch != '\0'; ch++)
+  {
+    if (*ch == ';' || *ch == ' ')
+      g_string_append_c (line, '_');
+    else
+      g_string_append_c (line, *ch);
+  }
 }
 
 static GumProfileReportNode *
 make_node_from_thread_context (GumFunctionThreadContext * thread_ctx,
                                GHashTable ** processed_nodes)
 {
-  gpointer parent_function_address;
   gchar * parent_node_name;
   GumProfileReportNode * parent_node;
   GumFunctionThreadContext * child_ctx;
@@ -490,8 +874,8 @@ make_node_from_thread_context (GumFunctionThreadContext * thread_ctx,
   if (*processed_nodes != NULL)
     g_hash_table_ref (*processed_nodes);
 
-  parent_function_address = thread_ctx->function_ctx->function_address;
-  parent_node_name = gum_symbol_name_from_address (parent_function_address);
+  parent_node_name = g_strdup (
+      gum_function_context_get_name (thread_ctx->function_ctx));
 
   child_ctx = thread_ctx->child_ctx;
   if (child_ctx != NULL)
@@ -508,8 +892,9 @@ make_node_from_thread_context (GumFunctionThreadContext * thread_ctx,
   }
 
   parent_node = make_node (parent_node_name, thread_ctx->total_calls,
-      thread_ctx->total_duration, thread_ctx->worst_case.duration,
-      g_strdup (thread_ctx->worst_case.info.buf),
+      thread_ctx->total_duration, thread_ctx->worst_case_duration,
+      g_strdup ((thread_ctx->worst_case_info != NULL)
+          ? thread_ctx->worst_case_info : ""),
       child_node);
 
   if (*processed_nodes != NULL)
@@ -545,11 +930,17 @@ gum_profiler_get_number_of_threads (GumProfiler * self)
   GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
   guint result;
   GHashTable * unique_thread_id_set;
+  guint i;
 
   unique_thread_id_set = g_hash_table_new (g_direct_hash, g_direct_equal);
   GUM_PROFILER_LOCK ();
-  g_hash_table_foreach (priv->function_by_address,
-      get_number_of_threads_foreach, unique_thread_id_set);
+  for (i = 0; i != priv->threads->len; i++)
+  {
+    GumProfilerThread * thread = g_ptr_array_index (priv->threads, i);
+
+    g_hash_table_insert (unique_thread_id_set,
+        GUINT_TO_POINTER (thread->thread_id), NULL);
+  }
   GUM_PROFILER_UNLOCK ();
   result = g_hash_table_size (unique_thread_id_set);
   g_hash_table_unref (unique_thread_id_set);
@@ -562,17 +953,12 @@ gum_profiler_get_total_duration_of (GumProfiler * self,
                                     guint thread_index,
                                     gpointer function_address)
 {
-  GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
-  GumFunctionContext * function_ctx;
-
-  GUM_PROFILER_LOCK ();
-  function_ctx = (GumFunctionContext *)
-      g_hash_table_lookup (priv->function_by_address, function_address);
-  GUM_PROFILER_UNLOCK ();
+  GumFunctionThreadContext * thread_ctx;
 
-  if (function_ctx != NULL
-      && (gint) thread_index < function_ctx->thread_context_count)
-    return function_ctx->thread_contexts[thread_index].total_duration;
+  thread_ctx = gum_profiler_find_nth_thread_context (self, thread_index,
+      function_address);
+  if (thread_ctx != NULL)
+    return thread_ctx->total_duration;
   else
     return 0;
 }
@@ -582,17 +968,12 @@ gum_profiler_get_worst_case_duration_of (GumProfiler * self,
                                          guint thread_index,
                                          gpointer function_address)
 {
-  GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
-  GumFunctionContext * function_ctx;
-
-  GUM_PROFILER_LOCK ();
-  function_ctx = (GumFunctionContext *)
-      g_hash_table_lookup (priv->function_by_address, function_address);
-  GUM_PROFILER_UNLOCK ();
+  GumFunctionThreadContext * thread_ctx;
 
-  if (function_ctx != NULL
-      && (gint) thread_index < function_ctx->thread_context_count)
-    return function_ctx->thread_contexts[thread_index].worst_case.duration;
+  thread_ctx = gum_profiler_find_nth_thread_context (self, thread_index,
+      function_address);
+  if (thread_ctx != NULL)
+    return thread_ctx->worst_case_duration;
   else
     return 0;
 }
@@ -601,20 +982,40 @@ const gchar *
 gum_profiler_get_worst_case_info_of (GumProfiler * self,
                                      guint thread_index,
                                      gpointer function_address)
+{
+  GumFunctionThreadContext * thread_ctx;
+
+  thread_ctx = gum_profiler_find_nth_thread_context (self, thread_index,
+      function_address);
+  if (thread_ctx != NULL && thread_ctx->worst_case_info != NULL)
+    return thread_ctx->worst_case_info;
+  else
+    return "";
+}
+
+/*
+ * Threads are numbered in the order they first entered the function, as each
+ * function keeps its own list of per-thread contexts.
+ */
+static GumFunctionThreadContext *
+gum_profiler_find_nth_thread_context (GumProfiler * self,
+                                      guint thread_index,
+                                      gpointer function_address)
 {
   GumProfilerPrivate * priv = GUM_PROFILER_GET_PRIVATE (self);
   GumFunctionContext * function_ctx;
+  GumFunctionThreadContext * result = NULL;
 
   GUM_PROFILER_LOCK ();
+
   function_ctx = (GumFunctionContext *)
       g_hash_table_lookup (priv->function_by_address, function_address);
+  if (function_ctx != NULL && thread_index < function_ctx->thread_contexts->len)
+    result = g_ptr_array_index (function_ctx->thread_contexts, thread_index);
+
   GUM_PROFILER_UNLOCK ();
 
-  if (function_ctx != NULL
-      && (gint) thread_index < function_ctx->thread_context_count)
-    return function_ctx->thread_contexts[thread_index].worst_case.info.buf;
-  else
-    return "";
+  return result;
 }
 
 static void
@@ -634,50 +1035,127 @@ thread_context_register_child_timing (GumFunctionThreadContext * parent_ctx,
   }
 }
 
+static GumProfilerThread *
+gum_profiler_thread_new (guint thread_id)
+{
+  GumProfilerThread * thread;
+
+  thread = g_slice_new0 (GumProfilerThread);
+  thread->thread_id = thread_id;
+  thread->stack = g_array_sized_new (FALSE, FALSE,
+      sizeof (GumFunctionThreadContext *), GUM_MAX_CALL_DEPTH);
+
+  return thread;
+}
+
 static void
-get_number_of_threads_foreach (gpointer key,
-                               gpointer value,
-                               gpointer user_data)
+gum_profiler_thread_free (GumProfilerThread * thread)
 {
-  GumFunctionContext * function_ctx = value;
-  GHashTable * unique_thread_id_set = user_data;
-  guint thread_count = function_ctx->thread_context_count;
   guint i;
 
-  (void) key;
-
-  for (i = 0; i < thread_count; i++)
+  for (i = 0; i != thread->stats_capacity; i++)
   {
-    g_hash_table_insert (unique_thread_id_set,
-        GUINT_TO_POINTER (function_ctx->thread_contexts[i].thread_id), NULL);
+    GumFunctionThreadContext * thread_ctx = thread->stats[i];
+
+    if (thread_ctx != NULL)
+      g_free (thread_ctx->worst_case_info);
   }
+  g_free (thread->stats);
+
+  g_slist_free_full (thread->chunks, g_free);
+
+  g_array_free (thread->stack, TRUE);
+
+  g_slice_free (GumProfilerThread, thread);
 }
 
-GumFunctionThreadContext *
-gum_function_context_get_current_thread (GumFunctionContext * function_ctx,
-                                         GumInvocationContext * context)
+static GumFunctionThreadContext *
+gum_profiler_thread_lookup (GumProfilerThread * thread,
+                            GumFunctionContext * function_ctx)
+{
+  if (function_ctx->index >= thread->stats_capacity)
+    return NULL;
+
+  return thread->stats[function_ctx->index];
+}
+
+static GumFunctionThreadContext *
+gum_profiler_thread_add (GumProfilerThread * thread,
+                         GumFunctionContext * function_ctx,
+                         GumProfilerPrivate * priv)
 {
-  guint32 current_thread_id;
-  guint thread_count;
-  guint i;
   GumFunctionThreadContext * thread_ctx;
 
-  current_thread_id = gum_invocation_context_get_thread_id (context);
+  if (thread->chunk_remaining == 0)
+  {
+    gpointer chunk;
+
+    chunk = g_malloc0 ((GUM_PROFILER_STATS_PER_CHUNK *
+        GUM_PROFILER_STATS_BLOCK_SIZE) + GUM_PROFILER_CACHE_LINE_SIZE - 1);
+    thread->chunks = g_slist_prepend (thread->chunks, chunk);
+    thread->chunk_cursor = GUM_ALIGN_POINTER (guint8 *, chunk,
+        GUM_PROFILER_CACHE_LINE_SIZE);
+    thread->chunk_remaining = GUM_PROFILER_STATS_PER_CHUNK;
+  }
+
+  thread_ctx = (GumFunctionThreadContext *) thread->chunk_cursor;
+  thread->chunk_cursor += GUM_PROFILER_STATS_BLOCK_SIZE;
+  thread->chunk_remaining--;
 
-  thread_count = g_atomic_int_get (&function_ctx->thread_context_count);
-  for (i = 0; i != thread_count; i++)
+  thread_ctx->function_ctx = function_ctx;
+  if (function_ctx->inspector_func != NULL)
   {
-    thread_ctx = &function_ctx->thread_contexts[i];
+    thread_ctx->worst_case_info = g_malloc0 (2 * GUM_MAX_WORST_CASE_INFO_SIZE);
+    thread_ctx->potential_info =
+        thread_ctx->worst_case_info + GUM_MAX_WORST_CASE_INFO_SIZE;
+  }
+
+  GUM_PROFILER_LOCK ();
 
-    if (thread_ctx->thread_id == current_thread_id)
-      return thread_ctx;
+  if (function_ctx->index >= thread->stats_capacity)
+  {
+    guint capacity;
+
+    capacity = MAX (MAX (thread->stats_capacity * 2, 16),
+        function_ctx->index + 1);
+    thread->stats = g_renew (GumFunctionThreadContext *, thread->stats,
+        capacity);
+    memset (thread->stats + thread->stats_capacity, 0,
+        (capacity - thread->stats_capacity) *
+        sizeof (GumFunctionThreadContext *));
+    thread->stats_capacity = capacity;
   }
 
-  i = g_atomic_int_add (&function_ctx->thread_context_count, 1);
-  g_assert (i < G_N_ELEMENTS (function_ctx->thread_contexts));
-  thread_ctx = &function_ctx->thread_contexts[i];
-  thread_ctx->function_ctx = function_ctx;
-  thread_ctx->thread_id = current_thread_id;
+  thread->stats[function_ctx->index] = thread_ctx;
+  g_ptr_array_add (function_ctx->thread_contexts, thread_ctx);
+
+  GUM_PROFILER_UNLOCK ();
 
   return thread_ctx;
 }
+
+/* Resolved once per function, as symbolication is expensive. */
+static const gchar *
+gum_function_context_get_name (GumFunctionContext * function_ctx)
+{
+  if (function_ctx->name == NULL)
+  {
+    function_ctx->name = gum_profiler_symbol_name_from_address (
+        function_ctx->function_address);
+  }
+
+  return function_ctx->name;
+}
+
+/* Falls back to the address for functions without a symbol. */
+static gchar *
+gum_profiler_symbol_name_from_address (gpointer address)
+{
+  gchar * name;
+
+  name = gum_symbol_name_from_address (address);
+  if (name == NULL)
+    name = g_strdup_printf ("%p", address);
+
+  return name;
+}
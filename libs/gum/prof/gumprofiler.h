@@ -11,6 +11,7 @@
 #include "gumsampler.h"
 #include "gumprofilereport.h"
 
+#include <gio/gio.h>
 #include <gum/guminvocationcontext.h>
 
 #define GUM_TYPE_PROFILER (gum_profiler_get_type ())
@@ -71,6 +72,10 @@ GUM_API GumInstrumentReturn gum_profiler_instrument_function_with_inspector (
     GumWorstCaseInspectorFunc inspector_func, gpointer user_data);
 
 GUM_API GumProfileReport * gum_profiler_generate_report (GumProfiler * self);
+GUM_API gboolean gum_profiler_emit_collapsed_stacks (GumProfiler * self,
+    GOutputStream * stream, GError ** error);
+GUM_API gboolean gum_profiler_emit_binary (GumProfiler * self,
+    GOutputStream * stream, GError ** error);
 
 GUM_API guint gum_profiler_get_number_of_threads (GumProfiler * self);
 GUM_API GumSample gum_profiler_get_total_duration_of (GumProfiler * self,
@@ -0,0 +1,920 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumsamplingprofiler.h"
+
+#include "gum-init.h"
+#include "gumprocess-priv.h"
+#include "gumsymbolutil.h"
+#include "backend-linux/gumlinux.h"
+#ifdef HAVE_I386
+# include "backend-linux/gumlinuxbacktracer.h"
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define DEFAULT_INTERVAL 1000
+
+#define GUM_SAMPLE_RING_SIZE          256
+#define GUM_SAMPLING_POLL_INTERVAL    (20 * G_TIME_SPAN_MILLISECOND)
+
+#ifndef SIGEV_THREAD_ID
+# define SIGEV_THREAD_ID 4
+#endif
+#ifndef sigev_notify_thread_id
+# define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* The kernel's encoding of a per-thread CPU-time clock for another thread. */
+#define GUM_THREAD_CPU_CLOCK(tid) ((clockid_t) ((~(guint) (tid) << 3) | 4 | 2))
+
+#if defined (HAVE_I386)
+# define GUM_CPU_CONTEXT_PC(c) GUM_CPU_CONTEXT_XIP (c)
+#else
+# define GUM_CPU_CONTEXT_PC(c) ((c)->pc)
+#endif
+
+enum
+{
+  PROP_0,
+  PROP_BACKTRACER,
+  PROP_INTERVAL
+};
+
+typedef struct _GumStackSample GumStackSample;
+typedef struct _GumSampleRing GumSampleRing;
+typedef struct _GumSampledNode GumSampledNode;
+typedef struct _GumReportBuilder GumReportBuilder;
+
+struct _GumSamplingProfilerPrivate
+{
+  gboolean disposed;
+
+  GMutex mutex;
+  GCond cond;
+
+  GumBacktracer * backtracer_instance;
+#ifdef HAVE_I386
+  GumLinuxBacktracer * unwinder;
+#endif
+  guint interval;
+
+  GThread * aggregator;
+  gboolean stopping;
+
+  GumSampleRing * rings;
+  GHashTable * ring_by_thread_id;
+  guint64 module_generation;
+
+  GHashTable * name_by_address;
+  GHashTable * roots_by_thread_id;
+  guint64 sample_count;
+  guint64 dropped_count;
+};
+
+struct _GumStackSample
+{
+  GumReturnAddress pc;
+  GumReturnAddressArray callers;
+};
+
+/*
+ * Each sampled thread has a ring that only its SIGPROF handler writes to and
+ * only the aggregator reads from, so head and tail are all the
+ * synchronization needed.
+ */
+struct _GumSampleRing
+{
+  guint thread_id;
+  timer_t timer;
+  gboolean armed;
+  gboolean seen;
+
+  volatile gint head;
+  volatile gint tail;
+  volatile gint dropped;
+
+  GumStackSample * samples;
+};
+
+struct _GumSampledNode
+{
+  const gchar * name;
+  guint64 count;
+  GHashTable * callers;
+};
+
+struct _GumReportBuilder
+{
+  GumSamplingProfiler * profiler;
+  GumProfileReport * report;
+  guint thread_id;
+};
+
+#define GUM_SAMPLING_PROFILER_LOCK() (g_mutex_lock (&priv->mutex))
+#define GUM_SAMPLING_PROFILER_UNLOCK() (g_mutex_unlock (&priv->mutex))
+
+static void gum_sampling_profiler_constructed (GObject * object);
+static void gum_sampling_profiler_dispose (GObject * object);
+static void gum_sampling_profiler_finalize (GObject * object);
+static void gum_sampling_profiler_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gum_sampling_profiler_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+
+static void gum_sampling_profiler_install_handler (void);
+static void gum_sampling_profiler_uninstall_handler (void);
+static void gum_sampling_profiler_on_sigprof (int sig, siginfo_t * info,
+    void * context);
+static void gum_sample_ring_capture (GumSampleRing * ring,
+    GumSamplingProfiler * self, ucontext_t * context);
+
+static gpointer gum_sampling_profiler_aggregate (gpointer data);
+static void gum_sampling_profiler_arm_new_threads (GumSamplingProfiler * self);
+static void gum_sampling_profiler_prepare_unwinder (
+    GumSamplingProfiler * self);
+static GumSampleRing * gum_sampling_profiler_arm_thread (
+    GumSamplingProfiler * self, guint thread_id);
+static void gum_sampling_profiler_disarm_ring (GumSamplingProfiler * self,
+    GumSampleRing * ring);
+static void gum_sampling_profiler_drain (GumSamplingProfiler * self);
+static void gum_sampling_profiler_add_sample (GumSamplingProfiler * self,
+    guint thread_id, const GumStackSample * sample);
+static const gchar * gum_sampling_profiler_resolve (GumSamplingProfiler * self,
+    GumReturnAddress address);
+
+static GHashTable * gum_sampled_node_table_new (void);
+static GumSampledNode * gum_sampled_node_table_lookup (GHashTable * table,
+    const gchar * name);
+static void gum_sampled_node_free (GumSampledNode * node);
+
+static void add_thread_to_report (gpointer key, gpointer value,
+    gpointer user_data);
+static void add_root_to_report (gpointer key, gpointer value,
+    gpointer user_data);
+static GumProfileReportNode * make_node_from_sampled_node (
+    GumSamplingProfiler * self, GumSampledNode * node);
+static void find_hottest_caller (gpointer key, gpointer value,
+    gpointer user_data);
+
+G_DEFINE_TYPE (GumSamplingProfiler, gum_sampling_profiler, G_TYPE_OBJECT);
+
+static GumSamplingProfiler * volatile gum_sampling_profiler_active = NULL;
+static volatile gint gum_sampling_profiler_handlers_running = 0;
+static struct sigaction gum_sampling_profiler_old_action;
+
+static void
+gum_sampling_profiler_class_init (GumSamplingProfilerClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (GumSamplingProfilerPrivate));
+
+  object_class->constructed = gum_sampling_profiler_constructed;
+  object_class->dispose = gum_sampling_profiler_dispose;
+  object_class->finalize = gum_sampling_profiler_finalize;
+  object_class->get_property = gum_sampling_profiler_get_property;
+  object_class->set_property = gum_sampling_profiler_set_property;
+
+  g_object_class_install_property (object_class, PROP_BACKTRACER,
+      g_param_spec_object ("backtracer", "Backtracer",
+      "Backtracer Implementation", GUM_TYPE_BACKTRACER,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (object_class, PROP_INTERVAL,
+      g_param_spec_uint ("interval", "Interval",
+      "Microseconds of CPU time between samples of a thread",
+      1, G_MAXUINT, DEFAULT_INTERVAL,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gum_sampling_profiler_init (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv;
+
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      GUM_TYPE_SAMPLING_PROFILER, GumSamplingProfilerPrivate);
+
+  priv = self->priv;
+
+  g_mutex_init (&priv->mutex);
+  g_cond_init (&priv->cond);
+
+  priv->interval = DEFAULT_INTERVAL;
+
+  priv->rings = g_new0 (GumSampleRing, GUM_MAX_THREADS);
+  priv->ring_by_thread_id = g_hash_table_new (NULL, NULL);
+
+  priv->name_by_address = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  priv->roots_by_thread_id = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_hash_table_unref);
+}
+
+static void
+gum_sampling_profiler_constructed (GObject * object)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  if (priv->backtracer_instance == NULL)
+  {
+    priv->backtracer_instance = gum_backtracer_make_accurate ();
+    if (priv->backtracer_instance == NULL)
+      priv->backtracer_instance = gum_backtracer_make_fuzzy ();
+  }
+
+#ifdef HAVE_I386
+  if (GUM_IS_LINUX_BACKTRACER (priv->backtracer_instance))
+    priv->unwinder = GUM_LINUX_BACKTRACER (priv->backtracer_instance);
+#endif
+}
+
+static void
+gum_sampling_profiler_dispose (GObject * object)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  if (!priv->disposed)
+  {
+    priv->disposed = TRUE;
+
+    gum_sampling_profiler_stop (self);
+
+#ifdef HAVE_I386
+    priv->unwinder = NULL;
+#endif
+    g_object_unref (priv->backtracer_instance);
+    priv->backtracer_instance = NULL;
+  }
+
+  G_OBJECT_CLASS (gum_sampling_profiler_parent_class)->dispose (object);
+}
+
+static void
+gum_sampling_profiler_finalize (GObject * object)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint i;
+
+  g_hash_table_unref (priv->roots_by_thread_id);
+  g_hash_table_unref (priv->name_by_address);
+
+  g_hash_table_unref (priv->ring_by_thread_id);
+  for (i = 0; i != GUM_MAX_THREADS; i++)
+    g_free (priv->rings[i].samples);
+  g_free (priv->rings);
+
+  g_cond_clear (&priv->cond);
+  g_mutex_clear (&priv->mutex);
+
+  G_OBJECT_CLASS (gum_sampling_profiler_parent_class)->finalize (object);
+}
+
+static void
+gum_sampling_profiler_get_property (GObject * object,
+                                    guint property_id,
+                                    GValue * value,
+                                    GParamSpec * pspec)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  switch (property_id)
+  {
+    case PROP_BACKTRACER:
+      g_value_set_object (value, priv->backtracer_instance);
+      break;
+    case PROP_INTERVAL:
+      g_value_set_uint (value, priv->interval);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+static void
+gum_sampling_profiler_set_property (GObject * object,
+                                    guint property_id,
+                                    const GValue * value,
+                                    GParamSpec * pspec)
+{
+  GumSamplingProfiler * self = GUM_SAMPLING_PROFILER (object);
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  switch (property_id)
+  {
+    case PROP_BACKTRACER:
+      priv->backtracer_instance = g_value_dup_object (value);
+      break;
+    case PROP_INTERVAL:
+      g_assert (priv->aggregator == NULL);
+      priv->interval = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+GumSamplingProfiler *
+gum_sampling_profiler_new (void)
+{
+  return g_object_new (GUM_TYPE_SAMPLING_PROFILER, NULL);
+}
+
+/*
+ * Only one sampling profiler can be active at a time, as the SIGPROF handler
+ * is process-wide. The handler stays installed once the first profiler has
+ * started, so that signals still in flight after a stop are discarded rather
+ * than terminating the process.
+ */
+void
+gum_sampling_profiler_start (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  gboolean activated;
+
+  g_assert (priv->aggregator == NULL);
+
+  activated = g_atomic_pointer_compare_and_exchange (
+      &gum_sampling_profiler_active, NULL, self);
+  g_assert (activated);
+
+  gum_sampling_profiler_install_handler ();
+
+  priv->stopping = FALSE;
+  priv->aggregator = g_thread_new ("gum-sampling-profiler",
+      gum_sampling_profiler_aggregate, self);
+}
+
+void
+gum_sampling_profiler_stop (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint i;
+
+  if (priv->aggregator == NULL)
+    return;
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+  priv->stopping = TRUE;
+  g_cond_signal (&priv->cond);
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  g_thread_join (priv->aggregator);
+  priv->aggregator = NULL;
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+
+  for (i = 0; i != GUM_MAX_THREADS; i++)
+  {
+    GumSampleRing * ring = &priv->rings[i];
+
+    if (ring->armed)
+    {
+      timer_delete (ring->timer);
+      ring->armed = FALSE;
+    }
+  }
+
+  g_atomic_pointer_set (&gum_sampling_profiler_active, NULL);
+  while (g_atomic_int_get (&gum_sampling_profiler_handlers_running) != 0)
+    g_thread_yield ();
+
+  gum_sampling_profiler_drain (self);
+
+  for (i = 0; i != GUM_MAX_THREADS; i++)
+    priv->rings[i].thread_id = 0;
+  g_hash_table_remove_all (priv->ring_by_thread_id);
+
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+}
+
+guint64
+gum_sampling_profiler_get_sample_count (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint64 result;
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+  result = priv->sample_count;
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  return result;
+}
+
+guint64
+gum_sampling_profiler_get_dropped_count (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint64 result;
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+  result = priv->dropped_count;
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  return result;
+}
+
+/*
+ * Root nodes are the functions samples landed in, and each node's child is
+ * the caller it was most often reached through. Durations are in
+ * microseconds of CPU time.
+ */
+GumProfileReport *
+gum_sampling_profiler_generate_report (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  GumReportBuilder builder;
+
+  builder.profiler = self;
+  builder.report = gum_profile_report_new ();
+  builder.thread_id = 0;
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+  gum_sampling_profiler_drain (self);
+  g_hash_table_foreach (priv->roots_by_thread_id, add_thread_to_report,
+      &builder);
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  _gum_profile_report_sort (builder.report);
+
+  return builder.report;
+}
+
+static void
+gum_sampling_profiler_install_handler (void)
+{
+  static volatile gint installed = FALSE;
+  struct sigaction action;
+
+  if (g_atomic_int_get (&installed) ||
+      !g_atomic_int_compare_and_exchange (&installed, FALSE, TRUE))
+    return;
+
+  memset (&action, 0, sizeof (action));
+  action.sa_sigaction = gum_sampling_profiler_on_sigprof;
+  sigemptyset (&action.sa_mask);
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigaction (SIGPROF, &action, &gum_sampling_profiler_old_action);
+
+  _gum_register_destructor (gum_sampling_profiler_uninstall_handler);
+}
+
+static void
+gum_sampling_profiler_uninstall_handler (void)
+{
+  sigaction (SIGPROF, &gum_sampling_profiler_old_action, NULL);
+}
+
+/*
+ * Runs on the sampled thread, so everything reachable from here must be
+ * async-signal-safe: no allocation and no locks, only the ring and the
+ * unwinder's async-safe path.
+ */
+static void
+gum_sampling_profiler_on_sigprof (int sig,
+                                  siginfo_t * info,
+                                  void * context)
+{
+  GumSamplingProfiler * self;
+  GumSampleRing * ring;
+  int saved_errno = errno;
+
+  g_atomic_int_inc (&gum_sampling_profiler_handlers_running);
+
+  self = g_atomic_pointer_get (&gum_sampling_profiler_active);
+  ring = info->si_value.sival_ptr;
+
+  if (self != NULL && info->si_code == SI_TIMER &&
+      ring >= self->priv->rings && ring < self->priv->rings + GUM_MAX_THREADS)
+  {
+    gum_sample_ring_capture (ring, self, context);
+  }
+  else if ((gum_sampling_profiler_old_action.sa_flags & SA_SIGINFO) != 0)
+  {
+    gum_sampling_profiler_old_action.sa_sigaction (sig, info, context);
+  }
+  else if (gum_sampling_profiler_old_action.sa_handler != SIG_DFL &&
+      gum_sampling_profiler_old_action.sa_handler != SIG_IGN)
+  {
+    gum_sampling_profiler_old_action.sa_handler (sig);
+  }
+
+  g_atomic_int_add (&gum_sampling_profiler_handlers_running, -1);
+
+  errno = saved_errno;
+}
+
+static void
+gum_sample_ring_capture (GumSampleRing * ring,
+                         GumSamplingProfiler * self,
+                         ucontext_t * context)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  gint head;
+  GumStackSample * sample;
+  GumCpuContext cpu_context;
+
+  head = ring->head;
+  if (head - g_atomic_int_get (&ring->tail) == GUM_SAMPLE_RING_SIZE)
+  {
+    g_atomic_int_inc (&ring->dropped);
+    return;
+  }
+
+  sample = &ring->samples[head % GUM_SAMPLE_RING_SIZE];
+
+  gum_linux_parse_ucontext (context, &cpu_context);
+  sample->pc = GSIZE_TO_POINTER (GUM_CPU_CONTEXT_PC (&cpu_context));
+
+  /*
+   * Other backtracers allocate and take locks, so without an unwinder that
+   * can run here, samples only record where each thread was.
+   */
+#ifdef HAVE_I386
+  if (priv->unwinder != NULL)
+  {
+    gum_linux_backtracer_generate_async_safe (priv->unwinder, &cpu_context,
+        &sample->callers);
+  }
+  else
+#endif
+  {
+    sample->callers.len = 0;
+  }
+
+  g_atomic_int_set (&ring->head, head + 1);
+}
+
+static gpointer
+gum_sampling_profiler_aggregate (gpointer data)
+{
+  GumSamplingProfiler * self = data;
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  GUM_SAMPLING_PROFILER_LOCK ();
+
+  while (!priv->stopping)
+  {
+    gum_sampling_profiler_arm_new_threads (self);
+    gum_sampling_profiler_drain (self);
+
+    g_cond_wait_until (&priv->cond, &priv->mutex,
+        g_get_monotonic_time () + GUM_SAMPLING_POLL_INTERVAL);
+  }
+
+  GUM_SAMPLING_PROFILER_UNLOCK ();
+
+  return NULL;
+}
+
+static void
+gum_sampling_profiler_arm_new_threads (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint self_id;
+  GDir * dir;
+  const gchar * name;
+  GArray * new_thread_ids;
+  guint64 generation;
+  guint i;
+
+  self_id = (guint) syscall (__NR_gettid);
+
+  for (i = 0; i != GUM_MAX_THREADS; i++)
+    priv->rings[i].seen = FALSE;
+
+  dir = g_dir_open ("/proc/self/task", 0, NULL);
+  if (dir == NULL)
+    return;
+
+  new_thread_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+  {
+    guint thread_id = atoi (name);
+    GumSampleRing * ring;
+
+    if (thread_id == self_id)
+      continue;
+
+    ring = g_hash_table_lookup (priv->ring_by_thread_id,
+        GUINT_TO_POINTER (thread_id));
+    if (ring != NULL)
+      ring->seen = TRUE;
+    else
+      g_array_append_val (new_thread_ids, thread_id);
+  }
+
+  g_dir_close (dir);
+
+  /*
+   * New threads bring new stacks, and modules loaded or unloaded since the
+   * last poll change where code and its unwind tables live. The unwinder
+   * must know about both.
+   */
+  generation = _gum_process_query_module_generation ();
+  if (new_thread_ids->len != 0 || generation != priv->module_generation)
+  {
+    priv->module_generation = generation;
+    gum_sampling_profiler_prepare_unwinder (self);
+  }
+
+  for (i = 0; i != new_thread_ids->len; i++)
+  {
+    GumSampleRing * ring;
+
+    ring = gum_sampling_profiler_arm_thread (self,
+        g_array_index (new_thread_ids, guint, i));
+    if (ring != NULL)
+      ring->seen = TRUE;
+  }
+
+  g_array_free (new_thread_ids, TRUE);
+
+  for (i = 0; i != GUM_MAX_THREADS; i++)
+  {
+    GumSampleRing * ring = &priv->rings[i];
+
+    if (ring->thread_id != 0 && !ring->seen)
+      gum_sampling_profiler_disarm_ring (self, ring);
+  }
+}
+
+/*
+ * Gathers everything the SIGPROF handler needs to unwind, such as the stack
+ * bounds and .eh_frame locations, so that it never has to look them up.
+ */
+static void
+gum_sampling_profiler_prepare_unwinder (GumSamplingProfiler * self)
+{
+#ifdef HAVE_I386
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  if (priv->unwinder != NULL)
+    gum_linux_backtracer_prepare (priv->unwinder);
+#endif
+}
+
+static GumSampleRing *
+gum_sampling_profiler_arm_thread (GumSamplingProfiler * self,
+                                  guint thread_id)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  GumSampleRing * ring = NULL;
+  guint i;
+  struct sigevent event;
+  struct itimerspec spec;
+
+  for (i = 0; i != GUM_MAX_THREADS && ring == NULL; i++)
+  {
+    if (priv->rings[i].thread_id == 0)
+      ring = &priv->rings[i];
+  }
+  if (ring == NULL)
+    return NULL;
+
+  if (ring->samples == NULL)
+    ring->samples = g_new (GumStackSample, GUM_SAMPLE_RING_SIZE);
+  ring->head = 0;
+  ring->tail = 0;
+  ring->dropped = 0;
+
+  memset (&event, 0, sizeof (event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_notify_thread_id = thread_id;
+  event.sigev_value.sival_ptr = ring;
+
+  if (timer_create (GUM_THREAD_CPU_CLOCK (thread_id), &event,
+      &ring->timer) != 0)
+  {
+    return NULL;
+  }
+
+  spec.it_interval.tv_sec = priv->interval / G_USEC_PER_SEC;
+  spec.it_interval.tv_nsec = (priv->interval % G_USEC_PER_SEC) * 1000;
+  spec.it_value = spec.it_interval;
+  timer_settime (ring->timer, 0, &spec, NULL);
+
+  ring->thread_id = thread_id;
+  ring->armed = TRUE;
+  g_hash_table_insert (priv->ring_by_thread_id, GUINT_TO_POINTER (thread_id),
+      ring);
+
+  return ring;
+}
+
+static void
+gum_sampling_profiler_disarm_ring (GumSamplingProfiler * self,
+                                   GumSampleRing * ring)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+
+  if (ring->armed)
+  {
+    timer_delete (ring->timer);
+    ring->armed = FALSE;
+  }
+
+  /*
+   * A signal delivered just before the timer went away may still be writing
+   * to the ring, and must be done before the ring is handed to a new thread.
+   */
+  while (g_atomic_int_get (&gum_sampling_profiler_handlers_running) != 0)
+    g_thread_yield ();
+
+  gum_sampling_profiler_drain (self);
+
+  g_hash_table_remove (priv->ring_by_thread_id,
+      GUINT_TO_POINTER (ring->thread_id));
+  ring->thread_id = 0;
+}
+
+static void
+gum_sampling_profiler_drain (GumSamplingProfiler * self)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  guint i;
+
+  for (i = 0; i != GUM_MAX_THREADS; i++)
+  {
+    GumSampleRing * ring = &priv->rings[i];
+    gint head, tail;
+
+    if (ring->thread_id == 0)
+      continue;
+
+    head = g_atomic_int_get (&ring->head);
+    for (tail = ring->tail; tail != head; tail++)
+    {
+      gum_sampling_profiler_add_sample (self, ring->thread_id,
+          &ring->samples[tail % GUM_SAMPLE_RING_SIZE]);
+    }
+    g_atomic_int_set (&ring->tail, tail);
+
+    priv->dropped_count += g_atomic_int_and (&ring->dropped, 0);
+  }
+}
+
+static void
+gum_sampling_profiler_add_sample (GumSamplingProfiler * self,
+                                  guint thread_id,
+                                  const GumStackSample * sample)
+{
+  GumSamplingProfilerPrivate * priv = self->priv;
+  GHashTable * roots;
+  GumSampledNode * node;
+  guint i;
+
+  roots = g_hash_table_lookup (priv->roots_by_thread_id,
+      GUINT_TO_POINTER (thread_id));
+  if (roots == NULL)
+  {
+    roots = gum_sampled_node_table_new ();
+    g_hash_table_insert (priv->roots_by_thread_id,
+        GUINT_TO_POINTER (thread_id), roots);
+  }
+
+  node = gum_sampled_node_table_lookup (roots,
+      gum_sampling_profiler_resolve (self, sample->pc));
+  node->count++;
+
+  for (i = 0; i != sample->callers.len; i++)
+  {
+    if (node->callers == NULL)
+      node->callers = gum_sampled_node_table_new ();
+
+    node = gum_sampled_node_table_lookup (node->callers,
+        gum_sampling_profiler_resolve (self, sample->callers.items[i]));
+    node->count++;
+  }
+
+  priv->sample_count++;
+}
+
+static const gchar *
+gum_sampling_profiler_resolve (GumSamplingProfiler * self,
+                               GumReturnAddress address)
+{
+  GHashTable * names = self->priv->name_by_address;
+  gchar * name;
+
+  name = g_hash_table_lookup (names, address);
+  if (name == NULL)
+  {
+    name = gum_symbol_name_from_address (address);
+    if (name == NULL)
+      name = g_strdup_printf ("%p", address);
+    g_hash_table_insert (names, address, name);
+  }
+
+  return name;
+}
+
+static GHashTable *
+gum_sampled_node_table_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify) gum_sampled_node_free);
+}
+
+static GumSampledNode *
+gum_sampled_node_table_lookup (GHashTable * table,
+                               const gchar * name)
+{
+  GumSampledNode * node;
+
+  node = g_hash_table_lookup (table, name);
+  if (node == NULL)
+  {
+    node = g_slice_new0 (GumSampledNode);
+    node->name = name;
+    g_hash_table_insert (table, (gpointer) name, node);
+  }
+
+  return node;
+}
+
+static void
+gum_sampled_node_free (GumSampledNode * node)
+{
+  if (node->callers != NULL)
+    g_hash_table_unref (node->callers);
+
+  g_slice_free (GumSampledNode, node);
+}
+
+static void
+add_thread_to_report (gpointer key,
+                      gpointer value,
+                      gpointer user_data)
+{
+  GumReportBuilder * builder = user_data;
+
+  builder->thread_id = GPOINTER_TO_UINT (key);
+  g_hash_table_foreach (value, add_root_to_report, builder);
+}
+
+static void
+add_root_to_report (gpointer key,
+                    gpointer value,
+                    gpointer user_data)
+{
+  GumReportBuilder * builder = user_data;
+
+  _gum_profile_report_append_thread_root_node (builder->report,
+      builder->thread_id,
+      make_node_from_sampled_node (builder->profiler, value));
+}
+
+static GumProfileReportNode *
+make_node_from_sampled_node (GumSamplingProfiler * self,
+                             GumSampledNode * node)
+{
+  GumProfileReportNode * result;
+  GumSampledNode * hottest_caller = NULL;
+
+  result = g_new (GumProfileReportNode, 1);
+  result->name = g_strdup (node->name);
+  result->total_calls = node->count;
+  result->total_duration = node->count * self->priv->interval;
+  result->worst_case_duration = 0;
+  result->worst_case_info = g_strdup ("");
+
+  if (node->callers != NULL)
+  {
+    g_hash_table_foreach (node->callers, find_hottest_caller,
+        &hottest_caller);
+  }
+
+  result->child = (hottest_caller != NULL)
+      ? make_node_from_sampled_node (self, hottest_caller)
+      : NULL;
+
+  return result;
+}
+
+static void
+find_hottest_caller (gpointer key,
+                     gpointer value,
+                     gpointer user_data)
+{
+  GumSampledNode * node = value;
+  GumSampledNode ** hottest = user_data;
+
+  if (*hottest == NULL || node->count > (*hottest)->count)
+    *hottest = node;
+}
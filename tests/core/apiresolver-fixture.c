@@ -9,6 +9,7 @@
 #include "testutil.h"
 
 #include <string.h>
+#include <glib/gstdio.h>
 
 #define API_RESOLVER_TESTCASE(NAME) \
     void test_api_resolver_ ## NAME ( \
@@ -19,6 +20,7 @@
 
 typedef struct _TestApiResolverFixture TestApiResolverFixture;
 typedef struct _TestForEachContext TestForEachContext;
+typedef struct _TestExpectedExportContext TestExpectedExportContext;
 
 struct _TestApiResolverFixture
 {
@@ -31,6 +33,14 @@ struct _TestForEachContext
   guint number_of_calls;
 };
 
+struct _TestExpectedExportContext
+{
+  const gchar * suffix;
+  GumAddress address;
+  guint number_of_calls;
+  gboolean found;
+};
+
 static void
 test_api_resolver_fixture_setup (TestApiResolverFixture * fixture,
                                  gconstpointer data)
@@ -44,6 +54,10 @@ test_api_resolver_fixture_teardown (TestApiResolverFixture * fixture,
   g_clear_object (&fixture->resolver);
 }
 
+static gboolean collect_match_address (const GumApiDetails * details,
+    gpointer user_data);
+static gboolean check_expected_export (const GumApiDetails * details,
+    gpointer user_data);
 static gboolean check_module_import (const GumApiDetails * details,
     gpointer user_data);
 static gboolean match_found_cb (const GumApiDetails * details,
@@ -8,6 +8,10 @@
 
 TEST_LIST_BEGIN (api_resolver)
   API_RESOLVER_TESTENTRY (module_exports_can_be_resolved)
+  API_RESOLVER_TESTENTRY (module_exports_can_be_resolved_by_exact_name)
+  API_RESOLVER_TESTENTRY (module_exports_can_be_resolved_by_substring)
+  API_RESOLVER_TESTENTRY (module_export_index_can_be_shared)
+  API_RESOLVER_TESTENTRY (module_export_index_can_be_cached_in_file)
   API_RESOLVER_TESTENTRY (module_imports_can_be_resolved)
   API_RESOLVER_TESTENTRY (objc_methods_can_be_resolved)
 TEST_LIST_END ()
@@ -40,6 +44,182 @@ API_RESOLVER_TESTCASE (module_exports_can_be_resolved)
   g_assert_cmpuint (ctx.number_of_calls, ==, 1);
 }
 
+API_RESOLVER_TESTCASE (module_exports_can_be_resolved_by_exact_name)
+{
+  TestExpectedExportContext ctx;
+  GError * error = NULL;
+#ifdef G_OS_WIN32
+  const gchar * query = "exports:*!_open";
+  const gchar * name = "_open";
+#else
+  const gchar * query = "exports:*!open";
+  const gchar * name = "open";
+#endif
+
+  fixture->resolver = gum_api_resolver_make ("module");
+  g_assert (fixture->resolver != NULL);
+
+  ctx.suffix = name;
+  ctx.address = gum_module_find_export_by_name (NULL, name);
+  ctx.number_of_calls = 0;
+  ctx.found = FALSE;
+  gum_api_resolver_enumerate_matches (fixture->resolver, query,
+      check_expected_export, &ctx, &error);
+  g_assert (error == NULL);
+  g_assert_cmpuint (ctx.number_of_calls, >=, 1);
+  g_assert (ctx.found);
+}
+
+API_RESOLVER_TESTCASE (module_exports_can_be_resolved_by_substring)
+{
+  TestExpectedExportContext ctx;
+  GError * error = NULL;
+  const gchar * query = "exports:*!*alloc*";
+
+  fixture->resolver = gum_api_resolver_make ("module");
+  g_assert (fixture->resolver != NULL);
+
+  ctx.suffix = NULL;
+  ctx.address = gum_module_find_export_by_name (NULL, "malloc");
+  ctx.number_of_calls = 0;
+  ctx.found = FALSE;
+  gum_api_resolver_enumerate_matches (fixture->resolver, query,
+      check_expected_export, &ctx, &error);
+  g_assert (error == NULL);
+  g_assert_cmpuint (ctx.number_of_calls, >, 1);
+  g_assert (ctx.found);
+
+  /* The second query is served by the shared export index. */
+  ctx.number_of_calls = 0;
+  ctx.found = FALSE;
+  gum_api_resolver_enumerate_matches (fixture->resolver, query,
+      check_expected_export, &ctx, &error);
+  g_assert (error == NULL);
+  g_assert (ctx.found);
+}
+
+API_RESOLVER_TESTCASE (module_export_index_can_be_shared)
+{
+  GumApiResolver * first, * second;
+  GError * error = NULL;
+  const gchar * query = "exports:*!*alloc*";
+  GArray * first_matches, * second_matches;
+
+  first = gum_api_resolver_make ("module");
+  second = gum_api_resolver_make ("module");
+
+  first_matches = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+  second_matches = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+  gum_api_resolver_enumerate_matches (first, query, collect_match_address,
+      first_matches, &error);
+  g_assert (error == NULL);
+  gum_api_resolver_enumerate_matches (second, query, collect_match_address,
+      second_matches, &error);
+  g_assert (error == NULL);
+  g_assert_cmpuint (first_matches->len, >, 1);
+  g_assert_cmpuint (second_matches->len, ==, first_matches->len);
+  g_assert (memcmp (first_matches->data, second_matches->data,
+      first_matches->len * sizeof (GumAddress)) == 0);
+
+  /* The second resolver keeps the shared index alive. */
+  g_object_unref (first);
+  g_array_set_size (second_matches, 0);
+  gum_api_resolver_enumerate_matches (second, query, collect_match_address,
+      second_matches, &error);
+  g_assert (error == NULL);
+  g_assert_cmpuint (second_matches->len, ==, first_matches->len);
+
+  /* Once both are gone the index is evicted, and built again on demand. */
+  g_object_unref (second);
+  fixture->resolver = gum_api_resolver_make ("module");
+  g_array_set_size (second_matches, 0);
+  gum_api_resolver_enumerate_matches (fixture->resolver, query,
+      collect_match_address, second_matches, &error);
+  g_assert (error == NULL);
+  g_assert_cmpuint (second_matches->len, ==, first_matches->len);
+  g_assert (memcmp (first_matches->data, second_matches->data,
+      first_matches->len * sizeof (GumAddress)) == 0);
+
+  g_array_free (second_matches, TRUE);
+  g_array_free (first_matches, TRUE);
+}
+
+API_RESOLVER_TESTCASE (module_export_index_can_be_cached_in_file)
+{
+  gchar * path;
+  GError * error = NULL;
+  const gchar * query = "exports:*!*alloc*";
+  GArray * built_matches, * loaded_matches;
+
+  g_close (g_file_open_tmp ("gum-export-index-XXXXXX", &path, NULL), NULL);
+  g_unlink (path);
+
+  gum_module_api_resolver_set_cache_file (path);
+
+  built_matches = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+  fixture->resolver = gum_api_resolver_make ("module");
+  gum_api_resolver_enumerate_matches (fixture->resolver, query,
+      collect_match_address, built_matches, &error);
+  g_assert (error == NULL);
+  g_assert_cmpuint (built_matches->len, >, 1);
+  g_clear_object (&fixture->resolver);
+
+#ifdef HAVE_LINUX
+  g_assert (g_file_test (path, G_FILE_TEST_IS_REGULAR));
+#endif
+
+  gum_module_api_resolver_set_cache_file (path);
+
+  loaded_matches = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+  fixture->resolver = gum_api_resolver_make ("module");
+  gum_api_resolver_enumerate_matches (fixture->resolver, query,
+      collect_match_address, loaded_matches, &error);
+  g_assert (error == NULL);
+  g_assert_cmpuint (loaded_matches->len, ==, built_matches->len);
+  g_assert (memcmp (built_matches->data, loaded_matches->data,
+      built_matches->len * sizeof (GumAddress)) == 0);
+  g_clear_object (&fixture->resolver);
+
+  gum_module_api_resolver_set_cache_file (NULL);
+  g_unlink (path);
+
+  g_array_free (loaded_matches, TRUE);
+  g_array_free (built_matches, TRUE);
+  g_free (path);
+}
+
+static gboolean
+collect_match_address (const GumApiDetails * details,
+                       gpointer user_data)
+{
+  GArray * addresses = user_data;
+
+  g_array_append_val (addresses, details->address);
+
+  return TRUE;
+}
+
+static gboolean
+check_expected_export (const GumApiDetails * details,
+                       gpointer user_data)
+{
+  TestExpectedExportContext * ctx = user_data;
+  const gchar * function_name;
+
+  function_name = strrchr (details->name, '!') + 1;
+  if (ctx->suffix != NULL)
+    g_assert_cmpstr (function_name, ==, ctx->suffix);
+  else
+    g_assert (strstr (function_name, "alloc") != NULL);
+
+  if (details->address == ctx->address)
+    ctx->found = TRUE;
+
+  ctx->number_of_calls++;
+
+  return TRUE;
+}
+
 API_RESOLVER_TESTCASE (module_imports_can_be_resolved)
 {
 #ifdef HAVE_DARWIN
@@ -10,6 +10,7 @@
 #include "valgrind.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #define BACKTRACER_TESTCASE(NAME) \
     void test_backtracer_ ## NAME ( \
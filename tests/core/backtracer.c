@@ -12,11 +12,34 @@
 TEST_LIST_BEGIN (backtracer)
   BACKTRACER_TESTENTRY (basics)
   BACKTRACER_TESTENTRY (full_cycle)
+  BACKTRACER_TESTENTRY (batch_symbolization)
+  BACKTRACER_TESTENTRY (repeated_generation_is_stable)
+#if defined (HAVE_LINUX) && defined (HAVE_I386)
+  BACKTRACER_TESTENTRY (known_call_chain_is_recovered)
+#endif
 #if ENABLE_PERFORMANCE_TEST
   BACKTRACER_TESTENTRY (performance)
 #endif
 TEST_LIST_END ()
 
+#if defined (HAVE_LINUX) && defined (HAVE_I386)
+
+typedef struct _TestCallChain TestCallChain;
+
+struct _TestCallChain
+{
+  GumBacktracer * backtracer;
+  GumReturnAddressArray ret_addrs;
+  GumReturnAddress expected[3];
+  volatile guint depth;
+};
+
+static void call_chain_a (TestCallChain * chain);
+static void call_chain_b (TestCallChain * chain);
+static void call_chain_c (TestCallChain * chain);
+
+#endif
+
 #if PRINT_BACKTRACES
 static void print_backtrace (GumReturnAddressArray * ret_addrs);
 #endif
@@ -57,6 +80,90 @@ BACKTRACER_TESTCASE (basics)
 #endif
 }
 
+BACKTRACER_TESTCASE (repeated_generation_is_stable)
+{
+  GumReturnAddressArray first = { 0, };
+  guint i;
+
+  if (fixture->backtracer == NULL)
+  {
+    g_print ("<skipping, no accurate backtracer> ");
+    return;
+  }
+
+  gum_backtracer_generate (fixture->backtracer, NULL, &first);
+  g_assert_cmpuint (first.len, >=, 2);
+
+  for (i = 0; i != 100; i++)
+  {
+    GumReturnAddressArray ret_addrs = { 0, };
+
+    gum_backtracer_generate (fixture->backtracer, NULL, &ret_addrs);
+    g_assert_cmpuint (ret_addrs.len, ==, first.len);
+    g_assert (memcmp (ret_addrs.items + 1, first.items + 1,
+        (first.len - 1) * sizeof (GumReturnAddress)) == 0);
+  }
+}
+
+#if defined (HAVE_LINUX) && defined (HAVE_I386)
+
+BACKTRACER_TESTCASE (known_call_chain_is_recovered)
+{
+  TestCallChain chain = { 0, };
+  guint i;
+
+  if (fixture->backtracer == NULL)
+  {
+    g_print ("<skipping, no accurate backtracer> ");
+    return;
+  }
+
+  chain.backtracer = fixture->backtracer;
+  call_chain_a (&chain);
+  g_assert_cmpuint (chain.depth, ==, 3);
+
+  /* The first frames may belong to gum_backtracer_generate () itself */
+  for (i = 0; i != chain.ret_addrs.len; i++)
+  {
+    if (chain.ret_addrs.items[i] == chain.expected[0])
+      break;
+  }
+  g_assert_cmpuint (i, <=, 2);
+  g_assert_cmpuint (chain.ret_addrs.len, >=, i + 3);
+  g_assert (chain.ret_addrs.items[i + 1] == chain.expected[1]);
+  g_assert (chain.ret_addrs.items[i + 2] == chain.expected[2]);
+}
+
+/*
+ * Each function records where it will return to, and does some work after
+ * its call so that the call cannot be turned into a tail call.
+ */
+static void GUM_NOINLINE
+call_chain_a (TestCallChain * chain)
+{
+  chain->expected[2] = __builtin_return_address (0);
+  call_chain_b (chain);
+  chain->depth++;
+}
+
+static void GUM_NOINLINE
+call_chain_b (TestCallChain * chain)
+{
+  chain->expected[1] = __builtin_return_address (0);
+  call_chain_c (chain);
+  chain->depth++;
+}
+
+static void GUM_NOINLINE
+call_chain_c (TestCallChain * chain)
+{
+  chain->expected[0] = __builtin_return_address (0);
+  gum_backtracer_generate (chain->backtracer, NULL, &chain->ret_addrs);
+  chain->depth++;
+}
+
+#endif
+
 BACKTRACER_TESTCASE (full_cycle)
 {
   GumAllocatorProbe * probe;
@@ -131,6 +238,58 @@ BACKTRACER_TESTCASE (full_cycle)
   g_object_unref (tracker);
 }
 
+BACKTRACER_TESTCASE (batch_symbolization)
+{
+  GumReturnAddressArray first = { 0, }, second = { 0, };
+  const GumReturnAddressArray * arrays[2];
+  guint n_items, i;
+  GumReturnAddressDetails * details;
+  gboolean * resolved;
+
+  if (!g_test_slow ())
+  {
+    g_print ("<skipping, run in slow mode> ");
+    return;
+  }
+
+  gum_backtracer_generate (fixture->backtracer, NULL, &first);
+  gum_backtracer_generate (fixture->backtracer, NULL, &second);
+  g_assert_cmpuint (first.len, >=, 2);
+
+  arrays[0] = &first;
+  arrays[1] = &second;
+  n_items = first.len + second.len;
+  details = g_new (GumReturnAddressDetails, n_items);
+  resolved = g_new (gboolean, n_items);
+
+  g_assert_cmpuint (gum_return_address_details_from_arrays (arrays, 2,
+      details, resolved), >=, 2);
+
+  for (i = 0; i != n_items; i++)
+  {
+    GumReturnAddress address = (i < first.len)
+        ? first.items[i]
+        : second.items[i - first.len];
+    GumReturnAddressDetails rad;
+
+    g_assert_cmpint (resolved[i], ==,
+        gum_return_address_details_from_address (address, &rad));
+    if (!resolved[i])
+      continue;
+
+    g_assert (details[i].address == address);
+    g_assert_cmpstr (details[i].module_name, ==, rad.module_name);
+    g_assert_cmpstr (details[i].function_name, ==, rad.function_name);
+    g_assert_cmpstr (details[i].file_name, ==, rad.file_name);
+    g_assert_cmpuint (details[i].line_number, ==, rad.line_number);
+  }
+
+  g_assert_cmpstr (details[0].function_name, ==, __FUNCTION__);
+
+  g_free (resolved);
+  g_free (details);
+}
+
 #if ENABLE_PERFORMANCE_TEST
 
 BACKTRACER_TESTCASE (performance)
@@ -8,6 +8,10 @@
 
 #include "gummemory-priv.h"
 
+#ifdef HAVE_LINUX
+# include <sys/mman.h>
+#endif
+
 #define MEMORY_TESTCASE(NAME) \
     void test_memory_ ## NAME (void)
 #define MEMORY_TESTENTRY(NAME) \
@@ -24,12 +28,21 @@ TEST_LIST_BEGIN (memory)
   MEMORY_TESTENTRY (match_pattern_from_string_does_proper_validation)
   MEMORY_TESTENTRY (scan_range_finds_three_exact_matches)
   MEMORY_TESTENTRY (scan_range_finds_three_wildcarded_matches)
+  MEMORY_TESTENTRY (scan_range_finds_matches_at_block_boundaries)
+  MEMORY_TESTENTRY (scan_range_finds_matches_of_multiple_patterns)
   MEMORY_TESTENTRY (is_memory_readable_handles_mixed_page_protections)
+#ifdef HAVE_LINUX
+  MEMORY_TESTENTRY (protection_changes_made_behind_our_back_are_detected)
+#endif
   MEMORY_TESTENTRY (alloc_n_pages_returns_aligned_rw_address)
   MEMORY_TESTENTRY (alloc_n_pages_near_returns_aligned_rw_address_within_range)
   MEMORY_TESTENTRY (mprotect_handles_page_boundaries)
+  MEMORY_TESTENTRY (blocks_freed_by_another_thread_are_accounted_for)
 TEST_LIST_END ()
 
+#define TEST_REMOTE_BLOCK_COUNT 64
+#define TEST_REMOTE_BLOCK_SIZE 48
+
 typedef struct _TestForEachContext {
   gboolean value_to_return;
   guint number_of_calls;
@@ -38,8 +51,18 @@ typedef struct _TestForEachContext {
   guint expected_size;
 } TestForEachContext;
 
+typedef struct _TestMultiScanContext {
+  GumAddress base;
+  GString * matches;
+} TestMultiScanContext;
+
 static gboolean match_found_cb (GumAddress address, gsize size,
     gpointer user_data);
+static gboolean store_match_cb (GumAddress address, gsize size,
+    gpointer user_data);
+static gboolean store_multi_match_cb (guint pattern_id, GumAddress address,
+    gsize size, gpointer user_data);
+static gpointer allocate_blocks (gpointer data);
 
 MEMORY_TESTCASE (read_from_valid_address_should_succeed)
 {
@@ -304,6 +327,112 @@ MEMORY_TESTCASE (scan_range_finds_three_wildcarded_matches)
   gum_match_pattern_free (pattern);
 }
 
+MEMORY_TESTCASE (scan_range_finds_matches_at_block_boundaries)
+{
+  const gchar * patterns[] = {
+    "13 37",
+    "12 ?? 13 37",
+    "de ad be ef ?? ?? 13 37 ca fe ba be 01 02 03 04"
+  };
+  guint8 * page;
+  guint page_size, i;
+
+  page = gum_alloc_n_pages (1, GUM_PAGE_RW);
+  page_size = gum_query_page_size ();
+
+  for (i = 0; i != G_N_ELEMENTS (patterns); i++)
+  {
+    GumMatchPattern * pattern;
+    guint offsets[6] = { 0, 17, 47, 64, 200, 0 };
+    GumMemoryRange range;
+    GArray * matches;
+    guint j, k;
+
+    pattern = gum_match_pattern_new_from_string (patterns[i]);
+    g_assert (pattern != NULL);
+    offsets[5] = page_size - pattern->size;
+
+    memset (page, 0, page_size);
+    for (j = 0; j != G_N_ELEMENTS (offsets); j++)
+    {
+      for (k = 0; k != pattern->tokens->len; k++)
+      {
+        GumMatchToken * token = GUM_PATTERN_NTH_TOKEN (pattern, k);
+
+        memcpy (page + offsets[j] + token->offset, token->bytes->data,
+            token->bytes->len);
+      }
+    }
+
+    matches = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+
+    range.base_address = GUM_ADDRESS (page);
+    range.size = page_size;
+    gum_memory_scan (&range, pattern, store_match_cb, matches);
+    g_assert_cmpuint (matches->len, ==, G_N_ELEMENTS (offsets));
+    for (j = 0; j != G_N_ELEMENTS (offsets); j++)
+    {
+      g_assert_cmphex (g_array_index (matches, GumAddress, j), ==,
+          GUM_ADDRESS (page + offsets[j]));
+    }
+
+    g_array_set_size (matches, 0);
+    range.size = page_size - 1;
+    gum_memory_scan (&range, pattern, store_match_cb, matches);
+    g_assert_cmpuint (matches->len, ==, G_N_ELEMENTS (offsets) - 1);
+
+    g_array_set_size (matches, 0);
+    range.base_address = GUM_ADDRESS (page + 1);
+    range.size = page_size - 1;
+    gum_memory_scan (&range, pattern, store_match_cb, matches);
+    g_assert_cmpuint (matches->len, ==, G_N_ELEMENTS (offsets) - 1);
+
+    g_array_free (matches, TRUE);
+    gum_match_pattern_free (pattern);
+  }
+
+  gum_free_pages (page);
+}
+
+MEMORY_TESTCASE (scan_range_finds_matches_of_multiple_patterns)
+{
+  guint8 buf[] = {
+    0x12, 0x11, 0x13, 0x37,
+    0x12, 0x00,
+    0x13, 0x37, 0x13, 0x37,
+    0xca, 0xfe, 0x13, 0x37
+  };
+  GumMemoryRange range;
+  GumMatchPatternSet * set;
+  TestMultiScanContext ctx;
+
+  set = gum_match_pattern_set_new ();
+  g_assert_cmpuint (gum_match_pattern_set_add (set,
+      gum_match_pattern_new_from_string ("13 37")), ==, 0);
+  g_assert_cmpuint (gum_match_pattern_set_add (set,
+      gum_match_pattern_new_from_string ("12 ?? 13 37")), ==, 1);
+  g_assert_cmpuint (gum_match_pattern_set_add (set,
+      gum_match_pattern_new_from_string ("37 13 37")), ==, 2);
+  g_assert_cmpuint (gum_match_pattern_set_size (set), ==, 3);
+
+  ctx.base = GUM_ADDRESS (buf);
+  ctx.matches = g_string_new ("");
+
+  range.base_address = GUM_ADDRESS (buf);
+  range.size = sizeof (buf);
+  gum_memory_scan_multi (&range, set, store_multi_match_cb, &ctx);
+  g_assert_cmpstr (ctx.matches->str, ==, "0@2 1@0 0@6 1@4 2@7 0@8 0@12");
+
+  g_string_truncate (ctx.matches, 0);
+  range.base_address = GUM_ADDRESS (buf + 1);
+  range.size = sizeof (buf) - 2;
+  gum_memory_scan_multi (&range, set, store_multi_match_cb, &ctx);
+  g_assert_cmpstr (ctx.matches->str, ==, "0@2 0@6 1@4 2@7 0@8");
+
+  g_string_free (ctx.matches, TRUE);
+  gum_match_pattern_set_free (set);
+}
+
 MEMORY_TESTCASE (is_memory_readable_handles_mixed_page_protections)
 {
   guint8 * pages;
@@ -339,6 +468,47 @@ MEMORY_TESTCASE (is_memory_readable_handles_mixed_page_protections)
   gum_free_pages (pages);
 }
 
+#ifdef HAVE_LINUX
+
+MEMORY_TESTCASE (protection_changes_made_behind_our_back_are_detected)
+{
+  guint8 * pages;
+  guint page_size;
+  guint8 magic[2] = { 0x13, 0x37 };
+  gsize n_bytes_read;
+  guint8 * data;
+
+  pages = gum_alloc_n_pages (2, GUM_PAGE_RW);
+  page_size = gum_query_page_size ();
+
+  g_assert (gum_memory_is_readable (GUM_ADDRESS (pages), 2 * page_size));
+  g_assert (gum_memory_write (GUM_ADDRESS (pages), magic, sizeof (magic)));
+
+  g_assert_cmpint (mprotect (pages + page_size, page_size, PROT_NONE), ==, 0);
+
+  g_assert (!gum_memory_is_readable (GUM_ADDRESS (pages), 2 * page_size));
+  data = gum_memory_read (GUM_ADDRESS (pages), 2 * page_size, &n_bytes_read);
+  g_assert (data != NULL);
+  g_assert_cmpuint (n_bytes_read, ==, page_size);
+  g_assert_cmphex (data[0], ==, 0x13);
+  g_assert_cmphex (data[1], ==, 0x37);
+  g_free (data);
+  g_assert (!gum_memory_write (GUM_ADDRESS (pages + page_size), magic,
+      sizeof (magic)));
+
+  g_assert_cmpint (mprotect (pages + page_size, page_size,
+      PROT_READ | PROT_WRITE), ==, 0);
+
+  g_assert (gum_memory_is_readable (GUM_ADDRESS (pages), 2 * page_size));
+  g_assert (gum_memory_write (GUM_ADDRESS (pages + page_size), magic,
+      sizeof (magic)));
+  g_assert_cmphex (pages[page_size + 1], ==, 0x37);
+
+  gum_free_pages (pages);
+}
+
+#endif
+
 MEMORY_TESTCASE (alloc_n_pages_returns_aligned_rw_address)
 {
   gpointer page;
@@ -404,6 +574,37 @@ MEMORY_TESTCASE (mprotect_handles_page_boundaries)
   gum_free_pages (pages);
 }
 
+MEMORY_TESTCASE (blocks_freed_by_another_thread_are_accounted_for)
+{
+  gpointer blocks[TEST_REMOTE_BLOCK_COUNT];
+  GThread * thread;
+  guint usage_before, usage_after, i;
+
+  thread = g_thread_new ("memory-test-allocator", allocate_blocks, blocks);
+  g_thread_join (thread);
+
+  usage_before = gum_peek_private_memory_usage ();
+
+  for (i = 0; i != TEST_REMOTE_BLOCK_COUNT; i++)
+    gum_free (blocks[i]);
+
+  usage_after = gum_peek_private_memory_usage ();
+  g_assert_cmpuint (usage_before - usage_after, >=,
+      TEST_REMOTE_BLOCK_COUNT * TEST_REMOTE_BLOCK_SIZE);
+}
+
+static gpointer
+allocate_blocks (gpointer data)
+{
+  gpointer * blocks = data;
+  guint i;
+
+  for (i = 0; i != TEST_REMOTE_BLOCK_COUNT; i++)
+    blocks[i] = gum_malloc (TEST_REMOTE_BLOCK_SIZE);
+
+  return NULL;
+}
+
 static gboolean
 match_found_cb (GumAddress address,
                 gsize size,
@@ -421,3 +622,31 @@ match_found_cb (GumAddress address,
 
   return ctx->value_to_return;
 }
+
+static gboolean
+store_match_cb (GumAddress address,
+                gsize size,
+                gpointer user_data)
+{
+  GArray * matches = (GArray *) user_data;
+
+  g_array_append_val (matches, address);
+
+  return TRUE;
+}
+
+static gboolean
+store_multi_match_cb (guint pattern_id,
+                      GumAddress address,
+                      gsize size,
+                      gpointer user_data)
+{
+  TestMultiScanContext * ctx = (TestMultiScanContext *) user_data;
+
+  if (ctx->matches->len != 0)
+    g_string_append_c (ctx->matches, ' ');
+  g_string_append_printf (ctx->matches, "%u@%u", pattern_id,
+      (guint) (address - ctx->base));
+
+  return TRUE;
+}
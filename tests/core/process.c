@@ -9,6 +9,9 @@
 #include "testutil.h"
 
 #include "valgrind.h"
+#ifdef HAVE_LINUX
+#include <gum/backend-linux/gumlinux.h>
+#endif
 
 #ifndef G_OS_WIN32
 #include <dlfcn.h>
@@ -19,6 +22,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined (HAVE_I386)
+# if GLIB_SIZEOF_VOID_P == 4
+#  define PROCESS_TEST_SHLIB_ARCH "ia32"
+# else
+#  define PROCESS_TEST_SHLIB_ARCH "amd64"
+# endif
+#elif defined (HAVE_ARM)
+# define PROCESS_TEST_SHLIB_ARCH "arm"
+#elif defined (HAVE_ARM64)
+# define PROCESS_TEST_SHLIB_ARCH "arm64"
+#elif defined (HAVE_MIPS)
+# if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#  define PROCESS_TEST_SHLIB_ARCH "mipsel"
+# else
+#  define PROCESS_TEST_SHLIB_ARCH "mips"
+# endif
+#endif
+
 #define PROCESS_TESTCASE(NAME) \
     void test_process_ ## NAME (void)
 #define PROCESS_TESTENTRY(NAME) \
@@ -36,6 +57,16 @@ TEST_LIST_BEGIN (process)
   PROCESS_TESTENTRY (module_base)
   PROCESS_TESTENTRY (module_export_can_be_found)
   PROCESS_TESTENTRY (module_export_matches_system_lookup)
+  PROCESS_TESTENTRY (module_map_finds_modules_by_address)
+  PROCESS_TESTENTRY (memory_map_finds_ranges_spanning_adjacent_mappings)
+#ifdef HAVE_LINUX
+  PROCESS_TESTENTRY (module_map_covers_code_of_main_program)
+  PROCESS_TESTENTRY (nearest_export_can_be_found)
+#endif
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+  PROCESS_TESTENTRY (module_export_is_found_without_dlsym)
+  PROCESS_TESTENTRY (module_export_follows_module_reload)
+#endif
 #ifdef G_OS_WIN32
   PROCESS_TESTENTRY (get_set_system_error)
   PROCESS_TESTENTRY (get_current_thread_id)
@@ -69,6 +100,10 @@ static gboolean store_export_address_if_mach_msg (
     const GumExportDetails * details, gpointer user_data);
 #endif
 
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+static void * replacement_dlsym (void * handle, const char * symbol);
+#endif
+
 static gpointer sleeping_dummy (gpointer data);
 static gboolean thread_found_cb (const GumThreadDetails * details,
     gpointer user_data);
@@ -337,6 +372,184 @@ PROCESS_TESTCASE (module_export_matches_system_lookup)
 #endif
 }
 
+PROCESS_TESTCASE (module_map_finds_modules_by_address)
+{
+  GumModuleMap * map;
+  GumAddress addresses[3];
+  const GumModuleDetails * modules[3];
+
+  map = gum_module_map_new ();
+
+  addresses[0] = GUM_ADDRESS (gum_module_find_export_by_name (
+      SYSTEM_MODULE_NAME, SYSTEM_MODULE_EXPORT));
+  addresses[1] = 1;
+  addresses[2] = addresses[0];
+  gum_module_map_find_many (map, addresses, G_N_ELEMENTS (addresses),
+      modules);
+
+  g_assert (modules[0] != NULL);
+  g_assert (GUM_MEMORY_RANGE_INCLUDES (modules[0]->range, addresses[0]));
+  g_assert (modules[1] == NULL);
+  g_assert (modules[2] == modules[0]);
+  g_assert (gum_module_map_find (map, addresses[0]) == modules[0]);
+
+  g_object_unref (map);
+}
+
+#ifdef HAVE_LINUX
+PROCESS_TESTCASE (module_map_covers_code_of_main_program)
+{
+  GumModuleMap * map;
+  const GumModuleDetails * details;
+
+  map = gum_module_map_new ();
+
+  details = gum_module_map_find (map,
+      GUM_ADDRESS (test_process_process_modules));
+  g_assert (details != NULL);
+  g_assert_cmpstr (details->name, ==, GUM_TESTS_MODULE_NAME);
+
+  gum_module_map_update (map);
+  g_assert (gum_module_map_find (map,
+      GUM_ADDRESS (test_process_process_modules)) != NULL);
+
+  g_object_unref (map);
+}
+#endif
+
+#ifdef HAVE_LINUX
+PROCESS_TESTCASE (nearest_export_can_be_found)
+{
+  GumAddress address;
+  GumExportDetails details;
+
+  address = gum_module_find_export_by_name (SYSTEM_MODULE_NAME,
+      SYSTEM_MODULE_EXPORT);
+  g_assert (address != 0);
+
+  g_assert (gum_linux_find_nearest_export (address + 1, &details));
+  g_assert_cmphex (details.address, ==, address);
+  g_assert_cmpint (details.type, ==, GUM_EXPORT_FUNCTION);
+}
+#endif
+
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+PROCESS_TESTCASE (module_export_is_found_without_dlsym)
+{
+  GumInterceptor * interceptor;
+  gpointer dlsym_impl;
+  guint dlsym_calls = 0;
+  GumAddress address;
+
+  if (RUNNING_ON_VALGRIND)
+  {
+    g_print ("<skipping, not compatible with Valgrind> ");
+    return;
+  }
+
+  interceptor = gum_interceptor_obtain ();
+  dlsym_impl = dlsym (RTLD_DEFAULT, "dlsym");
+
+  g_assert_cmpint (gum_interceptor_replace_function (interceptor, dlsym_impl,
+      replacement_dlsym, &dlsym_calls), ==, GUM_REPLACE_OK);
+  address = gum_module_find_export_by_name (SYSTEM_MODULE_NAME,
+      SYSTEM_MODULE_EXPORT);
+  gum_interceptor_revert_function (interceptor, dlsym_impl);
+
+  g_object_unref (interceptor);
+
+  g_assert (address != 0);
+  g_assert_cmpuint (dlsym_calls, ==, 0);
+}
+
+static void *
+replacement_dlsym (void * handle,
+                   const char * symbol)
+{
+  GumInvocationContext * ctx;
+  void * (* dlsym_impl) (void * handle, const char * symbol);
+  guint * counter;
+
+  ctx = gum_interceptor_get_current_invocation ();
+  g_assert (ctx != NULL);
+
+  dlsym_impl = ctx->function;
+  counter = (guint *)
+      gum_invocation_context_get_replacement_function_data (ctx);
+
+  (*counter)++;
+
+  return dlsym_impl (handle, symbol);
+}
+
+PROCESS_TESTCASE (module_export_follows_module_reload)
+{
+  gchar * testdir, * filename;
+  guint i;
+
+  testdir = test_util_get_data_dir ();
+  filename = g_build_filename (testdir,
+      "specialfunctions-linux-" PROCESS_TEST_SHLIB_ARCH ".so", NULL);
+  g_free (testdir);
+
+  if (!g_file_test (filename, G_FILE_TEST_EXISTS))
+  {
+    g_print ("<skipping, missing test library> ");
+    g_free (filename);
+    return;
+  }
+
+  for (i = 0; i != 2; i++)
+  {
+    void * lib, * system_address;
+
+    lib = dlopen (filename, RTLD_NOW | RTLD_LOCAL);
+    g_assert (lib != NULL);
+    system_address = dlsym (lib, "gum_test_special_function");
+    g_assert (system_address != NULL);
+
+    g_assert_cmphex (gum_module_find_export_by_name (filename,
+        "gum_test_special_function"), ==, GPOINTER_TO_SIZE (system_address));
+
+    dlclose (lib);
+  }
+
+  g_free (filename);
+}
+#endif
+
+PROCESS_TESTCASE (memory_map_finds_ranges_spanning_adjacent_mappings)
+{
+  guint page_size;
+  guint8 * pages;
+  GumMemoryMap * map;
+  GumMemoryRange ranges[3];
+  gboolean results[3];
+
+  page_size = gum_query_page_size ();
+  pages = gum_alloc_n_pages (3, GUM_PAGE_RW);
+  gum_mprotect (pages + page_size, page_size, GUM_PAGE_READ);
+  gum_mprotect (pages + (2 * page_size), page_size, GUM_PAGE_NO_ACCESS);
+
+  map = gum_memory_map_new (GUM_PAGE_READ);
+
+  ranges[0].base_address = GUM_ADDRESS (pages);
+  ranges[0].size = 2 * page_size;
+  ranges[1].base_address = GUM_ADDRESS (pages) + page_size;
+  ranges[1].size = 2 * page_size;
+  ranges[2].base_address = GUM_ADDRESS (pages) + (2 * page_size);
+  ranges[2].size = 1;
+  g_assert_cmpuint (gum_memory_map_contains_many (map, ranges,
+      G_N_ELEMENTS (ranges), results), ==, 1);
+  g_assert (results[0]);
+  g_assert (!results[1]);
+  g_assert (!results[2]);
+
+  g_object_unref (map);
+
+  gum_free_pages (pages);
+}
+
 #ifndef G_OS_WIN32
 static gboolean
 store_export_address_if_tricky_module_export (const GumExportDetails * details,
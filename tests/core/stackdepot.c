@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "testutil.h"
+
+#define STACKDEPOT_TESTCASE(NAME) \
+    void test_stack_depot_ ## NAME (void)
+#define STACKDEPOT_TESTENTRY(NAME) \
+    TEST_ENTRY_SIMPLE ("Core/StackDepot", test_stack_depot, NAME)
+
+#define STACKDEPOT_THREAD_COUNT 4
+#define STACKDEPOT_STACK_COUNT  500
+
+TEST_LIST_BEGIN (stackdepot)
+  STACKDEPOT_TESTENTRY (empty_stack_has_no_id)
+  STACKDEPOT_TESTENTRY (identical_stacks_should_share_id)
+  STACKDEPOT_TESTENTRY (stacks_should_round_trip)
+  STACKDEPOT_TESTENTRY (concurrent_puts_should_agree)
+TEST_LIST_END ()
+
+static void make_stack (guint seed, GumReturnAddressArray * stack);
+static gpointer put_stacks (gpointer data);
+
+STACKDEPOT_TESTCASE (empty_stack_has_no_id)
+{
+  GumReturnAddressArray stack = { 0, };
+
+  g_assert_cmpuint (gum_stack_depot_put (&stack), ==, GUM_STACK_ID_NONE);
+
+  stack.len = 42;
+  gum_stack_depot_get (GUM_STACK_ID_NONE, &stack);
+  g_assert_cmpuint (stack.len, ==, 0);
+}
+
+STACKDEPOT_TESTCASE (identical_stacks_should_share_id)
+{
+  GumReturnAddressArray a, b;
+  GumStackId a_id, b_id;
+
+  make_stack (1, &a);
+  make_stack (1, &b);
+  a_id = gum_stack_depot_put (&a);
+  b_id = gum_stack_depot_put (&b);
+  g_assert_cmpuint (a_id, !=, GUM_STACK_ID_NONE);
+  g_assert_cmpuint (a_id, ==, b_id);
+
+  b.items[0] = GSIZE_TO_POINTER (0x1337);
+  b_id = gum_stack_depot_put (&b);
+  g_assert_cmpuint (b_id, !=, GUM_STACK_ID_NONE);
+  g_assert_cmpuint (a_id, !=, b_id);
+}
+
+STACKDEPOT_TESTCASE (stacks_should_round_trip)
+{
+  guint seed;
+
+  for (seed = 0; seed != STACKDEPOT_STACK_COUNT; seed++)
+  {
+    GumReturnAddressArray expected, actual;
+
+    make_stack (seed, &expected);
+    gum_stack_depot_get (gum_stack_depot_put (&expected), &actual);
+    g_assert (gum_return_address_array_is_equal (&actual, &expected));
+  }
+}
+
+STACKDEPOT_TESTCASE (concurrent_puts_should_agree)
+{
+  GThread * threads[STACKDEPOT_THREAD_COUNT];
+  GumStackId * ids[STACKDEPOT_THREAD_COUNT];
+  guint i, seed;
+
+  for (i = 0; i != STACKDEPOT_THREAD_COUNT; i++)
+  {
+    ids[i] = g_new (GumStackId, STACKDEPOT_STACK_COUNT);
+    threads[i] = g_thread_new ("stack-depot-test", put_stacks, ids[i]);
+  }
+
+  for (i = 0; i != STACKDEPOT_THREAD_COUNT; i++)
+    g_thread_join (threads[i]);
+
+  for (seed = 0; seed != STACKDEPOT_STACK_COUNT; seed++)
+  {
+    for (i = 1; i != STACKDEPOT_THREAD_COUNT; i++)
+      g_assert_cmpuint (ids[i][seed], ==, ids[0][seed]);
+  }
+
+  for (i = 0; i != STACKDEPOT_THREAD_COUNT; i++)
+    g_free (ids[i]);
+}
+
+static void
+make_stack (guint seed,
+            GumReturnAddressArray * stack)
+{
+  guint i;
+
+  stack->len = 1 + (seed % G_N_ELEMENTS (stack->items));
+  for (i = 0; i != stack->len; i++)
+  {
+    stack->items[i] = GSIZE_TO_POINTER (0x10000 +
+        (((seed * (i + 1)) % 97) * 16) + (stack->len - i));
+  }
+}
+
+static gpointer
+put_stacks (gpointer data)
+{
+  GumStackId * ids = data;
+  guint seed;
+
+  for (seed = 0; seed != STACKDEPOT_STACK_COUNT; seed++)
+  {
+    GumReturnAddressArray stack;
+
+    make_stack (seed, &stack);
+    ids[seed] = gum_stack_depot_put (&stack);
+  }
+
+  return NULL;
+}
@@ -30,10 +30,12 @@
 TEST_LIST_BEGIN (symbolutil)
   SYMUTIL_TESTENTRY (symbol_details_from_address)
   SYMUTIL_TESTENTRY (symbol_name_from_address)
+  SYMUTIL_TESTENTRY (symbol_name_from_address_in_library)
   SYMUTIL_TESTENTRY (find_external_public_function)
   SYMUTIL_TESTENTRY (find_local_static_function)
   SYMUTIL_TESTENTRY (find_functions_named)
   SYMUTIL_TESTENTRY (find_functions_matching)
+  SYMUTIL_TESTENTRY (return_address_details_from_arrays)
 TEST_LIST_END ()
 
 static void GUM_CDECL gum_dummy_function_0 (void);
@@ -65,6 +67,22 @@ SYMUTIL_TESTCASE (symbol_name_from_address)
   g_free (symbol_name);
 }
 
+SYMUTIL_TESTCASE (symbol_name_from_address_in_library)
+{
+  GArray * functions;
+  gchar * symbol_name;
+
+  functions = gum_find_functions_named ("g_thread_new");
+  g_assert_cmpuint (functions->len, >=, 1);
+
+  symbol_name = gum_symbol_name_from_address (
+      g_array_index (functions, gpointer, 0));
+  g_assert_cmpstr (symbol_name, ==, "g_thread_new");
+  g_free (symbol_name);
+
+  g_array_free (functions, TRUE);
+}
+
 SYMUTIL_TESTCASE (find_external_public_function)
 {
   g_assert (gum_find_function ("g_thread_new") != NULL);
@@ -114,6 +132,58 @@ SYMUTIL_TESTCASE (find_functions_matching)
   g_array_free (functions, TRUE);
 }
 
+SYMUTIL_TESTCASE (return_address_details_from_arrays)
+{
+  GumReturnAddressArray first, second;
+  const GumReturnAddressArray * arrays[2];
+  GumReturnAddressDetails details[7];
+  gboolean resolved[7];
+  gpointer thread_new, hash_table_new;
+  guint i;
+
+  thread_new = gum_find_function ("g_thread_new");
+  hash_table_new = gum_find_function ("g_hash_table_new");
+  g_assert (thread_new != NULL);
+  g_assert (hash_table_new != NULL);
+
+  /* Interleaved modules, with duplicates both within and across arrays. */
+  first.len = 4;
+  first.items[0] = gum_dummy_function_1;
+  first.items[1] = thread_new;
+  first.items[2] = gum_dummy_function_0;
+  first.items[3] = gum_dummy_function_1;
+  second.len = 3;
+  second.items[0] = thread_new;
+  second.items[1] = gum_dummy_function_0;
+  second.items[2] = hash_table_new;
+  arrays[0] = &first;
+  arrays[1] = &second;
+
+  g_assert_cmpuint (gum_return_address_details_from_arrays (arrays, 2,
+      details, resolved), ==, 7);
+
+  for (i = 0; i != 7; i++)
+  {
+    GumReturnAddress address = (i < first.len)
+        ? first.items[i]
+        : second.items[i - first.len];
+    GumReturnAddressDetails rad;
+
+    g_assert (resolved[i]);
+    g_assert (gum_return_address_details_from_address (address, &rad));
+    g_assert (details[i].address == address);
+    g_assert_cmpstr (details[i].module_name, ==, rad.module_name);
+    g_assert_cmpstr (details[i].function_name, ==, rad.function_name);
+    g_assert_cmpstr (details[i].file_name, ==, rad.file_name);
+    g_assert_cmpuint (details[i].line_number, ==, rad.line_number);
+  }
+
+  g_assert_cmpstr (details[0].function_name, ==, "gum_dummy_function_1");
+  g_assert_cmpstr (details[1].function_name, ==, "g_thread_new");
+  g_assert_cmpstr (details[2].function_name, ==, "gum_dummy_function_0");
+  g_assert_cmpstr (details[6].function_name, ==, "g_hash_table_new");
+}
+
 static void GUM_CDECL
 gum_dummy_function_0 (void)
 {
@@ -0,0 +1,537 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+/*
+ * Micro-benchmarks for Gum's hot paths. Each benchmark runs a number of
+ * timed samples, each sample being a batch of iterations, and prints one
+ * JSON object per line with percentiles of the per-unit cost, e.g.:
+ *
+ *   {"benchmark":"interceptor/on-enter","unit":"ns/call","samples":50,...}
+ *
+ * Usage: gum-benchmarks [--samples N] [FILTER]
+ */
+
+#include "testutil.h"
+
+#include "core/interceptor-callbacklistener.c"
+#include "stubs/fakeeventsink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCHMARK_DEFAULT_SAMPLES 50
+#define BENCHMARK_SCAN_BUFFER_SIZE (8 * 1024 * 1024)
+
+typedef struct _StalkerWorkload StalkerWorkload;
+
+typedef void (* BenchmarkFunc) (gpointer user_data, guint iterations);
+
+struct _StalkerWorkload
+{
+  GumStalker * stalker;
+  GumEventSink * sink;
+  BenchmarkFunc func;
+};
+
+static void benchmark_interceptor (void);
+static void benchmark_stalker (void);
+static void benchmark_memory_scan (void);
+static void benchmark_enumeration (void);
+static void benchmark_allocation_tracker (void);
+
+static void benchmark_run (const gchar * name, const gchar * unit,
+    guint iterations, gdouble units_per_iteration, BenchmarkFunc func,
+    gpointer user_data);
+static gint benchmark_compare_doubles (gconstpointer a, gconstpointer b);
+static gdouble benchmark_percentile (const gdouble * sorted, guint n,
+    gdouble q);
+
+static void call_target_function (gpointer user_data, guint iterations);
+static gpointer GUM_NOINLINE benchmark_target_function (gpointer data);
+static gpointer benchmark_replacement_function (gpointer data);
+
+#ifdef HAVE_I386
+static void run_loop_workload (gpointer user_data, guint iterations);
+static void run_virtual_call_workload (gpointer user_data, guint iterations);
+static void run_recursion_workload (gpointer user_data, guint iterations);
+static void GUM_NOINLINE workload_add_one (void);
+static void GUM_NOINLINE workload_add_two (void);
+static void GUM_NOINLINE workload_add_three (void);
+static void GUM_NOINLINE workload_add_four (void);
+static void follow_and_run (gpointer user_data, guint iterations);
+static guint GUM_NOINLINE workload_fib (guint n);
+#endif
+
+static void scan_buffer (gpointer user_data, guint iterations);
+static gboolean on_scan_match (GumAddress address, gsize size,
+    gpointer user_data);
+
+static void enumerate_modules (gpointer user_data, guint iterations);
+static gboolean on_module (const GumModuleDetails * details,
+    gpointer user_data);
+static void enumerate_exports (gpointer user_data, guint iterations);
+static gboolean on_export (const GumExportDetails * details,
+    gpointer user_data);
+
+static void track_allocations (gpointer user_data, guint iterations);
+
+static guint benchmark_sample_count = BENCHMARK_DEFAULT_SAMPLES;
+static const gchar * benchmark_filter = NULL;
+
+static volatile guint benchmark_counter = 0;
+
+gint
+main (gint argc,
+      gchar * argv[])
+{
+  gint i;
+
+  for (i = 1; i != argc; i++)
+  {
+    if (strcmp (argv[i], "--samples") == 0 && i + 1 != argc)
+      benchmark_sample_count = MAX (atoi (argv[++i]), 1);
+    else
+      benchmark_filter = argv[i];
+  }
+
+#if GLIB_CHECK_VERSION (2, 46, 0)
+  glib_init ();
+  gio_init ();
+#endif
+  gum_init ();
+
+  benchmark_interceptor ();
+  benchmark_stalker ();
+  benchmark_memory_scan ();
+  benchmark_enumeration ();
+  benchmark_allocation_tracker ();
+
+  return 0;
+}
+
+static void
+benchmark_interceptor (void)
+{
+  GumInterceptor * interceptor;
+  GumSampler * counter;
+  TestCallbackListener * listener;
+
+  interceptor = gum_interceptor_obtain ();
+
+  benchmark_run ("interceptor/baseline", "ns/call", 100000, 1,
+      call_target_function, NULL);
+
+  /* The call count sampler is a listener with only an on_enter handler */
+  counter = gum_call_count_sampler_new (benchmark_target_function, NULL);
+  benchmark_run ("interceptor/on-enter", "ns/call", 10000, 1,
+      call_target_function, NULL);
+  g_object_unref (counter);
+
+  listener = test_callback_listener_new ();
+  gum_interceptor_attach_listener (interceptor, benchmark_target_function,
+      GUM_INVOCATION_LISTENER (listener), NULL);
+  benchmark_run ("interceptor/on-enter-and-leave", "ns/call", 10000, 1,
+      call_target_function, NULL);
+  gum_interceptor_detach_listener (interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+  g_object_unref (listener);
+
+  gum_interceptor_replace_function (interceptor, benchmark_target_function,
+      benchmark_replacement_function, NULL);
+  benchmark_run ("interceptor/replacement", "ns/call", 10000, 1,
+      call_target_function, NULL);
+  gum_interceptor_revert_function (interceptor, benchmark_target_function);
+
+  g_object_unref (interceptor);
+}
+
+static void
+benchmark_stalker (void)
+{
+#ifdef HAVE_I386
+  static const struct
+  {
+    const gchar * name;
+    BenchmarkFunc func;
+  } workloads[] = {
+    { "loop", run_loop_workload },
+    { "virtual-calls", run_virtual_call_workload },
+    { "recursion", run_recursion_workload }
+  };
+  StalkerWorkload workload;
+  guint i;
+
+  workload.stalker = gum_stalker_new ();
+  workload.sink = gum_fake_event_sink_new ();
+  GUM_FAKE_EVENT_SINK (workload.sink)->mask = GUM_NOTHING;
+
+  for (i = 0; i != G_N_ELEMENTS (workloads); i++)
+  {
+    gchar * name;
+
+    name = g_strconcat ("stalker/", workloads[i].name, "/native", NULL);
+    benchmark_run (name, "ns/run", 200, 1, workloads[i].func, NULL);
+    g_free (name);
+
+    /* Includes following and unfollowing, amortized over the batch */
+    workload.func = workloads[i].func;
+    name = g_strconcat ("stalker/", workloads[i].name, "/followed", NULL);
+    benchmark_run (name, "ns/run", 200, 1, follow_and_run, &workload);
+    g_free (name);
+  }
+
+  g_object_unref (workload.sink);
+  g_object_unref (workload.stalker);
+#endif
+}
+
+static void
+benchmark_memory_scan (void)
+{
+  guint8 * buffer;
+  guint i;
+
+  buffer = g_malloc (BENCHMARK_SCAN_BUFFER_SIZE);
+  for (i = 0; i != BENCHMARK_SCAN_BUFFER_SIZE; i++)
+    buffer[i] = i & 0x7f;
+
+  benchmark_run ("memory/scan", "ns/MiB", 1,
+      BENCHMARK_SCAN_BUFFER_SIZE / (1024 * 1024), scan_buffer, buffer);
+
+  g_free (buffer);
+}
+
+static void
+benchmark_enumeration (void)
+{
+  benchmark_run ("process/enumerate-modules", "ns/enumeration", 10, 1,
+      enumerate_modules, NULL);
+  benchmark_run ("module/enumerate-exports", "ns/enumeration", 10, 1,
+      enumerate_exports, (gpointer) SYSTEM_MODULE_NAME);
+}
+
+static void
+benchmark_allocation_tracker (void)
+{
+  GumAllocationTracker * tracker;
+  GumBacktracer * backtracer;
+
+  tracker = gum_allocation_tracker_new ();
+  gum_allocation_tracker_begin (tracker);
+  benchmark_run ("allocation-tracker/malloc-free", "ns/pair", 10000, 1,
+      track_allocations, tracker);
+  g_object_unref (tracker);
+
+  backtracer = gum_backtracer_make_accurate ();
+  if (backtracer == NULL)
+    backtracer = gum_backtracer_make_fuzzy ();
+  if (backtracer != NULL)
+  {
+    tracker = gum_allocation_tracker_new_with_backtracer (backtracer);
+    gum_allocation_tracker_begin (tracker);
+    benchmark_run ("allocation-tracker/malloc-free-backtraced", "ns/pair",
+        1000, 1, track_allocations, tracker);
+    g_object_unref (tracker);
+
+    tracker = gum_allocation_tracker_new_with_backtracer (backtracer);
+    gum_allocation_tracker_set_sample_interval (tracker, 512 * 1024);
+    gum_allocation_tracker_begin (tracker);
+    benchmark_run ("allocation-tracker/malloc-free-sampled", "ns/pair",
+        10000, 1, track_allocations, tracker);
+    g_object_unref (tracker);
+
+    g_object_unref (backtracer);
+  }
+}
+
+static void
+benchmark_run (const gchar * name,
+               const gchar * unit,
+               guint iterations,
+               gdouble units_per_iteration,
+               BenchmarkFunc func,
+               gpointer user_data)
+{
+  gdouble * samples;
+  GTimer * timer;
+  gdouble sum = 0.0;
+  guint i;
+
+  if (benchmark_filter != NULL && strstr (name, benchmark_filter) == NULL)
+    return;
+
+  samples = g_new (gdouble, benchmark_sample_count);
+  timer = g_timer_new ();
+
+  /* Warm up caches, lazily initialized state and trampolines */
+  func (user_data, iterations);
+
+  for (i = 0; i != benchmark_sample_count; i++)
+  {
+    g_timer_start (timer);
+    func (user_data, iterations);
+    g_timer_stop (timer);
+
+    samples[i] = (g_timer_elapsed (timer, NULL) * 1e9) /
+        (iterations * units_per_iteration);
+    sum += samples[i];
+  }
+
+  qsort (samples, benchmark_sample_count, sizeof (gdouble),
+      benchmark_compare_doubles);
+
+  printf ("{\"benchmark\":\"%s\",\"unit\":\"%s\",\"samples\":%u,"
+      "\"iterations\":%u,\"min\":%.2f,\"p50\":%.2f,\"p90\":%.2f,"
+      "\"p99\":%.2f,\"max\":%.2f,\"mean\":%.2f}\n",
+      name, unit, benchmark_sample_count, iterations,
+      samples[0],
+      benchmark_percentile (samples, benchmark_sample_count, 0.50),
+      benchmark_percentile (samples, benchmark_sample_count, 0.90),
+      benchmark_percentile (samples, benchmark_sample_count, 0.99),
+      samples[benchmark_sample_count - 1],
+      sum / benchmark_sample_count);
+  fflush (stdout);
+
+  g_timer_destroy (timer);
+  g_free (samples);
+}
+
+static gint
+benchmark_compare_doubles (gconstpointer a,
+                           gconstpointer b)
+{
+  gdouble value_a = *((const gdouble *) a);
+  gdouble value_b = *((const gdouble *) b);
+
+  if (value_a < value_b)
+    return -1;
+  else if (value_a > value_b)
+    return 1;
+  else
+    return 0;
+}
+
+/* Nearest-rank percentile of an ascending array */
+static gdouble
+benchmark_percentile (const gdouble * sorted,
+                      guint n,
+                      gdouble q)
+{
+  guint rank;
+
+  rank = (guint) ((q * n) + 0.999999);
+  if (rank == 0)
+    rank = 1;
+
+  return sorted[MIN (rank, n) - 1];
+}
+
+static void
+call_target_function (gpointer user_data,
+                      guint iterations)
+{
+  guint i;
+
+  for (i = 0; i != iterations; i++)
+    benchmark_target_function (user_data);
+}
+
+static gpointer GUM_NOINLINE
+benchmark_target_function (gpointer data)
+{
+  benchmark_counter++;
+  if (data != NULL)
+    benchmark_counter += 2;
+
+  return GSIZE_TO_POINTER (benchmark_counter);
+}
+
+static gpointer
+benchmark_replacement_function (gpointer data)
+{
+  benchmark_counter += 3;
+  if (data != NULL)
+    benchmark_counter += 2;
+
+  return GSIZE_TO_POINTER (benchmark_counter);
+}
+
+#ifdef HAVE_I386
+
+static void
+run_loop_workload (gpointer user_data,
+                   guint iterations)
+{
+  guint i, j;
+
+  for (i = 0; i != iterations; i++)
+  {
+    for (j = 0; j != 1000; j++)
+      benchmark_counter += j;
+  }
+}
+
+static void GUM_NOINLINE
+workload_add_one (void)
+{
+  benchmark_counter += 1;
+}
+
+static void GUM_NOINLINE
+workload_add_two (void)
+{
+  benchmark_counter += 2;
+}
+
+static void GUM_NOINLINE
+workload_add_three (void)
+{
+  benchmark_counter += 3;
+}
+
+static void GUM_NOINLINE
+workload_add_four (void)
+{
+  benchmark_counter += 4;
+}
+
+static void
+run_virtual_call_workload (gpointer user_data,
+                           guint iterations)
+{
+  static void (* const vtable[]) (void) = {
+    workload_add_one,
+    workload_add_two,
+    workload_add_three,
+    workload_add_four
+  };
+  guint i, j;
+
+  for (i = 0; i != iterations; i++)
+  {
+    for (j = 0; j != 1000; j++)
+      vtable[(j ^ benchmark_counter) & 3] ();
+  }
+}
+
+static void
+run_recursion_workload (gpointer user_data,
+                        guint iterations)
+{
+  guint i;
+
+  for (i = 0; i != iterations; i++)
+    benchmark_counter += workload_fib (12);
+}
+
+static guint GUM_NOINLINE
+workload_fib (guint n)
+{
+  if (n < 2)
+    return n;
+
+  return workload_fib (n - 1) + workload_fib (n - 2);
+}
+
+static void
+follow_and_run (gpointer user_data,
+                guint iterations)
+{
+  StalkerWorkload * workload = user_data;
+
+  gum_stalker_follow_me (workload->stalker, workload->sink);
+  workload->func (NULL, iterations);
+  gum_stalker_unfollow_me (workload->stalker);
+
+  while (gum_stalker_garbage_collect (workload->stalker))
+    g_usleep (10000);
+}
+
+#endif
+
+static void
+scan_buffer (gpointer user_data,
+             guint iterations)
+{
+  GumMemoryRange range;
+  GumMatchPattern * pattern;
+  guint i;
+
+  range.base_address = GUM_ADDRESS (user_data);
+  range.size = BENCHMARK_SCAN_BUFFER_SIZE;
+  pattern = gum_match_pattern_new_from_string ("13 37 ?? ff");
+
+  for (i = 0; i != iterations; i++)
+    gum_memory_scan (&range, pattern, on_scan_match, NULL);
+
+  gum_match_pattern_free (pattern);
+}
+
+static gboolean
+on_scan_match (GumAddress address,
+               gsize size,
+               gpointer user_data)
+{
+  benchmark_counter++;
+
+  return TRUE;
+}
+
+static void
+enumerate_modules (gpointer user_data,
+                   guint iterations)
+{
+  guint i;
+
+  for (i = 0; i != iterations; i++)
+    gum_process_enumerate_modules (on_module, NULL);
+}
+
+static gboolean
+on_module (const GumModuleDetails * details,
+           gpointer user_data)
+{
+  benchmark_counter++;
+
+  return TRUE;
+}
+
+static void
+enumerate_exports (gpointer user_data,
+                   guint iterations)
+{
+  const gchar * module_name = user_data;
+  guint i;
+
+  for (i = 0; i != iterations; i++)
+    gum_module_enumerate_exports (module_name, on_export, NULL);
+}
+
+static gboolean
+on_export (const GumExportDetails * details,
+           gpointer user_data)
+{
+  benchmark_counter++;
+
+  return TRUE;
+}
+
+static void
+track_allocations (gpointer user_data,
+                   guint iterations)
+{
+  GumAllocationTracker * tracker = user_data;
+  guint i;
+
+  for (i = 0; i != iterations; i++)
+  {
+    gpointer block = GSIZE_TO_POINTER (0x10000 + (i * 16));
+
+    gum_allocation_tracker_on_malloc (tracker, block, 16 + (i & 255));
+    gum_allocation_tracker_on_free (tracker, block);
+  }
+}
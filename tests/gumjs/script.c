@@ -109,6 +109,7 @@ TEST_LIST_BEGIN (script)
   SCRIPT_TESTENTRY (invalid_write_results_in_exception)
   SCRIPT_TESTENTRY (memory_can_be_scanned)
   SCRIPT_TESTENTRY (memory_can_be_scanned_synchronously)
+  SCRIPT_TESTENTRY (memory_scan_spanning_many_chunks_reports_matches_in_order)
   SCRIPT_TESTENTRY (memory_scan_should_be_interruptible)
   SCRIPT_TESTENTRY (memory_scan_handles_unreadable_memory)
 #ifdef G_OS_WIN32
@@ -2668,6 +2669,44 @@ SCRIPT_TESTCASE (memory_can_be_scanned_synchronously)
   EXPECT_SEND_MESSAGE_WITH ("\"done\"");
 }
 
+SCRIPT_TESTCASE (memory_scan_spanning_many_chunks_reports_matches_in_order)
+{
+  const gsize mb = 1024 * 1024;
+  guint page_size, n_pages;
+  guint8 * haystack;
+  guint i;
+
+  page_size = gum_query_page_size ();
+  n_pages = (4 * mb) / page_size;
+  haystack = gum_alloc_n_pages (n_pages, GUM_PAGE_RW);
+
+  haystack[0] = 0x13;
+  haystack[1] = 0x37;
+  for (i = 1; i != 4; i++)
+  {
+    haystack[(i * mb) - 1] = 0x13;
+    haystack[(i * mb)] = 0x37;
+  }
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "Memory.scan(" GUM_PTR_CONST ", %u, '13 37', {"
+        "onMatch: function (address, size) {"
+        "  send('onMatch offset=' + address.sub(" GUM_PTR_CONST
+             ").toInt32() + ' size=' + size);"
+        "},"
+        "onComplete: function () {"
+        "  send('onComplete');"
+        "}"
+      "});", haystack, n_pages * page_size, haystack);
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=0 size=2\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=1048575 size=2\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=2097151 size=2\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=3145727 size=2\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onComplete\"");
+
+  gum_free_pages (haystack);
+}
+
 SCRIPT_TESTCASE (memory_scan_should_be_interruptible)
 {
   guint8 haystack[] = { 0x01, 0x02, 0x13, 0x37, 0x03, 0x13, 0x37 };
@@ -175,6 +175,7 @@ main (gint argc, gchar * argv[])
 #if !defined (HAVE_QNX) && !(defined (HAVE_ANDROID) && defined (HAVE_ARM64)) && !(defined (HAVE_MIPS))
   TEST_RUN_LIST (backtracer);
 #endif
+  TEST_RUN_LIST (stackdepot);
 
   /* Heap */
   TEST_RUN_LIST (allocation_tracker);
@@ -213,6 +214,9 @@ main (gint argc, gchar * argv[])
 #ifdef G_OS_WIN32
   TEST_RUN_LIST (profiler);
 #endif
+#ifdef HAVE_LINUX
+  TEST_RUN_LIST (samplingprofiler);
+#endif
 
 #if defined (HAVE_GUMJS)
   /* GumJS */
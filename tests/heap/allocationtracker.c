@@ -24,6 +24,10 @@ TEST_LIST_BEGIN (allocation_tracker)
   ALLOCTRACKER_TESTENTRY (realloc_zero_size)
   ALLOCTRACKER_TESTENTRY (realloc_backtrace)
 
+  ALLOCTRACKER_TESTENTRY (concurrent_tracking_should_be_consistent)
+  ALLOCTRACKER_TESTENTRY (sampling_should_estimate_live_heap)
+  ALLOCTRACKER_TESTENTRY (snapshot_diff_should_show_growth)
+
   ALLOCTRACKER_TESTENTRY (memory_usage_without_backtracer_should_be_sensible)
   ALLOCTRACKER_TESTENTRY (memory_usage_with_backtracer_should_be_sensible)
 
@@ -398,6 +402,184 @@ ALLOCTRACKER_TESTCASE (realloc_backtrace)
   g_object_unref (backtracer);
 }
 
+#define CONCURRENT_THREAD_COUNT      4
+#define CONCURRENT_BLOCKS_PER_THREAD 1000
+
+typedef struct _TrackBlocksContext TrackBlocksContext;
+
+struct _TrackBlocksContext
+{
+  GumAllocationTracker * tracker;
+  gsize base;
+};
+
+static gpointer
+track_blocks (gpointer data)
+{
+  TrackBlocksContext * ctx = data;
+  guint i;
+
+  for (i = 0; i != CONCURRENT_BLOCKS_PER_THREAD; i++)
+  {
+    gpointer address = GSIZE_TO_POINTER (ctx->base + (i * 16));
+
+    gum_allocation_tracker_on_malloc (ctx->tracker, address, 16);
+    if (i % 2 == 0)
+      gum_allocation_tracker_on_free (ctx->tracker, address);
+  }
+
+  return NULL;
+}
+
+ALLOCTRACKER_TESTCASE (concurrent_tracking_should_be_consistent)
+{
+  GumAllocationTracker * t = fixture->tracker;
+  GThread * threads[CONCURRENT_THREAD_COUNT];
+  TrackBlocksContext contexts[CONCURRENT_THREAD_COUNT];
+  GList * blocks, * groups;
+  GumAllocationGroup * group;
+  guint alive_peak, i;
+
+  gum_allocation_tracker_begin (t);
+
+  for (i = 0; i != CONCURRENT_THREAD_COUNT; i++)
+  {
+    contexts[i].tracker = t;
+    contexts[i].base = 0x100000 + (i * CONCURRENT_BLOCKS_PER_THREAD * 16);
+    threads[i] = g_thread_new ("alloc-tracker-test", track_blocks,
+        &contexts[i]);
+  }
+  for (i = 0; i != CONCURRENT_THREAD_COUNT; i++)
+    g_thread_join (threads[i]);
+
+  g_assert_cmpuint (gum_allocation_tracker_peek_block_count (t), ==,
+      CONCURRENT_THREAD_COUNT * CONCURRENT_BLOCKS_PER_THREAD / 2);
+  g_assert_cmpuint (gum_allocation_tracker_peek_block_total_size (t), ==,
+      CONCURRENT_THREAD_COUNT * CONCURRENT_BLOCKS_PER_THREAD / 2 * 16);
+
+  blocks = gum_allocation_tracker_peek_block_list (t);
+  g_assert_cmpuint (g_list_length (blocks), ==,
+      CONCURRENT_THREAD_COUNT * CONCURRENT_BLOCKS_PER_THREAD / 2);
+  gum_allocation_block_list_free (blocks);
+
+  groups = gum_allocation_tracker_peek_block_groups (t);
+  g_assert_cmpuint (g_list_length (groups), ==, 1);
+  group = (GumAllocationGroup *) groups->data;
+  g_assert_cmpuint (group->alive_now, ==,
+      CONCURRENT_THREAD_COUNT * CONCURRENT_BLOCKS_PER_THREAD / 2);
+  g_assert_cmpuint (group->total_peak, ==,
+      CONCURRENT_THREAD_COUNT * CONCURRENT_BLOCKS_PER_THREAD);
+  /* No thread ever holds more blocks than it ends up with. */
+  g_assert_cmpuint (group->alive_peak, ==,
+      CONCURRENT_THREAD_COUNT * CONCURRENT_BLOCKS_PER_THREAD / 2);
+  alive_peak = group->alive_peak;
+  gum_allocation_group_list_free (groups);
+
+  /* Freeing everything must leave the peak where it was. */
+  for (i = 0; i != CONCURRENT_THREAD_COUNT; i++)
+  {
+    guint j;
+
+    for (j = 1; j < CONCURRENT_BLOCKS_PER_THREAD; j += 2)
+    {
+      gum_allocation_tracker_on_free (t,
+          GSIZE_TO_POINTER (contexts[i].base + (j * 16)));
+    }
+  }
+
+  groups = gum_allocation_tracker_peek_block_groups (t);
+  g_assert_cmpuint (g_list_length (groups), ==, 1);
+  group = (GumAllocationGroup *) groups->data;
+  g_assert_cmpuint (group->alive_now, ==, 0);
+  g_assert_cmpuint (group->alive_peak, ==, alive_peak);
+  gum_allocation_group_list_free (groups);
+}
+
+ALLOCTRACKER_TESTCASE (sampling_should_estimate_live_heap)
+{
+  GumBacktracer * backtracer;
+  GumAllocationTracker * t;
+  const guint num_allocations = 100000;
+  const guint64 expected_size = num_allocations * 64;
+  GumHeapProfileNode * root, * outer, * inner;
+  guint i;
+
+  backtracer = gum_fake_backtracer_new (dummy_return_addresses_a,
+      G_N_ELEMENTS (dummy_return_addresses_a));
+  t = gum_allocation_tracker_new_with_backtracer (backtracer);
+  gum_allocation_tracker_set_sample_interval (t, 1024);
+  gum_allocation_tracker_begin (t);
+
+  for (i = 0; i != num_allocations; i++)
+    gum_allocation_tracker_on_malloc (t, GUINT_TO_POINTER (0x50000 + (i * 64)),
+        64);
+
+  g_assert_cmpuint (gum_allocation_tracker_peek_block_count (t), <,
+      num_allocations / 4);
+
+  root = gum_allocation_tracker_peek_heap_profile (t);
+  g_assert_cmpuint (root->size, >, expected_size * 9 / 10);
+  g_assert_cmpuint (root->size, <, expected_size * 11 / 10);
+  g_assert_cmpuint (root->count, >, num_allocations * 9 / 10);
+  g_assert_cmpuint (root->count, <, num_allocations * 11 / 10);
+
+  g_assert_cmpuint (g_list_length (root->children), ==, 1);
+  outer = root->children->data;
+  g_assert (outer->address == dummy_return_addresses_a[1]);
+  g_assert_cmpuint (outer->size, ==, root->size);
+
+  g_assert_cmpuint (g_list_length (outer->children), ==, 1);
+  inner = outer->children->data;
+  g_assert (inner->address == dummy_return_addresses_a[0]);
+  g_assert (inner->children == NULL);
+
+  gum_heap_profile_node_free (root);
+
+  g_object_unref (t);
+  g_object_unref (backtracer);
+}
+
+ALLOCTRACKER_TESTCASE (snapshot_diff_should_show_growth)
+{
+  GumAllocationTracker * t = fixture->tracker;
+  GumHeapSnapshot * older, * newer, * diff;
+
+  gum_allocation_tracker_begin (t);
+
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_A, 32);
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_B, 64);
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_C, 32);
+
+  older = gum_allocation_tracker_take_snapshot (t);
+  g_assert_cmpuint (older->length, ==, 2);
+  g_assert_cmpuint (older->entries[0].size, ==, 32);
+  g_assert_cmpint (older->entries[0].count, ==, 2);
+  g_assert_cmpuint (older->entries[1].size, ==, 64);
+  g_assert_cmpint (older->entries[1].count, ==, 1);
+  g_assert_cmpint (older->total_size, ==, 128);
+
+  gum_allocation_tracker_on_free (t, DUMMY_BLOCK_B);
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_D, 16);
+  gum_allocation_tracker_on_malloc (t, DUMMY_BLOCK_E, 32);
+
+  newer = gum_allocation_tracker_take_snapshot (t);
+  diff = gum_heap_snapshot_diff (older, newer);
+
+  g_assert_cmpuint (diff->length, ==, 3);
+  g_assert_cmpuint (diff->entries[0].size, ==, 16);
+  g_assert_cmpint (diff->entries[0].count, ==, 1);
+  g_assert_cmpuint (diff->entries[1].size, ==, 32);
+  g_assert_cmpint (diff->entries[1].count, ==, 1);
+  g_assert_cmpuint (diff->entries[2].size, ==, 64);
+  g_assert_cmpint (diff->entries[2].count, ==, -1);
+  g_assert_cmpint (diff->total_count, ==, 1);
+  g_assert_cmpint (diff->total_size, ==, 16 + 32 - 64);
+
+  gum_heap_snapshot_free (diff);
+  gum_heap_snapshot_free (newer);
+  gum_heap_snapshot_free (older);
+}
+
 ALLOCTRACKER_TESTCASE (memory_usage_without_backtracer_should_be_sensible)
 {
   GumAllocationTracker * t = fixture->tracker;
@@ -18,8 +18,12 @@ TEST_LIST_BEGIN (instancetracker)
   INSTRACKER_TESTENTRY (peek_instances)
   INSTRACKER_TESTENTRY (walk_instances)
   INSTRACKER_TESTENTRY (avoid_heap)
+  INSTRACKER_TESTENTRY (concurrent_construction)
 TEST_LIST_END ()
 
+#define PONY_THREAD_COUNT 4
+#define PONIES_PER_THREAD 100
+
 typedef struct _WalkInstancesContext WalkInstancesContext;
 
 struct _WalkInstancesContext
@@ -31,6 +35,7 @@ struct _WalkInstancesContext
 static gboolean no_ponies_filter_func (GumInstanceTracker * tracker,
     GType gtype, gpointer user_data);
 static void walk_instance (GumInstanceDetails * id, gpointer user_data);
+static gpointer create_ponies (gpointer data);
 
 INSTRACKER_TESTCASE (total_count)
 {
@@ -237,6 +242,48 @@ INSTRACKER_TESTCASE (avoid_heap)
   g_object_unref (heap_access_counter);
 }
 
+INSTRACKER_TESTCASE (concurrent_construction)
+{
+  GumInstanceTracker * t = fixture->tracker;
+  GThread * threads[PONY_THREAD_COUNT];
+  GList * ponies = NULL, * cur;
+  guint i;
+
+  for (i = 0; i != PONY_THREAD_COUNT; i++)
+    threads[i] = g_thread_new ("instance-tracker-test", create_ponies, NULL);
+  for (i = 0; i != PONY_THREAD_COUNT; i++)
+    ponies = g_list_concat (ponies, (GList *) g_thread_join (threads[i]));
+
+  g_assert_cmpuint (gum_instance_tracker_peek_total_count (t, "MyPony"),
+      ==, PONY_THREAD_COUNT * (PONIES_PER_THREAD / 2));
+
+  for (cur = ponies; cur != NULL; cur = cur->next)
+    g_object_unref (cur->data);
+  g_list_free (ponies);
+
+  g_assert_cmpuint (gum_instance_tracker_peek_total_count (t, "MyPony"),
+      ==, 0);
+}
+
+static gpointer
+create_ponies (gpointer data)
+{
+  GList * kept = NULL;
+  guint i;
+
+  for (i = 0; i != PONIES_PER_THREAD; i++)
+  {
+    MyPony * pony = MY_PONY (g_object_new (MY_TYPE_PONY, NULL));
+
+    if (i % 2 == 0)
+      kept = g_list_prepend (kept, pony);
+    else
+      g_object_unref (pony);
+  }
+
+  return kept;
+}
+
 static gboolean
 no_ponies_filter_func (GumInstanceTracker * tracker,
                        GType gtype,
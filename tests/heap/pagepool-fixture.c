@@ -18,6 +18,8 @@
     TEST_ENTRY_WITH_FIXTURE ("Heap/PagePool", test_page_pool, NAME, \
         TestPagePoolFixture)
 
+#define PAGEPOOL_THREAD_COUNT 4
+
 typedef struct _TestPagePoolFixture
 {
   GumPagePool * pool;
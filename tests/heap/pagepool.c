@@ -15,8 +15,12 @@ TEST_LIST_BEGIN (pagepool)
   PAGEPOOL_TESTENTRY (query_block_details)
   PAGEPOOL_TESTENTRY (peek_used)
   PAGEPOOL_TESTENTRY (alloc_and_fill_full_cycle)
+  PAGEPOOL_TESTENTRY (quarantine_delays_reuse)
+  PAGEPOOL_TESTENTRY (concurrent_alloc_and_free)
 TEST_LIST_END ()
 
+static gpointer alloc_and_free_blocks (gpointer data);
+
 PAGEPOOL_TESTCASE (alloc_sizes)
 {
   GumPagePool * pool;
@@ -214,3 +218,93 @@ PAGEPOOL_TESTCASE (alloc_and_fill_full_cycle)
 
   memset (p, 0, buffer_size);
 }
+
+PAGEPOOL_TESTCASE (quarantine_delays_reuse)
+{
+  GumPagePool * pool;
+  gpointer p1, p2;
+
+  fixture->pool = g_object_new (GUM_TYPE_PAGE_POOL,
+      "size", 4,
+      "quarantine-size", 1,
+      NULL);
+  pool = fixture->pool;
+
+  p1 = gum_page_pool_try_alloc (pool, 1);
+  g_assert (gum_page_pool_try_free (pool, p1));
+  g_assert_cmpuint (gum_page_pool_peek_used (pool), ==, 0);
+  g_assert_cmpuint (gum_page_pool_peek_available (pool), ==, 2);
+
+  p2 = gum_page_pool_try_alloc (pool, 1);
+  g_assert (p2 != NULL);
+  g_assert (p2 != p1);
+  g_assert (!gum_memory_is_readable (GUM_ADDRESS (p1), 1));
+
+  g_assert (gum_page_pool_try_free (pool, p2));
+  g_assert_cmpuint (gum_page_pool_peek_available (pool), ==, 2);
+  g_assert (gum_page_pool_try_alloc (pool, 1) == p1);
+}
+
+PAGEPOOL_TESTCASE (concurrent_alloc_and_free)
+{
+  GThread * threads[PAGEPOOL_THREAD_COUNT];
+  guint i;
+
+  fixture->pool = g_object_new (GUM_TYPE_PAGE_POOL,
+      "size", 1024,
+      "segment-count", PAGEPOOL_THREAD_COUNT,
+      "quarantine-size", 8,
+      NULL);
+
+  for (i = 0; i != PAGEPOOL_THREAD_COUNT; i++)
+  {
+    threads[i] = g_thread_new ("page-pool-test", alloc_and_free_blocks,
+        fixture->pool);
+  }
+
+  for (i = 0; i != PAGEPOOL_THREAD_COUNT; i++)
+    g_thread_join (threads[i]);
+
+  g_assert_cmpuint (gum_page_pool_peek_used (fixture->pool), ==, 0);
+}
+
+static gpointer
+alloc_and_free_blocks (gpointer data)
+{
+  GumPagePool * pool = data;
+  guint8 * blocks[8] = { NULL, };
+  guint sizes[8];
+  guint round;
+
+  for (round = 0; round != 2000; round++)
+  {
+    guint slot = (round * 7) % G_N_ELEMENTS (blocks);
+    guint8 * block = blocks[slot];
+
+    if (block != NULL)
+    {
+      guint i;
+
+      for (i = 0; i != sizes[slot]; i++)
+        g_assert_cmpuint (block[i], ==, (guint8) slot);
+      g_assert (gum_page_pool_try_free (pool, block));
+      blocks[slot] = NULL;
+    }
+    else
+    {
+      sizes[slot] = 1 + ((round * 131) % 9000);
+      block = gum_page_pool_try_alloc (pool, sizes[slot]);
+      if (block != NULL)
+        memset (block, slot, sizes[slot]);
+      blocks[slot] = block;
+    }
+  }
+
+  for (round = 0; round != G_N_ELEMENTS (blocks); round++)
+  {
+    if (blocks[round] != NULL)
+      gum_page_pool_try_free (pool, blocks[round]);
+  }
+
+  return NULL;
+}
@@ -16,6 +16,8 @@ TEST_LIST_BEGIN (sanitychecker)
   SANITYCHECKER_TESTENTRY (array_access_out_of_bounds_causes_exception)
   SANITYCHECKER_TESTENTRY (multiple_checks_at_once_should_not_collide)
   SANITYCHECKER_TESTENTRY (checker_itself_does_not_leak)
+  SANITYCHECKER_TESTENTRY (block_growth_between_snapshots)
+  SANITYCHECKER_TESTENTRY (no_block_growth_between_snapshots)
 TEST_LIST_END ()
 
 SANITYCHECKER_TESTCASE (no_leaks)
@@ -129,4 +131,62 @@ SANITYCHECKER_TESTCASE (checker_itself_does_not_leak)
   gum_sanity_checker_destroy (checker);
 }
 
+SANITYCHECKER_TESTCASE (block_growth_between_snapshots)
+{
+  GumHeapSnapshot * older, * newer;
+  gboolean no_growth;
+
+  gum_sanity_checker_begin (fixture->checker, GUM_CHECK_BLOCK_LEAKS);
+  older = gum_sanity_checker_take_snapshot (fixture->checker);
+  fixture->first_block = malloc (5);
+  fixture->second_block = malloc (15);
+  fixture->third_block = malloc (5);
+  free (malloc (42));
+  newer = gum_sanity_checker_take_snapshot (fixture->checker);
+
+  no_growth = gum_sanity_checker_report_growth (fixture->checker, older,
+      newer);
+  g_assert (!no_growth);
+  assert_same_output (fixture,
+      "Block growth detected:\n"
+      "\n"
+      "\tCount\tSize\n"
+      "\t-----\t----\n"
+      "\t+1\t15\n"
+      "\t+2\t5\n");
+
+  gum_heap_snapshot_free (newer);
+  gum_heap_snapshot_free (older);
+
+  test_sanity_checker_fixture_do_cleanup (fixture);
+  g_string_truncate (fixture->output, 0);
+  g_assert (gum_sanity_checker_end (fixture->checker));
+  g_assert_cmpuint (fixture->output->len, ==, 0);
+}
+
+SANITYCHECKER_TESTCASE (no_block_growth_between_snapshots)
+{
+  GumHeapSnapshot * older, * newer;
+  gboolean no_growth;
+
+  gum_sanity_checker_begin (fixture->checker, GUM_CHECK_BLOCK_LEAKS);
+  fixture->first_block = malloc (5);
+  older = gum_sanity_checker_take_snapshot (fixture->checker);
+  forget_block (&fixture->first_block);
+  fixture->second_block = malloc (5);
+  newer = gum_sanity_checker_take_snapshot (fixture->checker);
+
+  no_growth = gum_sanity_checker_report_growth (fixture->checker, older,
+      newer);
+  g_assert (no_growth);
+  g_assert_cmpuint (fixture->output->len, ==, 0);
+
+  gum_heap_snapshot_free (newer);
+  gum_heap_snapshot_free (older);
+
+  test_sanity_checker_fixture_do_cleanup (fixture);
+  g_assert (gum_sanity_checker_end (fixture->checker));
+  g_assert_cmpuint (fixture->output->len, ==, 0);
+}
+
 #endif /* G_OS_WIN32 */
@@ -454,6 +454,13 @@ simple_3 (GumFakeSampler * sampler)
   dummy_variable_to_trick_optimizer += 3;
 }
 
+static void GUM_NOINLINE
+sleepy_function_then_example_b (GumFakeSampler * sampler)
+{
+  sleepy_function (sampler);
+  example_b (sampler);
+}
+
 #define INSTRUMENT_FUNCTION(f) \
     gum_profiler_instrument_function (fixture->profiler, f, fixture->sampler)
 
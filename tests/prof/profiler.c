@@ -17,6 +17,10 @@ TEST_LIST_BEGIN (profiler)
 
   PROFILER_TESTENTRY (flat_function)
   PROFILER_TESTENTRY (two_calls)
+  PROFILER_TESTENTRY (per_thread_durations)
+  PROFILER_TESTENTRY (per_function_thread_ordering)
+  PROFILER_TESTENTRY (collapsed_stacks)
+  PROFILER_TESTENTRY (binary_stream)
   PROFILER_TESTENTRY (profile_matching_functions)
   PROFILER_TESTENTRY (recursion)
   PROFILER_TESTENTRY (deep_recursion)
@@ -99,6 +103,108 @@ PROFILER_TESTCASE (two_calls)
       &sleepy_function), ==, 2 * 1000);
 }
 
+PROFILER_TESTCASE (per_thread_durations)
+{
+  GumProfiler * prof = fixture->profiler;
+
+  gum_profiler_instrument_function (prof, &example_b, fixture->sampler);
+  gum_profiler_instrument_function (prof, &sleepy_function, fixture->sampler);
+
+  example_b (fixture->fake_sampler);
+  g_thread_join (g_thread_new ("profiler-test-helper-a",
+      (GThreadFunc) sleepy_function, fixture->fake_sampler));
+  g_thread_join (g_thread_new ("profiler-test-helper-b",
+      (GThreadFunc) sleepy_function, fixture->fake_sampler));
+
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 0,
+      &sleepy_function), ==, 1000);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 1,
+      &sleepy_function), ==, 1000);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 2,
+      &sleepy_function), ==, 0);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 0,
+      &example_b), ==, 3);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 1,
+      &example_b), ==, 0);
+}
+
+PROFILER_TESTCASE (per_function_thread_ordering)
+{
+  GumProfiler * prof = fixture->profiler;
+
+  gum_profiler_instrument_function (prof, &example_b, fixture->sampler);
+  gum_profiler_instrument_function (prof, &sleepy_function, fixture->sampler);
+
+  example_b (fixture->fake_sampler);
+  example_b (fixture->fake_sampler);
+  g_thread_join (g_thread_new ("profiler-test-helper",
+      (GThreadFunc) sleepy_function_then_example_b, fixture->fake_sampler));
+  sleepy_function (fixture->fake_sampler);
+  sleepy_function (fixture->fake_sampler);
+
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 0,
+      &example_b), ==, 2 * 3);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 1,
+      &example_b), ==, 3);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 0,
+      &sleepy_function), ==, 1000);
+  g_assert_cmpuint (gum_profiler_get_total_duration_of (prof, 1,
+      &sleepy_function), ==, 2 * 1000);
+}
+
+PROFILER_TESTCASE (collapsed_stacks)
+{
+  GOutputStream * stream;
+  gchar * output;
+
+  gum_profiler_instrument_function (fixture->profiler, &example_a,
+      fixture->sampler);
+  gum_profiler_instrument_function (fixture->profiler, &example_b,
+      fixture->sampler);
+  gum_profiler_instrument_function (fixture->profiler, &example_c,
+      fixture->sampler);
+
+  example_a (fixture->fake_sampler);
+
+  stream = g_memory_output_stream_new_resizable ();
+  g_assert (gum_profiler_emit_collapsed_stacks (fixture->profiler, stream,
+      NULL));
+  g_assert (g_output_stream_write (stream, "", 1, NULL, NULL) == 1);
+  output = g_memory_output_stream_steal_data (
+      G_MEMORY_OUTPUT_STREAM (stream));
+  g_assert_cmpstr (output, ==,
+      "example_a 5\n"
+      "example_a;example_c 4\n");
+  g_free (output);
+  g_object_unref (stream);
+}
+
+PROFILER_TESTCASE (binary_stream)
+{
+  GOutputStream * stream;
+  const guint8 * data;
+
+  gum_profiler_instrument_function (fixture->profiler, &example_a,
+      fixture->sampler);
+  gum_profiler_instrument_function (fixture->profiler, &example_c,
+      fixture->sampler);
+
+  example_a (fixture->fake_sampler);
+
+  stream = g_memory_output_stream_new_resizable ();
+  g_assert (gum_profiler_emit_binary (fixture->profiler, stream, NULL));
+  data = g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (stream));
+
+  /* header, two function records and two node records */
+  g_assert_cmpuint (g_memory_output_stream_get_data_size (
+      G_MEMORY_OUTPUT_STREAM (stream)), ==, 12 + (2 * 24) + (2 * 37));
+  g_assert_cmpstr ((const gchar *) data, ==, "GUMPROF");
+  g_assert_cmpuint (data[8], ==, 1);
+  g_assert_cmpuint (data[12], ==, 1);
+
+  g_object_unref (stream);
+}
+
 PROFILEREPORT_TESTCASE (bottleneck)
 {
   instrument_example_functions (fixture);
@@ -7,18 +7,34 @@
 
 #include "sampler-fixture.c"
 
+#define CALL_COUNT_THREAD_COUNT 4
+#define CALL_COUNT_CALLS_PER_THREAD 1000
+
 TEST_LIST_BEGIN (sampler)
   SAMPLER_TESTENTRY (cycle)
+  SAMPLER_TESTENTRY (grouped_instructions)
+  SAMPLER_TESTENTRY (cycles_are_counted_on_other_threads)
+#ifdef HAVE_LINUX
+  SAMPLER_TESTENTRY (cycle_counters_are_released_on_thread_exit)
+#endif
   SAMPLER_TESTENTRY (busy_cycle)
   SAMPLER_TESTENTRY (malloc_count)
   SAMPLER_TESTENTRY (multiple_call_counters)
+  SAMPLER_TESTENTRY (concurrent_call_counting)
+  SAMPLER_TESTENTRY (nested_calls_are_counted_once)
   SAMPLER_TESTENTRY (wallclock)
 TEST_LIST_END ()
 
 static void spin_for_one_tenth_second (void);
+static gpointer cycle_count_helper_thread (gpointer data);
+#ifdef HAVE_LINUX
+static guint count_open_file_descriptors (void);
+#endif
 static gpointer malloc_count_helper_thread (gpointer data);
+static gpointer call_count_helper_thread (gpointer data);
 static void nop_function_a (void);
 static void nop_function_b (void);
+static void nop_function_a_then_b (void);
 
 SAMPLER_TESTCASE (cycle)
 {
@@ -37,6 +53,94 @@ SAMPLER_TESTCASE (cycle)
   }
 }
 
+SAMPLER_TESTCASE (grouped_instructions)
+{
+  GumSampler * cycles;
+  GumSample cycles_start, instructions_start;
+
+  cycles = gum_cycle_sampler_new_full (GUM_CYCLE_SAMPLER_EVENT_CYCLES, NULL);
+  fixture->sampler = gum_cycle_sampler_new_full (
+      GUM_CYCLE_SAMPLER_EVENT_INSTRUCTIONS, GUM_CYCLE_SAMPLER (cycles));
+  if (fixture->sampler != NULL &&
+      gum_cycle_sampler_is_available (GUM_CYCLE_SAMPLER (fixture->sampler)))
+  {
+    cycles_start = gum_sampler_sample (cycles);
+    instructions_start = gum_sampler_sample (fixture->sampler);
+    spin_for_one_tenth_second ();
+    g_assert_cmpuint (gum_sampler_sample (cycles), >, cycles_start);
+    g_assert_cmpuint (gum_sampler_sample (fixture->sampler), >,
+        instructions_start);
+  }
+  else
+  {
+    g_test_message ("skipping test because of unsupported OS");
+  }
+
+  g_object_unref (cycles);
+}
+
+SAMPLER_TESTCASE (cycles_are_counted_on_other_threads)
+{
+  GThread * thread;
+  GumSample spin_diff;
+
+  fixture->sampler = gum_cycle_sampler_new_full (
+      GUM_CYCLE_SAMPLER_EVENT_CYCLES, NULL);
+  if (gum_cycle_sampler_is_available (GUM_CYCLE_SAMPLER (fixture->sampler)))
+  {
+    thread = g_thread_new ("sampler-test-cycle-count",
+        cycle_count_helper_thread, fixture->sampler);
+    spin_diff = GPOINTER_TO_SIZE (g_thread_join (thread));
+    g_assert_cmpuint (spin_diff, >, 0);
+  }
+  else
+  {
+    g_test_message ("skipping test because of unsupported OS");
+  }
+}
+
+#ifdef HAVE_LINUX
+
+SAMPLER_TESTCASE (cycle_counters_are_released_on_thread_exit)
+{
+  guint descriptors_before;
+  GThread * thread;
+
+  fixture->sampler = gum_cycle_sampler_new_full (
+      GUM_CYCLE_SAMPLER_EVENT_CYCLES, NULL);
+  if (gum_cycle_sampler_is_available (GUM_CYCLE_SAMPLER (fixture->sampler)))
+  {
+    descriptors_before = count_open_file_descriptors ();
+
+    thread = g_thread_new ("sampler-test-counter-release",
+        cycle_count_helper_thread, fixture->sampler);
+    g_thread_join (thread);
+
+    g_assert_cmpuint (count_open_file_descriptors (), ==, descriptors_before);
+  }
+  else
+  {
+    g_test_message ("skipping test because of unsupported OS");
+  }
+}
+
+static guint
+count_open_file_descriptors (void)
+{
+  GDir * dir;
+  guint count = 0;
+
+  dir = g_dir_open ("/proc/self/fd", 0, NULL);
+  g_assert (dir != NULL);
+  while (g_dir_read_name (dir) != NULL)
+    count++;
+  g_dir_close (dir);
+
+  return count;
+}
+
+#endif
+
 SAMPLER_TESTCASE (busy_cycle)
 {
   GumSample spin_start, spin_diff;
@@ -131,6 +235,45 @@ SAMPLER_TESTCASE (multiple_call_counters)
   g_object_unref (sampler1);
 }
 
+SAMPLER_TESTCASE (concurrent_call_counting)
+{
+  GThread * threads[CALL_COUNT_THREAD_COUNT];
+  guint i;
+
+  fixture->sampler = gum_call_count_sampler_new (nop_function_a,
+      nop_function_b, NULL);
+
+  nop_function_b ();
+
+  for (i = 0; i != CALL_COUNT_THREAD_COUNT; i++)
+  {
+    threads[i] = g_thread_new ("sampler-test-call-count",
+        call_count_helper_thread, fixture->sampler);
+  }
+  for (i = 0; i != CALL_COUNT_THREAD_COUNT; i++)
+  {
+    g_assert_cmpuint (GPOINTER_TO_SIZE (g_thread_join (threads[i])), ==,
+        CALL_COUNT_CALLS_PER_THREAD);
+  }
+
+  g_assert_cmpint (gum_sampler_sample (fixture->sampler), ==, 1);
+  g_assert_cmpuint (gum_call_count_sampler_peek_total_count (
+      GUM_CALL_COUNT_SAMPLER (fixture->sampler)), ==,
+      1 + (CALL_COUNT_THREAD_COUNT * CALL_COUNT_CALLS_PER_THREAD));
+}
+
+SAMPLER_TESTCASE (nested_calls_are_counted_once)
+{
+  fixture->sampler = gum_call_count_sampler_new (nop_function_a,
+      nop_function_b, nop_function_a_then_b, NULL);
+
+  nop_function_a_then_b ();
+  g_assert_cmpint (gum_sampler_sample (fixture->sampler), ==, 1);
+
+  nop_function_b ();
+  g_assert_cmpint (gum_sampler_sample (fixture->sampler), ==, 2);
+}
+
 SAMPLER_TESTCASE (wallclock)
 {
   GumSample sample_a, sample_b;
@@ -163,6 +306,18 @@ spin_for_one_tenth_second (void)
   g_timer_destroy (timer);
 }
 
+static gpointer
+cycle_count_helper_thread (gpointer data)
+{
+  GumSampler * sampler = data;
+  GumSample start;
+
+  start = gum_sampler_sample (sampler);
+  spin_for_one_tenth_second ();
+
+  return GSIZE_TO_POINTER (gum_sampler_sample (sampler) - start);
+}
+
 static gpointer
 malloc_count_helper_thread (gpointer data)
 {
@@ -183,6 +338,20 @@ malloc_count_helper_thread (gpointer data)
   return NULL;
 }
 
+static gpointer
+call_count_helper_thread (gpointer data)
+{
+  GumSampler * sampler = GUM_SAMPLER (data);
+  GumSample start;
+  guint i;
+
+  start = gum_sampler_sample (sampler);
+  for (i = 0; i != CALL_COUNT_CALLS_PER_THREAD; i++)
+    nop_function_a ();
+
+  return GSIZE_TO_POINTER (gum_sampler_sample (sampler) - start);
+}
+
 static gint dummy_variable_to_trick_optimizer = 0;
 
 static void GUM_NOINLINE
@@ -196,3 +365,10 @@ nop_function_b (void)
 {
   dummy_variable_to_trick_optimizer -= 7;
 }
+
+static void GUM_NOINLINE
+nop_function_a_then_b (void)
+{
+  nop_function_a ();
+  nop_function_b ();
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "testutil.h"
+
+#include <string.h>
+
+#define SAMPLINGPROFILER_TESTCASE(NAME) \
+    void test_sampling_profiler_ ## NAME (void)
+#define SAMPLINGPROFILER_TESTENTRY(NAME) \
+    TEST_ENTRY_SIMPLE ("Prof/SamplingProfiler", test_sampling_profiler, NAME)
+
+TEST_LIST_BEGIN (samplingprofiler)
+  SAMPLINGPROFILER_TESTENTRY (busy_thread_should_be_sampled)
+  SAMPLINGPROFILER_TESTENTRY (idle_thread_should_not_be_sampled)
+TEST_LIST_END ()
+
+static gpointer spin_for_one_fifth_second (gpointer data);
+
+SAMPLINGPROFILER_TESTCASE (busy_thread_should_be_sampled)
+{
+  GumSamplingProfiler * profiler;
+  GThread * thread;
+  GumProfileReport * report;
+  gchar * xml;
+
+  profiler = gum_sampling_profiler_new ();
+  gum_sampling_profiler_start (profiler);
+
+  thread = g_thread_new ("sampling-profiler-test", spin_for_one_fifth_second,
+      NULL);
+  g_thread_join (thread);
+
+  gum_sampling_profiler_stop (profiler);
+
+  g_assert_cmpuint (gum_sampling_profiler_get_sample_count (profiler), >, 0);
+
+  report = gum_sampling_profiler_generate_report (profiler);
+  xml = gum_profile_report_emit_xml (report);
+  g_assert (strstr (xml, "<Thread>") != NULL);
+  g_assert (strstr (xml, "spin_for_one_fifth_second") != NULL);
+  g_free (xml);
+  g_object_unref (report);
+
+  g_object_unref (profiler);
+}
+
+SAMPLINGPROFILER_TESTCASE (idle_thread_should_not_be_sampled)
+{
+  GumSamplingProfiler * profiler;
+  GumProfileReport * report;
+  gchar * xml;
+
+  profiler = gum_sampling_profiler_new ();
+  gum_sampling_profiler_start (profiler);
+  g_usleep (G_USEC_PER_SEC / 10);
+  gum_sampling_profiler_stop (profiler);
+
+  g_assert_cmpuint (gum_sampling_profiler_get_sample_count (profiler), <, 10);
+
+  report = gum_sampling_profiler_generate_report (profiler);
+  xml = gum_profile_report_emit_xml (report);
+  g_assert (g_str_has_prefix (xml, "<ProfileReport>"));
+  g_free (xml);
+  g_object_unref (report);
+
+  g_object_unref (profiler);
+}
+
+static gpointer
+spin_for_one_fifth_second (gpointer data)
+{
+  GTimer * timer;
+  volatile guint i = 0;
+  guint j;
+
+  /* Spin mostly here rather than in the clock, so that samples land here. */
+  timer = g_timer_new ();
+  while (g_timer_elapsed (timer, NULL) < 0.2)
+  {
+    for (j = 0; j != 10000; j++)
+      i++;
+  }
+  g_timer_destroy (timer);
+
+  return NULL;
+}